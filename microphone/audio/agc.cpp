@@ -0,0 +1,127 @@
+#include "agc.h"
+#include "sample_math.h"
+
+namespace audio {
+
+// dB quantities are Q8. Per octave: 6.0206 dB of amplitude, 3.0103 dB of
+// energy. 10885 = 65536 / 6.0206 turns amplitude dB into octaves.
+static constexpr int32_t kAmpDbPerLog2Q8 = 1541;
+static constexpr int32_t kPowDbPerLog2Q8 = 771;
+static constexpr int32_t kLog2PerAmpDbQ16 = 10885;
+
+// Levels are measured on x >> 8: the 0 dB output with 6 bits to spare, so
+// quiet blocks still resolve. kLevelOctaves is log2 of full scale there.
+static constexpr int kLevelShift = 8;
+static constexpr int32_t kLevelOctaves = 15 + (14 - kLevelShift);
+
+// Keeps the Q16 linear gain within 2^8..2^24; the product with a raw sample
+// then fits 64 bits with room to spare.
+static constexpr int kGainLimitDb = 48;
+
+// 2^(i/16) in Q16.
+static constexpr int32_t kExp2Q16[17] = {
+    65536,  68438,  71468,  74632,  77936,  81386,  84990,  88752,  92682,
+    96785,  101070, 105545, 110218, 115098, 120194, 125515, 131072};
+
+// Amplitude dB (Q8) to a Q16 factor. 16-point table, linear in between:
+// within 0.03 dB.
+static int32_t db_to_q16(int32_t db_q8) {
+  int32_t l = (int32_t)(((int64_t)db_q8 * kLog2PerAmpDbQ16) >> 16);
+  int32_t whole = l >> 8;
+  int32_t idx = (l >> 4) & 15;
+  int32_t lo = kExp2Q16[idx];
+  int32_t m = lo + (((kExp2Q16[idx + 1] - lo) * (l & 15)) >> 4);
+  return whole >= 0 ? m << whole : m >> -whole;
+}
+
+static int32_t clamp_db(int db) {
+  if (db > kGainLimitDb)
+    return kGainLimitDb * 256;
+  if (db < -kGainLimitDb)
+    return -kGainLimitDb * 256;
+  return db * 256;
+}
+
+Agc::Agc(const Config &config) {
+  target_q8_ = config.target_dbfs * 256;
+  max_gain_q8_ = clamp_db(config.max_gain_db);
+  min_gain_q8_ = clamp_db(config.min_gain_db);
+  if (min_gain_q8_ > max_gain_q8_)
+    min_gain_q8_ = max_gain_q8_;
+  gate_q8_ = config.gate_dbfs * 256;
+  limit_q8_ = config.limit_dbfs * 256;
+  attack_samples_ = config.attack_ms * (kSampleRate / 1000);
+  release_samples_ = config.release_ms * (kSampleRate / 1000);
+  reset();
+}
+
+void Agc::reset() {
+  stats_ = {};
+  gain_q16_ = 1 << 16;
+}
+
+void Agc::process(const int32_t *in, int n, int16_t *out) {
+  if (n <= 0)
+    return;
+
+  uint32_t peak = 0;
+  uint64_t energy = 0;
+  for (int i = 0; i < n; i++) {
+    int32_t v = in[i] >> kLevelShift;
+    uint32_t a = v < 0 ? (uint32_t)-v : (uint32_t)v;
+    if (a > peak)
+      peak = a;
+    energy += (uint64_t)((int64_t)v * v);
+  }
+  // Silence comes out around -126 dBFS, under any sensible gate.
+  int32_t rms_q8 =
+      (log2_q8(energy / (uint32_t)n) - 2 * kLevelOctaves * 256) *
+      kPowDbPerLog2Q8 >> 8;
+  int32_t peak_q8 =
+      (log2_q8(peak) - kLevelOctaves * 256) * kAmpDbPerLog2Q8 >> 8;
+
+  int32_t start = stats_.gain_db_q8;
+  int32_t gain = start;
+  if (rms_q8 < gate_q8_) {
+    stats_.held_blocks++;
+  } else {
+    int32_t want = target_q8_ - rms_q8;
+    if (want > max_gain_q8_)
+      want = max_gain_q8_;
+    if (want < min_gain_q8_)
+      want = min_gain_q8_;
+    // One pole over a block of n: 1 - exp(-n / tau) ~ n / (tau + n).
+    int32_t tau = want < gain ? attack_samples_ : release_samples_;
+    gain += (int32_t)((int64_t)(want - gain) * n / (tau + n));
+  }
+
+  // The limiter has no lookahead, so the whole block, ramp included, has
+  // to fit under the ceiling. The peak is at most +12 dBFS, which keeps the
+  // ceiling well inside the gain range.
+  int32_t ceiling = limit_q8_ - peak_q8;
+  if (gain > ceiling) {
+    gain = ceiling;
+    stats_.limited_blocks++;
+  }
+  int32_t g = start > ceiling ? db_to_q16(ceiling) : gain_q16_;
+  int32_t end = gain == start ? gain_q16_ : db_to_q16(gain);
+  int32_t step = (end - g) / n;
+
+  for (int i = 0; i < n; i++) {
+    g += step;
+    // |x| < 2^31 and g < 2^24, so y stays within 2^25.
+    int32_t y = (int32_t)(((int64_t)in[i] * g) >> 30);
+    int16_t s = clamp_int16(y);
+    if (s != y)
+      stats_.clips++;
+    out[i] = s;
+  }
+
+  gain_q16_ = end;
+  stats_.gain_db_q8 = gain;
+  stats_.rms_dbfs_q8 = rms_q8;
+  stats_.peak_dbfs_q8 = peak_q8;
+  stats_.blocks++;
+}
+
+} // namespace audio
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "audio_format.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+struct AgcStats {
+  int32_t gain_db_q8;      // applied at the end of the last block
+  int32_t rms_dbfs_q8;     // last block, before the gain
+  int32_t peak_dbfs_q8;    // last block, before the gain
+  uint32_t blocks;
+  uint32_t limited_blocks; // gain cut so the peak stays under the ceiling
+  uint32_t held_blocks;    // under the gate, gain left where it was
+  uint32_t clips;          // samples that still had to be clamped
+};
+
+// Block automatic gain control for the decimated stream, in place of the
+// fixed >> 14 of sample32_to_16(). Input is the decimator output at the raw
+// 32-bit scale; 0 dB gain is exactly the old shift, and levels are dBFS of
+// the int16 output at 0 dB.
+//
+// Per block (one capture chunk, ~5 ms) it measures the peak and the RMS and
+// moves the gain towards the one that brings the RMS to target_dbfs: down
+// with the attack time constant, up with the release one. Blocks under
+// gate_dbfs hold the gain so pauses do not pump the noise floor up. The
+// limiter then caps the gain so the block peak lands at limit_dbfs (the
+// log approximations allow ~0.5 dB over), immediately and for the whole
+// block. Within a block the linear gain ramps from the previous value to
+// the new one, so steps do not click.
+//
+// All integer: dB values are Q8, the linear gain Q16. Per sample it costs
+// one multiply-add for the RMS and one 32x32->64 multiply for the gain.
+class Agc {
+public:
+  struct Config {
+    int target_dbfs = -20;
+    int max_gain_db = 30;
+    int min_gain_db = -12;
+    int attack_ms = 10;
+    int release_ms = 800;
+    int gate_dbfs = -60;
+    int limit_dbfs = -1;
+  };
+
+  Agc() : Agc(Config()) {}
+  explicit Agc(const Config &config);
+
+  // Back to 0 dB; keeps the config.
+  void reset();
+
+  // Scales n filtered samples (raw scale) to int16 as one block.
+  void process(const int32_t *in, int n, int16_t *out);
+
+  int32_t gain_db_q8() const { return stats_.gain_db_q8; }
+  AgcStats stats() const { return stats_; }
+
+private:
+  int32_t target_q8_;
+  int32_t max_gain_q8_;
+  int32_t min_gain_q8_;
+  int32_t gate_q8_;
+  int32_t limit_q8_;
+  int32_t attack_samples_;
+  int32_t release_samples_;
+  int32_t gain_q16_; // linear form of stats_.gain_db_q8
+  AgcStats stats_;
+};
+
+} // namespace audio
@@ -0,0 +1,27 @@
+#pragma once
+
+// Capture format shared by the firmware and the host tools.
+
+namespace audio {
+
+// I2S runs at 48 kHz so the INMP441 stays in its happy BCLK range (~3 MHz).
+// On the original ESP32, IDF's I2S driver in PHILIPS + MONO mode delivers
+// BOTH slot positions to DMA per frame (the inactive slot is a duplicate of
+// the active one), so the DMA stream is 2x the configured rate. Chips that
+// can pick the slot in hardware deliver one word per frame. Either way the
+// capture chain sees one word per frame: the duplicate is dropped before
+// decimation (drop_duplicate_slots), and 48 kHz decimates by 3 to the clean
+// 16 kHz output that downstream consumers expect.
+constexpr int kI2SAskedRate = 48000;
+constexpr int kI2SDuplicatedRate = kI2SAskedRate * 2; // DMA words/s, both
+constexpr int kI2SEffectiveRate = kI2SAskedRate;      // into the chain
+constexpr int kSampleRate = 16000;
+constexpr int kDecimation = kI2SEffectiveRate / kSampleRate;
+constexpr int kChannels = 1;
+constexpr int kBitsPerSample = 16;
+
+// Raw 32-bit words per pass of the capture chain; DMA buffers are processed
+// in pieces of at most this.
+constexpr int kChunkSamples = 256;
+
+} // namespace audio
@@ -0,0 +1,168 @@
+#include "audio_stats.h"
+#include "sample_math.h"
+
+namespace audio {
+
+// Mean square of s in Q16 without shifting the whole sum (which could
+// overflow on a long window).
+static uint64_t mean_square_q16(uint64_t sum_sq, uint32_t n) {
+  return ((sum_sq / n) << 16) + (((sum_sq % n) << 16) / n);
+}
+
+void LevelMeter::clear(Sums &s) {
+  s.n = 0;
+  s.min = INT16_MAX;
+  s.max = INT16_MIN;
+  s.sum = 0;
+  s.sum_sq = 0;
+  s.clips = 0;
+}
+
+void LevelMeter::add(Sums &s, const int16_t *x, int n) {
+  int16_t min_v = s.min;
+  int16_t max_v = s.max;
+  int32_t sum = 0;
+  uint64_t sum_sq = 0;
+  uint32_t clips = 0;
+  for (int i = 0; i < n; i++) {
+    int16_t v = x[i];
+    if (v < min_v)
+      min_v = v;
+    if (v > max_v)
+      max_v = v;
+    sum += v;
+    sum_sq += (uint32_t)((int32_t)v * v);
+    if (v == INT16_MAX || v == INT16_MIN)
+      clips++;
+  }
+  s.n += (uint32_t)n;
+  s.min = min_v;
+  s.max = max_v;
+  s.sum += sum;
+  s.sum_sq += sum_sq;
+  s.clips += clips;
+}
+
+void LevelMeter::merge(Sums &into, const Sums &s) {
+  into.n += s.n;
+  if (s.min < into.min)
+    into.min = s.min;
+  if (s.max > into.max)
+    into.max = s.max;
+  into.sum += s.sum;
+  into.sum_sq += s.sum_sq;
+  into.clips += s.clips;
+}
+
+LevelWindow LevelMeter::summarise(const Sums &s) const {
+  LevelWindow w = {};
+  w.samples = s.n;
+  w.min = s.min;
+  w.max = s.max;
+  w.clips = s.clips;
+  w.dc_offset_q8 = dc_q8_;
+  if (s.n > 0) {
+    w.mean_q8 = (int32_t)(s.sum * 256 / (int64_t)s.n);
+    w.rms_q8 = isqrt64(mean_square_q16(s.sum_sq, s.n));
+  }
+  return w;
+}
+
+void LevelMeter::merge(Running &into, const Sums &s) {
+  if (s.n == 0)
+    return;
+
+  int64_t mean_b = s.sum * 65536 / (int64_t)s.n;
+  int64_t mean_b_q8 = s.sum * 256 / (int64_t)s.n;
+  int64_t var_b = (int64_t)mean_square_q16(s.sum_sq, s.n) -
+                  mean_b_q8 * mean_b_q8;
+  if (var_b < 0)
+    var_b = 0;
+
+  if (into.n == 0) {
+    into.mean_q16 = mean_b;
+    into.var_q16 = (uint64_t)var_b;
+  } else {
+    // Chan et al. pairwise update of (n, mean, variance), normalised so
+    // none of the stored terms grow with the number of samples.
+    uint64_t na = into.n;
+    uint64_t nb = s.n;
+    uint64_t n = na + nb;
+    int64_t delta = mean_b - into.mean_q16;
+    into.mean_q16 += delta * (int64_t)nb / (int64_t)n;
+
+    int64_t d8 = delta / 256;
+    uint64_t cross = (uint64_t)(d8 * d8) * nb / n * na / n;
+    int64_t var = (int64_t)into.var_q16 +
+                  (var_b - (int64_t)into.var_q16) * (int64_t)nb / (int64_t)n +
+                  (int64_t)cross;
+    into.var_q16 = var < 0 ? 0 : (uint64_t)var;
+  }
+
+  into.n += s.n;
+  if (s.min < into.min)
+    into.min = s.min;
+  if (s.max > into.max)
+    into.max = s.max;
+  into.clips += s.clips;
+}
+
+LevelWindow LevelMeter::summarise(const Running &r) const {
+  LevelWindow w = {};
+  w.samples = r.n > UINT32_MAX ? UINT32_MAX : (uint32_t)r.n;
+  w.min = r.min;
+  w.max = r.max;
+  w.clips = r.clips;
+  w.dc_offset_q8 = dc_q8_;
+  if (r.n > 0) {
+    int64_t mean_q8 = r.mean_q16 / 256;
+    w.mean_q8 = (int32_t)mean_q8;
+    w.rms_q8 = isqrt64(r.var_q16 + (uint64_t)(mean_q8 * mean_q8));
+  }
+  return w;
+}
+
+void LevelMeter::reset() {
+  clear(window_);
+  total_ = {};
+  total_.min = INT16_MAX;
+  total_.max = INT16_MIN;
+  dc_q8_ = 0;
+  telemetry_ = {};
+  published_.publish(telemetry_);
+}
+
+void LevelMeter::process(const int16_t *x, int n) {
+  if (n <= 0)
+    return;
+
+  Sums chunk;
+  clear(chunk);
+  add(chunk, x, n);
+
+  // One-pole tracker on the chunk means, time constant of one window.
+  // Seeded from the first chunk so it does not ramp up from zero.
+  int32_t chunk_mean_q8 = (int32_t)(chunk.sum * 256 / n);
+  if (total_.n == 0 && window_.n == 0)
+    dc_q8_ = chunk_mean_q8;
+  dc_q8_ += (int32_t)((int64_t)(chunk_mean_q8 - dc_q8_) * n / window_len_);
+
+  telemetry_.chunk = summarise(chunk);
+
+  merge(window_, chunk);
+  if (window_.n >= window_len_) {
+    telemetry_.second = summarise(window_);
+    telemetry_.seconds++;
+    merge(total_, window_);
+    clear(window_);
+  }
+
+  // Totals cover completed windows plus the one in progress.
+  Running total = total_;
+  merge(total, window_);
+  telemetry_.total = summarise(total);
+
+  published_.publish(telemetry_);
+}
+
+} // namespace audio
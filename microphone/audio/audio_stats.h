@@ -0,0 +1,87 @@
+#pragma once
+
+#include "seqlock.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+// Level summary of a run of int16 samples. Fixed point, Q8 where noted, so
+// it can be produced in the capture loop without floats.
+struct LevelWindow {
+  uint32_t samples;
+  int16_t min;
+  int16_t max;
+  int32_t mean_q8;
+  uint32_t rms_q8;      // includes DC
+  uint32_t clips;       // samples pinned at the int16 rails
+  int32_t dc_offset_q8; // slow-tracking mean, time constant ~1 s
+};
+
+// What LevelMeter publishes after every chunk.
+struct LevelTelemetry {
+  LevelWindow chunk;  // the chunk just processed
+  LevelWindow second; // last completed ~1 s window
+  LevelWindow total;  // everything since reset()
+  uint32_t seconds;   // completed 1 s windows since reset()
+};
+
+// Streaming level statistics, kept inside the capture loop.
+//
+// Per sample it only updates min/max, a sum, a sum of squares and the clip
+// counter. Windows are summarised from those exact integer sums. The
+// since-reset totals would overflow on a long capture, so each finished
+// window is merged into a running mean/variance with the Welford/Chan
+// pairwise update instead, in Q16 fixed point.
+class LevelMeter {
+public:
+  explicit LevelMeter(uint32_t window_samples) : window_len_(window_samples) {
+    reset();
+  }
+
+  void reset();
+
+  // Feeds one chunk of output samples (at most 32768) and publishes the
+  // updated telemetry. Only the capture task may call this.
+  void process(const int16_t *x, int n);
+
+  // Lock-free snapshot, safe to call from any task.
+  LevelTelemetry snapshot() const { return published_.read(); }
+
+private:
+  struct Sums {
+    uint32_t n;
+    int16_t min;
+    int16_t max;
+    int64_t sum;
+    uint64_t sum_sq;
+    uint32_t clips;
+  };
+
+  // Since-reset totals: sample count, mean and variance in Q16.
+  struct Running {
+    uint64_t n;
+    int64_t mean_q16;
+    uint64_t var_q16;
+    int16_t min;
+    int16_t max;
+    uint32_t clips;
+  };
+
+  static void clear(Sums &s);
+  static void add(Sums &s, const int16_t *x, int n);
+  static void merge(Sums &into, const Sums &s);
+  static void merge(Running &into, const Sums &s);
+  LevelWindow summarise(const Sums &s) const;
+  LevelWindow summarise(const Running &r) const;
+
+  uint32_t window_len_;
+  Sums window_;
+  Running total_;
+
+  int32_t dc_q8_;
+  LevelTelemetry telemetry_;
+  SeqLock<LevelTelemetry> published_;
+};
+
+} // namespace audio
@@ -0,0 +1,1361 @@
+// Host benchmark for the microphone DSP chain. See CMakeLists.txt in the
+// parent directory for the build; run it as
+//
+//   ./dsp_bench [recording.pcm]
+//
+// With a path, the recorded 16 kHz PCM16 capture (tools/recording.pcm) is
+// also pushed through the chain. It is held 3x and shifted back up to raw
+// I2S words, which is close enough to exercise the real data path.
+//
+// Numbers are for the host CPU; they are useful for relative comparisons
+// between implementations, not as an absolute ESP32 budget. Each chain run
+// hashes its output (FNV-1a) and checks it against kGoldenHashes below, so
+// a change that alters the output by a single bit fails.
+//
+// Where a section has limits (the decimator's passband and alias
+// rejection, the lossless round trip, the voice gate's accuracy, ...) they
+// are checked too: each miss is printed as FAIL and the exit status is
+// non-zero.
+
+#include "agc.h"
+#include "audio_format.h"
+#include "audio_stats.h"
+#include "capture_chain.h"
+#include "clock_drift.h"
+#include "dc_blocker.h"
+#include "event_trigger.h"
+#include "fir_decimator.h"
+#include "ima_adpcm.h"
+#include "lossless.h"
+#include "sample_math.h"
+#include "spectrum.h"
+#include "stream_frame.h"
+#include "vad.h"
+
+#include <chrono>
+#include <math.h>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t cycles_now() { return __rdtsc(); }
+static constexpr bool kHaveCycles = true;
+#else
+static inline uint64_t cycles_now() { return 0; }
+static constexpr bool kHaveCycles = false;
+#endif
+
+using audio::kChunkSamples;
+using audio::kDecimation;
+using audio::kI2SEffectiveRate;
+using audio::kSampleRate;
+
+using Decimator = audio::CaptureChain::Decimator;
+
+static int s_checks = 0;
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    s_checks++;                                                                \
+    if (!(cond)) {                                                             \
+      s_failures++;                                                            \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+    }                                                                          \
+  } while (0)
+
+static std::vector<int32_t> make_sine(double freq, double amplitude, int n) {
+  std::vector<int32_t> v((size_t)n);
+  for (int i = 0; i < n; i++) {
+    double s = amplitude * sin(2 * M_PI * freq * i / kI2SEffectiveRate);
+    v[(size_t)i] = (int32_t)(s * 2147483647.0);
+  }
+  return v;
+}
+
+// Linear chirp from 20 Hz to the input Nyquist, exercises the stopband too.
+static std::vector<int32_t> make_sweep(double amplitude, int n) {
+  std::vector<int32_t> v((size_t)n);
+  double f0 = 20, f1 = kI2SEffectiveRate / 2.0;
+  double t_end = (double)n / kI2SEffectiveRate;
+  for (int i = 0; i < n; i++) {
+    double t = (double)i / kI2SEffectiveRate;
+    double phase = 2 * M_PI * (f0 * t + (f1 - f0) * t * t / (2 * t_end));
+    v[(size_t)i] = (int32_t)(amplitude * sin(phase) * 2147483647.0);
+  }
+  return v;
+}
+
+// Reference: the box-car average the FIR replaced, partial average carried
+// between chunks like the firmware did.
+struct Boxcar {
+  int64_t accum = 0;
+  int count = 0;
+
+  int process(const int32_t *in, int n, int32_t *out) {
+    int produced = 0;
+    for (int i = 0; i < n; i++) {
+      accum += in[i];
+      if (++count == kDecimation) {
+        out[produced++] = (int32_t)(accum / kDecimation);
+        accum = 0;
+        count = 0;
+      }
+    }
+    return produced;
+  }
+};
+
+template <typename Fn>
+static void time_chunks(const char *name, const std::vector<int32_t> &input,
+                        Fn &&fn) {
+  static int32_t out[kChunkSamples];
+  int chunks = (int)input.size() / kChunkSamples;
+  int64_t outputs = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (int c = 0; c < chunks; c++)
+    outputs += fn(&input[(size_t)c * kChunkSamples], kChunkSamples, out);
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/chunk %7.2f ns/out", name, ns / chunks,
+         ns / (double)outputs);
+  if (kHaveCycles)
+    printf(" %7.1f cycles/out", (double)(c1 - c0) / (double)outputs);
+  printf(" (%lld outputs)\n", (long long)outputs);
+}
+
+static void bench_decimators() {
+  printf("== decimator cost, %d-sample chunks ==\n", kChunkSamples);
+  std::vector<int32_t> input = make_sine(1000, 0.5, kI2SEffectiveRate * 20);
+
+  Boxcar box;
+  time_chunks("boxcar", input, [&](const int32_t *in, int n, int32_t *out) {
+    return box.process(in, n, out);
+  });
+
+  Decimator dec;
+  time_chunks("fir", input, [&](const int32_t *in, int n, int32_t *out) {
+    return dec.process(in, n, out);
+  });
+
+  // The same audio as the original ESP32 DMAs it, each word twice. Before
+  // drop_duplicate_slots the chain filtered all of it at 96 kHz.
+  std::vector<int32_t> dup(input.size() * 2);
+  for (size_t i = 0; i < input.size(); i++)
+    dup[2 * i] = dup[2 * i + 1] = input[i];
+  audio::FirDecimator<audio::kI2SDuplicatedRate, kSampleRate> dec2;
+  time_chunks("fir 2-slot", dup, [&](const int32_t *in, int n, int32_t *out) {
+    return dec2.process(in, n, out);
+  });
+  dec.reset();
+  // In place, as on the DMA buffer; time_chunks makes a single pass.
+  time_chunks("drop+fir", dup, [&](const int32_t *in, int n, int32_t *out) {
+    int m = audio::drop_duplicate_slots(const_cast<int32_t *>(in), n);
+    return dec.process(in, m, out);
+  });
+}
+
+// Gain in dB of a sine at freq through the decimator, measured as output RMS
+// over input RMS after the filter has settled. Tones above the output
+// Nyquist show up as their aliases, so this is the alias rejection there.
+template <typename Fn> static double gain_db(double freq, Fn &&decimate) {
+  const int n = kI2SEffectiveRate / 4;
+  std::vector<int32_t> in = make_sine(freq, 0.5, n);
+  std::vector<int32_t> out((size_t)n / kDecimation + 1);
+  int produced = decimate(in.data(), n, out.data());
+
+  double sum_sq = 0;
+  int skip = Decimator::kTaps; // settle time
+  for (int i = skip; i < produced; i++)
+    sum_sq += (double)out[(size_t)i] * out[(size_t)i];
+  double rms = sqrt(sum_sq / (produced - skip));
+  double in_rms = 0.5 * 2147483647.0 / sqrt(2.0);
+  return 20 * log10(rms / in_rms + 1e-12);
+}
+
+static void frequency_response() {
+  printf("== frequency response (dB), output Nyquist %d Hz ==\n",
+         kSampleRate / 2);
+  printf("%8s %10s %10s\n", "freq", "boxcar", "fir");
+  const double freqs[] = {100,   1000,  3000,  5000,  6000,  7000,
+                          8000,  9000,  10000, 12000, 15000, 20000,
+                          23000};
+  for (double f : freqs) {
+    Decimator dec;
+    double fir = gain_db(f, [&](const int32_t *in, int n, int32_t *out) {
+      return dec.process(in, n, out);
+    });
+    Boxcar bc;
+    double box = gain_db(f, [&](const int32_t *in, int n, int32_t *out) {
+      return bc.process(in, n, out);
+    });
+    printf("%8.0f %10.2f %10.2f%s\n", f, box, fir,
+           f >= kSampleRate / 2 ? "  (aliased)" : "");
+  }
+
+  // Limits, on a finer grid: flat to 5 kHz, and nothing that lands below
+  // 7 kHz after aliasing (input above 9 kHz) within 60 dB. 8 kHz is the end
+  // of the transition band.
+  auto fir_gain = [](double f) {
+    Decimator dec;
+    return gain_db(f, [&](const int32_t *in, int n, int32_t *out) {
+      return dec.process(in, n, out);
+    });
+  };
+  double lo = 0, hi = -200;
+  for (double f = 50; f <= 5000; f += 50) {
+    double g = fir_gain(f);
+    lo = g < lo ? g : lo;
+    hi = g > hi ? g : hi;
+  }
+  double stop = -200;
+  for (double f = 9000; f < kI2SEffectiveRate / 2; f += 250) {
+    double g = fir_gain(f);
+    stop = g > stop ? g : stop;
+  }
+  double edge = fir_gain(kSampleRate / 2);
+  printf("passband to 5 kHz %+.2f..%+.2f dB, %.1f dB at 8 kHz, worst alias "
+         "above 9 kHz %.1f dB\n",
+         lo, hi, edge, stop);
+  CHECK(lo >= -0.5 && hi <= 0.1, "passband %+.2f..%+.2f dB, want -0.5..+0.1",
+        lo, hi);
+  CHECK(edge <= -30, "%.1f dB at 8 kHz, want <= -30", edge);
+  CHECK(stop <= -60, "alias above 9 kHz at %.1f dB, want <= -60", stop);
+}
+
+static uint32_t fnv1a(const void *data, size_t len, uint32_t h = 2166136261u) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static std::vector<int32_t> load_recording(const char *path) {
+  std::vector<int32_t> raw;
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    return raw;
+  }
+  int16_t s;
+  while (fread(&s, sizeof(s), 1, f) == 1) {
+    for (int k = 0; k < kDecimation; k++)
+      raw.push_back((int32_t)s * (1 << 14));
+  }
+  fclose(f);
+  return raw;
+}
+
+// Capture chain output per fixture. Only a change meant to alter the output
+// updates these; it says so in its commit. sine1k and sweep are generated
+// with libm and assume glibc's sin(); the recording ones are exact anywhere.
+static const struct {
+  const char *name;
+  uint32_t hash;
+} kGoldenHashes[] = {
+    {"sine1k", 0x98308e25u},    {"sweep", 0xd9706d6du},
+    {"recording", 0x03cd849au}, {"rec+agc", 0x67caaea7u},
+    {"rec+dc", 0x1406238fu},    {"rec+dc+agc", 0xb376dcc5u},
+};
+
+static uint32_t golden_hash(const char *name) {
+  for (const auto &g : kGoldenHashes) {
+    if (strcmp(g.name, name) == 0)
+      return g.hash;
+  }
+  return 0;
+}
+
+// Runs input through the full capture chain in kChunkSamples reads, with
+// the level meter updated per chunk like the firmware capture loop. With
+// agc, scaling goes through the AGC instead of the fixed shift.
+static void bench_chain(const char *name, const std::vector<int32_t> &input,
+                        const audio::Agc::Config *agc = nullptr,
+                        int dc_cutoff_hz = 0) {
+  audio::CaptureChain chain;
+  audio::LevelMeter levels(kSampleRate);
+  if (dc_cutoff_hz > 0)
+    chain.enable_dc_block(dc_cutoff_hz);
+  if (agc)
+    chain.enable_agc(*agc);
+  chain.reset();
+  static int16_t out[audio::CaptureChain::kChunkOutMax];
+  int chunks = (int)input.size() / kChunkSamples;
+  int64_t outputs = 0;
+  uint32_t hash = 2166136261u;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (int c = 0; c < chunks; c++) {
+    const int32_t *raw = &input[(size_t)c * kChunkSamples];
+    int n = chain.process(raw, kChunkSamples, out);
+    levels.process(out, n);
+    hash = fnv1a(out, (size_t)n * sizeof(int16_t), hash);
+    outputs += n;
+  }
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/chunk %7.2f Msamples/s out (%.0fx real time) "
+         "hash=%08x\n",
+         name, ns / chunks, (double)outputs / ns * 1e3,
+         (double)outputs / kSampleRate / (ns / 1e9), hash);
+  audio::LevelWindow t = levels.snapshot().total;
+  printf("%-10s rms=%.1f mean=%.1f min=%d max=%d clips=%u\n", "",
+         t.rms_q8 / 256.0, t.mean_q8 / 256.0, t.min, t.max,
+         (unsigned)t.clips);
+  if (const audio::Agc *a = chain.agc()) {
+    audio::AgcStats st = a->stats();
+    printf("%-10s agc gain=%.1f dB limited=%u/%u held=%u clips=%u\n", "",
+           st.gain_db_q8 / 256.0, (unsigned)st.limited_blocks,
+           (unsigned)st.blocks, (unsigned)st.held_blocks, (unsigned)st.clips);
+  }
+  CHECK(hash == golden_hash(name), "%s: output hash %08x, want %08x", name,
+        hash, golden_hash(name));
+}
+
+// Cost of the streaming level meter alone, per decimated chunk.
+static void bench_levels() {
+  const int chunk = audio::CaptureChain::kChunkOutMax - 1;
+  std::vector<int32_t> raw = make_sine(440, 0.3, kI2SEffectiveRate * 20);
+  std::vector<int16_t> pcm(raw.size() / kDecimation);
+  for (size_t i = 0; i < pcm.size(); i++)
+    pcm[i] = (int16_t)(raw[i * kDecimation] >> 16);
+
+  audio::LevelMeter levels(kSampleRate);
+  int chunks = (int)pcm.size() / chunk;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int c = 0; c < chunks; c++)
+    levels.process(&pcm[(size_t)c * chunk], chunk);
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/chunk %7.2f ns/sample\n", "levels", ns / chunks,
+         ns / ((double)chunks * chunk));
+}
+
+// IMA-ADPCM encode cost per block, plus round-trip SNR. The budget line is
+// how much of one I2S read period (kChunkSamples raw samples) a block's
+// worth of encoding per chunk would take.
+static void bench_adpcm(const char *name, const std::vector<int16_t> &pcm) {
+  using audio::ima_adpcm::kBlockBytes;
+  using audio::ima_adpcm::kBlockSamples;
+  int blocks = (int)pcm.size() / kBlockSamples;
+  if (blocks == 0)
+    return;
+  std::vector<uint8_t> enc((size_t)blocks * kBlockBytes);
+
+  int step_index = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (int b = 0; b < blocks; b++)
+    audio::ima_adpcm::encode_block(&pcm[(size_t)b * kBlockSamples],
+                                   &enc[(size_t)b * kBlockBytes], step_index);
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+
+  double sig = 0, err = 0;
+  int16_t dec[kBlockSamples];
+  for (int b = 0; b < blocks; b++) {
+    audio::ima_adpcm::decode_block(&enc[(size_t)b * kBlockBytes], dec);
+    for (int i = 0; i < kBlockSamples; i++) {
+      double x = pcm[(size_t)b * kBlockSamples + (size_t)i];
+      sig += x * x;
+      err += (x - dec[i]) * (x - dec[i]);
+    }
+  }
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  double chunk_period_ns = 1e9 * kChunkSamples / kI2SEffectiveRate;
+  double per_chunk_ns = ns / blocks * (kChunkSamples / kDecimation) /
+                        kBlockSamples;
+  printf("%-10s %9.2f ns/block", name, ns / blocks);
+  if (kHaveCycles)
+    printf(" %7.1f cycles/sample",
+           (double)(c1 - c0) / ((double)blocks * kBlockSamples));
+  printf(" snr=%.1f dB budget=%.3f%% of chunk period\n",
+         10 * log10(sig / (err + 1e-9)), 100 * per_chunk_ns / chunk_period_ns);
+}
+
+// Lossless codec: encode and decode cost, whether the round trip is exact,
+// and the size. The wire rate counts one v2 frame header per block, against
+// 284.8 kbit/s for the PCM16 stream's 10 ms frames.
+static void bench_lossless(const char *name, const std::vector<int16_t> &pcm) {
+  using audio::lossless::kBlockSamples;
+  using audio::lossless::kMaxBlockBytes;
+  int blocks = (int)pcm.size() / kBlockSamples;
+  if (blocks == 0)
+    return;
+  std::vector<uint8_t> enc((size_t)blocks * kMaxBlockBytes);
+  std::vector<int> sizes((size_t)blocks);
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (int b = 0; b < blocks; b++)
+    sizes[(size_t)b] = audio::lossless::encode_block(
+        &pcm[(size_t)b * kBlockSamples], kBlockSamples,
+        &enc[(size_t)b * kMaxBlockBytes]);
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+
+  std::vector<int16_t> dec((size_t)blocks * kBlockSamples);
+  bool ok = true;
+  auto t2 = std::chrono::steady_clock::now();
+  for (int b = 0; b < blocks; b++)
+    ok &= audio::lossless::decode_block(&enc[(size_t)b * kMaxBlockBytes],
+                                        (size_t)sizes[(size_t)b],
+                                        kBlockSamples,
+                                        &dec[(size_t)b * kBlockSamples]);
+  auto t3 = std::chrono::steady_clock::now();
+  int mismatches = 0;
+  for (size_t i = 0; i < dec.size(); i++)
+    mismatches += dec[i] != pcm[i];
+
+  uint64_t bytes = 0;
+  int orders[audio::lossless::kMaxOrder + 1] = {};
+  int verbatim = 0;
+  for (int b = 0; b < blocks; b++) {
+    bytes += (uint64_t)sizes[(size_t)b];
+    uint8_t order = enc[(size_t)b * kMaxBlockBytes];
+    if (order == audio::lossless::kVerbatim)
+      verbatim++;
+    else
+      orders[order]++;
+  }
+
+  double samples = (double)blocks * kBlockSamples;
+  double enc_ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  double dec_ns = std::chrono::duration<double, std::nano>(t3 - t2).count();
+  double chunk_period_ns = 1e9 * kChunkSamples / kI2SEffectiveRate;
+  double per_chunk_ns = enc_ns / samples * (kChunkSamples / kDecimation);
+  double seconds = samples / kSampleRate;
+  printf("%-10s enc %6.2f ns/sample", name, enc_ns / samples);
+  if (kHaveCycles)
+    printf(" %5.1f cycles/sample", (double)(c1 - c0) / samples);
+  printf(" (%.0fx real time) dec %6.2f ns/sample budget=%.3f%%\n",
+         1e9 / (enc_ns / samples) / kSampleRate, dec_ns / samples,
+         100 * per_chunk_ns / chunk_period_ns);
+  printf("%-10s %.3f bits/sample, ratio %.2f, wire %.1f kbit/s, "
+         "orders %d/%d/%d/%d/%d verbatim %d, %s (%d mismatches)\n",
+         "", 8.0 * bytes / samples, 2.0 * samples / bytes,
+         8.0 * (bytes + (uint64_t)blocks * audio::frame::kHeaderBytes) /
+             seconds / 1000,
+         orders[0], orders[1], orders[2], orders[3], orders[4], verbatim,
+         ok && mismatches == 0 ? "exact" : "NOT EXACT", mismatches);
+  CHECK(ok && mismatches == 0, "%s: lossless round trip %s, %d mismatches",
+        name, ok ? "decoded" : "failed to decode", mismatches);
+}
+
+// VoiceGate throughput: the capture loop feeds it one decimated chunk at a
+// time, so that is the unit timed here.
+static void bench_vad_speed(const char *name, const std::vector<int16_t> &pcm) {
+  constexpr int kChunkOut = kChunkSamples / kDecimation;
+  int chunks = (int)pcm.size() / kChunkOut;
+  if (chunks == 0)
+    return;
+  audio::VoiceGate gate;
+  auto emit = [](const audio::VadFrame &) {};
+
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (int c = 0; c < chunks; c++)
+    gate.process(&pcm[(size_t)c * kChunkOut], kChunkOut, emit);
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  double chunk_period_ns = 1e9 * kChunkSamples / kI2SEffectiveRate;
+  audio::VadStats st = gate.stats();
+  printf("%-10s %9.2f ns/chunk", name, ns / chunks);
+  if (kHaveCycles)
+    printf(" %7.1f cycles/sample",
+           (double)(c1 - c0) / ((double)chunks * kChunkOut));
+  printf(" budget=%.3f%% active=%.1f%% segments=%lu\n",
+         100 * ns / chunks / chunk_period_ns,
+         100.0 * st.active_frames / (st.frames ? st.frames : 1),
+         (unsigned long)st.segments);
+}
+
+static double gaussian(uint32_t &state) {
+  auto uniform = [&]() {
+    state = state * 1664525u + 1013904223u;
+    return ((state >> 8) + 0.5) / 16777216.0;
+  };
+  double u1 = uniform(), u2 = uniform();
+  return sqrt(-2 * log(u1)) * cos(2 * M_PI * u2);
+}
+
+// Labelled accuracy test. Alternates 1.5 s of the recording with 1.5 s of
+// nothing, adds white noise at the given SNR, and scores the gate per 10 ms
+// frame against the known labels. Sent frames within the hangover after a
+// talk spurt or the pre-roll before one are expected, so noise frames there
+// are not counted as false alarms. SNR is measured above 100 Hz, where the
+// gate looks; the recording has a lot of sub-100 Hz rumble.
+static void bench_vad_accuracy(const std::vector<int16_t> &speech,
+                               double snr_db) {
+  constexpr int kFrame = audio::VoiceGate::kFrameSamples;
+  constexpr int kSpurt = kSampleRate * 3 / 2;
+  audio::VoiceGate::Config cfg;
+  if ((int)speech.size() < kSpurt)
+    return;
+
+  double sig = 0, y1 = 0, x1 = 0;
+  for (int16_t x : speech) {
+    double y = x - x1 + 0.96 * y1;
+    x1 = x;
+    y1 = y;
+    sig += y * y;
+  }
+  double noise_rms = sqrt(sig / speech.size() / pow(10, snr_db / 10));
+
+  const int kCycles = 8;
+  int total = kCycles * 2 * kSpurt;
+  std::vector<int16_t> mix((size_t)total);
+  std::vector<uint8_t> label((size_t)(total / kFrame));
+  uint32_t rng = 12345;
+  int src = 0;
+  for (int i = 0; i < total; i++) {
+    bool active = (i / kSpurt) % 2 == 1;
+    double v = noise_rms * gaussian(rng);
+    if (active) {
+      v += speech[(size_t)src];
+      src = (src + 1) % (int)speech.size();
+    }
+    mix[(size_t)i] = audio::clamp_int16((int32_t)lrint(v));
+    label[(size_t)(i / kFrame)] = active;
+  }
+
+  std::vector<uint8_t> sent(label.size());
+  audio::VoiceGate gate(cfg);
+  gate.process(mix.data(), total, [&](const audio::VadFrame &f) {
+    sent[f.index / kFrame] = 1;
+  });
+
+  int hang = cfg.hangover_ms / 10, pre = cfg.preroll_ms / 10;
+  int speech_frames = 0, speech_hits = 0, noise_frames = 0, false_alarms = 0;
+  int sent_frames = 0;
+  for (size_t f = 0; f < label.size(); f++) {
+    sent_frames += sent[f];
+    if (label[f]) {
+      speech_frames++;
+      speech_hits += sent[f];
+      continue;
+    }
+    bool excused = false;
+    for (int d = 1; d <= hang && !excused; d++)
+      excused = f >= (size_t)d && label[f - (size_t)d];
+    for (int d = 1; d <= pre && !excused; d++)
+      excused = f + (size_t)d < label.size() && label[f + (size_t)d];
+    if (excused)
+      continue;
+    noise_frames++;
+    false_alarms += sent[f];
+  }
+  double passed = 100.0 * speech_hits / speech_frames;
+  double noise_passed =
+      100.0 * false_alarms / (noise_frames ? noise_frames : 1);
+  printf("snr=%4.0f dB  speech passed=%5.1f%%  noise passed=%5.1f%%  "
+         "sent=%5.1f%% of frames\n",
+         snr_db, passed, noise_passed,
+         100.0 * sent_frames / (double)label.size());
+  // Noise alone must not open the gate at any SNR; speech has to get
+  // through while it is clearly above the noise. At 5 dB and below the
+  // threshold (9 dB) is expected to miss it.
+  CHECK(noise_passed <= 2, "vad snr %.0f dB: %.1f%% of noise passed", snr_db,
+        noise_passed);
+  double want = snr_db >= 20 ? 95 : snr_db >= 10 ? 85 : 0;
+  CHECK(passed >= want, "vad snr %.0f dB: %.1f%% of speech passed, want %.0f%%",
+        snr_db, passed, want);
+}
+
+// Loud-event trigger on a labelled scene: the recording, looped and scaled
+// by background_db (-20 dB is speech across a room), with a door slam (a
+// 150 ms decaying noise burst) or an alarm (3 s of a 3 kHz tone, 250 ms on
+// and off) dropped in once a minute. An event counts as found if the
+// trigger fires within 100 ms of its onset; a later firing inside the event
+// is a refire and anything else a false trigger. Also prints the cost per
+// sample and the share of the continuous stream that clips of pre + post
+// seconds around each firing would take.
+//
+// With agc the scene goes through the default AGC first, a frame per
+// block, and the trigger gets each frame's gain as it does from the frame
+// headers on the device.
+static void bench_event_trigger(const std::vector<int16_t> &background,
+                                double background_db, double event_dbfs,
+                                int pre_s, int post_s, bool agc = false) {
+  constexpr int kFrame = audio::EventTrigger::kFrameSamples;
+  constexpr int kEvery = kSampleRate * 60;
+  const int kEvents = 12;
+  int total = kEvery * kEvents;
+  std::vector<int16_t> scene((size_t)total);
+  double gain = pow(10, background_db / 20);
+  for (int i = 0; i < total; i++)
+    scene[(size_t)i] = (int16_t)lrint(
+        background[(size_t)i % background.size()] * gain);
+
+  // Peak amplitude of a sine at event_dbfs; the noise burst starts at the
+  // same RMS.
+  double amp = 32767 * pow(10, event_dbfs / 20);
+  uint32_t rng = 99;
+  std::vector<int> onsets;
+  for (int e = 0; e < kEvents; e++) {
+    int start = e * kEvery + kEvery / 2;
+    onsets.push_back(start);
+    bool slam = e % 2 == 0;
+    int len = slam ? kSampleRate * 15 / 100 : kSampleRate * 3;
+    for (int i = 0; i < len; i++) {
+      double v;
+      if (slam) {
+        v = amp / sqrt(2) * gaussian(rng) * exp(-i / (0.03 * kSampleRate));
+      } else {
+        bool on = (i / (kSampleRate / 4)) % 2 == 0;
+        v = on ? amp * sin(2 * M_PI * 3000 * i / kSampleRate) : 0;
+      }
+      size_t at = (size_t)(start + i);
+      scene[at] = audio::clamp_int16(scene[at] + (int32_t)lrint(v));
+    }
+  }
+
+  int frames = total / kFrame;
+  std::vector<int32_t> gains((size_t)frames, 0);
+  if (agc) {
+    audio::Agc stage;
+    int32_t raw[kFrame];
+    for (int f = 0; f < frames; f++) {
+      int16_t *x = &scene[(size_t)f * kFrame];
+      // Back to the raw scale, where 0 dB is the fixed >> 14.
+      for (int i = 0; i < kFrame; i++)
+        raw[i] = (int32_t)x[i] * 16384;
+      stage.process(raw, kFrame, x);
+      gains[(size_t)f] = stage.gain_db_q8();
+    }
+  }
+
+  audio::EventTrigger trigger;
+  std::vector<int> fired;
+  uint64_t c0 = cycles_now();
+  for (int f = 0; f < frames; f++) {
+    if (trigger.process_frame(&scene[(size_t)f * kFrame], gains[(size_t)f]))
+      fired.push_back(f * kFrame);
+  }
+  uint64_t c1 = cycles_now();
+
+  // Firings later in an event (each alarm beep after the hold-off) only
+  // extend its clip, like the recorder does.
+  int found = 0, refires = 0, false_triggers = 0;
+  double latency_ms = 0;
+  for (int at : fired) {
+    bool hit = false;
+    for (size_t e = 0; e < onsets.size() && !hit; e++) {
+      int onset = onsets[e];
+      int end = onset + (e % 2 == 0 ? kSampleRate * 15 / 100 : kSampleRate * 3);
+      if (at + kFrame > onset && at < onset + kSampleRate / 10) {
+        found++;
+        latency_ms += 1000.0 * (at + kFrame - onset) / kSampleRate;
+        hit = true;
+      } else if (at > onset && at < end) {
+        refires++;
+        hit = true;
+      }
+    }
+    false_triggers += !hit;
+  }
+  // Overlapping clips merge into one.
+  int64_t clip_samples = 0, covered_to = 0;
+  for (int at : fired) {
+    int64_t from = at - (int64_t)pre_s * kSampleRate;
+    int64_t to = at + (int64_t)post_s * kSampleRate;
+    if (from < covered_to)
+      from = covered_to;
+    if (to > from)
+      clip_samples += to - from;
+    if (to > covered_to)
+      covered_to = to;
+  }
+  printf("speech %+3.0f dB, events %4.0f dBFS%s: found %2d/%d (%3.0f ms) "
+         "refired=%-2d false=%-3d",
+         background_db, event_dbfs, agc ? ", agc" : "", found, kEvents,
+         found ? latency_ms / found : 0.0, refires, false_triggers);
+  if (kHaveCycles)
+    printf("  %.1f cycles/sample", (double)(c1 - c0) / total);
+  printf("  clips=%.0f%% of the stream\n", 100.0 * clip_samples / total);
+
+  // Behind the AGC the trigger must still go by the room: events well over
+  // the threshold are all found, those under it never fire, and the
+  // boosted speech around them does not either.
+  if (agc) {
+    audio::EventTrigger::Config cfg;
+    if (event_dbfs >= cfg.threshold_dbfs + 6)
+      CHECK(found == kEvents, "trigger agc, events %.0f dBFS: found %d/%d",
+            event_dbfs, found, kEvents);
+    if (event_dbfs < cfg.threshold_dbfs)
+      CHECK(fired.empty(), "trigger agc, events %.0f dBFS: fired %d times",
+            event_dbfs, (int)fired.size());
+    CHECK(false_triggers == 0, "trigger agc, speech %.0f dB: %d false",
+          background_db, false_triggers);
+  }
+}
+
+// AGC cost per chunk on decimated (raw-scale) samples, next to the fixed
+// shift it replaces.
+static void bench_agc_speed() {
+  const int chunk = audio::CaptureChain::kChunkOutMax - 1;
+  std::vector<int32_t> in = make_sine(440, 0.3, kSampleRate * 20);
+  static int16_t out[audio::CaptureChain::kChunkOutMax];
+  int chunks = (int)in.size() / chunk;
+  int16_t sink = 0;
+
+  audio::Agc agc;
+  for (int pass = 0; pass < 2; pass++) {
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t c0 = cycles_now();
+    for (int c = 0; c < chunks; c++) {
+      const int32_t *x = &in[(size_t)c * chunk];
+      if (pass == 0) {
+        for (int i = 0; i < chunk; i++)
+          out[i] = audio::sample32_to_16(x[i]);
+      } else {
+        agc.process(x, chunk, out);
+      }
+      sink ^= out[c % chunk];
+    }
+    uint64_t c1 = cycles_now();
+    auto t1 = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    double samples = (double)chunks * chunk;
+    printf("%-10s %9.2f ns/chunk %7.2f ns/sample", pass ? "agc" : "shift14",
+           ns / chunks, ns / samples);
+    if (kHaveCycles)
+      printf(" %7.1f cycles/sample", (double)(c1 - c0) / samples);
+    printf("\n");
+  }
+  if (sink == 12345)
+    printf("\n");
+}
+
+static double block_rms_db(const int16_t *x, int n) {
+  double e = 0;
+  for (int i = 0; i < n; i++)
+    e += (double)x[i] * x[i];
+  return 10 * log10(e / n / (32768.0 * 32768.0) + 1e-20);
+}
+
+// Level tracking with the default config: a 1 kHz tone whose RMS steps
+// between levels (dBFS at 0 dB gain), fed straight in at the raw scale in
+// chunk-sized blocks. Per step: where the output settled (mean of the last
+// 0.5 s), how long until every later block stays within 1 dB of that, the
+// highest output peak, clamped samples and limited blocks. The -70 dBFS step
+// is under the gate and should keep the gain it found before.
+static void bench_agc_tracking() {
+  struct Step {
+    double level_dbfs;
+    double seconds;
+  };
+  const Step steps[] = {{-50, 4}, {-20, 3}, {-6, 3},  {6, 2},
+                        {-40, 6}, {-70, 3}, {-30, 4}};
+  const int chunk = audio::CaptureChain::kChunkOutMax - 1;
+  audio::Agc::Config cfg;
+  audio::Agc agc(cfg);
+  int16_t out[audio::CaptureChain::kChunkOutMax];
+  int32_t in[audio::CaptureChain::kChunkOutMax];
+  printf("target %d dBFS, gain %d..%d dB, attack %d ms, release %d ms, "
+         "gate %d dBFS, ceiling %d dBFS\n",
+         cfg.target_dbfs, cfg.min_gain_db, cfg.max_gain_db, cfg.attack_ms,
+         cfg.release_ms, cfg.gate_dbfs, cfg.limit_dbfs);
+
+  long phase = 0;
+  for (const Step &st : steps) {
+    double amp = 32768.0 * sqrt(2.0) * pow(10, st.level_dbfs / 20) * 16384;
+    int blocks = (int)(st.seconds * kSampleRate / chunk);
+    std::vector<double> rms((size_t)blocks);
+    double peak = 0;
+    audio::AgcStats before = agc.stats();
+    for (int b = 0; b < blocks; b++) {
+      for (int i = 0; i < chunk; i++, phase++) {
+        double v = amp * sin(2 * M_PI * 1000.0 * phase / kSampleRate);
+        in[i] = (int32_t)fmax(fmin(v, 2147483647.0), -2147483648.0);
+      }
+      agc.process(in, chunk, out);
+      for (int i = 0; i < chunk; i++)
+        peak = fmax(peak, fabs((double)out[i]));
+      rms[(size_t)b] = block_rms_db(out, chunk);
+    }
+    int tail = (int)(0.5 * kSampleRate / chunk);
+    double settled = 0;
+    for (int b = blocks - tail; b < blocks; b++)
+      settled += rms[(size_t)b] / tail;
+    int settle = blocks;
+    while (settle > 0 && fabs(rms[(size_t)settle - 1] - settled) <= 1.0)
+      settle--;
+    audio::AgcStats after = agc.stats();
+    printf("in %4.0f dBFS: out %6.1f dBFS, gain %5.1f dB, settled in "
+           "%5.0f ms, peak %5.1f dBFS, clips %u, limited %u, held %u\n",
+           st.level_dbfs, settled, after.gain_db_q8 / 256.0,
+           settle * 1000.0 * chunk / kSampleRate,
+           20 * log10(peak / 32768.0 + 1e-20),
+           (unsigned)(after.clips - before.clips),
+           (unsigned)(after.limited_blocks - before.limited_blocks),
+           (unsigned)(after.held_blocks - before.held_blocks));
+
+    // Above the gate the output must settle within 1 dB of the target, or
+    // of where the gain limits leave it; below, the gain must hold.
+    CHECK(after.clips == before.clips, "agc in %.0f dBFS: %u clips",
+          st.level_dbfs, (unsigned)(after.clips - before.clips));
+    CHECK(settle < blocks - tail, "agc in %.0f dBFS: not settled in %.0f s",
+          st.level_dbfs, st.seconds);
+    if (st.level_dbfs < cfg.gate_dbfs) {
+      CHECK(after.gain_db_q8 == before.gain_db_q8 &&
+                after.held_blocks - before.held_blocks == (uint32_t)blocks,
+            "agc in %.0f dBFS: gain moved below the gate", st.level_dbfs);
+      continue;
+    }
+    double gain = fmax(fmin(cfg.target_dbfs - st.level_dbfs,
+                            (double)cfg.max_gain_db),
+                       (double)cfg.min_gain_db);
+    CHECK(fabs(settled - (st.level_dbfs + gain)) <= 1.0,
+          "agc in %.0f dBFS: out %.1f dBFS, want %.1f", st.level_dbfs,
+          settled, st.level_dbfs + gain);
+  }
+}
+
+// Radix-4 kernel cost per 256-point transform, and the analyzer's cost per
+// frame (window, FFT, bin powers) on 20 s of a tone in noise.
+static void bench_fft_speed() {
+  const int n = audio::fft::kSize;
+  const int transforms = 20000;
+  std::vector<audio::fft::Complex> input((size_t)n);
+  uint32_t state = 1;
+  for (auto &c : input) {
+    state = state * 1664525u + 1013904223u;
+    c = {(int32_t)(state >> 9) - (1 << 22), 0};
+  }
+  static audio::fft::Complex work[audio::fft::kSize];
+  int32_t sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (int t = 0; t < transforms; t++) {
+    memcpy(work, input.data(), sizeof(work));
+    audio::fft::radix4(work);
+    sink ^= work[t % n].re;
+  }
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.1f ns/frame", "radix4", ns / transforms);
+  if (kHaveCycles)
+    printf(" %9.0f cycles/frame", (double)(c1 - c0) / transforms);
+  printf("\n");
+
+  std::vector<int16_t> pcm((size_t)kSampleRate * 20);
+  for (size_t i = 0; i < pcm.size(); i++) {
+    state = state * 1664525u + 1013904223u;
+    pcm[i] = (int16_t)(3000 * sin(2 * M_PI * 1000.0 * i / kSampleRate) +
+                       (int32_t)(state >> 22) - 512);
+  }
+  audio::SpectrumAnalyzer analyzer;
+  const int chunk = audio::CaptureChain::kChunkOutMax - 1;
+  int frames = 0;
+  t0 = std::chrono::steady_clock::now();
+  c0 = cycles_now();
+  for (size_t i = 0; i + chunk <= pcm.size(); i += chunk)
+    frames += analyzer.process(&pcm[i], chunk);
+  c1 = cycles_now();
+  t1 = std::chrono::steady_clock::now();
+  ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.1f ns/frame", "analyzer", ns / frames);
+  if (kHaveCycles)
+    printf(" %9.0f cycles/frame", (double)(c1 - c0) / frames);
+  printf(", %.1f frames/s of audio\n", frames / 20.0);
+  if (sink == 12345)
+    printf("\n");
+}
+
+// Kernel accuracy: windowed tones and noise at the analyzer's input scale,
+// against a double-precision DFT / kSize of the same input.
+static void bench_fft_accuracy() {
+  const int n = audio::fft::kSize;
+  struct Case {
+    const char *name;
+    double tone_hz;
+    double amplitude; // of the int16 input
+  };
+  const Case cases[] = {{"tone -1dB", 1000, 29000},
+                        {"tone -40dB", 3000, 330},
+                        {"tone -80dB", 440, 3.3},
+                        {"noise", 0, 8000}};
+  uint32_t state = 7;
+  for (const Case &cs : cases) {
+    audio::fft::Complex x[audio::fft::kSize];
+    std::vector<double> ref_in((size_t)n);
+    for (int i = 0; i < n; i++) {
+      double v = cs.amplitude * sin(2 * M_PI * cs.tone_hz * i / kSampleRate);
+      if (cs.tone_hz == 0)
+        v = cs.amplitude * gaussian(state);
+      double w = sin(M_PI * i / n) * sin(M_PI * i / n);
+      int32_t s = (int32_t)lrint(w * fmax(fmin(v, 32767), -32768) * 256);
+      x[i] = {s, 0};
+      ref_in[(size_t)i] = s;
+    }
+    audio::fft::radix4(x);
+    double signal = 0, error = 0;
+    for (int k = 0; k < n; k++) {
+      double re = 0, im = 0;
+      for (int i = 0; i < n; i++) {
+        re += ref_in[(size_t)i] * cos(2 * M_PI * k * i / n) / n;
+        im -= ref_in[(size_t)i] * sin(2 * M_PI * k * i / n) / n;
+      }
+      double dr = x[k].re - re, di = x[k].im - im;
+      signal += re * re + im * im;
+      error += dr * dr + di * di;
+    }
+    printf("%-10s SNR %5.1f dB (error %.2f LSB rms per bin)\n", cs.name,
+           10 * log10(signal / (error + 1e-30)), sqrt(error / n));
+  }
+}
+
+// Reports for 0.5 s of steady input: a tone should show up in its octave at
+// its RMS level with the peak interpolated to within a few Hz; white noise
+// spreads by bandwidth, +3 dB per octave band.
+static void bench_spectrum_tones() {
+  struct Case {
+    const char *name;
+    double tone_hz;
+    double rms_dbfs;
+  };
+  const Case cases[] = {{"100Hz", 100, -20},  {"440Hz", 440, -20},
+                        {"1010Hz", 1010, -6}, {"3000Hz", 3000, -40},
+                        {"6500Hz", 6500, -60}, {"noise", 0, -30}};
+  audio::SpectrumAnalyzer analyzer;
+  printf("%-8s %6s %6s %6s |", "input", "peakHz", "peakdB", "level");
+  for (int b = 0; b < audio::SpectrumAnalyzer::kBands; b++)
+    printf(" %5d", analyzer.band_low_hz(b));
+  printf("\n");
+  uint32_t state = 11;
+  for (const Case &cs : cases) {
+    double amp = 32768.0 * pow(10, cs.rms_dbfs / 20);
+    std::vector<int16_t> pcm((size_t)kSampleRate / 2);
+    for (size_t i = 0; i < pcm.size(); i++) {
+      double v = cs.tone_hz > 0
+                     ? amp * sqrt(2.0) *
+                           sin(2 * M_PI * cs.tone_hz * i / kSampleRate)
+                     : amp * gaussian(state);
+      pcm[i] = (int16_t)lrint(fmax(fmin(v, 32767), -32768));
+    }
+    analyzer.reset();
+    analyzer.process(pcm.data(), (int)pcm.size());
+    audio::SpectrumReport r = analyzer.take_report();
+    printf("%-8s %6u %6.1f %6.1f |", cs.name, (unsigned)r.peak_hz,
+           r.peak_dbfs_q8 / 256.0, r.level_dbfs_q8 / 256.0);
+    for (int b = 0; b < audio::SpectrumAnalyzer::kBands; b++)
+      printf(" %5.1f", r.band_dbfs_q8[b] / 256.0);
+    printf("\n");
+  }
+}
+
+// DC blocker cost per 16 kHz sample, in capture-chunk-sized calls.
+static void bench_dc_blocker_speed() {
+  std::vector<int32_t> x((size_t)kSampleRate * 20);
+  uint32_t state = 9;
+  for (auto &v : x)
+    v = (int32_t)lrint(3e8 * gaussian(state)) - 50000000;
+  audio::DcBlocker dc;
+  const int chunk = audio::CaptureChain::kChunkOutMax - 1;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (size_t i = 0; i + chunk <= x.size(); i += chunk)
+    dc.process(&x[i], chunk);
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/sample", "dc_block", ns / x.size());
+  if (kHaveCycles)
+    printf(" %7.1f cycles/sample", (double)(c1 - c0) / x.size());
+  printf(" budget=%.3f%% of real time\n", 100 * ns / 20e9);
+}
+
+// Gain of the blocker for a tone, in dB: RMS out over RMS in once the
+// start-up transient is over.
+static double dc_blocker_gain_db(int cutoff_hz, double freq) {
+  audio::DcBlocker dc(cutoff_hz);
+  const int n = kSampleRate * 2;
+  std::vector<int32_t> x((size_t)n);
+  for (int i = 0; i < n; i++)
+    x[(size_t)i] = (int32_t)lrint(1e9 * sin(2 * M_PI * freq * i / kSampleRate));
+  std::vector<int32_t> y = x;
+  dc.process(y.data(), n);
+  double in = 0, out = 0;
+  for (int i = n / 2; i < n; i++) {
+    in += (double)x[(size_t)i] * x[(size_t)i];
+    out += (double)y[(size_t)i] * y[(size_t)i];
+  }
+  return 10 * log10(out / in);
+}
+
+// Step response: silence, then a jump to a -30 dBFS offset (about what an
+// INMP441 shows) at 0.1 s. The output jumps with it and must decay to
+// nothing; settle is the time until it stays under 1 LSB of the int16 output
+// at 0 dB, and after 1.9 s it has to read exactly 0. Then the tone gains.
+static void bench_dc_blocker_response() {
+  printf("%-6s %9s %9s %9s | %7s", "cutoff", "settle", "undershoot",
+         "final", "0.5Hz");
+  for (int f : {1, 2, 3, 10})
+    printf(" %5dfc", f);
+  printf(" %7s  (dB)\n", "7kHz");
+  const int32_t offset = (int32_t)(2147483647.0 * pow(10, -30 / 20.0));
+  for (int cutoff : {5, 20, 50, 100}) {
+    audio::DcBlocker dc(cutoff);
+    const int n = kSampleRate * 2, step_at = kSampleRate / 10;
+    std::vector<int32_t> x((size_t)n);
+    for (int i = 0; i < n; i++)
+      x[(size_t)i] = i < step_at ? 0 : offset;
+    dc.process(x.data(), n);
+    int settled = step_at;
+    int32_t lowest = 0;
+    for (int i = step_at; i < n; i++) {
+      if (x[(size_t)i] < lowest)
+        lowest = x[(size_t)i];
+      if (abs(x[(size_t)i] >> 14) > 1)
+        settled = i + 1;
+    }
+    double settle_s = (double)(settled - step_at) / kSampleRate;
+    printf("%4dHz %7.1fms %8.3f%% %9d |", cutoff, settle_s * 1000,
+           100.0 * lowest / offset, x[(size_t)n - 1]);
+    double slow = dc_blocker_gain_db(cutoff, 0.5);
+    printf(" %7.2f", slow);
+    const double multiples[] = {1, 2, 3, 10};
+    double gain[4];
+    for (int k = 0; k < 4; k++) {
+      gain[k] = dc_blocker_gain_db(cutoff, multiples[k] * cutoff);
+      printf(" %7.2f", gain[k]);
+    }
+    double top = dc_blocker_gain_db(cutoff, 7000);
+    printf(" %7.2f\n", top);
+
+    // A one-pole high-pass: the step decays without overshoot, in about
+    // ln(offset in LSB) / (2 pi fc), to nothing; -3 dB at the cutoff,
+    // 6 dB per octave below it, flat well above.
+    CHECK(settle_s <= 1.5 / cutoff, "dc %d Hz: step settles in %.1f ms",
+          cutoff, settle_s * 1000);
+    CHECK(lowest >= -offset / 1000, "dc %d Hz: step undershoots %.3f%%",
+          cutoff, 100.0 * lowest / offset);
+    CHECK(abs(x[(size_t)n - 1]) < 1 << 14, "dc %d Hz: %d left after the step",
+          cutoff, x[(size_t)n - 1]);
+    CHECK(fabs(gain[0] + 3.0) <= 0.2, "dc %d Hz: %.2f dB at the cutoff",
+          cutoff, gain[0]);
+    CHECK(slow <= 20 * log10(0.5 / cutoff) + 1, "dc %d Hz: %.2f dB at 0.5 Hz",
+          cutoff, slow);
+    CHECK(gain[3] >= -0.1 && top >= -0.1,
+          "dc %d Hz: %.2f dB at 10 fc, %.2f dB at 7 kHz", cutoff, gain[3], top);
+  }
+}
+
+// Resampler cost per 16 kHz output sample, at a drift well inside the range.
+static void bench_resampler_speed() {
+  std::vector<int16_t> pcm((size_t)kSampleRate * 20);
+  uint32_t state = 3;
+  for (size_t i = 0; i < pcm.size(); i++)
+    pcm[i] = (int16_t)lrint(8000 * gaussian(state));
+  std::vector<int16_t> out(pcm.size() + pcm.size() / 512 + 2);
+  audio::DriftResampler resampler;
+  resampler.set_ppm_q8(100 * 256);
+  const int chunk = audio::CaptureChain::kChunkOutMax - 1;
+  int produced = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (size_t i = 0; i + chunk <= pcm.size(); i += chunk)
+    produced += resampler.process(&pcm[i], chunk, &out[(size_t)produced]);
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/sample", "resampler", ns / produced);
+  if (kHaveCycles)
+    printf(" %7.1f cycles/sample", (double)(c1 - c0) / produced);
+  printf(" budget=%.3f%% of real time\n", 100 * ns / 20e9);
+}
+
+// Tones through the resampler at several drifts, against the exact value at
+// each output's position (j * (1 + ppm) input samples, less the 8-sample
+// delay). Over 10 s the output count must come out at n / (1 + ppm).
+static void bench_resampler_accuracy() {
+  const double tones[] = {100, 1000, 3000, 5000, 6400};
+  const int n = kSampleRate * 10;
+  const double amplitude = 20000;
+  printf("%-8s %8s %8s |", "ppm", "out", "expect");
+  for (double f : tones)
+    printf(" %5.0fHz", f);
+  printf("  (SNR dB)\n");
+  for (double ppm : {-1000.0, -250.0, 0.0, 37.5, 100.0, 1000.0}) {
+    int produced = 0;
+    printf("%-8.1f", ppm);
+    std::vector<double> snr;
+    for (double f : tones) {
+      std::vector<int16_t> in((size_t)n), out((size_t)(n + n / 512 + 2));
+      for (int i = 0; i < n; i++)
+        in[(size_t)i] =
+            (int16_t)lrint(amplitude * sin(2 * M_PI * f * i / kSampleRate));
+      audio::DriftResampler resampler;
+      resampler.set_ppm_q8((int32_t)lrint(ppm * 256));
+      produced = 0;
+      for (int i = 0; i < n; i += kSampleRate / 100)
+        produced += resampler.process(&in[(size_t)i], kSampleRate / 100,
+                                      &out[(size_t)produced]);
+      double step = 1 + ppm * 1e-6, signal = 0, error = 0;
+      for (int j = 1000; j < produced - 16; j++) {
+        double ref =
+            amplitude * sin(2 * M_PI * f * (j * step - 8) / kSampleRate);
+        signal += ref * ref;
+        error += (out[(size_t)j] - ref) * (out[(size_t)j] - ref);
+      }
+      snr.push_back(10 * log10(signal / error));
+    }
+    printf(" %8d %8.1f |", produced, n / (1 + ppm * 1e-6));
+    for (double v : snr)
+      printf(" %7.1f", v);
+    printf("\n");
+  }
+}
+
+// The estimator on a simulated capture: 5 ms DMA buffers from a clock off by
+// a known amount, stamped with a few microseconds of random interrupt
+// latency, a 2 ms stall every ~5 s and a burst of lost buffers at 40 s.
+// Prints the error of the estimate as the window fills.
+static void bench_drift_estimator() {
+  const int frames = 240;
+  const int report_s[] = {3, 5, 10, 30, 64, 120, 300};
+  printf("%-8s", "true ppm");
+  for (int t : report_s)
+    printf(" %6ds", t);
+  printf("  (estimate error, ppm)\n");
+  for (double ppm : {0.0, 37.5, -120.0, 850.0}) {
+    audio::DriftEstimator estimator(kI2SEffectiveRate);
+    const double period_us =
+        frames * 1e6 / (kI2SEffectiveRate * (1 + ppm * 1e-6));
+    uint32_t state = 5;
+    size_t next_report = 0;
+    printf("%-8.1f", ppm);
+    for (uint32_t index = 0; next_report < sizeof(report_s) / sizeof(int);
+         index++) {
+      double t_us = (index + 1) * period_us;
+      if (index >= 8000 && index < 8003)
+        continue; // lost: never seen, but still counted by index
+      double latency = 3 + 4 * fabs(gaussian(state));
+      if (index % 997 == 500)
+        latency += 2000;
+      estimator.update((uint64_t)(index + 1) * frames,
+                       (int64_t)(t_us + latency));
+      if (t_us >= report_s[next_report] * 1e6) {
+        printf(" %7.3f", estimator.ppm_q8() / 256.0 - ppm);
+        next_report++;
+      }
+    }
+    printf("%s\n", "");
+  }
+}
+
+// Stream v2 framing: the cost of finishing a 10 ms PCM16 frame (header and
+// CRC) on the producer side, the host parser's throughput on clean input,
+// and how it recovers when the byte stream is damaged. Damage is one flipped
+// byte every 37 frames and 100 bytes dropped every 53 frames; each should
+// cost only the frame it lands in (the last frame's loss shows no seq gap).
+static void bench_framing(const std::vector<int16_t> &pcm) {
+  namespace fr = audio::frame;
+  constexpr int kFrame = kSampleRate / 100;
+  constexpr size_t kUnit = fr::kHeaderBytes + kFrame * sizeof(int16_t);
+  int frames = (int)pcm.size() / kFrame;
+  if (frames == 0)
+    return;
+
+  std::vector<uint8_t> stream((size_t)frames * kUnit);
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = cycles_now();
+  for (int i = 0; i < frames; i++) {
+    uint8_t *f = &stream[(size_t)i * kUnit];
+    memcpy(f + fr::kHeaderBytes, &pcm[(size_t)i * kFrame],
+           kFrame * sizeof(int16_t));
+    fr::Header h = {};
+    h.codec = fr::kCodecPcm16;
+    h.seq = (uint32_t)i;
+    h.payload_bytes = kFrame * sizeof(int16_t);
+    h.samples = kFrame;
+    h.timestamp_us = (int64_t)i * 10000;
+    h.sample_index = (uint32_t)(i * kFrame);
+    h.gain_db_q8 = (int16_t)(i % 64 * 128);
+    fr::finish(h, f);
+  }
+  uint64_t c1 = cycles_now();
+  auto t1 = std::chrono::steady_clock::now();
+  double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/frame", "finish", ns / frames);
+  if (kHaveCycles)
+    printf(" %7.1f cycles/byte", (double)(c1 - c0) / stream.size());
+  printf(" budget=%.3f%% of frame period\n", 100 * ns / frames / 1e7);
+
+  // Fed in TCP-segment-sized pieces, as recv() would return them.
+  auto parse = [](const std::vector<uint8_t> &bytes, uint64_t *samples) {
+    auto p = std::make_unique<fr::Parser>();
+    for (size_t off = 0; off < bytes.size(); off += 1460) {
+      size_t len = bytes.size() - off < 1460 ? bytes.size() - off : 1460;
+      p->feed(&bytes[off], len, [&](const fr::Header &h, const uint8_t *) {
+        *samples += h.samples;
+      });
+    }
+    return p->stats();
+  };
+
+  uint64_t samples = 0;
+  t0 = std::chrono::steady_clock::now();
+  fr::Parser::Stats st = parse(stream, &samples);
+  t1 = std::chrono::steady_clock::now();
+  ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+  printf("%-10s %9.2f ns/frame %7.1f MB/s frames=%lu/%d\n", "parse",
+         ns / frames, stream.size() / ns * 1e3, (unsigned long)st.frames,
+         frames);
+
+  std::vector<uint8_t> bad;
+  int damaged = 0;
+  for (int i = 0; i < frames; i++) {
+    const uint8_t *f = &stream[(size_t)i * kUnit];
+    if (i % 53 == 26) {
+      bad.insert(bad.end(), f, f + kUnit - 100);
+      damaged++;
+    } else if (i % 37 == 18) {
+      size_t at = bad.size() + (size_t)(i * 7919) % kUnit;
+      bad.insert(bad.end(), f, f + kUnit);
+      bad[at] ^= 0x5a;
+      damaged++;
+    } else {
+      bad.insert(bad.end(), f, f + kUnit);
+    }
+  }
+  samples = 0;
+  st = parse(bad, &samples);
+  printf("%-10s damaged=%d recovered=%lu/%d crc_errors=%lu "
+         "resync_bytes=%lu seq_gaps=%lu\n",
+         "corrupt", damaged, (unsigned long)st.frames, frames - damaged,
+         (unsigned long)st.crc_errors, (unsigned long)st.resync_bytes,
+         (unsigned long)st.seq_gaps);
+}
+
+int main(int argc, char **argv) {
+  bench_decimators();
+  frequency_response();
+
+  printf("== level meter ==\n");
+  bench_levels();
+
+  printf("== ima-adpcm ==\n");
+  {
+    std::vector<int32_t> raw = make_sine(440, 0.3, kI2SEffectiveRate * 20);
+    std::vector<int16_t> pcm(raw.size() / kDecimation);
+    for (size_t i = 0; i < pcm.size(); i++)
+      pcm[i] = (int16_t)(raw[i * kDecimation] >> 16);
+    bench_adpcm("sine440", pcm);
+  }
+  std::vector<int16_t> pcm;
+  if (argc > 1) {
+    FILE *f = fopen(argv[1], "rb");
+    int16_t s;
+    while (f && fread(&s, sizeof(s), 1, f) == 1)
+      pcm.push_back(s);
+    if (f)
+      fclose(f);
+    bench_adpcm("recording", pcm);
+  }
+
+  printf("== lossless ==\n");
+  {
+    std::vector<int32_t> raw = make_sine(440, 0.3, kI2SEffectiveRate * 20);
+    std::vector<int16_t> sine(raw.size() / kDecimation);
+    for (size_t i = 0; i < sine.size(); i++)
+      sine[i] = (int16_t)(raw[i * kDecimation] >> 16);
+    bench_lossless("sine440", sine);
+    uint32_t seed = 7;
+    std::vector<int16_t> noise((size_t)kSampleRate * 20);
+    for (int16_t &x : noise)
+      x = audio::clamp_int16((int32_t)lrint(gaussian(seed) * 8000));
+    bench_lossless("noise", noise);
+    if (!pcm.empty()) {
+      std::vector<int16_t> looped;
+      while (looped.size() < (size_t)kSampleRate * 60)
+        looped.insert(looped.end(), pcm.begin(), pcm.end());
+      bench_lossless("recording", looped);
+    }
+  }
+  if (argc > 1 && !pcm.empty()) {
+    printf("== voice gate ==\n");
+    // Skip the first 0.8 s: power-on thump and the quiet lead-in.
+    std::vector<int16_t> speech(pcm.begin() + (pcm.size() > 12800 ? 12800 : 0),
+                                pcm.end());
+    std::vector<int16_t> looped;
+    while (looped.size() < (size_t)kSampleRate * 60)
+      looped.insert(looped.end(), pcm.begin(), pcm.end());
+    bench_vad_speed("recording", looped);
+    for (double snr : {30.0, 20.0, 10.0, 5.0, 0.0})
+      bench_vad_accuracy(speech, snr);
+  }
+
+  if (!pcm.empty()) {
+    printf("== event trigger ==\n");
+    for (double dbfs : {-6.0, -12.0, -18.0, -30.0})
+      bench_event_trigger(pcm, -20, dbfs, 2, 3);
+    // Talking right into the mic is as loud as the threshold.
+    bench_event_trigger(pcm, 0, -6, 2, 3);
+    // The AGC lifts speech across the room (and further) up to its target,
+    // which is the threshold; the trigger takes the gain back off.
+    for (double background_db : {-20.0, -40.0}) {
+      for (double dbfs : {-6.0, -25.0})
+        bench_event_trigger(pcm, background_db, dbfs, 2, 3, true);
+    }
+  }
+
+  printf("== agc ==\n");
+  bench_agc_speed();
+  bench_agc_tracking();
+
+  printf("== spectrum ==\n");
+  bench_fft_speed();
+  bench_fft_accuracy();
+  bench_spectrum_tones();
+
+  printf("== dc blocker ==\n");
+  bench_dc_blocker_speed();
+  bench_dc_blocker_response();
+
+  printf("== clock drift ==\n");
+  bench_resampler_speed();
+  bench_resampler_accuracy();
+  bench_drift_estimator();
+
+  if (!pcm.empty()) {
+    printf("== stream framing ==\n");
+    bench_framing(pcm);
+  }
+
+  printf("== capture chain ==\n");
+  bench_chain("sine1k", make_sine(1000, 0.5, kI2SEffectiveRate * 20));
+  bench_chain("sweep", make_sweep(0.9, kI2SEffectiveRate * 20));
+  if (argc > 1) {
+    std::vector<int32_t> rec = load_recording(argv[1]);
+    if (!rec.empty()) {
+      bench_chain("recording", rec);
+      audio::Agc::Config agc;
+      bench_chain("rec+agc", rec, &agc);
+      bench_chain("rec+dc", rec, nullptr, 20);
+      bench_chain("rec+dc+agc", rec, &agc, 20);
+    }
+  }
+  printf("%d checks, %d failed\n", s_checks, s_failures);
+  return s_failures ? 1 : 0;
+}
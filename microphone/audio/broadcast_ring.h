@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace audio {
+
+// Single-producer, many-reader byte ring for fanning one stream out to
+// several consumers without copying it per consumer.
+//
+// The producer never waits: push() always succeeds and overwrites the oldest
+// bytes. Readers keep their own free-running position and read straight out
+// of the ring with peek(). A reader whose lag (head() - pos) exceeds the
+// capacity has lost data; readers are expected to check their lag before
+// reading and leave some guard so the bytes they are reading are not
+// overwritten mid-read. The caller provides the storage, whose size must be
+// a power of two.
+class BroadcastRing {
+public:
+  BroadcastRing(uint8_t *storage, size_t capacity)
+      : buf_(storage), capacity_(capacity) {}
+
+  size_t capacity() const { return capacity_; }
+
+  // Total bytes ever pushed (wraps at 2^32). Readers start from here.
+  uint32_t head() const { return head_.load(std::memory_order_acquire); }
+
+  // Producer side. len must not exceed the capacity.
+  void push(const void *data, size_t len) {
+    const uint8_t *src = (const uint8_t *)data;
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    size_t idx = head & (capacity_ - 1);
+    size_t first = capacity_ - idx < len ? capacity_ - idx : len;
+    memcpy(&buf_[idx], src, first);
+    memcpy(&buf_[0], src + first, len - first);
+    head_.store(head + (uint32_t)len, std::memory_order_release);
+  }
+
+  // Reader side. Points *data at the bytes starting at pos and returns how
+  // many are contiguous, capped at max. The caller owns pos.
+  size_t peek(uint32_t pos, const uint8_t **data, size_t max) const {
+    size_t idx = pos & (capacity_ - 1);
+    size_t len = capacity_ - idx < max ? capacity_ - idx : max;
+    *data = &buf_[idx];
+    return len;
+  }
+
+  // Copies len bytes starting at pos out of the ring, across the wrap.
+  void copy(uint32_t pos, void *out, size_t len) const {
+    uint8_t *dst = (uint8_t *)out;
+    while (len > 0) {
+      const uint8_t *data;
+      size_t n = peek(pos, &data, len);
+      memcpy(dst, data, n);
+      dst += n;
+      pos += (uint32_t)n;
+      len -= n;
+    }
+  }
+
+private:
+  uint8_t *buf_;
+  size_t capacity_;
+  std::atomic<uint32_t> head_{0};
+};
+
+} // namespace audio
@@ -0,0 +1,43 @@
+#include "capture_chain.h"
+#include "sample_math.h"
+
+namespace audio {
+
+void CaptureChain::reset() {
+  decimator_.reset();
+  dc_.reset();
+  agc_.reset();
+}
+
+void CaptureChain::enable_dc_block(int cutoff_hz) {
+  dc_ = DcBlocker(cutoff_hz);
+  dc_enabled_ = true;
+}
+
+void CaptureChain::enable_agc(const Agc::Config &config) {
+  agc_ = Agc(config);
+  agc_enabled_ = true;
+}
+
+int CaptureChain::process(const int32_t *raw, int n, int16_t *out) {
+  int produced = 0;
+  while (n > 0) {
+    int m = n < kChunkSamples ? n : kChunkSamples;
+    int filtered = decimator_.process(raw, m, filtered_);
+    if (dc_enabled_)
+      dc_.process(filtered_, filtered);
+    if (agc_enabled_) {
+      agc_.process(filtered_, filtered, &out[produced]);
+    } else {
+      for (int i = 0; i < filtered; i++) {
+        out[produced + i] = sample32_to_16(filtered_[i]);
+      }
+    }
+    produced += filtered;
+    raw += m;
+    n -= m;
+  }
+  return produced;
+}
+
+} // namespace audio
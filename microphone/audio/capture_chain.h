@@ -0,0 +1,50 @@
+#pragma once
+
+#include "agc.h"
+#include "audio_format.h"
+#include "dc_blocker.h"
+#include "fir_decimator.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+// Raw I2S words in, kSampleRate int16 PCM out. Anti-alias and decimate,
+// remove the DC offset once enable_dc_block() was called, then scale to 16
+// bits: a fixed >> 14, or the AGC once enable_agc() was called. Holds the
+// filter state, so one instance per stream.
+class CaptureChain {
+public:
+  using Decimator = FirDecimator<kI2SEffectiveRate, kSampleRate>;
+
+  // Worst case output of one kChunkSamples read (the decimator carries its
+  // phase between calls, so one extra sample can fall out).
+  static constexpr int kChunkOutMax = kChunkSamples / kDecimation + 1;
+
+  void reset();
+
+  // Scales through an Agc from now on, one AGC block per chunk. Call before
+  // capturing; reset() puts the gain back to 0 dB but keeps it enabled.
+  void enable_agc(const Agc::Config &config);
+
+  // High-passes the decimated samples from now on, before the scaling.
+  // Call before capturing; reset() clears the filter but keeps it enabled.
+  void enable_dc_block(int cutoff_hz);
+
+  // Null while the fixed shift is in use.
+  const Agc *agc() const { return agc_enabled_ ? &agc_ : nullptr; }
+
+  // Processes n raw samples; out must hold n / kDecimation + 1 entries.
+  // Returns the number of output samples written.
+  int process(const int32_t *raw, int n, int16_t *out);
+
+private:
+  Decimator decimator_;
+  DcBlocker dc_;
+  bool dc_enabled_ = false;
+  Agc agc_;
+  bool agc_enabled_ = false;
+  int32_t filtered_[kChunkOutMax];
+};
+
+} // namespace audio
@@ -0,0 +1,159 @@
+#include "clock_drift.h"
+#include "fir_decimator.h"
+#include "sample_math.h"
+
+#include <string.h>
+
+namespace audio {
+
+void DriftEstimator::reset() {
+  count_ = 0;
+  newest_ = 0;
+  have_candidate_ = false;
+  second_start_us_ = 0;
+  ppm_q8_ = 0;
+  settled_ = false;
+}
+
+void DriftEstimator::update(uint64_t samples, int64_t time_us) {
+  constexpr int kSlots = kWindowSeconds + 1;
+  // Time past where the nominal clock would put this sample. Drift moves it
+  // by the same amount within every second, so picking the minimum does not
+  // bias the slope.
+  int64_t lateness =
+      time_us - (int64_t)(samples * 1000000 / (uint64_t)nominal_rate_);
+  if (!have_candidate_ || lateness < candidate_lateness_) {
+    candidate_ = {samples, time_us};
+    candidate_lateness_ = lateness;
+  }
+  if (!have_candidate_ && count_ == 0)
+    second_start_us_ = time_us;
+  have_candidate_ = true;
+  if (time_us - second_start_us_ < 1000000)
+    return;
+
+  newest_ = (newest_ + 1) % kSlots;
+  points_[newest_] = candidate_;
+  if (count_ < kSlots)
+    count_++;
+  have_candidate_ = false;
+  second_start_us_ = time_us;
+  if (count_ < 2)
+    return;
+
+  const Point &newest = points_[newest_];
+  const Point &oldest = points_[(newest_ + kSlots - (count_ - 1)) % kSlots];
+  int64_t dt = newest.time_us - oldest.time_us;
+  if (dt <= 0)
+    return;
+  // Rate in mHz, then the difference to nominal in ppm Q8. ds stays under
+  // ~2^22 for the window, so neither product overflows.
+  int64_t ds = (int64_t)(newest.samples - oldest.samples);
+  int64_t rate_mhz = ds * 1000000000 / dt;
+  int64_t nominal_mhz = (int64_t)nominal_rate_ * 1000;
+  ppm_q8_ = (int32_t)((rate_mhz - nominal_mhz) * 256000000 / nominal_mhz);
+  settled_ = count_ == kSlots;
+}
+
+namespace {
+
+using Resampler = DriftResampler;
+constexpr int kHalf = Resampler::kTaps / 2;
+
+struct Table {
+  // Row p is the filter for an output p / kPhases of a sample past x[i],
+  // over x[i - kHalf + 1] .. x[i + kHalf]. One extra row for interpolating
+  // towards the next sample.
+  int16_t h[Resampler::kPhases + 1][Resampler::kTaps];
+};
+
+constexpr Table design() {
+  using namespace fir_design;
+  // Cut-off at the input Nyquist. Ratios stay within 1000 ppm of 1, so this
+  // is a fractional delay rather than a rate change, and the decimator left
+  // nothing above 80% of Nyquist to alias.
+  constexpr double kCutoff = 1.0;
+  constexpr double kBeta = 7.0;
+  Table t = {};
+  for (int p = 0; p <= Resampler::kPhases; p++) {
+    double frac = (double)p / Resampler::kPhases;
+    double ideal[Resampler::kTaps] = {};
+    double sum = 0;
+    for (int k = 0; k < Resampler::kTaps; k++) {
+      double x = k - (kHalf - 1) - frac;
+      double r = x / kHalf;
+      double w = r * r < 1 ? bessel_i0(kBeta * cx_sqrt(1 - r * r)) /
+                                 bessel_i0(kBeta)
+                           : 0;
+      ideal[k] = kCutoff * sinc(kCutoff * x) * w;
+      sum += ideal[k];
+    }
+    // Unity DC gain per phase, rounding error folded into the middle taps.
+    int total = 0;
+    for (int k = 0; k < Resampler::kTaps; k++) {
+      double v = ideal[k] / sum * 16384;
+      t.h[p][k] = (int16_t)(v < 0 ? v - 0.5 : v + 0.5);
+      total += t.h[p][k];
+    }
+    t.h[p][kHalf - 1 + (p >= Resampler::kPhases / 2)] +=
+        (int16_t)(16384 - total);
+  }
+  return t;
+}
+
+constexpr Table kTable = design();
+
+} // namespace
+
+void DriftResampler::reset() {
+  memset(work_, 0, sizeof(work_));
+  pos_ = (uint64_t)(kHalf - 1) << 32;
+  step_ = 1ull << 32;
+}
+
+void DriftResampler::set_ppm_q8(int32_t ppm_q8) {
+  if (ppm_q8 > kMaxPpm * 256)
+    ppm_q8 = kMaxPpm * 256;
+  if (ppm_q8 < -kMaxPpm * 256)
+    ppm_q8 = -kMaxPpm * 256;
+  // 2^32 * ppm / 1e6, with the ppm in Q8.
+  step_ = (1ull << 32) +
+          (uint64_t)((int64_t)ppm_q8 * (int64_t)(1ull << 32) / 256000000);
+}
+
+int DriftResampler::process(const int16_t *in, int n, int16_t *out) {
+  int produced = 0;
+  while (n > 0) {
+    int m = n < kMaxBlock ? n : kMaxBlock;
+    memcpy(&work_[kTaps - 1], in, (size_t)m * sizeof(int16_t));
+    const int len = kTaps - 1 + m;
+
+    while ((int)(pos_ >> 32) + kHalf < len) {
+      const int16_t *x = &work_[(int)(pos_ >> 32) - (kHalf - 1)];
+      uint32_t frac = (uint32_t)pos_;
+      const int16_t *h0 = kTable.h[frac >> 26];
+      const int16_t *h1 = kTable.h[(frac >> 26) + 1];
+      int64_t alpha = (frac >> 11) & 0x7fff;
+      // Both neighbouring phases, then between their outputs: interpolating
+      // the coefficients instead would round each tap and leave the DC gain
+      // wobbling with the phase.
+      int32_t acc0 = 0, acc1 = 0;
+      for (int k = 0; k < kTaps; k++) {
+        acc0 += x[k] * h0[k];
+        acc1 += x[k] * h1[k];
+      }
+      int64_t acc = ((int64_t)acc0 << 15) + (acc1 - (int64_t)acc0) * alpha;
+      out[produced++] = clamp_int16((int32_t)((acc + (1ll << 28)) >> 29));
+      pos_ += step_;
+    }
+
+    // Keep the last kTaps - 1 samples as history for the next block.
+    memmove(work_, &work_[m], (kTaps - 1) * sizeof(int16_t));
+    pos_ -= (uint64_t)m << 32;
+    in += m;
+    n -= m;
+  }
+  return produced;
+}
+
+} // namespace audio
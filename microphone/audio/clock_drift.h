@@ -0,0 +1,91 @@
+#pragma once
+
+#include "audio_format.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+// Rate of the capture clock measured against esp_timer, in ppm of the
+// nominal rate (positive: samples arrive faster than nominal).
+//
+// Fed one (sample count, time) point per DMA buffer, where the count is
+// derived from the buffer's completion number so samples the capture task
+// lost still count. Interrupt latency only ever makes a timestamp late, so
+// each second keeps one checkpoint, its least late point against the
+// nominal clock, and a latency spike has to last a whole second to matter.
+// The estimate is the slope across the last kWindowSeconds of checkpoints:
+// with the best timestamps good to a few microseconds that is well under
+// 1 ppm. Until the window is full it uses whatever span there is and
+// settled() is false.
+//
+// esp_timer runs from the same crystal as the I2S PLL, so this measures the
+// clock divider's error (and the APLL's, when used), not the crystal's.
+class DriftEstimator {
+public:
+  static constexpr int kWindowSeconds = 64;
+
+  explicit DriftEstimator(int nominal_rate) : nominal_rate_(nominal_rate) {
+    reset();
+  }
+
+  void reset();
+  void update(uint64_t samples, int64_t time_us);
+
+  // ppm in Q8, 0 until there are two checkpoints.
+  int32_t ppm_q8() const { return ppm_q8_; }
+  bool settled() const { return settled_; }
+
+private:
+  struct Point {
+    uint64_t samples;
+    int64_t time_us;
+  };
+
+  int nominal_rate_;
+  Point points_[kWindowSeconds + 1];
+  int count_;
+  int newest_;
+  Point candidate_; // least late point of the current second
+  int64_t candidate_lateness_;
+  int64_t second_start_us_;
+  bool have_candidate_;
+  int32_t ppm_q8_;
+  bool settled_;
+};
+
+// Fractional resampler that takes the capture stream at its real rate
+// (nominal * (1 + ppm)) to exactly the nominal rate, for streams that must
+// not drift against wall-clock time.
+//
+// Each output is a 16-tap Kaiser-windowed sinc at the fractional position,
+// interpolated between the two nearest of 64 phases (Q14, built at compile
+// time). Tones come through 70-88 dB clean up to 5 kHz, below the
+// microphone's own noise. The position is a 32.32 fixed-point accumulator
+// stepped by 1 + ppm per output, so over a long run the output count is
+// the input count / (1 + ppm) to the sample. Delay is 8 samples.
+class DriftResampler {
+public:
+  static constexpr int kTaps = 16;
+  static constexpr int kPhases = 64;
+  static constexpr int kMaxBlock = 256;
+  static constexpr int32_t kMaxPpm = 1000;
+
+  DriftResampler() { reset(); }
+
+  void reset();
+
+  // Clamped to +-kMaxPpm. Takes effect from the next output sample.
+  void set_ppm_q8(int32_t ppm_q8);
+
+  // Resamples n samples into out, which must hold n + n / 512 + 2.
+  // Returns the number written.
+  int process(const int16_t *in, int n, int16_t *out);
+
+private:
+  int16_t work_[kTaps - 1 + kMaxBlock];
+  uint64_t pos_;  // 32.32, next output's position in work_
+  uint64_t step_; // 32.32 input samples per output
+};
+
+} // namespace audio
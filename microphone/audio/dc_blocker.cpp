@@ -0,0 +1,51 @@
+#include "dc_blocker.h"
+
+namespace audio {
+
+static constexpr int kPoleShift = 28;
+// 2 pi in Q28.
+static constexpr int64_t kTwoPiQ28 = 1686629713;
+
+DcBlocker::DcBlocker(int cutoff_hz, int sample_rate) : cutoff_hz_(cutoff_hz) {
+  int64_t one = (int64_t)1 << kPoleShift;
+  int64_t step = kTwoPiQ28 * cutoff_hz / sample_rate;
+  pole_q28_ = (int32_t)(step < one ? one - step : 0);
+  gain_q28_ = (int32_t)((one + pole_q28_) / 2);
+  reset();
+}
+
+void DcBlocker::reset() {
+  primed_ = false;
+  x1_ = 0;
+  y1_ = 0;
+  err_ = 0;
+}
+
+void DcBlocker::process(int32_t *x, int n) {
+  if (n <= 0)
+    return;
+  if (!primed_) {
+    x1_ = x[0];
+    primed_ = true;
+  }
+  int32_t x1 = x1_;
+  int64_t y1 = y1_;
+  int64_t err = err_;
+  for (int i = 0; i < n; i++) {
+    int32_t in = x[i];
+    // Inputs are full 32-bit words, so the difference needs 33 bits; |y|
+    // stays under 2^32 (the impulse response sums to 2 in magnitude), so
+    // with Q28 coefficients everything stays under 2^62.
+    int64_t acc = ((int64_t)in - x1) * gain_q28_ + y1 * pole_q28_ + err;
+    int64_t y = acc >> kPoleShift;
+    err = acc - y * ((int64_t)1 << kPoleShift);
+    x1 = in;
+    y1 = y;
+    x[i] = y > INT32_MAX ? INT32_MAX : y < INT32_MIN ? INT32_MIN : (int32_t)y;
+  }
+  x1_ = x1;
+  y1_ = y1;
+  err_ = err;
+}
+
+} // namespace audio
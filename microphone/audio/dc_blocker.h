@@ -0,0 +1,47 @@
+#pragma once
+
+#include "audio_format.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+// First-order DC blocker for the decimated stream, in place, at the raw
+// 32-bit scale (ahead of the AGC or the fixed >> 14):
+//
+//   y[n] = g * (x[n] - x[n-1]) + p * y[n-1],  p = 1 - 2 pi fc / fs,
+//                                            g = (1 + p) / 2
+//
+// A zero exactly at DC and a pole just inside the unit circle, so the
+// response is down 3 dB at fc, under 0.5 dB from 3 fc up, and g makes it
+// exactly unity at Nyquist. Step response is a plain exponential decay with
+// time constant 1 / (2 pi fc), no undershoot.
+//
+// p and g are Q28 and the rounding error of each output is fed into the
+// next, so the state cannot settle on a small offset or a limit cycle: a
+// constant input decays to exactly 0. The first sample after reset() primes
+// x[n-1], so capture starts without the step from 0 to the microphone's
+// offset.
+//
+// Per sample: two 32x32->64 multiplies and a few adds.
+class DcBlocker {
+public:
+  explicit DcBlocker(int cutoff_hz = 20, int sample_rate = kSampleRate);
+
+  void reset();
+
+  void process(int32_t *x, int n);
+
+  int cutoff_hz() const { return cutoff_hz_; }
+
+private:
+  int cutoff_hz_;
+  int32_t pole_q28_;
+  int32_t gain_q28_;
+  bool primed_;
+  int32_t x1_;
+  int64_t y1_;   // unclamped, so a clamped output does not skew the state
+  int64_t err_;  // rounding error carried into the next output, Q28
+};
+
+} // namespace audio
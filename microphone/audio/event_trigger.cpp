@@ -0,0 +1,66 @@
+#include "event_trigger.h"
+#include "sample_math.h"
+
+namespace audio {
+
+// dB quantities are Q8. 10 * log10(2) = 3.0103 dB per octave of power.
+static constexpr int32_t kDbPerLog2Q8 = 771;
+// A full-scale sine has a power of 2^29 LSB^2: that is 0 dBFS.
+static constexpr int32_t kFullScaleLog2Q8 = 29 * 256;
+// Floor rise while the signal is above it: ~3 dB/s at 100 frames/s, so a
+// steady source 15 dB up stops firing after about five seconds.
+static constexpr int32_t kFloorRiseQ8 = 8;
+
+EventTrigger::EventTrigger(const Config &config) {
+  threshold_q8_ = config.threshold_dbfs * 256;
+  rise_q8_ = config.rise_db * 256;
+  holdoff_frames_ =
+      config.holdoff_ms > 0 ? (uint32_t)config.holdoff_ms / 10 : 0;
+  reset();
+}
+
+void EventTrigger::reset() {
+  floor_q8_ = 0;
+  floor_seeded_ = false;
+  quiet_frames_ = 0;
+  stats_ = {};
+}
+
+bool EventTrigger::process_frame(const int16_t *x, int32_t gain_db_q8) {
+  int64_t sum = 0;
+  uint64_t sum_sq = 0;
+  for (int i = 0; i < kFrameSamples; i++) {
+    sum += x[i];
+    sum_sq += (uint64_t)((int32_t)x[i] * x[i]);
+  }
+  // n^2 times the variance, exact; the mean's own square is at most
+  // sum_sq * n, so this cannot go negative.
+  uint64_t n = kFrameSamples;
+  uint64_t power = (sum_sq * n - (uint64_t)(sum * sum)) / (n * n);
+  int32_t level_q8 =
+      (log2_q8(power) - kFullScaleLog2Q8) * kDbPerLog2Q8 / 256 - gain_db_q8;
+
+  bool fired = false;
+  if (!floor_seeded_) {
+    floor_q8_ = level_q8;
+    floor_seeded_ = true;
+  } else if (quiet_frames_ > 0) {
+    quiet_frames_--;
+  } else if (level_q8 >= threshold_q8_ && level_q8 - floor_q8_ >= rise_q8_) {
+    fired = true;
+    quiet_frames_ = holdoff_frames_;
+    stats_.triggers++;
+  }
+
+  if (level_q8 < floor_q8_)
+    floor_q8_ += (level_q8 - floor_q8_) / 4;
+  else
+    floor_q8_ += kFloorRiseQ8;
+
+  stats_.frames++;
+  stats_.level_dbfs_q8 = level_q8;
+  stats_.floor_dbfs_q8 = floor_q8_;
+  return fired;
+}
+
+} // namespace audio
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "audio_format.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+struct TriggerStats {
+  uint32_t frames;
+  uint32_t triggers;
+  int32_t level_dbfs_q8; // last frame, at 0 dB gain
+  int32_t floor_dbfs_q8; // background the rise is measured against
+};
+
+// Loud-event detector for the decimated stream: door slams, alarms, glass.
+//
+// Works on fixed 10 ms frames. A frame's level is its AC power (the frame
+// mean removed, so mic DC does not count) in dBFS. It fires on a frame that
+// is at least threshold_dbfs loud and rise_db above the background, a floor
+// that follows quiet frames quickly and creeps up through loud ones, so a
+// steady loud source (a fan, traffic) stops counting as an event after a
+// while. After firing it stays quiet for holdoff_ms. Integer only: one
+// multiply-add per sample and a log per frame.
+class EventTrigger {
+public:
+  static constexpr int kFrameSamples = kSampleRate / 100; // 10 ms
+
+  struct Config {
+    int threshold_dbfs = -20;
+    int rise_db = 15;
+    int holdoff_ms = 1000;
+  };
+
+  EventTrigger() : EventTrigger(Config()) {}
+  explicit EventTrigger(const Config &config);
+
+  void reset();
+
+  // Feeds one frame of kFrameSamples. gain_db_q8 is the gain already in x
+  // (the AGC's, from the frame header); it is taken off the level, so the
+  // threshold and the background are those of the room, not of the AGC
+  // output. Returns true if it fired.
+  bool process_frame(const int16_t *x, int32_t gain_db_q8 = 0);
+
+  TriggerStats stats() const { return stats_; }
+
+private:
+  int32_t threshold_q8_;
+  int32_t rise_q8_;
+  uint32_t holdoff_frames_;
+
+  int32_t floor_q8_;
+  bool floor_seeded_;
+  uint32_t quiet_frames_; // left in the hold-off
+  TriggerStats stats_;
+};
+
+} // namespace audio
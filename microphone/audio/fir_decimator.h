@@ -0,0 +1,169 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace audio {
+
+// constexpr helpers for generating filter coefficients at compile time.
+// <cmath> is not constexpr before C++26, so these are small series
+// expansions that are plenty accurate for a 16-bit coefficient table.
+namespace fir_design {
+
+constexpr double kPi = 3.14159265358979323846;
+
+constexpr double cx_sin(double x) {
+  // Reduce to [-pi, pi] then Taylor series.
+  while (x > kPi)
+    x -= 2 * kPi;
+  while (x < -kPi)
+    x += 2 * kPi;
+  double term = x;
+  double sum = x;
+  for (int n = 1; n < 20; n++) {
+    term *= -x * x / ((2 * n) * (2 * n + 1));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double cx_sqrt(double x) {
+  if (x <= 0)
+    return 0;
+  double r = x > 1 ? x : 1;
+  for (int i = 0; i < 60; i++)
+    r = 0.5 * (r + x / r);
+  return r;
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser
+// window.
+constexpr double bessel_i0(double x) {
+  double sum = 1;
+  double term = 1;
+  for (int k = 1; k < 40; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+constexpr double sinc(double x) {
+  return x == 0 ? 1.0 : cx_sin(kPi * x) / (kPi * x);
+}
+
+} // namespace fir_design
+
+// Fixed-point anti-aliasing FIR decimator for integer rate ratios.
+//
+// Kaiser-windowed sinc low-pass, cut off at 80% of the output Nyquist and
+// quantised to Q13 at compile time. Only every kFactor-th output is computed
+// (the polyphase view of a decimating FIR), and the filter is symmetric so
+// each output costs kTaps / 2 32-bit multiply-adds.
+//
+// Input and output are INMP441-style words: 24-bit audio MSB-justified in a
+// 32-bit slot. Input is reduced to 18 bits (>> 14) before filtering so the
+// accumulator stays in 32 bits; the output keeps the extra precision that the
+// filtering buys back, so it can go straight into sample32_to_16.
+template <int InRate, int OutRate, int TapsPerPhase = 16, int MaxBlock = 256>
+class FirDecimator {
+public:
+  static constexpr int kFactor = InRate / OutRate;
+  static constexpr int kTaps = kFactor * TapsPerPhase;
+  static constexpr int kCoeffShift = 13;
+  static constexpr int kInputShift = 14;
+
+  static_assert(kFactor * OutRate == InRate,
+                "FirDecimator needs an integer rate ratio");
+  static_assert(kTaps % 2 == 0, "symmetric fold assumes an even tap count");
+  static_assert(kInputShift >= kCoeffShift, "output rescale is a left shift");
+
+  struct Coeffs {
+    int16_t h[kTaps];
+  };
+
+  static constexpr Coeffs design() {
+    constexpr double kBeta = 7.0; // ~70 dB stopband
+    double cutoff = 0.8 * (double)OutRate / 2 / InRate; // cycles/sample
+    double ideal[kTaps] = {};
+    double sum = 0;
+    for (int i = 0; i < kTaps; i++) {
+      double m = i - (kTaps - 1) / 2.0;
+      double r = 2.0 * i / (kTaps - 1) - 1.0;
+      double w =
+          fir_design::bessel_i0(kBeta * fir_design::cx_sqrt(1 - r * r)) /
+          fir_design::bessel_i0(kBeta);
+      ideal[i] = 2 * cutoff * fir_design::sinc(2 * cutoff * m) * w;
+      sum += ideal[i];
+    }
+
+    // Normalise to unity DC gain, quantise, then put the rounding error on
+    // the two centre taps so the integer taps sum to exactly 1.0 in Q13.
+    Coeffs c = {};
+    int32_t qsum = 0;
+    for (int i = 0; i < kTaps; i++) {
+      double v = ideal[i] / sum * (1 << kCoeffShift);
+      c.h[i] = (int16_t)(v < 0 ? v - 0.5 : v + 0.5);
+      qsum += c.h[i];
+    }
+    int32_t diff = (1 << kCoeffShift) - qsum;
+    c.h[kTaps / 2 - 1] += (int16_t)(diff / 2);
+    c.h[kTaps / 2] += (int16_t)(diff - diff / 2);
+    return c;
+  }
+
+  static constexpr Coeffs kCoeffs = design();
+
+  FirDecimator() { reset(); }
+
+  void reset() {
+    memset(work_, 0, sizeof(work_));
+    // The first output lands after kFactor inputs, like the old box-car.
+    next_ = kTaps - 1 + kFactor - 1;
+  }
+
+  // Filters n input samples and writes the decimated result to out, which
+  // must hold at least n / kFactor + 1 entries. Phase is carried across
+  // calls, so n does not have to be a multiple of kFactor. Returns the number
+  // of output samples written.
+  int process(const int32_t *in, int n, int32_t *out) {
+    int produced = 0;
+    while (n > 0) {
+      int m = n < MaxBlock ? n : MaxBlock;
+      for (int i = 0; i < m; i++)
+        work_[kTaps - 1 + i] = in[i] >> kInputShift;
+
+      int len = kTaps - 1 + m;
+      while (next_ < len) {
+        out[produced++] = dot(&work_[next_ - (kTaps - 1)]);
+        next_ += kFactor;
+      }
+
+      // Keep the last kTaps - 1 samples as history for the next block.
+      memmove(work_, &work_[m], (kTaps - 1) * sizeof(int32_t));
+      next_ -= m;
+      in += m;
+      n -= m;
+    }
+    return produced;
+  }
+
+private:
+  static int32_t dot(const int32_t *x) {
+    int32_t acc = 0;
+    for (int j = 0; j < kTaps / 2; j++)
+      acc += kCoeffs.h[j] * (x[j] + x[kTaps - 1 - j]);
+    // acc is in units of 2^(kInputShift - kCoeffShift) = 2 raw LSBs. Shift
+    // back to the raw 32-bit scale, saturating on the rare overshoot.
+    if (acc > INT32_MAX / 2)
+      return INT32_MAX;
+    if (acc < INT32_MIN / 2)
+      return INT32_MIN;
+    return acc * (1 << (kInputShift - kCoeffShift));
+  }
+
+  int32_t work_[kTaps - 1 + MaxBlock];
+  int next_;
+};
+
+} // namespace audio
@@ -0,0 +1,148 @@
+#include "ima_adpcm.h"
+
+#include <string.h>
+
+namespace audio {
+namespace ima_adpcm {
+
+static const int16_t kStepTable[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,
+    19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+    337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+    876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+    5894,  6484,  7132,  7845,  8630,  9493,  10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t kIndexTable[16] = {-1, -1, -1, -1, 2, 4, 6, 8,
+                                       -1, -1, -1, -1, 2, 4, 6, 8};
+
+static inline int clamp_index(int idx) {
+  if (idx < 0)
+    return 0;
+  if (idx > 88)
+    return 88;
+  return idx;
+}
+
+static inline int32_t clamp_sample(int32_t v) {
+  if (v > 32767)
+    return 32767;
+  if (v < -32768)
+    return -32768;
+  return v;
+}
+
+static inline uint8_t encode_sample(int16_t sample, int32_t &predictor,
+                                    int &index) {
+  int32_t step = kStepTable[index];
+  int32_t diff = sample - predictor;
+  uint8_t nibble = 0;
+  if (diff < 0) {
+    nibble = 8;
+    diff = -diff;
+  }
+
+  // Successive approximation of diff in units of step, tracking the value
+  // the decoder will reconstruct so both sides stay in lockstep.
+  int32_t vpdiff = step >> 3;
+  if (diff >= step) {
+    nibble |= 4;
+    diff -= step;
+    vpdiff += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 2;
+    diff -= step;
+    vpdiff += step;
+  }
+  step >>= 1;
+  if (diff >= step) {
+    nibble |= 1;
+    vpdiff += step;
+  }
+
+  predictor = clamp_sample(nibble & 8 ? predictor - vpdiff
+                                      : predictor + vpdiff);
+  index = clamp_index(index + kIndexTable[nibble]);
+  return nibble;
+}
+
+static inline int16_t decode_sample(uint8_t nibble, int32_t &predictor,
+                                    int &index) {
+  int32_t step = kStepTable[index];
+  int32_t vpdiff = step >> 3;
+  if (nibble & 4)
+    vpdiff += step;
+  if (nibble & 2)
+    vpdiff += step >> 1;
+  if (nibble & 1)
+    vpdiff += step >> 2;
+  predictor = clamp_sample(nibble & 8 ? predictor - vpdiff
+                                      : predictor + vpdiff);
+  index = clamp_index(index + kIndexTable[nibble]);
+  return (int16_t)predictor;
+}
+
+void encode_block(const int16_t *pcm, uint8_t *out, int &step_index) {
+  int32_t predictor = pcm[0];
+  int index = clamp_index(step_index);
+
+  out[0] = (uint8_t)(predictor & 0xff);
+  out[1] = (uint8_t)((predictor >> 8) & 0xff);
+  out[2] = (uint8_t)index;
+  out[3] = 0;
+
+  uint8_t *p = out + 4;
+  for (int i = 1; i < kBlockSamples; i += 2) {
+    uint8_t lo = encode_sample(pcm[i], predictor, index);
+    uint8_t hi = encode_sample(pcm[i + 1], predictor, index);
+    *p++ = (uint8_t)(lo | (hi << 4));
+  }
+  step_index = index;
+}
+
+void decode_block(const uint8_t *in, int16_t *pcm) {
+  int32_t predictor = (int16_t)(in[0] | (in[1] << 8));
+  int index = clamp_index(in[2]);
+  pcm[0] = (int16_t)predictor;
+
+  const uint8_t *p = in + 4;
+  for (int i = 1; i < kBlockSamples; i += 2) {
+    pcm[i] = decode_sample(*p & 0x0f, predictor, index);
+    pcm[i + 1] = decode_sample(*p >> 4, predictor, index);
+    p++;
+  }
+}
+
+} // namespace ima_adpcm
+
+void ImaAdpcmEncoder::reset() {
+  pending_count_ = 0;
+  step_index_ = 0;
+}
+
+int ImaAdpcmEncoder::encode(const int16_t *pcm, int n, uint8_t *out) {
+  int written = 0;
+  while (n > 0) {
+    int take = ima_adpcm::kBlockSamples - pending_count_;
+    if (take > n)
+      take = n;
+    memcpy(&pending_[pending_count_], pcm, (size_t)take * sizeof(int16_t));
+    pending_count_ += take;
+    pcm += take;
+    n -= take;
+
+    if (pending_count_ == ima_adpcm::kBlockSamples) {
+      ima_adpcm::encode_block(pending_, out + written, step_index_);
+      written += ima_adpcm::kBlockBytes;
+      pending_count_ = 0;
+    }
+  }
+  return written;
+}
+
+} // namespace audio
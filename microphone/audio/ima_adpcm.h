@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace audio {
+
+// IMA-ADPCM, 4 bits per sample, in the mono block layout WAV files use
+// (format tag 0x11): a 4-byte header holding the first sample and the step
+// index, then the remaining samples packed two per byte, low nibble first.
+// Every block decodes on its own, so a receiver can join or resync at any
+// block boundary.
+namespace ima_adpcm {
+
+constexpr int kBlockBytes = 256;
+constexpr int kBlockSamples = (kBlockBytes - 4) * 2 + 1; // 505
+
+// Encodes kBlockSamples samples into kBlockBytes bytes. step_index carries
+// across blocks and is updated in place.
+void encode_block(const int16_t *pcm, uint8_t *out, int &step_index);
+
+// Decodes one kBlockBytes block into kBlockSamples samples.
+void decode_block(const uint8_t *in, int16_t *pcm);
+
+} // namespace ima_adpcm
+
+// Buffers an arbitrary-sized sample stream into whole IMA-ADPCM blocks.
+class ImaAdpcmEncoder {
+public:
+  void reset();
+
+  // Consumes n samples and writes every block they complete to out, which
+  // must hold (n / kBlockSamples + 1) * kBlockBytes bytes. Returns the
+  // number of bytes written (a multiple of kBlockBytes).
+  int encode(const int16_t *pcm, int n, uint8_t *out);
+
+private:
+  int16_t pending_[ima_adpcm::kBlockSamples];
+  int pending_count_ = 0;
+  int step_index_ = 0;
+};
+
+} // namespace audio
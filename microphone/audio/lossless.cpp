@@ -0,0 +1,359 @@
+#include "lossless.h"
+#include "sample_math.h"
+
+#include <string.h>
+
+namespace audio {
+namespace lossless {
+
+namespace {
+
+// Residual of the order-N polynomial predictor at x[i] (i >= N): the N-th
+// difference of the signal.
+template <int N> inline int32_t residual(const int16_t *x, int i) {
+  if (N == 0)
+    return x[i];
+  if (N == 1)
+    return x[i] - x[i - 1];
+  if (N == 2)
+    return x[i] - 2 * x[i - 1] + x[i - 2];
+  if (N == 3)
+    return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+  return x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+}
+
+// Prediction the decoder adds the residual to.
+inline int32_t predict(int order, const int16_t *x, int i) {
+  switch (order) {
+  case 0:
+    return 0;
+  case 1:
+    return x[i - 1];
+  case 2:
+    return 2 * x[i - 1] - x[i - 2];
+  case 3:
+    return 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+  default:
+    return 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] - x[i - 4];
+  }
+}
+
+inline uint32_t zigzag(int32_t r) {
+  return ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+}
+
+inline int bit_length(uint32_t v) { return v ? 32 - __builtin_clz(v) : 0; }
+
+inline int partition_start(int p, int n, int order) {
+  int start = p * n / kPartitions;
+  return start > order ? start : order;
+}
+
+inline int partition_end(int p, int n) { return (p + 1) * n / kPartitions; }
+
+struct Choice {
+  int k; // Rice parameter or kEscape
+  int width;
+  uint32_t bits;
+};
+
+// Cheapest coding of residuals [start, end), counting its 5-bit parameter
+// (and the escape's width). Rice costs are exact for the parameter nearest
+// the mean and its two neighbours, which is where the optimum lies.
+template <int N>
+Choice choose(const int16_t *x, int start, int end) {
+  int m = end - start;
+  if (m <= 0)
+    return {0, 0, 5};
+  uint32_t sum = 0, max_u = 0; // < 2^21 * 512, no overflow
+  for (int i = start; i < end; i++) {
+    uint32_t u = zigzag(residual<N>(x, i));
+    sum += u;
+    if (u > max_u)
+      max_u = u;
+  }
+  int k = bit_length(sum / (uint32_t)m);
+  k = k > 1 ? k - 1 : 0;
+  int lo = k > 0 ? k - 1 : 0;
+  uint32_t q[3] = {0, 0, 0};
+  for (int i = start; i < end; i++) {
+    uint32_t u = zigzag(residual<N>(x, i));
+    q[0] += u >> lo;
+    q[1] += u >> (lo + 1);
+    q[2] += u >> (lo + 2);
+  }
+  Choice best = {kEscape, bit_length(max_u),
+                 10 + (uint32_t)m * (uint32_t)bit_length(max_u)};
+  for (int c = 0; c < 3; c++) {
+    uint32_t bits = 5 + q[c] + (uint32_t)m * (uint32_t)(lo + c + 1);
+    if (lo + c < kEscape && bits < best.bits)
+      best = {lo + c, 0, bits};
+  }
+  return best;
+}
+
+class BitWriter {
+public:
+  explicit BitWriter(uint8_t *out) : p_(out) {}
+
+  // n <= 32.
+  void put(uint32_t v, int n) {
+    acc_ = (acc_ << n) | v;
+    bits_ += n;
+    while (bits_ >= 8) {
+      bits_ -= 8;
+      *p_++ = (uint8_t)(acc_ >> bits_);
+    }
+  }
+
+  void rice(uint32_t u, int k) {
+    uint32_t q = u >> k;
+    while (q >= 24) {
+      put(0, 24);
+      q -= 24;
+    }
+    // The stop bit and the low bits in one go when they fit.
+    if ((int)q + 1 + k <= 32) {
+      put((1u << k) | (u & ((1u << k) - 1)), (int)q + 1 + k);
+    } else {
+      put(1, (int)q + 1);
+      put(u & ((1u << k) - 1), k);
+    }
+  }
+
+  uint8_t *finish() {
+    if (bits_ > 0)
+      put(0, 8 - bits_);
+    return p_;
+  }
+
+private:
+  uint8_t *p_;
+  uint64_t acc_ = 0;
+  int bits_ = 0;
+};
+
+class BitReader {
+public:
+  BitReader(const uint8_t *in, const uint8_t *end) : p_(in), end_(end) {}
+
+  bool ok() const { return ok_; }
+
+  uint32_t get(int n) {
+    if (n == 0)
+      return 0;
+    refill();
+    if (bits_ < n) {
+      ok_ = false;
+      return 0;
+    }
+    uint32_t v = (uint32_t)(acc_ >> (64 - n));
+    acc_ <<= n;
+    bits_ -= n;
+    return v;
+  }
+
+  // Zeros before the next one, consuming the one. Fails past the end.
+  uint32_t unary() {
+    uint32_t q = 0;
+    while (true) {
+      refill();
+      if (bits_ == 0) {
+        ok_ = false;
+        return 0;
+      }
+      if (acc_ == 0) {
+        q += (uint32_t)bits_;
+        bits_ = 0;
+        continue;
+      }
+      int z = __builtin_clzll(acc_);
+      q += (uint32_t)z;
+      acc_ <<= z + 1;
+      bits_ -= z + 1;
+      return q;
+    }
+  }
+
+private:
+  // Keeps acc_ MSB-aligned: the next bit is bit 63.
+  void refill() {
+    while (bits_ <= 56 && p_ < end_) {
+      acc_ |= (uint64_t)*p_++ << (56 - bits_);
+      bits_ += 8;
+    }
+  }
+
+  const uint8_t *p_;
+  const uint8_t *end_;
+  uint64_t acc_ = 0;
+  int bits_ = 0;
+  bool ok_ = true;
+};
+
+template <int N>
+void write_partition(BitWriter &w, const int16_t *x, int start, int end,
+                     const Choice &c) {
+  w.put((uint32_t)c.k, 5);
+  if (c.k == kEscape) {
+    w.put((uint32_t)c.width, 5);
+    uint32_t mask = c.width ? 0xffffffffu >> (32 - c.width) : 0;
+    for (int i = start; i < end; i++)
+      w.put((uint32_t)residual<N>(x, i) & mask, c.width);
+    return;
+  }
+  for (int i = start; i < end; i++)
+    w.rice(zigzag(residual<N>(x, i)), c.k);
+}
+
+template <int N> int encode_order(const int16_t *pcm, int n, uint8_t *out) {
+  Choice choices[kPartitions];
+  uint32_t bits = 8 + 16 * N;
+  for (int p = 0; p < kPartitions; p++) {
+    choices[p] =
+        choose<N>(pcm, partition_start(p, n, N), partition_end(p, n));
+    bits += choices[p].bits;
+  }
+  if ((bits + 7) / 8 >= (uint32_t)(1 + 2 * n))
+    return -1;
+
+  out[0] = (uint8_t)N;
+  uint8_t *p = out + 1;
+  for (int i = 0; i < N; i++) {
+    *p++ = (uint8_t)(pcm[i] & 0xff);
+    *p++ = (uint8_t)((pcm[i] >> 8) & 0xff);
+  }
+  BitWriter w(p);
+  for (int part = 0; part < kPartitions; part++)
+    write_partition<N>(w, pcm, partition_start(part, n, N),
+                       partition_end(part, n), choices[part]);
+  return (int)(w.finish() - out);
+}
+
+// Order whose residual has the least absolute sum over the samples every
+// order can predict. Differences of successive orders are carried along, so
+// this is one pass.
+int pick_order(const int16_t *pcm, int n) {
+  uint32_t sum[kMaxOrder + 1] = {};
+  int32_t last[kMaxOrder] = {}; // previous sample's difference of each order
+  for (int i = 0; i < n; i++) {
+    int32_t d = pcm[i];
+    for (int k = 0; k <= kMaxOrder; k++) {
+      if (i >= kMaxOrder)
+        sum[k] += (uint32_t)(d < 0 ? -d : d);
+      if (k == kMaxOrder)
+        break;
+      int32_t next = d - last[k];
+      last[k] = d;
+      d = next;
+    }
+  }
+  int best = 0;
+  for (int k = 1; k <= kMaxOrder; k++) {
+    if (sum[k] < sum[best])
+      best = k;
+  }
+  return best;
+}
+
+} // namespace
+
+int encode_block(const int16_t *pcm, int n, uint8_t *out) {
+  int written = -1;
+  if (n > kMaxOrder) {
+    switch (pick_order(pcm, n)) {
+    case 0:
+      written = encode_order<0>(pcm, n, out);
+      break;
+    case 1:
+      written = encode_order<1>(pcm, n, out);
+      break;
+    case 2:
+      written = encode_order<2>(pcm, n, out);
+      break;
+    case 3:
+      written = encode_order<3>(pcm, n, out);
+      break;
+    default:
+      written = encode_order<4>(pcm, n, out);
+      break;
+    }
+  }
+  if (written > 0)
+    return written;
+
+  // Noise (or a tiny block) gains nothing from prediction.
+  out[0] = kVerbatim;
+  for (int i = 0; i < n; i++) {
+    out[1 + 2 * i] = (uint8_t)(pcm[i] & 0xff);
+    out[2 + 2 * i] = (uint8_t)((pcm[i] >> 8) & 0xff);
+  }
+  return 1 + 2 * n;
+}
+
+bool decode_block(const uint8_t *in, size_t len, int n, int16_t *pcm) {
+  if (len < 1 || n < 1 || n > kBlockSamples)
+    return false;
+  int order = in[0];
+  if (order == kVerbatim) {
+    if (len < 1 + 2 * (size_t)n)
+      return false;
+    for (int i = 0; i < n; i++)
+      pcm[i] = (int16_t)(in[1 + 2 * i] | (in[2 + 2 * i] << 8));
+    return true;
+  }
+  if (order > kMaxOrder || order >= n || len < 1 + 2 * (size_t)order)
+    return false;
+  for (int i = 0; i < order; i++)
+    pcm[i] = (int16_t)(in[1 + 2 * i] | (in[2 + 2 * i] << 8));
+
+  BitReader r(in + 1 + 2 * order, in + len);
+  for (int p = 0; p < kPartitions; p++) {
+    int start = partition_start(p, n, order), end = partition_end(p, n);
+    if (start >= end) {
+      r.get(5);
+      continue;
+    }
+    int k = (int)r.get(5);
+    int width = k == kEscape ? (int)r.get(5) : 0;
+    for (int i = start; i < end; i++) {
+      int32_t res;
+      if (k == kEscape) {
+        uint32_t v = r.get(width);
+        // Sign-extend from width bits.
+        res = width ? (int32_t)(v << (32 - width)) >> (32 - width) : 0;
+      } else {
+        uint32_t q = r.unary();
+        // Real residuals stay under 2^20; anything more is garbage, and
+        // would overflow below.
+        if (q > (0xffffffu >> k))
+          return false;
+        uint32_t u = (q << k) | r.get(k);
+        res = (int32_t)(u >> 1) ^ -(int32_t)(u & 1);
+      }
+      if (!r.ok())
+        return false;
+      pcm[i] = clamp_int16(predict(order, pcm, i) + res);
+    }
+  }
+  return r.ok();
+}
+
+} // namespace lossless
+
+int LosslessEncoder::encode(const int16_t *pcm, int n, uint8_t *out) {
+  int take = lossless::kBlockSamples - pending_count_;
+  if (take > n)
+    take = n;
+  memcpy(&pending_[pending_count_], pcm, (size_t)take * sizeof(int16_t));
+  pending_count_ += take;
+  if (pending_count_ < lossless::kBlockSamples)
+    return 0;
+
+  int written = lossless::encode_block(pending_, lossless::kBlockSamples, out);
+  pending_count_ = n - take;
+  memcpy(pending_, &pcm[take], (size_t)pending_count_ * sizeof(int16_t));
+  return written;
+}
+
+} // namespace audio
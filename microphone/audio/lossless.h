@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace audio {
+
+// Lossless block codec for PCM16, after FLAC's fixed predictors: each block
+// picks the polynomial predictor of order 0-4 that leaves the smallest
+// residual, and the residual is Rice coded in kPartitions partitions with a
+// parameter of their own. Blocks decode on their own, like IMA-ADPCM
+// blocks, so a receiver can join or resync at any block.
+//
+// Layout of one block of n samples (n comes from the frame header):
+//
+//   u8   predictor order 0-4, or kVerbatim
+//        kVerbatim: n int16 little-endian, nothing else
+//   i16  the first `order` samples as they are (little-endian)
+//        then, MSB first, for each partition:
+//   5b   Rice parameter k, or kEscape
+//        k:       each residual zigzag mapped (0, -1, 1, -2 ..), the
+//                 quotient >> k in unary (zeros, then a one), then the low
+//                 k bits
+//        kEscape: a 5-bit width w, then each residual as w-bit two's
+//                 complement
+//   pad to a whole byte with zeros
+//
+// Partition p covers samples [p * n / kPartitions, (p + 1) * n /
+// kPartitions), less the warm-up samples in the first. A block is never
+// larger than its verbatim form, kMaxBlockBytes at most.
+namespace lossless {
+
+constexpr int kBlockSamples = 512;
+constexpr int kMaxOrder = 4;
+constexpr int kPartitions = 4;
+constexpr uint8_t kVerbatim = 0xff;
+constexpr int kEscape = 31;
+constexpr int kMaxBlockBytes = 1 + kBlockSamples * 2;
+
+// Encodes n samples (1 .. kBlockSamples) into out (kMaxBlockBytes). Returns
+// the number of bytes written.
+int encode_block(const int16_t *pcm, int n, uint8_t *out);
+
+// Decodes one block of n samples from len bytes. Returns false if it is
+// malformed or runs past len.
+bool decode_block(const uint8_t *in, size_t len, int n, int16_t *pcm);
+
+} // namespace lossless
+
+// Buffers an arbitrary-sized sample stream into whole lossless blocks of
+// kBlockSamples.
+class LosslessEncoder {
+public:
+  void reset() { pending_count_ = 0; }
+
+  // Consumes n samples and encodes the block they complete, if any, to out
+  // (lossless::kMaxBlockBytes). Returns its size in bytes, 0 if no block was
+  // completed. n must be less than kBlockSamples, so one call never
+  // completes two blocks.
+  int encode(const int16_t *pcm, int n, uint8_t *out);
+
+private:
+  int16_t pending_[lossless::kBlockSamples];
+  int pending_count_ = 0;
+};
+
+} // namespace audio
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace audio {
+
+static inline int16_t clamp_int16(int32_t x) {
+  if (x > 32767)
+    return 32767;
+  if (x < -32768)
+    return -32768;
+  return (int16_t)x;
+}
+
+// log2(x) in Q8 from the leading bit and the next 8 bits, linear in between.
+// Good to ~0.03 octaves (never above the true value); log2_q8(0) is 0.
+static inline int32_t log2_q8(uint64_t x) {
+  if (x == 0)
+    return 0;
+  int msb = 63 - __builtin_clzll(x);
+  uint32_t frac = msb >= 8 ? (uint32_t)(x >> (msb - 8)) & 0xff
+                           : (uint32_t)(x << (8 - msb)) & 0xff;
+  return msb * 256 + (int32_t)frac;
+}
+
+// floor(sqrt(x)), bit by bit.
+static inline uint32_t isqrt64(uint64_t x) {
+  uint64_t res = 0;
+  uint64_t bit = 1ull << 62;
+  while (bit > x)
+    bit >>= 2;
+  while (bit != 0) {
+    if (x >= res + bit) {
+      x -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)res;
+}
+
+// INMP441 emits 24-bit signed audio MSB-justified in a 32-bit slot.
+// Shift right by 14 to keep the top 18 bits then clamp to int16 — gives
+// reasonable headroom for normal speech without the heavy clipping that
+// >> 8 caused. This is the fixed scaling; the Agc's 0 dB matches it.
+static inline int16_t sample32_to_16(int32_t sample) {
+  return clamp_int16(sample >> 14);
+}
+
+// Compacts (active, duplicate) slot pairs to the active words, in place,
+// keeping the first of each pair. Returns the number of words left, n / 2.
+// Loads run ahead of stores four pairs at a time, which lets compilers with
+// SIMD turn the loop into shuffles; on the ESP32 it is a plain copy loop and
+// still far cheaper than filtering the duplicates.
+static inline int drop_duplicate_slots(int32_t *words, int n) {
+  const int32_t *src = words;
+  const int32_t *end = words + (n & ~1);
+  int32_t *dst = words;
+  for (; end - src >= 8; src += 8, dst += 4) {
+    int32_t a = src[0];
+    int32_t b = src[2];
+    int32_t c = src[4];
+    int32_t d = src[6];
+    dst[0] = a;
+    dst[1] = b;
+    dst[2] = c;
+    dst[3] = d;
+  }
+  for (; src < end; src += 2)
+    *dst++ = *src;
+  return n / 2;
+}
+
+} // namespace audio
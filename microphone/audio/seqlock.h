@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+namespace audio {
+
+// Single-writer sequence lock for publishing small POD snapshots.
+//
+// The writer never blocks and readers never take a lock: a reader copies the
+// value and retries if the sequence number was odd (write in progress) or
+// changed underneath it. Only one task may call publish().
+template <typename T> class SeqLock {
+public:
+  void publish(const T &v) {
+    uint32_t seq = seq_.load(std::memory_order_relaxed);
+    seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&value_, &v, sizeof(T));
+    seq_.store(seq + 2, std::memory_order_release);
+  }
+
+  T read() const {
+    T out;
+    uint32_t before, after;
+    do {
+      before = seq_.load(std::memory_order_acquire);
+      memcpy(&out, &value_, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = seq_.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return out;
+  }
+
+  // Number of completed publishes, handy for "anything new?" checks.
+  uint32_t version() const {
+    return seq_.load(std::memory_order_acquire) / 2;
+  }
+
+private:
+  std::atomic<uint32_t> seq_{0};
+  T value_{};
+};
+
+} // namespace audio
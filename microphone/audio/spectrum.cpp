@@ -0,0 +1,232 @@
+#include "spectrum.h"
+#include "fir_decimator.h"
+#include "sample_math.h"
+
+#include <string.h>
+
+namespace audio {
+
+namespace fft {
+
+namespace {
+
+constexpr int kQuarter = kSize / 4;
+
+struct Tables {
+  // e^(-2 pi i m / kSize) = cos - i sin, for the m < 3 kSize / 4 that the
+  // third leg of a butterfly reaches.
+  int16_t cos_q15[3 * kQuarter];
+  int16_t sin_q15[3 * kQuarter];
+  uint8_t digit_rev[kSize];
+};
+
+constexpr int16_t to_q15(double v) {
+  double s = v * 32768.0;
+  s += s < 0 ? -0.5 : 0.5;
+  return (int16_t)(s > 32767 ? 32767 : s < -32768 ? -32768 : s);
+}
+
+constexpr Tables make_tables() {
+  Tables t = {};
+  for (int m = 0; m < 3 * kQuarter; m++) {
+    double angle = 2 * fir_design::kPi * m / kSize;
+    t.sin_q15[m] = to_q15(fir_design::cx_sin(angle));
+    t.cos_q15[m] = to_q15(fir_design::cx_sin(angle + fir_design::kPi / 2));
+  }
+  for (int k = 0; k < kSize; k++) {
+    int rev = 0;
+    for (int n = k, d = 1; d < kSize; d *= 4, n /= 4)
+      rev = rev * 4 + n % 4;
+    t.digit_rev[k] = (uint8_t)rev;
+  }
+  return t;
+}
+
+constexpr Tables kTables = make_tables();
+
+inline int32_t quarter(int32_t v) { return (v + 2) >> 2; }
+
+inline Complex twiddle(int32_t re, int32_t im, int m) {
+  int64_t c = kTables.cos_q15[m];
+  int64_t s = kTables.sin_q15[m];
+  return {(int32_t)((re * c + im * s + (1 << 14)) >> 15),
+          (int32_t)((im * c - re * s + (1 << 14)) >> 15)};
+}
+
+} // namespace
+
+void radix4(Complex *x) {
+  for (int len = kSize; len >= 4; len /= 4) {
+    const int q = len / 4;
+    const int step = kSize / len;
+    for (int j = 0; j < q; j++) {
+      const int m = j * step;
+      for (int k = j; k < kSize; k += len) {
+        Complex &a = x[k];
+        Complex &b = x[k + q];
+        Complex &c = x[k + 2 * q];
+        Complex &d = x[k + 3 * q];
+        int32_t t0r = a.re + c.re, t0i = a.im + c.im;
+        int32_t t1r = a.re - c.re, t1i = a.im - c.im;
+        int32_t t2r = b.re + d.re, t2i = b.im + d.im;
+        int32_t t3r = b.re - d.re, t3i = b.im - d.im;
+        // y0 = t0 + t2, y1 = t1 - i t3, y2 = t0 - t2, y3 = t1 + i t3.
+        a = {quarter(t0r + t2r), quarter(t0i + t2i)};
+        int32_t y1r = quarter(t1r + t3i), y1i = quarter(t1i - t3r);
+        int32_t y2r = quarter(t0r - t2r), y2i = quarter(t0i - t2i);
+        int32_t y3r = quarter(t1r - t3i), y3i = quarter(t1i + t3r);
+        if (m == 0) {
+          b = {y1r, y1i};
+          c = {y2r, y2i};
+          d = {y3r, y3i};
+        } else {
+          b = twiddle(y1r, y1i, m);
+          c = twiddle(y2r, y2i, 2 * m);
+          d = twiddle(y3r, y3i, 3 * m);
+        }
+      }
+    }
+  }
+  for (int k = 0; k < kSize; k++) {
+    int r = kTables.digit_rev[k];
+    if (r > k) {
+      Complex t = x[k];
+      x[k] = x[r];
+      x[r] = t;
+    }
+  }
+}
+
+} // namespace fft
+
+namespace {
+
+using Analyzer = SpectrumAnalyzer;
+
+// Window and input scale in one multiply: Q15 Hann, and the samples moved up
+// 8 bits so the 1/kSize of the FFT does not throw quiet signals away.
+constexpr int kInputShift = 8;
+
+struct Window {
+  int16_t hann_q15[Analyzer::kFftSize];
+};
+
+constexpr Window make_window() {
+  Window w = {};
+  for (int i = 0; i < Analyzer::kFftSize; i++) {
+    // Periodic Hann, sin^2(pi i / N).
+    double s = fir_design::cx_sin(fir_design::kPi * i / Analyzer::kFftSize);
+    w.hann_q15[i] = fft::to_q15(s * s);
+  }
+  return w;
+}
+
+constexpr Window kWindow = make_window();
+
+// Summed half-spectrum power of a signal with mean square 1.0 (full-scale
+// int16 squared): Parseval over the positive bins gives ms / 2 times the
+// window's mean square (3/8), in the FFT's 1/kSize scale and the input
+// shift.
+constexpr uint64_t kFullScalePower = 3ull << (30 - 4 + 2 * kInputShift);
+
+constexpr int16_t kFloorDbQ8 = -120 * 256;
+
+int16_t power_dbfs_q8(uint64_t power) {
+  if (power == 0)
+    return kFloorDbQ8;
+  int32_t octaves_q8 = log2_q8(power) - log2_q8(kFullScalePower);
+  // 10 log10(2) = 3.0103 dB per octave, 771 / 256.
+  int32_t db = (int32_t)(((int64_t)octaves_q8 * 771) >> 8);
+  return (int16_t)(db < kFloorDbQ8 ? kFloorDbQ8 : db);
+}
+
+} // namespace
+
+SpectrumAnalyzer::SpectrumAnalyzer(int sample_rate)
+    : sample_rate_(sample_rate) {
+  reset();
+}
+
+void SpectrumAnalyzer::reset() {
+  fill_ = 0;
+  frames_ = 0;
+  memset(power_, 0, sizeof(power_));
+}
+
+int SpectrumAnalyzer::process(const int16_t *x, int n) {
+  int done = 0;
+  while (n > 0) {
+    int take = kFftSize - fill_ < n ? kFftSize - fill_ : n;
+    memcpy(&frame_[fill_], x, (size_t)take * sizeof(int16_t));
+    fill_ += take;
+    x += take;
+    n -= take;
+    if (fill_ == kFftSize) {
+      analyze_frame();
+      memmove(frame_, &frame_[kHop], (kFftSize - kHop) * sizeof(int16_t));
+      fill_ = kFftSize - kHop;
+      done++;
+    }
+  }
+  return done;
+}
+
+void SpectrumAnalyzer::analyze_frame() {
+  for (int i = 0; i < kFftSize; i++) {
+    work_[i].re = ((int32_t)frame_[i] * kWindow.hann_q15[i]) >>
+                  (15 - kInputShift);
+    work_[i].im = 0;
+  }
+  fft::radix4(work_);
+  for (int k = 0; k < kBins; k++) {
+    int64_t re = work_[k].re;
+    int64_t im = work_[k].im;
+    power_[k] += (uint64_t)(re * re + im * im);
+  }
+  frames_++;
+}
+
+SpectrumReport SpectrumAnalyzer::take_report() {
+  SpectrumReport r = {};
+  r.frames = frames_;
+  if (frames_ == 0) {
+    for (int b = 0; b < kBands; b++)
+      r.band_dbfs_q8[b] = kFloorDbQ8;
+    r.level_dbfs_q8 = kFloorDbQ8;
+    r.peak_dbfs_q8 = kFloorDbQ8;
+    return r;
+  }
+
+  uint64_t total = 0;
+  for (int b = 0; b < kBands; b++) {
+    int hi = b == kBands - 1 ? kBins : 2 << b;
+    uint64_t band = 0;
+    for (int k = 1 << b; k < hi; k++)
+      band += power_[k];
+    total += band;
+    r.band_dbfs_q8[b] = power_dbfs_q8(band / frames_);
+  }
+  r.level_dbfs_q8 = power_dbfs_q8(total / frames_);
+
+  int peak = 1;
+  for (int k = 2; k < kBins; k++) {
+    if (power_[k] > power_[peak])
+      peak = k;
+  }
+  r.peak_dbfs_q8 = power_dbfs_q8(power_[peak] / frames_);
+  // Hann: delta = 2 (|X[k+1]| - |X[k-1]|) / (|X[k-1]| + 2 |X[k]| + |X[k+1]|),
+  // exact for a single tone. Bin units, Q8.
+  int64_t a = isqrt64(power_[peak - 1]);
+  int64_t b = isqrt64(power_[peak]);
+  int64_t c = peak + 1 < kBins ? isqrt64(power_[peak + 1]) : 0;
+  int64_t den = a + 2 * b + c;
+  int64_t delta_q8 = den > 0 ? 2 * 256 * (c - a) / den : 0;
+  r.peak_hz = (uint32_t)(((int64_t)peak * 256 + delta_q8) * sample_rate_ /
+                         (256 * kFftSize));
+
+  frames_ = 0;
+  memset(power_, 0, sizeof(power_));
+  return r;
+}
+
+} // namespace audio
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "audio_format.h"
+
+#include <stdint.h>
+
+namespace audio {
+
+namespace fft {
+
+constexpr int kSize = 256; // 4^4 points
+
+struct Complex {
+  int32_t re;
+  int32_t im;
+};
+
+// In-place forward FFT of kSize points, radix-4 decimation in frequency with
+// Q15 twiddles and a base-4 digit reversal at the end. Every stage scales by
+// 1/4, so the result is DFT / kSize: inputs up to +-2^23 cannot overflow.
+// Twiddle products are 32x32->64, rounded back to 32 bits.
+void radix4(Complex *x);
+
+} // namespace fft
+
+struct SpectrumReport {
+  static constexpr int kBands = 7;
+  uint32_t frames;              // FFT frames averaged
+  int16_t band_dbfs_q8[kBands]; // octave bands, see band_low_hz()
+  int16_t level_dbfs_q8;        // all bands together
+  uint32_t peak_hz;             // dominant frequency, interpolated
+  int16_t peak_dbfs_q8;         // power in the peak bin
+};
+
+// Coarse spectrum of the decimated stream: octave band energies and the
+// dominant frequency, averaged over a reporting period.
+//
+// Frames are fft::kSize samples (16 ms at 16 kHz) with a Hann window and
+// 50% overlap. Bins are sample_rate / kSize wide (62.5 Hz), so the octave
+// bands are exactly the bins [2^b, 2^(b+1)): 62.5-125 Hz up to 4-8 kHz,
+// the Nyquist bin in the top band and DC in none. Levels are dBFS on the
+// same scale as the level meter and the AGC (mean square against full
+// scale), corrected for the window, so a tone or white noise reads what its
+// RMS would. The peak frequency is interpolated from the three bins around
+// the strongest one with the exact estimator for the Hann window.
+//
+// Per frame it costs the window (one multiply per sample), the FFT and one
+// 64-bit power per bin; reports only cost some logs and square roots.
+class SpectrumAnalyzer {
+public:
+  static constexpr int kFftSize = fft::kSize;
+  static constexpr int kHop = kFftSize / 2;
+  static constexpr int kBins = kFftSize / 2 + 1;
+  static constexpr int kBands = SpectrumReport::kBands;
+
+  explicit SpectrumAnalyzer(int sample_rate = kSampleRate);
+
+  // Drops the partial frame and the running averages.
+  void reset();
+
+  // Feeds n samples. Returns the number of FFT frames that completed.
+  int process(const int16_t *x, int n);
+
+  // Averages of the frames since the previous call (frames is 0 if there
+  // were none) and starts a new period.
+  SpectrumReport take_report();
+
+  int band_low_hz(int band) const {
+    return (int)((int64_t)sample_rate_ * (1 << band) / kFftSize);
+  }
+
+private:
+  void analyze_frame();
+
+  int sample_rate_;
+  int fill_;
+  uint32_t frames_;
+  int16_t frame_[kFftSize];
+  fft::Complex work_[kFftSize];
+  uint64_t power_[kBins]; // summed over the period's frames
+};
+
+} // namespace audio
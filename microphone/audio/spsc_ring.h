@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace audio {
+
+// Lock-free single-producer / single-consumer ring buffer.
+//
+// head_ is only written by the producer and tail_ only by the consumer, so
+// the two sides never contend on the same index. Both are free-running
+// counters; the capacity must be a power of two so they can be masked into
+// the buffer and their difference stays correct across uint32_t wrap.
+template <typename T, size_t N> class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0,
+                "SpscRing capacity must be a power of two");
+
+public:
+  static constexpr size_t capacity() { return N; }
+
+  // Number of elements ready to pop. Safe to call from either side.
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+
+  // Producer side. Copies up to n elements and returns how many fit; the
+  // caller decides what to do with the rest (we never overwrite unread data).
+  size_t push(const T *src, size_t n) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load(std::memory_order_acquire);
+    size_t space = N - (size_t)(head - tail);
+    if (n > space)
+      n = space;
+    if (n == 0)
+      return 0;
+
+    size_t idx = head & (N - 1);
+    size_t first = N - idx < n ? N - idx : n;
+    memcpy(&buf_[idx], src, first * sizeof(T));
+    memcpy(&buf_[0], src + first, (n - first) * sizeof(T));
+
+    head_.store(head + (uint32_t)n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side. Copies up to max elements out and returns the count.
+  size_t pop(T *dst, size_t max) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    uint32_t head = head_.load(std::memory_order_acquire);
+    size_t n = (size_t)(head - tail);
+    if (n > max)
+      n = max;
+    if (n == 0)
+      return 0;
+
+    size_t idx = tail & (N - 1);
+    size_t first = N - idx < n ? N - idx : n;
+    memcpy(dst, &buf_[idx], first * sizeof(T));
+    memcpy(dst + first, &buf_[0], (n - first) * sizeof(T));
+
+    tail_.store(tail + (uint32_t)n, std::memory_order_release);
+    return n;
+  }
+
+  // Consumer side. Drops everything currently queued.
+  void discard() {
+    tail_.store(head_.load(std::memory_order_acquire),
+                std::memory_order_release);
+  }
+
+private:
+  T buf_[N];
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+};
+
+} // namespace audio
@@ -0,0 +1,170 @@
+#include "stream_frame.h"
+
+#include <string.h>
+
+namespace audio {
+namespace frame {
+
+namespace {
+
+struct CrcTable {
+  uint32_t t[256];
+};
+
+constexpr CrcTable make_crc_table() {
+  CrcTable table = {};
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+    table.t[i] = c;
+  }
+  return table;
+}
+
+constexpr CrcTable kCrcTable = make_crc_table();
+
+constexpr size_t kCrcOffset = 28;
+
+void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+void put_u32(uint8_t *p, uint32_t v) {
+  put_u16(p, (uint16_t)v);
+  put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+uint16_t get_u16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+uint32_t get_u32(const uint8_t *p) {
+  return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16);
+}
+
+uint32_t frame_crc(const uint8_t *frame, size_t header_bytes,
+                   size_t payload_bytes) {
+  uint32_t crc = crc32(frame, kCrcOffset);
+  return crc32(frame + kMinHeaderBytes,
+               header_bytes - kMinHeaderBytes + payload_bytes, crc);
+}
+
+} // namespace
+
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc) {
+  crc = ~crc;
+  for (size_t i = 0; i < len; i++)
+    crc = kCrcTable.t[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  return ~crc;
+}
+
+void finish(const Header &h, uint8_t *frame) {
+  put_u32(&frame[0], kMagic);
+  frame[4] = kVersion;
+  frame[5] = h.codec;
+  frame[6] = h.flags;
+  frame[7] = (uint8_t)kHeaderBytes;
+  put_u32(&frame[8], h.seq);
+  put_u16(&frame[12], h.payload_bytes);
+  put_u16(&frame[14], h.samples);
+  put_u32(&frame[16], (uint32_t)h.timestamp_us);
+  put_u32(&frame[20], (uint32_t)((uint64_t)h.timestamp_us >> 32));
+  put_u32(&frame[24], h.sample_index);
+  put_u16(&frame[32], (uint16_t)h.gain_db_q8);
+  put_u16(&frame[34], (uint16_t)h.drift_ppm_q4);
+  put_u32(&frame[kCrcOffset], frame_crc(frame, kHeaderBytes, h.payload_bytes));
+}
+
+size_t write_info(const Info &info, int64_t timestamp_us, uint8_t *out) {
+  uint8_t *p = out + kHeaderBytes;
+  memset(p, 0, kInfoBytes);
+  put_u32(&p[0], info.sample_rate);
+  p[4] = info.channels;
+  p[5] = info.codec;
+  p[6] = info.gated;
+  put_u16(&p[8], info.frame_samples);
+
+  Header h = {};
+  h.codec = kCodecInfo;
+  h.payload_bytes = (uint16_t)kInfoBytes;
+  h.timestamp_us = timestamp_us;
+  finish(h, out);
+  return kHeaderBytes + kInfoBytes;
+}
+
+bool parse_header(const uint8_t *p, Header *h) {
+  if (get_u32(&p[0]) != kMagic || p[4] != kVersion ||
+      p[7] < kMinHeaderBytes || p[7] > kMaxHeaderBytes)
+    return false;
+  h->codec = p[5];
+  h->flags = p[6];
+  h->seq = get_u32(&p[8]);
+  h->payload_bytes = get_u16(&p[12]);
+  h->samples = get_u16(&p[14]);
+  h->timestamp_us =
+      (int64_t)((uint64_t)get_u32(&p[16]) | ((uint64_t)get_u32(&p[20]) << 32));
+  h->sample_index = get_u32(&p[24]);
+  bool v2 = p[7] >= kHeaderBytes;
+  h->gain_db_q8 = v2 ? (int16_t)get_u16(&p[32]) : 0;
+  h->drift_ppm_q4 = v2 ? (int16_t)get_u16(&p[34]) : 0;
+  return h->payload_bytes <= kMaxPayloadBytes;
+}
+
+bool parse_info(const uint8_t *payload, size_t len, Info *info) {
+  if (len < kInfoBytes)
+    return false;
+  info->sample_rate = get_u32(&payload[0]);
+  info->channels = payload[4];
+  info->codec = payload[5];
+  info->gated = payload[6];
+  info->frame_samples = get_u16(&payload[8]);
+  return true;
+}
+
+bool Parser::next(Header *h, const uint8_t **payload) {
+  if (start_ > 0) {
+    memmove(buf_, &buf_[start_], fill_ - start_);
+    fill_ -= start_;
+    start_ = 0;
+  }
+
+  while (fill_ >= kMinHeaderBytes) {
+    size_t header_bytes = buf_[7];
+    if (fill_ < header_bytes && header_bytes <= kMaxHeaderBytes &&
+        get_u32(buf_) == kMagic)
+      return false;
+    bool ok = fill_ >= header_bytes && parse_header(buf_, h);
+    if (ok) {
+      size_t total = header_bytes + h->payload_bytes;
+      if (fill_ < total)
+        return false;
+      if (get_u32(&buf_[kCrcOffset]) ==
+          frame_crc(buf_, header_bytes, h->payload_bytes)) {
+        if (h->codec != kCodecInfo) {
+          uint32_t gap = h->seq - last_seq_ - 1;
+          if (have_seq_ && gap != 0 && gap < 0x80000000u)
+            stats_.seq_gaps += gap;
+          have_seq_ = true;
+          last_seq_ = h->seq;
+        }
+        stats_.frames++;
+        *payload = &buf_[header_bytes];
+        start_ = total;
+        return true;
+      }
+      stats_.crc_errors++;
+    }
+
+    // Hunt for the next possible magic.
+    size_t skip = 1;
+    while (skip < fill_ && buf_[skip] != (uint8_t)kMagic)
+      skip++;
+    stats_.resync_bytes += (uint32_t)skip;
+    memmove(buf_, &buf_[skip], fill_ - skip);
+    fill_ -= skip;
+  }
+  return false;
+}
+
+} // namespace frame
+} // namespace audio
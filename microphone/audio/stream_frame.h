@@ -0,0 +1,144 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace audio {
+
+// Wire format v2 for the microphone stream: a sequence of self-delimiting,
+// CRC-checked frames. All fields little-endian.
+//
+//   0  u32  magic "MICF"
+//   4  u8   version (2)
+//   5  u8   codec, see Codec
+//   6  u8   flags, see Flags
+//   7  u8   header bytes (36); a reader skips anything past what it knows
+//   8  u32  sequence number, +1 per audio frame of the stream; a gap means
+//           frames were skipped
+//  12  u16  payload bytes
+//  14  u16  samples in the payload
+//  16  i64  esp_timer time of the first sample, microseconds since boot
+//  24  u32  sample clock of the first sample (wraps)
+//  28  u32  CRC-32 (IEEE, as zlib) of bytes 0..27, then everything from
+//           byte 32 to the end of the payload
+//  32  i16  capture gain in dB, Q8: the AGC gain when the frame was sent,
+//           0 with fixed scaling
+//  34  i16  capture clock error in ppm, Q4: how far the I2S sample clock
+//           runs from nominal against esp_timer (positive: fast), 0 if not
+//           measured yet. With kFlagResampled it has been corrected for and
+//           the payload is at the nominal rate.
+//  36       payload
+//
+// Readers also accept the original 32-byte header; its gain and clock error
+// read as 0.
+//
+// A stream starts with one kCodecInfo frame describing the audio frames
+// that follow. There is no end of stream; it runs until the socket closes.
+namespace frame {
+
+constexpr uint32_t kMagic = 0x4643494d; // "MICF"
+constexpr uint8_t kVersion = 2;
+constexpr size_t kHeaderBytes = 36;    // as written
+constexpr size_t kMinHeaderBytes = 32; // as accepted
+constexpr size_t kMaxHeaderBytes = 64;
+constexpr size_t kMaxPayloadBytes = 4096;
+
+enum Codec : uint8_t {
+  kCodecInfo = 0,     // payload is an Info
+  kCodecPcm16 = 1,    // int16 little-endian
+  kCodecImaAdpcm = 2, // one WAV-layout mono IMA-ADPCM block
+  kCodecLossless = 3, // one audio::lossless block, payload size varies
+};
+
+enum Flags : uint8_t {
+  kFlagSegmentStart = 1 << 0, // gated stream: first frame after silence
+  kFlagSegmentEnd = 1 << 1,   // gated stream: last frame before silence
+  kFlagResampled = 1 << 2,    // clock error resampled out, see drift_ppm_q4
+};
+
+struct Header {
+  uint8_t codec;
+  uint8_t flags;
+  uint32_t seq;
+  uint16_t payload_bytes;
+  uint16_t samples;
+  int64_t timestamp_us;
+  uint32_t sample_index;
+  int16_t gain_db_q8;
+  int16_t drift_ppm_q4;
+};
+
+// Payload of the kCodecInfo frame.
+struct Info {
+  uint32_t sample_rate;
+  uint8_t channels;
+  uint8_t codec;          // of the audio frames
+  uint8_t gated;          // 1: only voice segments are sent
+  uint16_t frame_samples; // per audio frame
+};
+constexpr size_t kInfoBytes = 12;
+
+uint32_t crc32(const uint8_t *data, size_t len, uint32_t crc = 0);
+
+// Fills in the header of a frame whose payload (h.payload_bytes) is already
+// at frame + kHeaderBytes, CRC included.
+void finish(const Header &h, uint8_t *frame);
+
+// Builds a complete kCodecInfo frame into out (kHeaderBytes + kInfoBytes).
+size_t write_info(const Info &info, int64_t timestamp_us, uint8_t *out);
+
+// Decodes and sanity-checks a header (magic, version, sizes). p must hold
+// the whole header, p[7] bytes. Does not check the CRC, which covers the
+// payload too.
+bool parse_header(const uint8_t *p, Header *h);
+
+bool parse_info(const uint8_t *payload, size_t len, Info *info);
+
+// Incremental stream parser. Feed it whatever recv() returned; it calls
+// on_frame(const Header &, const uint8_t *payload) for each frame whose CRC
+// checks out. On a bad header or CRC it drops one byte and hunts for the
+// next magic, so a corrupted frame costs only that frame.
+class Parser {
+public:
+  struct Stats {
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t resync_bytes; // bytes dropped while hunting for a header
+    uint32_t seq_gaps;     // frames missing according to the sequence
+  };
+
+  template <typename OnFrame>
+  void feed(const uint8_t *data, size_t len, OnFrame &&on_frame) {
+    while (len > 0) {
+      size_t take = sizeof(buf_) - fill_;
+      if (take > len)
+        take = len;
+      for (size_t i = 0; i < take; i++)
+        buf_[fill_ + i] = data[i];
+      fill_ += take;
+      data += take;
+      len -= take;
+
+      Header h;
+      const uint8_t *payload;
+      while (next(&h, &payload))
+        on_frame(h, payload);
+    }
+  }
+
+  const Stats &stats() const { return stats_; }
+
+private:
+  // Pops one good frame from buf_ if a whole one is there.
+  bool next(Header *h, const uint8_t **payload);
+
+  uint8_t buf_[kMaxHeaderBytes + kMaxPayloadBytes];
+  size_t fill_ = 0;
+  size_t start_ = 0; // first unconsumed byte
+  bool have_seq_ = false;
+  uint32_t last_seq_ = 0;
+  Stats stats_ = {};
+};
+
+} // namespace frame
+} // namespace audio
@@ -0,0 +1,123 @@
+#include "vad.h"
+#include "sample_math.h"
+
+namespace audio {
+
+// High-pass pole, 0.96 in Q15: corner ~100 Hz at 16 kHz.
+static constexpr int32_t kHighPassPoleQ15 = 31457;
+
+// dB quantities are Q8. 10 * log10(2) = 3.0103 dB per octave of energy.
+static constexpr int32_t kDbPerLog2Q8 = 771;
+static constexpr int32_t kNoisyZcrQ8 = 90;        // 0.35 crossings/sample
+static constexpr int32_t kNoisyExtraQ8 = 6 * 256; // dB
+// Floor rise while the signal is above it: ~1.2 dB/s at 100 frames/s.
+static constexpr int32_t kFloorRiseQ8 = 3;
+
+VoiceGate::VoiceGate(const Config &config) {
+  threshold_q8_ = config.threshold_db * 256;
+  hangover_frames_ = config.hangover_ms / 10; // 10 ms frames
+  preroll_frames_ = config.preroll_ms / 10;
+  if (preroll_frames_ > kMaxPrerollFrames)
+    preroll_frames_ = kMaxPrerollFrames;
+  if (preroll_frames_ < 0)
+    preroll_frames_ = 0;
+  reset();
+}
+
+void VoiceGate::reset() {
+  head_ = 0;
+  fill_ = 0;
+  buffered_ = 0;
+  open_count_ = 0;
+  next_index_ = 0;
+  hp_x1_ = 0;
+  hp_y1_ = 0;
+  floor_q8_ = 0;
+  floor_seeded_ = false;
+  onset_ = 0;
+  hang_ = 0;
+  open_ = false;
+  stats_ = {};
+}
+
+VoiceGate::Step VoiceGate::step() {
+  const int16_t *x = history_[head_];
+
+  int32_t x1 = hp_x1_;
+  int32_t y1 = hp_y1_;
+  bool neg_prev = y1 < 0;
+  uint64_t energy = 0;
+  int crossings = 0;
+  for (int i = 0; i < kFrameSamples; i++) {
+    int32_t y = x[i] - x1 + ((y1 * kHighPassPoleQ15) >> 15);
+    x1 = x[i];
+    y1 = y;
+    // |y| can reach ~2^16 on a full-scale step, halve it so the square
+    // stays in 32 bits.
+    int32_t h = y >> 1;
+    energy += (uint32_t)(h * h);
+    bool neg = y < 0;
+    crossings += neg != neg_prev;
+    neg_prev = neg;
+  }
+  hp_x1_ = x1;
+  hp_y1_ = y1;
+
+  // Mean energy per sample in dB re 1 LSB^2 (+6 dB for the halving).
+  int32_t energy_q8 =
+      (log2_q8(energy / kFrameSamples) * kDbPerLog2Q8 >> 8) + 6 * 256;
+  int32_t zcr_q8 = crossings * 256 / kFrameSamples;
+
+  if (!floor_seeded_) {
+    floor_q8_ = energy_q8;
+    floor_seeded_ = true;
+  } else if (energy_q8 < floor_q8_) {
+    floor_q8_ += (energy_q8 - floor_q8_) / 4;
+  } else {
+    floor_q8_ += kFloorRiseQ8;
+  }
+
+  int32_t needed = threshold_q8_ + (zcr_q8 > kNoisyZcrQ8 ? kNoisyExtraQ8 : 0);
+  bool speech = energy_q8 - floor_q8_ > needed;
+
+  int cap = preroll_frames_ + kOnsetFrames;
+  if (buffered_ < cap)
+    buffered_++;
+
+  Step result = Step::kIdle;
+  if (!open_) {
+    onset_ = speech ? onset_ + 1 : 0;
+    if (onset_ >= kOnsetFrames) {
+      open_ = true;
+      hang_ = hangover_frames_;
+      open_count_ = buffered_;
+      buffered_ = 0;
+      stats_.segments++;
+      stats_.active_frames += (uint32_t)open_count_;
+      result = Step::kOpen;
+    }
+  } else {
+    hang_ = speech ? hangover_frames_ : hang_ - 1;
+    buffered_ = 0;
+    stats_.active_frames++;
+    result = Step::kSend;
+    if (hang_ <= 0) {
+      // Hangover used up: this frame ends the segment.
+      open_ = false;
+      onset_ = 0;
+      result = Step::kSendLast;
+    }
+  }
+
+  stats_.frames++;
+  stats_.noise_floor_db_q8 = floor_q8_;
+  stats_.energy_db_q8 = energy_q8;
+  stats_.zcr_q8 = (uint16_t)zcr_q8;
+  stats_.active = open_;
+
+  head_ = (head_ + 1) % kHistory;
+  next_index_ += kFrameSamples;
+  return result;
+}
+
+} // namespace audio
@@ -0,0 +1,132 @@
+#pragma once
+
+#include "audio_format.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace audio {
+
+// One unit of VoiceGate output.
+struct VadFrame {
+  enum Flags : uint8_t {
+    kStart = 1 << 0, // first frame of a segment (the oldest pre-roll frame)
+    kEnd = 1 << 1,   // last frame of a segment
+  };
+
+  uint32_t index;         // sample clock of samples[0] since reset()
+  const int16_t *samples; // kFrameSamples
+  uint8_t flags;
+};
+
+struct VadStats {
+  uint32_t frames;
+  uint32_t active_frames; // frames sent, pre-roll included
+  uint32_t segments;
+  int32_t noise_floor_db_q8;
+  int32_t energy_db_q8; // last frame
+  uint16_t zcr_q8;      // last frame, zero crossings per sample
+  bool active;
+};
+
+// Energy + zero-crossing voice activity gate for the decimated stream.
+//
+// Works on fixed 10 ms frames. Each frame is high-passed (one pole, ~100 Hz,
+// so mic DC and rumble do not count as energy), then its log energy is
+// compared to a noise floor that follows quiet frames quickly and rises
+// slowly through loud ones. A frame is speech if it is threshold_db above
+// the floor; noise-like frames (many zero crossings) need 6 dB more. Two
+// speech frames in a row open the gate, hangover_ms of non-speech closes it.
+//
+// While closed the last preroll_ms of frames are kept, so a segment starts
+// with the quiet lead-in before the onset. All integer; the per-sample cost
+// is one multiply for the filter, one for the energy and a compare.
+class VoiceGate {
+public:
+  static constexpr int kFrameSamples = kSampleRate / 100; // 10 ms
+  static constexpr int kMaxPrerollFrames = 30;
+  static constexpr int kOnsetFrames = 2;
+
+  struct Config {
+    int threshold_db = 9;
+    int hangover_ms = 300;
+    int preroll_ms = 200; // capped at kMaxPrerollFrames
+  };
+
+  VoiceGate() : VoiceGate(Config()) {}
+  explicit VoiceGate(const Config &config);
+
+  void reset();
+
+  // Feeds n samples; frames that pass the gate go to emit(const VadFrame &)
+  // in stream order. Frame samples are only valid during the call.
+  template <typename Emit> void process(const int16_t *x, int n, Emit &&emit) {
+    while (n > 0) {
+      int take = kFrameSamples - fill_;
+      if (take > n)
+        take = n;
+      memcpy(&history_[head_][fill_], x, (size_t)take * sizeof(int16_t));
+      fill_ += take;
+      x += take;
+      n -= take;
+      if (fill_ == kFrameSamples) {
+        fill_ = 0;
+        dispatch(step(), emit);
+      }
+    }
+  }
+
+  VadStats stats() const { return stats_; }
+
+private:
+  enum class Step { kIdle, kOpen, kSend, kSendLast };
+
+  // Classifies the frame at history_[head_], advances the state machine and
+  // the history ring. Returns what the caller has to emit.
+  Step step();
+
+  template <typename Emit> void dispatch(Step s, Emit &&emit) {
+    uint32_t frame_index = next_index_ - kFrameSamples;
+    int cur = (head_ + kHistory - 1) % kHistory; // step() advanced head_
+    if (s == Step::kOpen) {
+      // The pre-roll and onset frames, oldest first, ending with this one.
+      int count = open_count_;
+      for (int i = 0; i < count; i++) {
+        int slot = (cur - (count - 1 - i) + kHistory) % kHistory;
+        uint32_t back = (uint32_t)((count - 1 - i) * kFrameSamples);
+        VadFrame f = {frame_index - back, history_[slot],
+                      i == 0 ? (uint8_t)VadFrame::kStart : (uint8_t)0};
+        emit(f);
+      }
+    } else if (s != Step::kIdle) {
+      VadFrame f = {frame_index, history_[cur],
+                    s == Step::kSendLast ? (uint8_t)VadFrame::kEnd
+                                         : (uint8_t)0};
+      emit(f);
+    }
+  }
+
+  static constexpr int kHistory = kMaxPrerollFrames + kOnsetFrames;
+
+  int threshold_q8_;
+  int hangover_frames_;
+  int preroll_frames_;
+
+  int16_t history_[kHistory][kFrameSamples];
+  int head_;       // slot being filled
+  int fill_;       // samples in history_[head_]
+  int buffered_;   // unsent complete frames in history_
+  int open_count_; // frames to emit for Step::kOpen
+  uint32_t next_index_;
+
+  int32_t hp_x1_;
+  int32_t hp_y1_;
+  int32_t floor_q8_;
+  bool floor_seeded_;
+  int onset_;
+  int hang_;
+  bool open_;
+  VadStats stats_;
+};
+
+} // namespace audio
@@ -0,0 +1,79 @@
+#include "clip_buffer.h"
+
+extern "C" {
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+}
+#include <string.h>
+
+static const char *TAG = "MIC_CLIP";
+
+namespace mic {
+
+static constexpr uint32_t kInternalCaps = MALLOC_CAP_INTERNAL |
+                                          MALLOC_CAP_8BIT;
+static constexpr uint32_t kPsramCaps = MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT;
+
+bool parse_clip_placement(const char *name, ClipPlacement *out) {
+  if (strcmp(name, "auto") == 0)
+    *out = ClipPlacement::Auto;
+  else if (strcmp(name, "internal") == 0)
+    *out = ClipPlacement::Internal;
+  else if (strcmp(name, "psram") == 0)
+    *out = ClipPlacement::Psram;
+  else
+    return false;
+  return true;
+}
+
+const char *clip_placement_name(ClipPlacement placement) {
+  switch (placement) {
+  case ClipPlacement::Auto:
+    return "auto";
+  case ClipPlacement::Internal:
+    return "internal";
+  case ClipPlacement::Psram:
+    return "psram";
+  }
+  return "?";
+}
+
+bool ClipBuffer::allocate(int samples, ClipPlacement placement) {
+  release();
+  size_t bytes = (size_t)samples * sizeof(int16_t);
+  if (placement == ClipPlacement::Auto)
+    placement = heap_caps_get_largest_free_block(kPsramCaps) >= bytes
+                    ? ClipPlacement::Psram
+                    : ClipPlacement::Internal;
+
+  uint32_t caps =
+      placement == ClipPlacement::Psram ? kPsramCaps : kInternalCaps;
+  data_ = (int16_t *)heap_caps_malloc(bytes, caps);
+  if (!data_) {
+    ESP_LOGE(TAG, "No %s block of %u bytes for a %d-sample clip",
+             clip_placement_name(placement), (unsigned)bytes, samples);
+    log_clip_heap("after failed allocation");
+    return false;
+  }
+  samples_ = samples;
+  placement_ = placement;
+  return true;
+}
+
+void ClipBuffer::release() {
+  heap_caps_free(data_);
+  data_ = nullptr;
+  samples_ = 0;
+}
+
+void log_clip_heap(const char *when) {
+  ESP_LOGI(TAG,
+           "heap %s: internal %u free (largest %u), psram %u free "
+           "(largest %u)",
+           when, (unsigned)heap_caps_get_free_size(kInternalCaps),
+           (unsigned)heap_caps_get_largest_free_block(kInternalCaps),
+           (unsigned)heap_caps_get_free_size(kPsramCaps),
+           (unsigned)heap_caps_get_largest_free_block(kPsramCaps));
+}
+
+} // namespace mic
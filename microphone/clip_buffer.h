@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mic {
+
+// Where a clip's samples may live. Auto takes PSRAM when the chip has a
+// large enough free block there and falls back to internal RAM.
+enum class ClipPlacement { Auto, Internal, Psram };
+
+// "auto", "internal" or "psram". Returns false for anything else.
+bool parse_clip_placement(const char *name, ClipPlacement *out);
+const char *clip_placement_name(ClipPlacement placement);
+
+// The sample buffer of one clip-mode capture, taken from the heap for as
+// long as the recording and the send take and freed by release() or the
+// destructor. Nothing is held between captures, so idle RAM use does not
+// depend on the longest clip a client may ask for.
+class ClipBuffer {
+public:
+  ClipBuffer() = default;
+  ~ClipBuffer() { release(); }
+  ClipBuffer(const ClipBuffer &) = delete;
+  ClipBuffer &operator=(const ClipBuffer &) = delete;
+
+  // Allocates room for samples int16 samples. Returns false (logged, with
+  // the free heap) if no allowed region has a large enough block.
+  bool allocate(int samples, ClipPlacement placement);
+  void release();
+
+  int16_t *data() { return data_; }
+  const int16_t *data() const { return data_; }
+  int samples() const { return samples_; }
+  size_t bytes() const { return (size_t)samples_ * sizeof(int16_t); }
+  // Where allocate() actually put it: Internal or Psram.
+  ClipPlacement placement() const { return placement_; }
+
+private:
+  int16_t *data_ = nullptr;
+  int samples_ = 0;
+  ClipPlacement placement_ = ClipPlacement::Internal;
+};
+
+// Logs free and largest-block sizes of internal RAM and PSRAM.
+void log_clip_heap(const char *when);
+
+} // namespace mic
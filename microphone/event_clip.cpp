@@ -0,0 +1,389 @@
+#include "event_clip.h"
+#include "audio_format.h"
+#include "event_trigger.h"
+#include "ima_adpcm.h"
+#include "net_util.h"
+#include "stream_frame.h"
+#include "stream_server.h"
+#include "sys_event.h"
+#include "sys_manager.h"
+
+extern "C" {
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+}
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "MIC_EVENT";
+
+namespace mic {
+
+#if CONFIG_MIC_ADPCM
+static constexpr uint8_t kCodec = audio::frame::kCodecImaAdpcm;
+static constexpr int kFrameSamples = audio::ima_adpcm::kBlockSamples;
+static constexpr size_t kPayloadBytes = audio::ima_adpcm::kBlockBytes;
+#else
+static constexpr uint8_t kCodec = audio::frame::kCodecPcm16;
+static constexpr int kFrameSamples = kPcmFrameSamples;
+static constexpr size_t kPayloadBytes = kPcmFrameSamples * sizeof(int16_t);
+#endif
+static constexpr uint32_t kFrameBytes =
+    audio::frame::kHeaderBytes + kPayloadBytes;
+static constexpr size_t kInfoFrameBytes =
+    audio::frame::kHeaderBytes + audio::frame::kInfoBytes;
+
+static constexpr uint32_t kPreSamples =
+    CONFIG_MIC_EVENT_PRE_SECONDS * audio::kSampleRate;
+static constexpr uint32_t kPostSamples =
+    CONFIG_MIC_EVENT_POST_SECONDS * audio::kSampleRate;
+static constexpr uint32_t kMaxSamples =
+    CONFIG_MIC_EVENT_MAX_SECONDS * audio::kSampleRate;
+// The pre-roll, plus the frames that land between a trigger and its
+// handling (the PCM16 frames run up to a block ahead of ADPCM).
+static constexpr int kPrerollFrames =
+    (int)((kPreSamples + kFrameSamples - 1) / kFrameSamples) + 4;
+static constexpr size_t kMaxClipBytes =
+    kInfoFrameBytes + (kMaxSamples / kFrameSamples + 2) * kFrameBytes;
+static constexpr size_t kQueueBytes = CONFIG_MIC_EVENT_QUEUE_KB * 1024;
+static constexpr int kQueueClips = 8;
+static constexpr int kUploadTimeoutMs = 5000;
+static constexpr TickType_t kRetryTicks = pdMS_TO_TICKS(10000);
+
+struct Clip {
+  uint8_t *data;
+  size_t bytes;
+  uint32_t number;
+};
+
+struct EventStats {
+  uint32_t triggers; // posted
+  uint32_t clips;    // finished and queued
+  uint32_t dropped;  // no RAM, or the queue was full
+  uint32_t skips;    // fell behind the capture ring
+  uint32_t uploaded;
+};
+
+// Newest frames, kPrerollFrames slots of kFrameBytes, oldest at
+// s_preroll_next once it has wrapped.
+static uint8_t *s_preroll = nullptr;
+static int s_preroll_next = 0;
+static int s_preroll_count = 0;
+
+// The clip being cut; s_clip.data is null while idle.
+static Clip s_clip = {};
+static size_t s_clip_capacity = 0;
+static uint32_t s_clip_first = 0; // sample index of its first frame
+static uint32_t s_clip_end = 0;   // it runs until a frame reaches this
+static uint32_t s_clip_triggers = 0;
+static int32_t s_clip_peak_q8 = 0;
+static uint32_t s_next_number = 0;
+
+static QueueHandle_t s_upload_queue = nullptr;
+static std::atomic<size_t> s_queued_bytes{0};
+static EventStats s_stats = {};
+
+// PSRAM when the chip has some, otherwise internal RAM.
+static uint8_t *alloc_bytes(size_t bytes) {
+  void *p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!p)
+    p = heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  return (uint8_t *)p;
+}
+
+// Signed distance from b to a on the wrapping sample clock.
+static int32_t samples_after(uint32_t a, uint32_t b) {
+  return (int32_t)(a - b);
+}
+
+static uint32_t frame_index(const uint8_t *frame) {
+  audio::frame::Header h;
+  audio::frame::parse_header(frame, &h);
+  return h.sample_index;
+}
+
+// Grows the clip buffer to hold everything up to s_clip_end. Keeps the old
+// one (and the clip short) if there is no room.
+static void reserve_clip() {
+  uint32_t span = (uint32_t)samples_after(s_clip_end, s_clip_first);
+  size_t needed =
+      kInfoFrameBytes + (span / kFrameSamples + 2) * (size_t)kFrameBytes;
+  if (needed > kMaxClipBytes)
+    needed = kMaxClipBytes;
+  if (needed <= s_clip_capacity)
+    return;
+  uint8_t *data = alloc_bytes(needed);
+  if (!data) {
+    ESP_LOGW(TAG, "No %u bytes to extend clip %lu", (unsigned)needed,
+             (unsigned long)s_clip.number);
+    return;
+  }
+  memcpy(data, s_clip.data, s_clip.bytes);
+  heap_caps_free(s_clip.data);
+  s_clip.data = data;
+  s_clip_capacity = needed;
+}
+
+static void start_clip(uint32_t trigger_index) {
+  s_clip_capacity = kInfoFrameBytes + (size_t)(kPreSamples + kPostSamples) /
+                                          kFrameSamples * kFrameBytes +
+                    2 * kFrameBytes;
+  s_clip.data = alloc_bytes(s_clip_capacity);
+  if (!s_clip.data) {
+    ESP_LOGW(TAG, "No %u bytes for a clip, event dropped",
+             (unsigned)s_clip_capacity);
+    s_stats.dropped++;
+    return;
+  }
+  s_clip.number = s_next_number++;
+  audio::frame::Info info = {(uint32_t)audio::kSampleRate,
+                             (uint8_t)audio::kChannels, kCodec, 0,
+                             (uint16_t)kFrameSamples};
+  s_clip.bytes =
+      audio::frame::write_info(info, esp_timer_get_time(), s_clip.data);
+  s_clip_first = trigger_index - kPreSamples;
+  s_clip_end = trigger_index + kPostSamples;
+  s_clip_triggers = 1;
+
+  // The pre-roll frames that reach into the lead-in, oldest first.
+  int oldest = s_preroll_count < kPrerollFrames ? 0 : s_preroll_next;
+  bool first = true;
+  for (int i = 0; i < s_preroll_count; i++) {
+    const uint8_t *frame =
+        &s_preroll[(size_t)((oldest + i) % kPrerollFrames) * kFrameBytes];
+    uint32_t index = frame_index(frame);
+    if (samples_after(index + kFrameSamples, s_clip_first) <= 0)
+      continue;
+    if (first) {
+      s_clip_first = index;
+      first = false;
+    }
+    memcpy(&s_clip.data[s_clip.bytes], frame, kFrameBytes);
+    s_clip.bytes += kFrameBytes;
+  }
+  if (first)
+    s_clip_first = trigger_index;
+}
+
+static void finish_clip() {
+  size_t bytes = s_clip.bytes;
+  size_t queued = s_queued_bytes.load();
+  if (queued + bytes > kQueueBytes ||
+      xQueueSend(s_upload_queue, &s_clip, 0) != pdTRUE) {
+    ESP_LOGW(TAG, "Upload queue full (%u KB), clip %lu dropped",
+             (unsigned)(queued / 1024), (unsigned long)s_clip.number);
+    heap_caps_free(s_clip.data);
+    s_stats.dropped++;
+  } else {
+    s_queued_bytes.fetch_add(bytes);
+    s_stats.clips++;
+    uint32_t frames = (uint32_t)((bytes - kInfoFrameBytes) / kFrameBytes);
+    ESP_LOGI(TAG,
+             "Clip evt%05lu.mfr: %.1f s, %u KB, peak %.1f dBFS, %lu "
+             "trigger(s); %u KB queued",
+             (unsigned long)s_clip.number,
+             (double)frames * kFrameSamples / audio::kSampleRate,
+             (unsigned)(bytes / 1024), s_clip_peak_q8 / 256.0,
+             (unsigned long)s_clip_triggers,
+             (unsigned)((queued + bytes) / 1024));
+  }
+  s_clip = {};
+  s_clip_capacity = 0;
+}
+
+// A new frame of the stored codec: into the pre-roll, and into the clip
+// while one is open.
+static void take_frame(const audio::BroadcastRing &ring, uint32_t pos) {
+  uint8_t *slot = &s_preroll[(size_t)s_preroll_next * kFrameBytes];
+  ring.copy(pos, slot, kFrameBytes);
+  s_preroll_next = (s_preroll_next + 1) % kPrerollFrames;
+  if (s_preroll_count < kPrerollFrames)
+    s_preroll_count++;
+
+  if (!s_clip.data)
+    return;
+  uint32_t index = frame_index(slot);
+  if (s_clip.bytes + kFrameBytes <= s_clip_capacity) {
+    memcpy(&s_clip.data[s_clip.bytes], slot, kFrameBytes);
+    s_clip.bytes += kFrameBytes;
+  }
+  if (samples_after(index + kFrameSamples, s_clip_end) >= 0 ||
+      s_clip.bytes + kFrameBytes > s_clip_capacity)
+    finish_clip();
+}
+
+static void on_event(const sys::Event &e) {
+  if (e.type != sys::EventType::AUDIO_TRIGGER)
+    return;
+  uint32_t index = (uint32_t)e.arg0;
+  if (!s_clip.data) {
+    s_clip_peak_q8 = e.arg1;
+    start_clip(index);
+    return;
+  }
+  s_clip_triggers++;
+  if (e.arg1 > s_clip_peak_q8)
+    s_clip_peak_q8 = e.arg1;
+  uint32_t end = index + kPostSamples;
+  if (samples_after(end, s_clip_first) > (int32_t)kMaxSamples)
+    end = s_clip_first + kMaxSamples;
+  if (samples_after(end, s_clip_end) > 0) {
+    s_clip_end = end;
+    reserve_clip();
+  }
+}
+
+// Frames from pos up to the ring head, skipping ahead if the reader fell
+// more than guard behind. Calls fn(pos, header) for each; returns the new
+// pos.
+template <typename Fn>
+static uint32_t read_frames(const audio::BroadcastRing &ring, uint32_t pos,
+                            uint32_t frame_bytes, size_t payload_bytes,
+                            Fn &&fn) {
+  uint32_t capacity = (uint32_t)ring.capacity();
+  uint32_t guard = capacity - capacity / 4;
+  uint32_t lag = ring.head() - pos;
+  if (lag > guard) {
+    uint32_t frames = (lag - guard) / frame_bytes + 1;
+    pos += frames * frame_bytes;
+    lag -= frames * frame_bytes;
+    s_stats.skips++;
+  }
+  while (lag >= frame_bytes) {
+    uint8_t raw[audio::frame::kHeaderBytes];
+    audio::frame::Header h;
+    ring.copy(pos, raw, sizeof(raw));
+    if (!audio::frame::parse_header(raw, &h) ||
+        h.payload_bytes != payload_bytes) {
+      ESP_LOGE(TAG, "Lost frame alignment, restarting at live");
+      return ring.head();
+    }
+    fn(pos, h);
+    pos += frame_bytes;
+    lag -= frame_bytes;
+  }
+  return pos;
+}
+
+static const audio::BroadcastRing &clip_ring() {
+  const audio::BroadcastRing *adpcm = live_adpcm_ring();
+  return adpcm ? *adpcm : live_pcm_ring();
+}
+
+static void clip_task(void *arg) {
+  (void)arg;
+  const audio::BroadcastRing &pcm = live_pcm_ring();
+  const audio::BroadcastRing &ring = clip_ring();
+  uint32_t pcm_pos = pcm.head();
+  uint32_t pos = ring.head();
+  constexpr uint32_t kPcmFrameBytes =
+      audio::frame::kHeaderBytes + kPcmFrameSamples * sizeof(int16_t);
+
+  audio::EventTrigger::Config cfg;
+  cfg.threshold_dbfs = CONFIG_MIC_EVENT_THRESHOLD_DBFS;
+  cfg.rise_db = CONFIG_MIC_EVENT_RISE_DB;
+  audio::EventTrigger trigger(cfg);
+  static_assert(audio::EventTrigger::kFrameSamples == kPcmFrameSamples,
+                "the trigger takes whole PCM16 frames");
+  int16_t samples[kPcmFrameSamples];
+  sys::Subscription *sub =
+      sys::subscribe(sys::event_bit(sys::EventType::AUDIO_TRIGGER));
+  if (!sub)
+    vTaskDelete(nullptr); // subscribe() has logged why
+
+  while (true) {
+    // Woken by every captured chunk, like the store task.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+    pcm_pos = read_frames(
+        pcm, pcm_pos, kPcmFrameBytes, kPcmFrameSamples * sizeof(int16_t),
+        [&](uint32_t at, const audio::frame::Header &h) {
+          pcm.copy(at + audio::frame::kHeaderBytes, samples, sizeof(samples));
+          // The ring is after the AGC; the trigger wants the room level.
+          if (!trigger.process_frame(samples, h.gain_db_q8))
+            return;
+          s_stats.triggers++;
+          sys::post_event(sys::EventType::AUDIO_TRIGGER,
+                          (int32_t)h.sample_index,
+                          trigger.stats().level_dbfs_q8);
+        });
+    pos = read_frames(ring, pos, kFrameBytes, kPayloadBytes,
+                      [&](uint32_t at, const audio::frame::Header &) {
+                        take_frame(ring, at);
+                      });
+
+    // This task is woken by the capture, so it polls its subscription.
+    sys::Notice notice;
+    while (sys::next_notice(sub, &notice, 0))
+      on_event(notice.event);
+  }
+}
+
+static bool upload_clip(const Clip &clip) {
+  int sock = connect_to(CONFIG_MIC_UPLOAD_HOST, CONFIG_MIC_UPLOAD_PORT,
+                        kUploadTimeoutMs);
+  if (sock < 0)
+    return false;
+  char header[48];
+  int len = snprintf(header, sizeof(header), "UPLOAD evt%05lu.mfr %u\n",
+                     (unsigned long)clip.number, (unsigned)clip.bytes);
+  bool ok = send_all(sock, header, (size_t)len) &&
+            send_all(sock, clip.data, clip.bytes) && wait_ok(sock);
+  close(sock);
+  return ok;
+}
+
+static void upload_task(void *arg) {
+  (void)arg;
+  Clip clip;
+  while (true) {
+    if (xQueueReceive(s_upload_queue, &clip, portMAX_DELAY) != pdTRUE)
+      continue;
+    while (!upload_clip(clip)) {
+      ESP_LOGW(TAG, "Upload of evt%05lu.mfr failed, retrying in 10 s",
+               (unsigned long)clip.number);
+      vTaskDelay(kRetryTicks);
+    }
+    heap_caps_free(clip.data);
+    s_queued_bytes.fetch_sub(clip.bytes);
+    s_stats.uploaded++;
+    ESP_LOGI(TAG,
+             "Uploaded evt%05lu.mfr (%u KB); %lu clips from %lu triggers, "
+             "%lu dropped, %lu skips",
+             (unsigned long)clip.number, (unsigned)(clip.bytes / 1024),
+             (unsigned long)s_stats.clips, (unsigned long)s_stats.triggers,
+             (unsigned long)s_stats.dropped, (unsigned long)s_stats.skips);
+  }
+}
+
+void start_event_clips() {
+  s_preroll = alloc_bytes((size_t)kPrerollFrames * kFrameBytes);
+  s_upload_queue = xQueueCreate(kQueueClips, sizeof(Clip));
+  if (!s_preroll || !s_upload_queue) {
+    ESP_LOGE(TAG, "No RAM for the %u KB pre-roll, event clips disabled",
+             (unsigned)(kPrerollFrames * kFrameBytes / 1024));
+    return;
+  }
+  ESP_LOGI(TAG,
+           "Event clips: %d s before and %d s after a frame above %d dBFS "
+           "and %d dB over the background, %s, to %s:%d",
+           CONFIG_MIC_EVENT_PRE_SECONDS, CONFIG_MIC_EVENT_POST_SECONDS,
+           CONFIG_MIC_EVENT_THRESHOLD_DBFS, CONFIG_MIC_EVENT_RISE_DB,
+           kCodec == audio::frame::kCodecImaAdpcm ? "ADPCM" : "PCM16",
+           CONFIG_MIC_UPLOAD_HOST, CONFIG_MIC_UPLOAD_PORT);
+
+  TaskHandle_t task = nullptr;
+  // Same priority as the store task: behind the server, ahead of uploads.
+  xTaskCreate(clip_task, "mic_event", 4096, nullptr, 3, &task);
+  add_stream_reader(task);
+  xTaskCreate(upload_task, "mic_evup", 4096, nullptr, 2, nullptr);
+}
+
+} // namespace mic
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace mic {
+
+// Clips of loud events (CONFIG_MIC_EVENT_CLIP), instead of streaming
+// everything.
+//
+// The clip task keeps the last CONFIG_MIC_EVENT_PRE_SECONDS of the live
+// stream (IMA-ADPCM when built in, otherwise PCM16) in a pre-roll ring and
+// runs an audio::EventTrigger over the PCM16 frames. A firing is posted as
+// sys::EventType::AUDIO_TRIGGER on the miniOS event bus, and the task,
+// subscribed to it through the system manager, answers it by cutting a
+// clip from the pre-roll through CONFIG_MIC_EVENT_POST_SECONDS after the
+// trigger. Triggers during a clip push its end out, up to
+// CONFIG_MIC_EVENT_MAX_SECONDS.
+//
+// A finished clip is an info frame and v2 frames, like a store-and-forward
+// file, and is queued in RAM (PSRAM if there is any) for the upload task,
+// which sends it to CONFIG_MIC_UPLOAD_HOST:CONFIG_MIC_UPLOAD_PORT as
+// "UPLOAD evt<n>.mfr <bytes>\n" and waits for "OK\n"
+// (tools/receive_uploads.py), retrying every 10 s. Clips that would take
+// the queue past CONFIG_MIC_EVENT_QUEUE_KB are dropped.
+
+// Starts the clip and upload tasks. Call after start_stream_server() and
+// sys::start_system_manager().
+void start_event_clips();
+
+} // namespace mic
@@ -0,0 +1,192 @@
+#include "i2s_capture.h"
+#include "audio_format.h"
+#include "sample_math.h"
+
+extern "C" {
+#include "driver/i2s_std.h"
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+}
+#include "driver/gpio.h"
+#include <atomic>
+
+static const char *TAG = "MIC_I2S";
+
+namespace mic {
+
+static constexpr gpio_num_t I2S_SCK = GPIO_NUM_4; // BCLK
+static constexpr gpio_num_t I2S_WS = GPIO_NUM_5;  // WS / LRCLK
+static constexpr gpio_num_t I2S_SD = GPIO_NUM_6;  // DATA
+
+static constexpr uint32_t kDescNum = CONFIG_MIC_I2S_DMA_DESC_NUM;
+static constexpr uint32_t kFrameNum = CONFIG_MIC_I2S_DMA_FRAME_NUM;
+#if CONFIG_MIC_I2S_SLOT_UNPACK
+static constexpr bool kDropDuplicateSlot = true;
+#else
+static constexpr bool kDropDuplicateSlot = false;
+#endif
+#if CONFIG_MIC_I2S_CLK_APLL
+static constexpr bool kApllClock = true;
+#else
+static constexpr bool kApllClock = false;
+#endif
+
+// Completed buffers as posted by the interrupt, indexed by completion count.
+// Only the last kDescNum entries can still be valid, so this just has to be
+// at least that long.
+static constexpr uint32_t kSlots = 16;
+static_assert(kDescNum <= kSlots, "raise kSlots with the descriptor count");
+
+struct Slot {
+  int32_t *samples;
+  uint32_t bytes;
+  int64_t done_us;
+};
+
+static i2s_chan_handle_t s_rx = nullptr;
+static Slot s_slots[kSlots];
+static std::atomic<uint32_t> s_posted{0}; // buffers completed, ISR-owned
+static TaskHandle_t s_consumer = nullptr;
+static bool s_enabled = false;
+
+// Consumer side, capture task only.
+static uint32_t s_taken = 0;   // completion count of the next buffer to read
+static uint32_t s_current = 0; // completion count of the borrowed buffer
+static CaptureStats s_stats = {};
+
+// Runs in the I2S interrupt for every completed DMA buffer. The driver also
+// queues the buffer for i2s_channel_read(); nobody reads that queue, so it
+// just keeps dropping its oldest entry.
+static bool IRAM_ATTR on_recv(i2s_chan_handle_t handle, i2s_event_data_t *event,
+                              void *arg) {
+  (void)handle;
+  (void)arg;
+  uint32_t n = s_posted.load(std::memory_order_relaxed);
+  Slot &slot = s_slots[n % kSlots];
+  slot.samples = (int32_t *)event->dma_buf;
+  slot.bytes = (uint32_t)event->size;
+  slot.done_us = esp_timer_get_time();
+  s_posted.store(n + 1, std::memory_order_release);
+
+  BaseType_t woken = pdFALSE;
+  if (s_consumer)
+    vTaskNotifyGiveFromISR(s_consumer, &woken);
+  return woken == pdTRUE;
+}
+
+void init_i2s_capture() {
+  i2s_chan_config_t chan_cfg =
+      I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
+  chan_cfg.dma_desc_num = kDescNum;
+  chan_cfg.dma_frame_num = kFrameNum;
+  ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, nullptr, &s_rx));
+
+  i2s_std_config_t std_cfg = {
+      .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(audio::kI2SAskedRate),
+      .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT,
+                                                      I2S_SLOT_MODE_MONO),
+      .gpio_cfg =
+          {
+              .mclk = I2S_GPIO_UNUSED,
+              .bclk = I2S_SCK,
+              .ws = I2S_WS,
+              .dout = I2S_GPIO_UNUSED,
+              .din = I2S_SD,
+              .invert_flags =
+                  {
+                      .mclk_inv = false,
+                      .bclk_inv = false,
+                      .ws_inv = false,
+                  },
+          },
+  };
+#if CONFIG_MIC_I2S_CLK_APLL
+  std_cfg.clk_cfg.clk_src = I2S_CLK_SRC_APLL;
+#endif
+#if CONFIG_MIC_I2S_SLOT_HW
+  // The INMP441 (L/R tied low) drives the left slot. Receiving only that
+  // slot is what keeps the DMA at one word per frame, so it is spelled out
+  // rather than left to the mono default.
+  std_cfg.slot_cfg.slot_mask = I2S_STD_SLOT_LEFT;
+#endif
+  ESP_ERROR_CHECK(i2s_channel_init_std_mode(s_rx, &std_cfg));
+
+  // Must be registered before the channel is enabled.
+  i2s_event_callbacks_t callbacks = {};
+  callbacks.on_recv = on_recv;
+  ESP_ERROR_CHECK(i2s_channel_register_event_callback(s_rx, &callbacks,
+                                                      nullptr));
+  ESP_LOGI(TAG,
+           "INMP441 microphone initialized, %lu DMA buffers of %lu frames, "
+           "%s, %s clock",
+           (unsigned long)kDescNum, (unsigned long)kFrameNum,
+           kDropDuplicateSlot ? "duplicate slot dropped in software"
+                              : "one slot selected in hardware",
+           kApllClock ? "APLL" : "default");
+}
+
+void begin_capture() {
+  s_consumer = xTaskGetCurrentTaskHandle();
+  if (!s_enabled) {
+    ESP_ERROR_CHECK(i2s_channel_enable(s_rx));
+    s_enabled = true;
+  }
+  s_taken = s_posted.load(std::memory_order_acquire);
+}
+
+void end_capture() {
+  if (s_enabled) {
+    ESP_ERROR_CHECK(i2s_channel_disable(s_rx));
+    s_enabled = false;
+  }
+  s_consumer = nullptr;
+}
+
+bool next_dma_block(DmaBlock *block, TickType_t wait) {
+  uint32_t posted;
+  while ((posted = s_posted.load(std::memory_order_acquire)) == s_taken) {
+    if (ulTaskNotifyTake(pdTRUE, wait) == 0)
+      return false;
+  }
+  s_stats.buffers = posted;
+
+  uint32_t backlog = posted - s_taken;
+  if (backlog > s_stats.max_backlog)
+    s_stats.max_backlog = backlog;
+  // The DMA engine refills the buffer completed as number c once number
+  // c + kDescNum - 1 is done. Reading one that is a buffer away from that
+  // would race it, so jump to the newest instead.
+  if (backlog >= kDescNum - 1) {
+    s_stats.overruns++;
+    s_stats.lost_buffers += backlog - 1;
+    s_taken = posted - 1;
+  }
+
+  const Slot &slot = s_slots[s_taken % kSlots];
+  int words = (int)(slot.bytes / sizeof(int32_t));
+  block->samples = slot.samples;
+  block->dma_words = words;
+  block->count =
+      kDropDuplicateSlot ? audio::drop_duplicate_slots(slot.samples, words)
+                         : words;
+  block->done_us = slot.done_us;
+  block->index = s_taken;
+  s_current = s_taken++;
+  return true;
+}
+
+bool release_dma_block() {
+  uint32_t posted = s_posted.load(std::memory_order_acquire);
+  if (posted - s_current < kDescNum)
+    return true;
+  s_stats.overruns++;
+  s_stats.lost_buffers++;
+  return false;
+}
+
+CaptureStats capture_stats() { return s_stats; }
+
+} // namespace mic
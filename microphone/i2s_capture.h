@@ -0,0 +1,68 @@
+#pragma once
+
+extern "C" {
+#include "freertos/FreeRTOS.h"
+}
+#include <stdint.h>
+
+namespace mic {
+
+// Callback-driven I2S receive. The driver's on_recv interrupt hands us each
+// DMA buffer as it completes; the capture task then processes the samples
+// straight out of DMA memory instead of copying them through
+// i2s_channel_read(). Buffer count and size come from
+// CONFIG_MIC_I2S_DMA_DESC_NUM / CONFIG_MIC_I2S_DMA_FRAME_NUM. The clock
+// comes from the default PLL divider, or from the APLL with
+// CONFIG_MIC_I2S_CLK_APLL where the chip has one.
+//
+// Blocks always hold one word per I2S frame. With CONFIG_MIC_I2S_SLOT_UNPACK
+// (the original ESP32, which DMAs both slot positions in mono mode) the
+// duplicate words are dropped in place before the block is handed out.
+//
+// The DMA engine never waits: it cycles through its buffers whether or not
+// they have been read. A capture task that falls so far behind that the
+// buffer it is about to read is (nearly) due to be refilled skips to the
+// newest one, and counts an overrun.
+
+struct CaptureStats {
+  uint32_t buffers;      // DMA buffers completed
+  uint32_t overruns;     // times the capture task fell behind the DMA
+  uint32_t lost_buffers; // buffers skipped or overwritten unprocessed
+  uint32_t max_backlog;  // most completed buffers ever waiting at once
+};
+
+// One completed DMA buffer, borrowed in place until release_dma_block().
+struct DmaBlock {
+  const int32_t *samples;
+  int count;       // words in samples, one per frame
+  int dma_words;   // words the DMA wrote, duplicates included
+  int64_t done_us; // esp_timer time of the interrupt, ~ the last sample
+  uint32_t index;  // completion count since the channel was created, so
+                   // (index + 1) * count frames have been captured by now,
+                   // lost buffers included
+};
+
+// Creates and configures the RX channel on the INMP441 pins. Call once.
+void init_i2s_capture();
+
+// Makes the calling task the consumer, starts the channel on the first
+// call, and drops any buffers completed while nobody was reading (for
+// example while clip mode was sending). Not counted as overruns.
+void begin_capture();
+
+// Stops the channel until the next begin_capture(): no interrupts and no
+// DMA traffic in between, and the INMP441 powers down with its clock gone
+// (it takes ~85 ms to wake, which the clip warm-up covers).
+void end_capture();
+
+// Waits up to wait for the next completed buffer. Returns false on timeout.
+bool next_dma_block(DmaBlock *block, TickType_t wait);
+
+// Done with the block from next_dma_block(). Returns false if the DMA
+// started refilling it before we finished, i.e. what was processed may be
+// partly newer audio; that counts as an overrun too.
+bool release_dma_block();
+
+CaptureStats capture_stats();
+
+} // namespace mic
@@ -1,6 +1,5 @@
 extern "C" {
 void app_main(void);
-#include "driver/i2s_std.h"
 #include "esp_err.h"
 #include "esp_event.h"
 #include "esp_log.h"
@@ -14,260 +13,454 @@ void app_main(void);
 #include "nvs_flash.h"
 #include "sdkconfig.h"
 }
-#include "driver/gpio.h"
-#include <math.h>
+#include "audio_format.h"
+#include "audio_stats.h"
+#include "capture_chain.h"
+#include "clip_buffer.h"
+#include "clock_drift.h"
+#include "event_clip.h"
+#include "i2s_capture.h"
+#include "net_util.h"
+#include "rtp_sender.h"
+#include "sample_math.h"
+#include "spectrum_server.h"
+#include "store_forward.h"
+#include "stream_server.h"
+#include "sys_event.h"
+#include "sys_manager.h"
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 
-static constexpr gpio_num_t I2S_SCK = GPIO_NUM_4; // BCLK
-static constexpr gpio_num_t I2S_WS = GPIO_NUM_5;  // WS / LRCLK
-static constexpr gpio_num_t I2S_SD = GPIO_NUM_6;  // DATA
-
 static constexpr uint16_t kTcpPort = 3333;
 
 static const char *TAG = "MICROPHONE";
 
-static i2s_chan_handle_t rx_handle = nullptr;
-
-static constexpr int kSeconds = 5;
-// I2S runs at 48 kHz so the INMP441 stays in its happy BCLK range (~3 MHz).
-// IDF's I2S driver in PHILIPS + MONO mode delivers BOTH slot positions to
-// DMA per frame (the inactive slot is a duplicate of the active one), so the
-// effective sample stream we receive is 2× the configured rate. We account
-// for that here: effective input rate = 96 kHz, decimate by 6 to land on
-// a clean 16 kHz output that downstream consumers expect.
-static constexpr int kI2SAskedRate = 48000;
-static constexpr int kI2SEffectiveRate = kI2SAskedRate * 2;
-static constexpr int kSampleRate = 16000;
-static constexpr int kDecimation = kI2SEffectiveRate / kSampleRate;
-static constexpr int kChannels = 1;
-static constexpr int kBitsPerSample = 16;
-static constexpr int kTotalSamples = kSeconds * kSampleRate;
-static constexpr int kChunkSamples = 256;
-static constexpr int kWarmupSamples = kI2SEffectiveRate / 20; // 50 ms
-
-static int32_t raw_chunk[kChunkSamples];
-static int16_t pcm_recording[kTotalSamples];
+using audio::kChannels;
+using audio::kChunkSamples;
+using audio::kDecimation;
+using audio::kI2SAskedRate;
+using audio::kI2SEffectiveRate;
+using audio::kSampleRate;
+
+static constexpr int kWarmupSamples = kI2SEffectiveRate / 10; // 100 ms
+static constexpr int kChunkOutMax = audio::CaptureChain::kChunkOutMax;
+
+static audio::CaptureChain s_chain;
+
+#if CONFIG_MIC_AGC
+static audio::Agc::Config agc_config() {
+  audio::Agc::Config c;
+  c.target_dbfs = CONFIG_MIC_AGC_TARGET_DBFS;
+  c.max_gain_db = CONFIG_MIC_AGC_MAX_GAIN_DB;
+  c.attack_ms = CONFIG_MIC_AGC_ATTACK_MS;
+  c.release_ms = CONFIG_MIC_AGC_RELEASE_MS;
+  c.gate_dbfs = CONFIG_MIC_AGC_GATE_DBFS;
+  return c;
+}
+#endif
+
+// Live levels, updated per chunk by the capture loop. Any task can read a
+// snapshot without locking.
+static audio::LevelMeter s_levels(kSampleRate);
 
 static EventGroupHandle_t s_wifi_event_group = nullptr;
 static constexpr int WIFI_CONNECTED_BIT = BIT0;
 
-static void i2s_init_mic() {
-  i2s_chan_config_t chan_cfg =
-      I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_0, I2S_ROLE_MASTER);
-  ESP_ERROR_CHECK(i2s_new_channel(&chan_cfg, nullptr, &rx_handle));
-
-  i2s_std_config_t std_cfg = {
-      .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(kI2SAskedRate),
-      .slot_cfg = I2S_STD_PHILIPS_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT,
-                                                      I2S_SLOT_MODE_MONO),
-      .gpio_cfg =
-          {
-              .mclk = I2S_GPIO_UNUSED,
-              .bclk = I2S_SCK,
-              .ws = I2S_WS,
-              .dout = I2S_GPIO_UNUSED,
-              .din = I2S_SD,
-              .invert_flags =
-                  {
-                      .mclk_inv = false,
-                      .bclk_inv = false,
-                      .ws_inv = false,
-                  },
-          },
-  };
-
-  ESP_ERROR_CHECK(i2s_channel_init_std_mode(rx_handle, &std_cfg));
-  ESP_ERROR_CHECK(i2s_channel_enable(rx_handle));
-  ESP_LOGI(TAG, "INMP441 microphone initialized");
+// Longest wait for a DMA buffer before the capture loop goes round again.
+// Buffers complete every few ms, so hitting it means the I2S clock stopped.
+static constexpr TickType_t kDmaWait = pdMS_TO_TICKS(100);
+
+// Runs the capture chain over one DMA buffer, in place, kChunkSamples at a
+// time. emit(out, produced, captured_us) gets each piece's output; out is
+// whatever dest(max) returned, which must hold max samples.
+template <typename Dest, typename Emit>
+static void process_block(const mic::DmaBlock &block, Dest &&dest,
+                          Emit &&emit) {
+  for (int off = 0; off < block.count; off += kChunkSamples) {
+    int n = block.count - off < kChunkSamples ? block.count - off
+                                              : kChunkSamples;
+    // The interrupt fires as the last sample of the buffer lands.
+    int64_t captured_us =
+        block.done_us -
+        (int64_t)(block.count - off - n) * 1000000 / kI2SEffectiveRate;
+    int16_t *out = dest(n / kDecimation + 1);
+    int produced = s_chain.process(block.samples + off, n, out);
+    emit(out, produced, captured_us);
+  }
 }
 
-static inline int16_t clamp_int16(int32_t x) {
-  if (x > 32767)
-    return 32767;
-  if (x < -32768)
-    return -32768;
-  return (int16_t)x;
+// Warm-up: discard ~100 ms of samples so the INMP441 is out of its ~85 ms
+// power-up and its internal filters settle before we start recording.
+static void discard_warmup() {
+  int discarded = 0;
+  mic::DmaBlock block;
+  while (discarded < kWarmupSamples) {
+    if (!mic::next_dma_block(&block, kDmaWait))
+      continue;
+    discarded += block.count;
+    mic::release_dma_block();
+  }
 }
 
-// INMP441 emits 24-bit signed audio MSB-justified in a 32-bit slot.
-// Shift right by 14 to keep the top 18 bits then clamp to int16 — gives
-// reasonable headroom for normal speech without the heavy clipping that
-// >> 8 caused.
-static inline int16_t sample32_to_16(int32_t sample) {
-  return clamp_int16(sample >> 14);
-}
+// Capture clock error against esp_timer, fed once per DMA buffer. Frames
+// are counted by completion number, so buffers the capture task lost still
+// count.
+struct ClockTracker {
+  audio::DriftEstimator estimate{kI2SEffectiveRate};
+  uint64_t frames = 0;
+  uint32_t last_index = 0;
+  bool started = false;
+
+  void reset() {
+    estimate.reset();
+    frames = 0;
+    started = false;
+  }
 
-static void log_recording_stats(int64_t capture_us, int64_t raw_samples_seen) {
-  int32_t min_v = INT32_MAX;
-  int32_t max_v = INT32_MIN;
-  int64_t sum = 0;
-  int64_t sum_sq = 0;
-  for (int i = 0; i < kTotalSamples; i++) {
-    int32_t s = pcm_recording[i];
-    if (s < min_v)
-      min_v = s;
-    if (s > max_v)
-      max_v = s;
-    sum += s;
-    sum_sq += (int64_t)s * s;
+  void update(const mic::DmaBlock &block) {
+    if (started)
+      frames += (uint64_t)(block.index - last_index) * (uint32_t)block.count;
+    started = true;
+    last_index = block.index;
+    estimate.update(frames, block.done_us);
   }
-  double mean = (double)sum / kTotalSamples;
-  double rms = sqrt((double)sum_sq / kTotalSamples);
+};
+
+static ClockTracker s_capture_clock;
+
+static void log_capture_stats() {
+  mic::CaptureStats st = mic::capture_stats();
+  ESP_LOGI(TAG,
+           "capture: %lu DMA buffers, %lu overruns (%lu buffers lost), "
+           "max backlog %lu/%d",
+           (unsigned long)st.buffers, (unsigned long)st.overruns,
+           (unsigned long)st.lost_buffers, (unsigned long)st.max_backlog,
+           CONFIG_MIC_I2S_DMA_DESC_NUM);
+}
+
+#if CONFIG_MIC_MODE_CLIP
+static void log_levels(const char *label, const audio::LevelWindow &w) {
+  ESP_LOGI(TAG,
+           "%s: min=%d max=%d mean=%.1f rms=%.1f dc=%.1f clips=%lu "
+           "(%lu samples)",
+           label, w.min, w.max, w.mean_q8 / 256.0, w.rms_q8 / 256.0,
+           w.dc_offset_q8 / 256.0, (unsigned long)w.clips,
+           (unsigned long)w.samples);
+}
 
+// A clip is recorded when a client asks for one and lives in a ClipBuffer
+// until it has been sent. The client may send one request line right after
+// connecting; without it (older clients) it gets the Kconfig defaults.
+//
+//   RECORD <seconds> [<rate> [auto|internal|psram]]
+//
+// The reply is "PCM16 <rate> <channels> <samples>\n" and the samples, or
+// "ERR <reason>\n".
+struct ClipRequest {
+  int seconds = CONFIG_MIC_CLIP_SECONDS;
+  int rate = kSampleRate;
+  mic::ClipPlacement placement = mic::ClipPlacement::Auto;
+};
+
+static constexpr int kRequestWaitMs = 500;
+
+// 8 kHz clips run the chain's 16 kHz output (after the AGC) through a
+// second decimator.
+using HalfRateDecimator = audio::FirDecimator<kSampleRate, kSampleRate / 2>;
+
+// raw_samples_seen counts words as DMA delivered them, chain_samples_seen
+// after the duplicate slot is dropped.
+static void log_recording_stats(int64_t capture_us, int64_t raw_samples_seen,
+                                int64_t chain_samples_seen,
+                                const mic::ClipBuffer &clip, int rate) {
   double capture_s = (double)capture_us / 1e6;
   double effective_raw_rate = (double)raw_samples_seen / capture_s;
-  double effective_out_rate = (double)kTotalSamples / capture_s;
+  double effective_chain_rate = (double)chain_samples_seen / capture_s;
+  double effective_out_rate = (double)clip.samples() / capture_s;
+#if CONFIG_MIC_I2S_SLOT_UNPACK
+  const char *slots = "both slots";
+  int expected_raw = audio::kI2SDuplicatedRate;
+#else
+  const char *slots = "one slot";
+  int expected_raw = kI2SAskedRate;
+#endif
 
   ESP_LOGI(TAG,
-           "stats: wall=%.3fs (expected %ds) | raw_samples=%lld | "
-           "effective_raw=%.0f Hz (asked %d, expected %d after driver 2x) | "
+           "stats: wall=%.3fs (expected %.3fs) | raw_samples=%lld | "
+           "effective_raw=%.0f Hz (asked %d, expected %d for %s) | "
+           "chain_in=%.0f Hz (expected %d) | "
            "effective_out=%.0f Hz (claimed %d)",
-           capture_s, kSeconds, (long long)raw_samples_seen, effective_raw_rate,
-           kI2SAskedRate, kI2SEffectiveRate, effective_out_rate, kSampleRate);
-  ESP_LOGI(TAG, "samples: min=%ld max=%ld mean=%.1f rms=%.1f", (long)min_v,
-           (long)max_v, mean, rms);
+           capture_s, (double)clip.samples() / rate,
+           (long long)raw_samples_seen, effective_raw_rate, kI2SAskedRate,
+           expected_raw, slots, effective_chain_rate, kI2SEffectiveRate,
+           effective_out_rate, rate);
+  ESP_LOGI(TAG, "clock: %+.2f ppm against esp_timer",
+           s_capture_clock.estimate.ppm_q8() / 256.0);
+  log_levels("samples", s_levels.snapshot().total);
+  if (const audio::Agc *agc = s_chain.agc()) {
+    audio::AgcStats st = agc->stats();
+    ESP_LOGI(TAG,
+             "agc: gain=%.1f dB (last chunk rms=%.1f peak=%.1f dBFS), "
+             "limited=%lu held=%lu of %lu chunks, clips=%lu",
+             st.gain_db_q8 / 256.0, st.rms_dbfs_q8 / 256.0,
+             st.peak_dbfs_q8 / 256.0, (unsigned long)st.limited_blocks,
+             (unsigned long)st.held_blocks, (unsigned long)st.blocks,
+             (unsigned long)st.clips);
+  }
+  log_capture_stats();
 }
 
-static void read_mic_data() {
-  // Warm-up: discard ~50 ms of samples so the INMP441's internal filters
-  // settle before we start recording.
-  int discarded = 0;
-  while (discarded < kWarmupSamples) {
-    size_t bytes_read = 0;
-    esp_err_t err = i2s_channel_read(rx_handle, raw_chunk, sizeof(raw_chunk),
-                                     &bytes_read, portMAX_DELAY);
-    if (err != ESP_OK) {
-      ESP_LOGE(TAG, "warmup i2s_channel_read failed: %s", esp_err_to_name(err));
-      continue;
-    }
-    discarded += (int)(bytes_read / sizeof(int32_t));
-  }
+// Halves the rate of n 16 kHz samples in place. Returns the number left,
+// at most n / 2 + 1.
+static int halve_rate(HalfRateDecimator &decimator, int16_t *pcm, int n) {
+  int32_t wide[kChunkOutMax];
+  int32_t narrow[kChunkOutMax / 2 + 1];
+  // Back to the raw scale sample32_to_16 takes down from.
+  for (int i = 0; i < n; i++)
+    wide[i] = (int32_t)pcm[i] * (1 << 14);
+  int produced = decimator.process(wide, n, narrow);
+  for (int i = 0; i < produced; i++)
+    pcm[i] = audio::sample32_to_16(narrow[i]);
+  return produced;
+}
+
+// Fills clip with rate Hz samples.
+static void record_clip(mic::ClipBuffer &clip, int rate) {
+  mic::begin_capture();
+  discard_warmup();
 
   int64_t t_start = esp_timer_get_time();
   int64_t raw_samples_seen = 0;
+  int64_t chain_samples_seen = 0;
 
+  const int total = clip.samples();
+  int16_t *pcm = clip.data();
   int written_samples = 0;
-  int64_t accum = 0;
-  int accum_count = 0;
-  while (written_samples < kTotalSamples) {
-    size_t bytes_read = 0;
-    esp_err_t err = i2s_channel_read(rx_handle, raw_chunk, sizeof(raw_chunk),
-                                     &bytes_read, portMAX_DELAY);
-
-    if (err != ESP_OK) {
-      ESP_LOGE(TAG, "i2s_channel_read failed: %s", esp_err_to_name(err));
-      continue;
-    }
-
-    int samples_read = (int)(bytes_read / sizeof(int32_t));
-    if (samples_read <= 0) {
+  s_chain.reset();
+  s_levels.reset();
+  s_capture_clock.reset();
+  const bool halve = rate != kSampleRate;
+  HalfRateDecimator half;
+  int16_t spill[kChunkOutMax];
+  // At 16 kHz decimate straight into the clip; only the last piece, which
+  // may produce more than is left, goes through spill. 8 kHz always does.
+  auto dest = [&](int max) {
+    return !halve && total - written_samples >= max ? &pcm[written_samples]
+                                                    : spill;
+  };
+  auto emit = [&](int16_t *out, int produced, int64_t captured_us) {
+    (void)captured_us;
+    s_levels.process(out, produced);
+    if (halve)
+      produced = halve_rate(half, out, produced);
+    if (produced > total - written_samples)
+      produced = total - written_samples;
+    if (out == spill)
+      memcpy(&pcm[written_samples], spill, (size_t)produced * sizeof(int16_t));
+    written_samples += produced;
+  };
+  mic::DmaBlock block;
+  while (written_samples < total) {
+    if (!mic::next_dma_block(&block, kDmaWait))
       continue;
-    }
-    raw_samples_seen += samples_read;
-
-    for (int i = 0; i < samples_read && written_samples < kTotalSamples; i++) {
-      accum += raw_chunk[i];
-      accum_count++;
-      if (accum_count == kDecimation) {
-        int32_t avg = (int32_t)(accum / kDecimation);
-        pcm_recording[written_samples++] = sample32_to_16(avg);
-        accum = 0;
-        accum_count = 0;
-      }
-    }
+    raw_samples_seen += block.dma_words;
+    chain_samples_seen += block.count;
+    s_capture_clock.update(block);
+    process_block(block, dest, emit);
+    mic::release_dma_block();
   }
+  // Nothing runs on the I2S side until the next clip.
+  mic::end_capture();
 
   int64_t capture_us = esp_timer_get_time() - t_start;
 
   ESP_LOGI(TAG,
            "Recorded %d samples at %d Hz (I2S asked %d, effective %d, "
            "decimation %dx)",
-           written_samples, kSampleRate, kI2SAskedRate, kI2SEffectiveRate,
-           kDecimation);
-  log_recording_stats(capture_us, raw_samples_seen);
+           written_samples, rate, kI2SAskedRate, kI2SEffectiveRate,
+           kI2SEffectiveRate / rate);
+  log_recording_stats(capture_us, raw_samples_seen, chain_samples_seen, clip,
+                      rate);
 }
 
-static bool send_all(int sock, const void *data, size_t len) {
-  const uint8_t *p = (const uint8_t *)data;
-  while (len > 0) {
-    int sent = send(sock, p, len, 0);
-    if (sent < 0) {
-      ESP_LOGE(TAG, "send failed: errno %d", errno);
-      return false;
-    }
-    p += sent;
-    len -= (size_t)sent;
+// Reads the optional request line into req. Returns the reason the request
+// cannot be served, or nullptr.
+static const char *read_clip_request(int client, ClipRequest *req) {
+  timeval tv = {};
+  tv.tv_usec = kRequestWaitMs * 1000;
+  setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  char line[64];
+  int len = 0;
+  while (len < (int)sizeof(line) - 1 && recv(client, &line[len], 1, 0) == 1 &&
+         line[len] != '\n')
+    len++;
+  line[len] = '\0';
+  if (len == 0)
+    return nullptr;
+  if (strncmp(line, "RECORD ", 7) != 0) {
+    ESP_LOGW(TAG, "Client sent '%s', recording the default clip", line);
+    return nullptr;
   }
-  return true;
+
+  char where[12] = "auto";
+  if (sscanf(line + 7, "%d %d %11s", &req->seconds, &req->rate, where) < 1)
+    return "bad request";
+  if (req->seconds < 1 || req->seconds > CONFIG_MIC_CLIP_MAX_SECONDS)
+    return "seconds out of range";
+  if (req->rate != kSampleRate && req->rate != kSampleRate / 2)
+    return "unsupported rate";
+  if (!mic::parse_clip_placement(where, &req->placement))
+    return "unknown placement";
+  return nullptr;
 }
 
-static void serve_one_client(int listen_sock) {
-  struct sockaddr_in client_addr;
-  socklen_t addr_len = sizeof(client_addr);
-  int client = accept(listen_sock, (struct sockaddr *)&client_addr, &addr_len);
-  if (client < 0) {
-    ESP_LOGE(TAG, "accept failed: errno %d", errno);
+static void serve_clip(int client) {
+  ClipRequest req;
+  mic::ClipBuffer clip;
+  const char *error = read_clip_request(client, &req);
+  if (!error && !clip.allocate(req.seconds * req.rate, req.placement))
+    error = "out of memory";
+  if (error) {
+    ESP_LOGW(TAG, "Clip refused: %s", error);
+    char reply[48];
+    int len = snprintf(reply, sizeof(reply), "ERR %s\n", error);
+    mic::send_all(client, reply, (size_t)len);
     return;
   }
 
-  char ip_str[INET_ADDRSTRLEN] = {0};
-  inet_ntoa_r(client_addr.sin_addr, ip_str, sizeof(ip_str));
-  ESP_LOGI(TAG, "Client connected from %s", ip_str);
+  ESP_LOGI(TAG, "Recording %d s at %d Hz into %s RAM (%u bytes)",
+           req.seconds, req.rate, mic::clip_placement_name(clip.placement()),
+           (unsigned)clip.bytes());
+  record_clip(clip, req.rate);
 
   char header[64];
   int header_len = snprintf(header, sizeof(header), "PCM16 %d %d %d\n",
-                            kSampleRate, kChannels, kTotalSamples);
-
-  bool ok = send_all(client, header, (size_t)header_len);
-  if (ok) {
-    ok = send_all(client, pcm_recording,
-                  (size_t)kTotalSamples * sizeof(int16_t));
-  }
-  if (ok) {
-    ESP_LOGI(TAG, "Sent %d bytes of PCM",
-             (int)(kTotalSamples * sizeof(int16_t)));
-  }
-  close(client);
+                            req.rate, kChannels, clip.samples());
+  bool ok = mic::send_all(client, header, (size_t)header_len);
+  if (ok)
+    ok = mic::send_all(client, clip.data(), clip.bytes());
+  if (ok)
+    ESP_LOGI(TAG, "Sent %u bytes of PCM", (unsigned)clip.bytes());
 }
 
-static void stream_pcm_over_tcp() {
-  int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+static void serve_clips_over_tcp() {
+  int listen_sock = mic::open_listen_socket(kTcpPort, 1);
   if (listen_sock < 0) {
-    ESP_LOGE(TAG, "socket() failed: errno %d", errno);
     return;
   }
 
-  int opt = 1;
-  setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-  struct sockaddr_in addr = {};
-  addr.sin_family = AF_INET;
-  addr.sin_addr.s_addr = htonl(INADDR_ANY);
-  addr.sin_port = htons(kTcpPort);
-
-  if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-    ESP_LOGE(TAG, "bind failed: errno %d", errno);
-    close(listen_sock);
-    return;
+  mic::log_clip_heap("idle");
+  while (true) {
+    int client = mic::accept_client(listen_sock);
+    if (client < 0)
+      continue;
+    serve_clip(client);
+    close(client);
+    mic::log_clip_heap("idle");
   }
+}
 
-  if (listen(listen_sock, 1) < 0) {
-    ESP_LOGE(TAG, "listen failed: errno %d", errno);
-    close(listen_sock);
-    return;
-  }
+static void record_task(void *arg) {
+  (void)arg;
+  serve_clips_over_tcp();
+  vTaskDelete(nullptr);
+}
+#else
+// Gain the capture chain is scaling with now, dB Q8.
+static int16_t capture_gain_db_q8() {
+  const audio::Agc *agc = s_chain.agc();
+  return agc ? (int16_t)agc->gain_db_q8() : 0;
+}
 
-  ESP_LOGI(TAG, "Listening on TCP port %d — connect with the capture script",
-           kTcpPort);
+// Capture clock error for the stream frames, ppm Q4.
+static int16_t capture_drift_ppm_q4() {
+  int32_t q4 = s_capture_clock.estimate.ppm_q8() / 16;
+  if (q4 > INT16_MAX)
+    return INT16_MAX;
+  if (q4 < INT16_MIN)
+    return INT16_MIN;
+  return (int16_t)q4;
+}
 
+#if CONFIG_MIC_RESAMPLE
+static constexpr bool kResample = true;
+static audio::DriftResampler s_resampler;
+#else
+static constexpr bool kResample = false;
+#endif
+
+// Runs forever on the capture task: read, decimate, publish. Never blocks on
+// the network; subscribers read the shared ring at their own pace.
+static void capture_continuous() {
+  mic::begin_capture();
+  discard_warmup();
+
+  s_chain.reset();
+  s_levels.reset();
+  s_capture_clock.reset();
+  int16_t decimated[kChunkOutMax];
+  auto dest = [&](int) { return decimated; };
+#if CONFIG_MIC_RESAMPLE
+  // The estimate starts rough (a second's span) and tightens as its window
+  // fills; the resampler follows it block by block.
+  s_resampler.reset();
+  int16_t resampled[kChunkOutMax + kChunkOutMax / 512 + 2];
+#endif
+  auto emit = [&](int16_t *out, int produced, int64_t captured_us) {
+#if CONFIG_MIC_RESAMPLE
+    produced = s_resampler.process(out, produced, resampled);
+    out = resampled;
+#endif
+    s_levels.process(out, produced);
+    mic::publish_samples(out, produced, captured_us, capture_gain_db_q8(),
+                         capture_drift_ppm_q4());
+  };
+  mic::DmaBlock block;
+  uint32_t last_overruns = 0;
+  bool clock_logged = false;
+  int32_t logged_ppm_q8 = 0;
+  int64_t last_report_us = esp_timer_get_time();
   while (true) {
-    serve_one_client(listen_sock);
-    ESP_LOGI(TAG, "Re-recording for next client...");
-    read_mic_data();
+    if (!mic::next_dma_block(&block, kDmaWait))
+      continue;
+    s_capture_clock.update(block);
+#if CONFIG_MIC_RESAMPLE
+    s_resampler.set_ppm_q8(s_capture_clock.estimate.ppm_q8());
+#endif
+    process_block(block, dest, emit);
+    mic::release_dma_block();
+
+    // Every 10 s, but only once there is something to say.
+    int64_t now = esp_timer_get_time();
+    if (now - last_report_us >= 10 * 1000000) {
+      uint32_t overruns = mic::capture_stats().overruns;
+      if (overruns != last_overruns)
+        log_capture_stats();
+      last_overruns = overruns;
+      // The clock once it has a full window, then when it moves by 1 ppm.
+      int32_t ppm_q8 = s_capture_clock.estimate.ppm_q8();
+      int32_t moved = ppm_q8 - logged_ppm_q8;
+      if (s_capture_clock.estimate.settled() &&
+          (!clock_logged || moved >= 256 || moved <= -256)) {
+        ESP_LOGI(TAG, "capture clock %+.2f ppm against esp_timer%s",
+                 ppm_q8 / 256.0, kResample ? ", resampled to nominal" : "");
+        clock_logged = true;
+        logged_ppm_q8 = ppm_q8;
+      }
+      last_report_us = now;
+    }
   }
 }
 
+static void record_task(void *arg) {
+  (void)arg;
+  capture_continuous();
+  vTaskDelete(nullptr);
+}
+#endif
+
 static void wifi_event_handler(void *arg, esp_event_base_t event_base,
                                int32_t event_id, void *event_data) {
   if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
@@ -276,11 +469,17 @@ static void wifi_event_handler(void *arg, esp_event_base_t event_base,
              event_id == WIFI_EVENT_STA_DISCONNECTED) {
     ESP_LOGW(TAG, "Wi-Fi disconnected, retrying...");
     xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+#if CONFIG_MIC_STORE_FORWARD
+    mic::store_forward_set_online(false);
+#endif
     esp_wifi_connect();
   } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
     ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
     ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
     xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
+#if CONFIG_MIC_STORE_FORWARD
+    mic::store_forward_set_online(true);
+#endif
   }
 }
 
@@ -310,17 +509,25 @@ static void wifi_init_sta() {
   ESP_ERROR_CHECK(esp_wifi_start());
 
   ESP_LOGI(TAG, "Connecting to SSID '%s'...", CONFIG_WIFI_STA_SSID);
+#if CONFIG_MIC_STORE_FORWARD
+  // Capture starts right away; until Wi-Fi is up it goes to flash.
+#else
   xEventGroupWaitBits(s_wifi_event_group, WIFI_CONNECTED_BIT, pdFALSE, pdTRUE,
                       portMAX_DELAY);
   ESP_LOGI(TAG, "Wi-Fi connected");
+#endif
 }
 
-static void record_task(void *arg) {
+#if CONFIG_MIC_METRICS_DUMP_S > 0
+// The event bus metrics on the serial console, whatever else is built in.
+static void metrics_dump_task(void *arg) {
   (void)arg;
-  read_mic_data();
-  stream_pcm_over_tcp();
-  vTaskDelete(nullptr);
+  while (true) {
+    vTaskDelay(pdMS_TO_TICKS(CONFIG_MIC_METRICS_DUMP_S * 1000));
+    sys::print_event_metrics(stdout);
+  }
 }
+#endif
 
 extern "C" void app_main(void) {
   esp_err_t ret = nvs_flash_init();
@@ -331,7 +538,33 @@ extern "C" void app_main(void) {
   }
   ESP_ERROR_CHECK(ret);
 
+  sys::init_event_bus();
+  sys::start_system_manager();
+#if CONFIG_MIC_METRICS_DUMP_S > 0
+  xTaskCreate(metrics_dump_task, "metrics_dump", 3072, nullptr, 1, nullptr);
+#endif
   wifi_init_sta();
-  i2s_init_mic();
+  mic::init_i2s_capture();
+#if CONFIG_MIC_DC_BLOCK
+  s_chain.enable_dc_block(CONFIG_MIC_DC_BLOCK_HZ);
+#endif
+#if CONFIG_MIC_AGC
+  s_chain.enable_agc(agc_config());
+#endif
+#if !CONFIG_MIC_MODE_CLIP
+  mic::start_stream_server(kTcpPort, &s_levels);
+#if CONFIG_MIC_RTP
+  mic::start_rtp_sender(CONFIG_MIC_RTP_DEST_IP, CONFIG_MIC_RTP_PORT);
+#endif
+#if CONFIG_MIC_STORE_FORWARD
+  mic::start_store_forward();
+#endif
+#if CONFIG_MIC_EVENT_CLIP
+  mic::start_event_clips();
+#endif
+#if CONFIG_MIC_SPECTRUM
+  mic::start_spectrum_server(CONFIG_MIC_SPECTRUM_HTTP_PORT);
+#endif
+#endif
   xTaskCreate(record_task, "record_task", 10000, nullptr, 5, nullptr);
 }
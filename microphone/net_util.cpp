@@ -0,0 +1,118 @@
+#include "net_util.h"
+
+extern "C" {
+#include "esp_log.h"
+#include "lwip/sockets.h"
+}
+#include <string.h>
+
+static const char *TAG = "MIC_NET";
+
+namespace mic {
+
+bool send_all(int sock, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  while (len > 0) {
+    int sent = send(sock, p, len, 0);
+    if (sent < 0) {
+      ESP_LOGE(TAG, "send failed: errno %d", errno);
+      return false;
+    }
+    p += sent;
+    len -= (size_t)sent;
+  }
+  return true;
+}
+
+int open_listen_socket(uint16_t port, int backlog) {
+  int listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (listen_sock < 0) {
+    ESP_LOGE(TAG, "socket() failed: errno %d", errno);
+    return -1;
+  }
+
+  int opt = 1;
+  setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+
+  if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    ESP_LOGE(TAG, "bind failed: errno %d", errno);
+    close(listen_sock);
+    return -1;
+  }
+
+  if (listen(listen_sock, backlog) < 0) {
+    ESP_LOGE(TAG, "listen failed: errno %d", errno);
+    close(listen_sock);
+    return -1;
+  }
+
+  ESP_LOGI(TAG, "Listening on TCP port %d — connect with the capture script",
+           port);
+  return listen_sock;
+}
+
+int accept_client(int listen_sock) {
+  struct sockaddr_in client_addr;
+  socklen_t addr_len = sizeof(client_addr);
+  int client = accept(listen_sock, (struct sockaddr *)&client_addr, &addr_len);
+  if (client < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      ESP_LOGE(TAG, "accept failed: errno %d", errno);
+    }
+    return -1;
+  }
+
+  char ip_str[INET_ADDRSTRLEN] = {0};
+  inet_ntoa_r(client_addr.sin_addr, ip_str, sizeof(ip_str));
+  ESP_LOGI(TAG, "Client connected from %s", ip_str);
+  return client;
+}
+
+int connect_to(const char *ip, uint16_t port, int timeout_ms) {
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  if (inet_aton(ip, &addr.sin_addr) == 0) {
+    ESP_LOGE(TAG, "Bad address '%s'", ip);
+    return -1;
+  }
+
+  int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (sock < 0) {
+    ESP_LOGE(TAG, "socket() failed: errno %d", errno);
+    return -1;
+  }
+  struct timeval tv = {};
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+  setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+  if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    ESP_LOGW(TAG, "connect to %s:%d failed: errno %d", ip, port, errno);
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+bool wait_ok(int sock) {
+  char line[16];
+  size_t len = 0;
+  while (len < sizeof(line)) {
+    int got = recv(sock, &line[len], 1, 0);
+    if (got <= 0)
+      return false;
+    if (line[len] == '\n')
+      return len == 2 && memcmp(line, "OK", 2) == 0;
+    len++;
+  }
+  return false;
+}
+
+} // namespace mic
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace mic {
+
+// Blocking send of the whole buffer. Logs and returns false on error.
+bool send_all(int sock, const void *data, size_t len);
+
+// TCP listen socket on INADDR_ANY:port, or -1 (already logged).
+int open_listen_socket(uint16_t port, int backlog);
+
+// accept() that logs the peer address. Returns -1 on error or, for a
+// non-blocking listen socket, when nobody is waiting.
+int accept_client(int listen_sock);
+
+// TCP connection to ip:port with send and receive timeouts of timeout_ms
+// (also bounding a blocking send_all()), or -1 (already logged).
+int connect_to(const char *ip, uint16_t port, int timeout_ms);
+
+// Reads one line and returns true if it is "OK", the upload host's
+// acknowledgement (tools/receive_uploads.py).
+bool wait_ok(int sock);
+
+} // namespace mic
@@ -0,0 +1,194 @@
+#include "rtp_sender.h"
+#include "audio_format.h"
+#include "stream_frame.h"
+#include "stream_server.h"
+
+extern "C" {
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+}
+#include <string.h>
+
+static const char *TAG = "MIC_RTP";
+
+namespace mic {
+
+#if CONFIG_MIC_RTP_PACKET_10MS
+static constexpr int kPacketMs = 10;
+#else
+static constexpr int kPacketMs = 20;
+#endif
+static constexpr int kFramesPerPacket = kPacketMs / 10;
+static constexpr uint32_t kPacketSamples = kPcmFrameSamples * kFramesPerPacket;
+static constexpr uint32_t kFramePayloadBytes =
+    kPcmFrameSamples * sizeof(int16_t);
+static constexpr uint32_t kFrameBytes =
+    audio::frame::kHeaderBytes + kFramePayloadBytes;
+static constexpr uint32_t kPacketBytes = kPacketSamples * sizeof(int16_t);
+static constexpr int kRtpHeaderBytes = 12;
+static constexpr uint8_t kPayloadType = 96; // dynamic: L16/16000/1
+static constexpr int64_t kReportUs = 10 * 1000000;
+
+static uint8_t s_packet[kRtpHeaderBytes + kPacketBytes];
+
+static int s_sock = -1;
+static struct sockaddr_in s_dest;
+static uint32_t s_ssrc = 0;
+static uint32_t s_ts_offset = 0; // RTP timestamp = capture clock + offset
+static uint16_t s_seq = 0;
+
+static uint32_t s_sent = 0;
+static uint32_t s_dropped = 0; // lwIP had no room, packet discarded
+static uint32_t s_skips = 0;   // fell behind the ring, jumped to live
+static uint64_t s_skipped_samples = 0;
+
+static void put_be16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)(v >> 8);
+  p[1] = (uint8_t)v;
+}
+
+static void put_be32(uint8_t *p, uint32_t v) {
+  p[0] = (uint8_t)(v >> 24);
+  p[1] = (uint8_t)(v >> 16);
+  p[2] = (uint8_t)(v >> 8);
+  p[3] = (uint8_t)v;
+}
+
+// Builds and sends the packet holding the kFramesPerPacket ring frames at
+// pos. Returns false if pos is not on a frame.
+static bool send_packet(const audio::BroadcastRing &ring, uint32_t pos,
+                        bool marker) {
+  uint8_t *out = &s_packet[kRtpHeaderBytes];
+  for (int f = 0; f < kFramesPerPacket; f++) {
+    uint8_t raw[audio::frame::kHeaderBytes];
+    audio::frame::Header h;
+    ring.copy(pos, raw, sizeof(raw));
+    if (!audio::frame::parse_header(raw, &h) ||
+        h.payload_bytes != kFramePayloadBytes)
+      return false;
+    if (f == 0)
+      put_be32(&s_packet[4], h.sample_index + s_ts_offset);
+    pos += audio::frame::kHeaderBytes;
+
+    // L16 is network byte order; the frames hold little-endian samples. pos
+    // and the ring size are even, so no sample straddles the wrap.
+    uint32_t left = kFramePayloadBytes;
+    while (left > 0) {
+      const uint8_t *data;
+      size_t len = ring.peek(pos, &data, left);
+      for (size_t i = 0; i < len; i += 2) {
+        out[i] = data[i + 1];
+        out[i + 1] = data[i];
+      }
+      out += len;
+      pos += (uint32_t)len;
+      left -= (uint32_t)len;
+    }
+  }
+
+  s_packet[0] = 0x80; // V=2, no padding, no extension, no CSRCs
+  s_packet[1] = (uint8_t)((marker ? 0x80 : 0) | kPayloadType);
+  put_be16(&s_packet[2], s_seq);
+  put_be32(&s_packet[8], s_ssrc);
+  s_seq++;
+
+  int sent = sendto(s_sock, s_packet, sizeof(s_packet), MSG_DONTWAIT,
+                    (struct sockaddr *)&s_dest, sizeof(s_dest));
+  if (sent < 0) {
+    // ENOMEM/EAGAIN: out of pbufs or the Wi-Fi TX queue is full. Real-time
+    // audio is better off losing this packet than waiting for room.
+    if (errno != ENOMEM && errno != EAGAIN && errno != EWOULDBLOCK)
+      ESP_LOGW(TAG, "sendto failed: errno %d", errno);
+    s_dropped++;
+    return true;
+  }
+  s_sent++;
+  return true;
+}
+
+static void rtp_task(void *arg) {
+  (void)arg;
+  const audio::BroadcastRing &ring = live_pcm_ring();
+  uint32_t capacity = (uint32_t)ring.capacity();
+  uint32_t pos = ring.head();
+  bool marker = true;
+  int64_t last_report_us = esp_timer_get_time();
+
+  while (true) {
+    // Woken by every captured chunk, so a packet leaves as soon as it is
+    // complete.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+    uint32_t lag = ring.head() - pos;
+    // Same guard as the TCP server: the last quarter of the ring may be
+    // overwritten while we copy out of it. The timestamps come from the
+    // frames, so a skip shows up as a timestamp jump on its own.
+    if (lag > capacity - capacity / 4) {
+      uint32_t frames = lag / kFrameBytes - kFramesPerPacket;
+      pos += frames * kFrameBytes;
+      lag -= frames * kFrameBytes;
+      s_skips++;
+      s_skipped_samples += frames * kPcmFrameSamples;
+      marker = true;
+    }
+
+    while (lag >= kFramesPerPacket * kFrameBytes) {
+      if (!send_packet(ring, pos, marker)) {
+        ESP_LOGE(TAG, "Lost frame alignment, restarting at live");
+        pos = ring.head();
+        marker = true;
+        break;
+      }
+      marker = false;
+      pos += kFramesPerPacket * kFrameBytes;
+      lag -= kFramesPerPacket * kFrameBytes;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (now - last_report_us >= kReportUs) {
+      ESP_LOGI(TAG, "sent=%lu dropped=%lu skips=%lu (%llu samples)",
+               (unsigned long)s_sent, (unsigned long)s_dropped,
+               (unsigned long)s_skips, (unsigned long long)s_skipped_samples);
+      last_report_us = now;
+    }
+  }
+}
+
+void start_rtp_sender(const char *dest_ip, uint16_t port) {
+  memset(&s_dest, 0, sizeof(s_dest));
+  s_dest.sin_family = AF_INET;
+  s_dest.sin_port = htons(port);
+  if (inet_aton(dest_ip, &s_dest.sin_addr) == 0) {
+    ESP_LOGE(TAG, "Bad RTP destination '%s', RTP disabled", dest_ip);
+    return;
+  }
+
+  s_sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+  if (s_sock < 0) {
+    ESP_LOGE(TAG, "socket() failed: errno %d", errno);
+    return;
+  }
+  // DSCP EF. With WMM this puts the packets in the Wi-Fi voice queue,
+  // ahead of the TCP subscribers' bulk traffic.
+  int tos = 0xb8;
+  setsockopt(s_sock, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+
+  // RFC 3550 wants random starting values so streams are not confused
+  // across restarts.
+  s_ssrc = esp_random();
+  s_ts_offset = esp_random();
+  s_seq = (uint16_t)esp_random();
+
+  TaskHandle_t task = nullptr;
+  xTaskCreate(rtp_task, "mic_rtp", 3072, nullptr, 4, &task);
+  add_stream_reader(task);
+  ESP_LOGI(TAG, "RTP L16/%d/%d, %d ms packets, to %s:%d", audio::kSampleRate,
+           audio::kChannels, kPacketMs, dest_ip, port);
+}
+
+} // namespace mic
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace mic {
+
+// Sends the live PCM16 stream as RTP over UDP (RFC 3550/3551) to a fixed
+// destination, next to the TCP server. Payload is L16 mono, big-endian,
+// dynamic payload type 96 at the output sample rate; the RTP timestamp is
+// the sample clock. Packets are CONFIG_MIC_RTP_PACKET_* long.
+//
+// Nothing is ever retransmitted or waited for: a packet lwIP cannot take
+// right away is dropped and counted, and if the sender falls behind the
+// capture ring it skips ahead to live audio, leaving a timestamp gap.
+void start_rtp_sender(const char *dest_ip, uint16_t port);
+
+} // namespace mic
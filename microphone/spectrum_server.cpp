@@ -0,0 +1,199 @@
+#include "spectrum_server.h"
+#include "audio_format.h"
+#include "seqlock.h"
+#include "spectrum.h"
+#include "stream_frame.h"
+#include "stream_server.h"
+#include "sys_event.h"
+
+extern "C" {
+#include "esp_cpu.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+}
+#include <stdio.h>
+
+static const char *TAG = "MIC_FFT";
+
+namespace mic {
+
+static constexpr uint32_t kFramePayloadBytes =
+    kPcmFrameSamples * sizeof(int16_t);
+static constexpr uint32_t kFrameBytes =
+    audio::frame::kHeaderBytes + kFramePayloadBytes;
+static constexpr int64_t kReportUs =
+    (int64_t)CONFIG_MIC_SPECTRUM_REPORT_MS * 1000;
+static constexpr int64_t kLogUs = 10 * 1000000;
+static constexpr int kBands = audio::SpectrumAnalyzer::kBands;
+
+struct Published {
+  audio::SpectrumReport report;
+  uint32_t seq;
+  uint32_t cycles_per_frame; // mean over the report's frames
+  uint32_t cycles_per_frame_max;
+  uint32_t skips;
+};
+
+static audio::SpectrumAnalyzer s_analyzer;
+static audio::SeqLock<Published> s_published;
+
+static void spectrum_task(void *arg) {
+  (void)arg;
+  const audio::BroadcastRing &ring = live_pcm_ring();
+  uint32_t capacity = (uint32_t)ring.capacity();
+  uint32_t pos = ring.head();
+  int16_t pcm[kPcmFrameSamples];
+
+  Published out = {};
+  uint64_t cycles = 0;
+  uint32_t frames = 0;
+  int64_t next_report_us = esp_timer_get_time() + kReportUs;
+  int64_t last_log_us = esp_timer_get_time();
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+
+    uint32_t lag = ring.head() - pos;
+    // Same guard as the RTP sender. A skip costs the frame it lands in a
+    // splice, which is noise in a half-second average.
+    if (lag > capacity - capacity / 4) {
+      uint32_t skipped = lag / kFrameBytes - 1;
+      pos += skipped * kFrameBytes;
+      lag -= skipped * kFrameBytes;
+      out.skips++;
+    }
+
+    while (lag >= kFrameBytes) {
+      uint8_t raw[audio::frame::kHeaderBytes];
+      audio::frame::Header h;
+      ring.copy(pos, raw, sizeof(raw));
+      if (!audio::frame::parse_header(raw, &h) ||
+          h.payload_bytes != kFramePayloadBytes) {
+        ESP_LOGE(TAG, "Lost frame alignment, restarting at live");
+        pos = ring.head();
+        break;
+      }
+      ring.copy(pos + audio::frame::kHeaderBytes, pcm, kFramePayloadBytes);
+      pos += kFrameBytes;
+      lag -= kFrameBytes;
+
+      // A 10 ms ring frame completes at most one 8 ms hop, so this times
+      // one FFT frame or none.
+      esp_cpu_cycle_count_t start = esp_cpu_get_cycle_count();
+      int done = s_analyzer.process(pcm, kPcmFrameSamples);
+      uint32_t spent = (uint32_t)(esp_cpu_get_cycle_count() - start);
+      if (done > 0) {
+        cycles += spent;
+        frames += (uint32_t)done;
+        if (spent / done > out.cycles_per_frame_max)
+          out.cycles_per_frame_max = spent / done;
+      }
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (now < next_report_us)
+      continue;
+    next_report_us += kReportUs;
+    if (next_report_us <= now)
+      next_report_us = now + kReportUs;
+
+    out.report = s_analyzer.take_report();
+    out.seq++;
+    out.cycles_per_frame = frames ? (uint32_t)(cycles / frames) : 0;
+    s_published.publish(out);
+    if (now - last_log_us >= kLogUs) {
+      ESP_LOGI(TAG,
+               "level=%.1f dBFS peak=%lu Hz (%.1f dBFS), %lu cycles/frame "
+               "(max %lu), skips=%lu",
+               out.report.level_dbfs_q8 / 256.0,
+               (unsigned long)out.report.peak_hz,
+               out.report.peak_dbfs_q8 / 256.0,
+               (unsigned long)out.cycles_per_frame,
+               (unsigned long)out.cycles_per_frame_max,
+               (unsigned long)out.skips);
+      last_log_us = now;
+    }
+    cycles = 0;
+    frames = 0;
+    out.cycles_per_frame_max = 0;
+  }
+}
+
+static esp_err_t spectrum_get(httpd_req_t *req) {
+  Published p = s_published.read();
+  const audio::SpectrumReport &r = p.report;
+  char body[512];
+  int len = snprintf(body, sizeof(body),
+                     "{\"seq\":%lu,\"rate\":%d,\"fft\":%d,\"frames\":%lu,"
+                     "\"period_ms\":%d,\"bands_hz\":[",
+                     (unsigned long)p.seq, audio::kSampleRate,
+                     audio::SpectrumAnalyzer::kFftSize,
+                     (unsigned long)r.frames, CONFIG_MIC_SPECTRUM_REPORT_MS);
+  for (int b = 0; b < kBands; b++)
+    len += snprintf(&body[len], sizeof(body) - len, "%s%d", b ? "," : "",
+                    s_analyzer.band_low_hz(b));
+  len += snprintf(&body[len], sizeof(body) - len, "],\"bands_dbfs\":[");
+  for (int b = 0; b < kBands; b++)
+    len += snprintf(&body[len], sizeof(body) - len, "%s%.1f", b ? "," : "",
+                    r.band_dbfs_q8[b] / 256.0);
+  len += snprintf(&body[len], sizeof(body) - len,
+                  "],\"level_dbfs\":%.1f,\"peak_hz\":%lu,\"peak_dbfs\":%.1f,"
+                  "\"cycles_per_frame\":%lu,\"cycles_per_frame_max\":%lu,"
+                  "\"skips\":%lu}\n",
+                  r.level_dbfs_q8 / 256.0, (unsigned long)r.peak_hz,
+                  r.peak_dbfs_q8 / 256.0, (unsigned long)p.cycles_per_frame,
+                  (unsigned long)p.cycles_per_frame_max,
+                  (unsigned long)p.skips);
+  httpd_resp_set_type(req, "application/json");
+  return httpd_resp_send(req, body, len);
+}
+
+// The server runs one handler at a time, so one buffer does.
+static char s_metrics_body[3072];
+
+static esp_err_t metrics_get(httpd_req_t *req) {
+  size_t len =
+      sys::format_event_metrics(s_metrics_body, sizeof(s_metrics_body));
+  if (len >= sizeof(s_metrics_body))
+    len = sizeof(s_metrics_body) - 1;
+  httpd_resp_set_type(req, "text/plain; version=0.0.4");
+  return httpd_resp_send(req, s_metrics_body, len);
+}
+
+void start_spectrum_server(uint16_t port) {
+  httpd_handle_t server = nullptr;
+  httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+  config.server_port = port;
+  esp_err_t err = httpd_start(&server, &config);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "HTTP server failed to start (%s), spectrum disabled",
+             esp_err_to_name(err));
+    return;
+  }
+  httpd_uri_t uri = {};
+  uri.uri = "/spectrum";
+  uri.method = HTTP_GET;
+  uri.handler = spectrum_get;
+  httpd_register_uri_handler(server, &uri);
+  uri.uri = "/metrics";
+  uri.handler = metrics_get;
+  httpd_register_uri_handler(server, &uri);
+
+  TaskHandle_t task = nullptr;
+  // Below the server and the RTP sender. Pinned, because the cycle counter
+  // is per core and a migration between the two reads would garble it.
+  xTaskCreatePinnedToCore(spectrum_task, "mic_fft", 3072, nullptr, 3, &task,
+                          portNUM_PROCESSORS - 1);
+  add_stream_reader(task);
+  ESP_LOGI(TAG,
+           "Spectrum every %d ms at http://<device>:%d/spectrum "
+           "(%d-point FFT, %d octave bands), event bus metrics at /metrics",
+           CONFIG_MIC_SPECTRUM_REPORT_MS, port,
+           audio::SpectrumAnalyzer::kFftSize, kBands);
+}
+
+} // namespace mic
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace mic {
+
+// Spectrum analyser on the live stream (CONFIG_MIC_SPECTRUM), for coarse
+// spectral data without streaming the audio itself.
+//
+// A low-priority task reads the PCM16 ring like the RTP sender and runs an
+// audio::SpectrumAnalyzer over it. Every CONFIG_MIC_SPECTRUM_REPORT_MS the
+// averaged octave band levels, the overall level and the dominant frequency
+// are published, together with the cost per FFT frame in CPU cycles
+// (esp_cpu_get_cycle_count() around the analyzer), and served as JSON:
+//
+//   GET http://<device>:<port>/spectrum
+//   {"seq":12,"rate":16000,"fft":256,"frames":62,"period_ms":500,
+//    "bands_hz":[62,125,...],"bands_dbfs":[-61.2,...],"level_dbfs":-31.0,
+//    "peak_hz":1002,"peak_dbfs":-34.5,"cycles_per_frame":21034,
+//    "cycles_per_frame_max":24410,"skips":0}
+//
+// seq counts reports, so a poller can tell a new one from a repeat; skips
+// counts the times the task fell behind the ring and jumped to live audio.
+//
+// The same server has the miniOS event bus metrics
+// (sys::format_event_metrics()) in the Prometheus text format:
+//
+//   GET http://<device>:<port>/metrics
+//   minios_events_dispatched_total{type="AUDIO_TRIGGER"} 3
+//   minios_lane_high_water{lane="critical",slots="16"} 1
+//   minios_dispatch_latency_us_bucket{le="64"} 12
+//   ...
+// Call after start_stream_server().
+void start_spectrum_server(uint16_t port);
+
+} // namespace mic
@@ -0,0 +1,428 @@
+#include "store_forward.h"
+#include "audio_format.h"
+#include "ima_adpcm.h"
+#include "net_util.h"
+#include "stream_frame.h"
+#include "stream_server.h"
+
+extern "C" {
+#include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+}
+#include <atomic>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char *TAG = "MIC_STORE";
+
+namespace mic {
+
+static constexpr const char *kBasePath = "/spiffs";
+// SPIFFS erases and garbage-collects 4 KB blocks. Writing whole sectors
+// from our own buffer keeps it to one program pass per page; small writes
+// each cost a page update plus index churn.
+static constexpr size_t kSectorBytes = 4096;
+static constexpr size_t kFileBytes = CONFIG_MIC_STORE_FILE_KB * 1024;
+// Kept free: SPIFFS slows down sharply when nearly full, as the garbage
+// collector hunts for a block it can erase.
+static constexpr size_t kReserveBytes = 64 * 1024;
+static constexpr int kUploadTimeoutMs = 5000;
+static constexpr int64_t kRetryUs = 10 * 1000000;
+static constexpr int64_t kReportUs = 10 * 1000000;
+
+#if CONFIG_MIC_ADPCM
+static constexpr uint8_t kCodec = audio::frame::kCodecImaAdpcm;
+static constexpr int kFrameSamples = audio::ima_adpcm::kBlockSamples;
+static constexpr size_t kPayloadBytes = audio::ima_adpcm::kBlockBytes;
+#else
+static constexpr uint8_t kCodec = audio::frame::kCodecPcm16;
+static constexpr int kFrameSamples = kPcmFrameSamples;
+static constexpr size_t kPayloadBytes = kPcmFrameSamples * sizeof(int16_t);
+#endif
+static constexpr uint32_t kFrameBytes =
+    audio::frame::kHeaderBytes + kPayloadBytes;
+// Flash bytes per second of audio.
+static constexpr double kStoreRate =
+    (double)kFrameBytes * audio::kSampleRate / kFrameSamples;
+
+struct StoreStats {
+  uint32_t files;         // closed after writing
+  uint64_t bytes;         // written to flash
+  uint32_t skips;         // fell behind the capture ring
+  uint32_t dropped_files; // deleted unsent to make room
+  uint32_t write_errors;
+  int64_t max_write_us;
+  uint32_t uploaded;
+};
+
+static std::atomic<bool> s_online{false};
+
+// Files are rec<index>.mfr and [s_first, s_next) exist, oldest first. While
+// offline the newest one is open as s_fd.
+static uint32_t s_first = 0;
+static uint32_t s_next = 0;
+static int s_fd = -1;
+static size_t s_file_bytes = 0; // written to s_fd so far
+static uint8_t s_buf[kSectorBytes];
+static size_t s_fill = 0;
+static StoreStats s_stats = {};
+
+static void file_name(uint32_t index, char *out, size_t len) {
+  snprintf(out, len, "%s/rec%05lu.mfr", kBasePath, (unsigned long)index);
+}
+
+static size_t free_bytes() {
+  size_t total = 0, used = 0;
+  if (esp_spiffs_info(nullptr, &total, &used) != ESP_OK || used > total)
+    return 0;
+  return total - used;
+}
+
+// Picks up files left by a previous run, which upload like any other.
+static void scan_files() {
+  DIR *dir = opendir(kBasePath);
+  if (!dir)
+    return;
+  bool any = false;
+  uint32_t lo = 0, hi = 0;
+  while (struct dirent *e = readdir(dir)) {
+    unsigned long index;
+    if (sscanf(e->d_name, "rec%lu.mfr", &index) != 1)
+      continue;
+    if (!any || index < lo)
+      lo = (uint32_t)index;
+    if (!any || index > hi)
+      hi = (uint32_t)index;
+    any = true;
+  }
+  closedir(dir);
+  if (any) {
+    s_first = lo;
+    s_next = hi + 1;
+  }
+}
+
+static void delete_oldest() {
+  char path[32];
+  file_name(s_first++, path, sizeof(path));
+  unlink(path);
+}
+
+// Keeps needed bytes plus the reserve free by deleting the oldest closed
+// files. Returns false if even that is not enough.
+static bool make_room(size_t needed) {
+  uint32_t open_files = s_fd >= 0 ? 1 : 0;
+  while (free_bytes() < needed + kReserveBytes) {
+    if (s_next - s_first <= open_files)
+      return false;
+    delete_oldest();
+    s_stats.dropped_files++;
+  }
+  return true;
+}
+
+static void flush_buffer() {
+  if (s_fill == 0 || s_fd < 0)
+    return;
+  int64_t t0 = esp_timer_get_time();
+  ssize_t n = write(s_fd, s_buf, s_fill);
+  int64_t dt = esp_timer_get_time() - t0;
+  if (dt > s_stats.max_write_us)
+    s_stats.max_write_us = dt;
+  if (n == (ssize_t)s_fill) {
+    s_file_bytes += s_fill;
+    s_stats.bytes += s_fill;
+  } else {
+    // Out of space despite the reserve, or a flash error. The buffer is
+    // lost; the sequence gap in the file shows where.
+    s_stats.write_errors++;
+    ESP_LOGW(TAG, "write failed: errno %d", errno);
+  }
+  s_fill = 0;
+}
+
+static void close_file() {
+  if (s_fd < 0)
+    return;
+  flush_buffer();
+  close(s_fd);
+  s_fd = -1;
+  s_stats.files++;
+  ESP_LOGI(TAG, "Stored rec%05lu.mfr, %u KB", (unsigned long)(s_next - 1),
+           (unsigned)(s_file_bytes / 1024));
+}
+
+static bool open_next_file() {
+  close_file();
+  if (!make_room(kFileBytes)) {
+    ESP_LOGE(TAG, "No room for another file");
+    return false;
+  }
+  char path[32];
+  file_name(s_next, path, sizeof(path));
+  s_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (s_fd < 0) {
+    ESP_LOGE(TAG, "open %s failed: errno %d", path, errno);
+    return false;
+  }
+  s_next++;
+  s_file_bytes = 0;
+  audio::frame::Info info = {(uint32_t)audio::kSampleRate,
+                             (uint8_t)audio::kChannels, kCodec, 0,
+                             (uint16_t)kFrameSamples};
+  s_fill = audio::frame::write_info(info, esp_timer_get_time(), s_buf);
+  return true;
+}
+
+// Appends the frame at pos. Files are cut between frames, so each one
+// parses on its own.
+static void store_frame(const audio::BroadcastRing &ring, uint32_t pos) {
+  if (s_fd >= 0 && s_file_bytes + s_fill + kFrameBytes > kFileBytes)
+    close_file();
+  if (s_fd < 0 && !open_next_file())
+    return;
+  uint32_t left = kFrameBytes;
+  while (left > 0) {
+    size_t take = kSectorBytes - s_fill;
+    if (take > left)
+      take = left;
+    ring.copy(pos, &s_buf[s_fill], take);
+    s_fill += take;
+    pos += (uint32_t)take;
+    left -= (uint32_t)take;
+    if (s_fill == kSectorBytes)
+      flush_buffer();
+  }
+}
+
+static bool upload_file(int sock, uint32_t index) {
+  char path[32];
+  file_name(index, path, sizeof(path));
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    // Lost, e.g. power cut before it was ever written. Nothing to send.
+    ESP_LOGW(TAG, "open %s failed: errno %d, skipping", path, errno);
+    return true;
+  }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok) {
+    char header[64];
+    int len = snprintf(header, sizeof(header), "UPLOAD %s %ld\n",
+                       path + strlen(kBasePath) + 1, (long)st.st_size);
+    ok = send_all(sock, header, (size_t)len);
+  }
+  ssize_t n;
+  while (ok && (n = read(fd, s_buf, sizeof(s_buf))) > 0)
+    ok = send_all(sock, s_buf, (size_t)n);
+  close(fd);
+  return ok && wait_ok(sock);
+}
+
+// Sends every stored file, deleting each once acknowledged. Returns false
+// if the connection failed.
+static bool upload_all() {
+  int sock = connect_to(CONFIG_MIC_UPLOAD_HOST, CONFIG_MIC_UPLOAD_PORT,
+                        kUploadTimeoutMs);
+  if (sock < 0)
+    return false;
+  uint32_t sent = 0;
+  bool ok = true;
+  while (ok && s_first != s_next && s_online.load()) {
+    ok = upload_file(sock, s_first);
+    if (ok) {
+      delete_oldest();
+      s_stats.uploaded++;
+      sent++;
+    }
+  }
+  close(sock);
+  ESP_LOGI(TAG, "Uploaded %lu files, %lu left", (unsigned long)sent,
+           (unsigned long)(s_next - s_first));
+  return ok;
+}
+
+static void log_report() {
+  ESP_LOGI(TAG,
+           "offline: %lu files (%llu KB), %lu KB free, worst write %.1f ms, "
+           "skips=%lu dropped_files=%lu write_errors=%lu",
+           (unsigned long)(s_next - s_first),
+           (unsigned long long)(s_stats.bytes / 1024),
+           (unsigned long)(free_bytes() / 1024),
+           s_stats.max_write_us / 1000.0, (unsigned long)s_stats.skips,
+           (unsigned long)s_stats.dropped_files,
+           (unsigned long)s_stats.write_errors);
+}
+
+static const audio::BroadcastRing &store_ring() {
+  const audio::BroadcastRing *adpcm = live_adpcm_ring();
+  return adpcm ? *adpcm : live_pcm_ring();
+}
+
+static void store_task(void *arg) {
+  (void)arg;
+  const audio::BroadcastRing &ring = store_ring();
+  uint32_t capacity = (uint32_t)ring.capacity();
+  uint32_t guard = capacity - capacity / 4;
+  uint32_t pos = ring.head();
+  bool storing = false;
+  int64_t retry_at_us = 0;
+  int64_t last_report_us = esp_timer_get_time();
+
+  while (true) {
+    // Woken by every captured chunk, like the RTP sender.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(100));
+    int64_t now = esp_timer_get_time();
+
+    if (s_online.load()) {
+      if (storing) {
+        close_file();
+        storing = false;
+        ESP_LOGI(TAG, "Wi-Fi is back, %lu files to upload",
+                 (unsigned long)(s_next - s_first));
+      }
+      if (s_first != s_next && now >= retry_at_us) {
+        if (!upload_all())
+          retry_at_us = esp_timer_get_time() + kRetryUs;
+      }
+      pos = ring.head();
+      continue;
+    }
+
+    uint32_t head = ring.head();
+    if (!storing) {
+      // Start at the oldest frame the ring still safely holds: the audio
+      // from just before the outage was noticed.
+      uint32_t back = head < guard ? head : guard;
+      pos = head - back / kFrameBytes * kFrameBytes;
+      storing = true;
+      ESP_LOGW(TAG, "Wi-Fi down, storing to flash (%lu KB free, ~%.0f s)",
+               (unsigned long)(free_bytes() / 1024),
+               (double)free_bytes() / kStoreRate);
+    }
+
+    uint32_t lag = head - pos;
+    if (lag > guard) {
+      uint32_t frames = (lag - guard) / kFrameBytes + 1;
+      pos += frames * kFrameBytes;
+      lag -= frames * kFrameBytes;
+      s_stats.skips++;
+    }
+    while (lag >= kFrameBytes) {
+      uint8_t raw[audio::frame::kHeaderBytes];
+      audio::frame::Header h;
+      ring.copy(pos, raw, sizeof(raw));
+      if (!audio::frame::parse_header(raw, &h) ||
+          h.payload_bytes != kPayloadBytes) {
+        ESP_LOGE(TAG, "Lost frame alignment, restarting at live");
+        pos = ring.head();
+        break;
+      }
+      store_frame(ring, pos);
+      pos += kFrameBytes;
+      lag -= kFrameBytes;
+    }
+
+    if (now - last_report_us >= kReportUs) {
+      log_report();
+      last_report_us = now;
+    }
+  }
+}
+
+#if CONFIG_MIC_STORE_BENCH
+// Writes kBenchBytes in sector-sized writes and then in page-sized ones,
+// and sets the result against the rate the store needs. Wear assumes
+// SPIFFS spreads erases evenly, so filling the partition once costs each
+// block about one of its ~100k erase cycles.
+static void bench_flash() {
+  constexpr size_t kBenchBytes = 128 * 1024;
+  const size_t sizes[] = {kSectorBytes, 256};
+  char path[32];
+  snprintf(path, sizeof(path), "%s/bench.tmp", kBasePath);
+  for (size_t i = 0; i < sizeof(s_buf); i++)
+    s_buf[i] = (uint8_t)(i * 131);
+
+  for (size_t size : sizes) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      ESP_LOGE(TAG, "bench: open failed: errno %d", errno);
+      return;
+    }
+    int64_t worst = 0;
+    int64_t t0 = esp_timer_get_time();
+    for (size_t off = 0; off < kBenchBytes; off += size) {
+      int64_t w0 = esp_timer_get_time();
+      if (write(fd, s_buf, size) != (ssize_t)size)
+        break;
+      int64_t dt = esp_timer_get_time() - w0;
+      if (dt > worst)
+        worst = dt;
+    }
+    close(fd);
+    double secs = (esp_timer_get_time() - t0) / 1e6;
+    unlink(path);
+    double rate = kBenchBytes / secs;
+    ESP_LOGI(TAG,
+             "bench: %u-byte writes %.1f KB/s (%.1fx the store rate), "
+             "worst write %.1f ms",
+             (unsigned)size, rate / 1024, rate / kStoreRate, worst / 1000.0);
+  }
+
+  size_t total = 0, used = 0;
+  esp_spiffs_info(nullptr, &total, &used);
+  double usable = (double)(total - used - kReserveBytes);
+  double cycle_s = total / kStoreRate;
+  ESP_LOGI(TAG,
+           "bench: store needs %.1f KB/s; %u KB partition holds ~%.0f s "
+           "offline; wear is one erase per block every %.0f s offline, "
+           "~%.0f h of outages to 100k cycles",
+           kStoreRate / 1024, (unsigned)(total / 1024), usable / kStoreRate,
+           cycle_s, cycle_s * 100000 / 3600);
+}
+#endif
+
+void store_forward_set_online(bool online) { s_online.store(online); }
+
+void start_store_forward() {
+  esp_vfs_spiffs_conf_t conf = {};
+  conf.base_path = kBasePath;
+  conf.partition_label = nullptr;
+  conf.max_files = 3;
+  conf.format_if_mount_failed = true;
+  esp_err_t err = esp_vfs_spiffs_register(&conf);
+  if (err != ESP_OK) {
+    ESP_LOGE(TAG, "SPIFFS mount failed (%s), store-and-forward disabled",
+             esp_err_to_name(err));
+    return;
+  }
+  scan_files();
+#if CONFIG_MIC_STORE_BENCH
+  bench_flash();
+#endif
+  ESP_LOGI(TAG,
+           "Store-and-forward to %s:%d, %u KB files, %lu waiting, %lu KB "
+           "free (~%.0f s of %s)",
+           CONFIG_MIC_UPLOAD_HOST, CONFIG_MIC_UPLOAD_PORT,
+           (unsigned)(kFileBytes / 1024), (unsigned long)(s_next - s_first),
+           (unsigned long)(free_bytes() / 1024),
+           (double)free_bytes() / kStoreRate,
+           kCodec == audio::frame::kCodecImaAdpcm ? "ADPCM" : "PCM16");
+
+  TaskHandle_t task = nullptr;
+  // Below the server: flash writes can take a while and must not hold up
+  // the subscribers.
+  xTaskCreate(store_task, "mic_store", 4096, nullptr, 3, &task);
+  add_stream_reader(task);
+}
+
+} // namespace mic
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace mic {
+
+// Store-and-forward across Wi-Fi outages (CONFIG_MIC_STORE_FORWARD).
+//
+// While the station has no IP, the live stream (IMA-ADPCM when built in,
+// otherwise PCM16) is written to the spiffs partition as v2 frames, each
+// file opening with an info frame, so a file reads exactly like a PROTO 2
+// capture. Writes go through one buffer in whole 4 KB flash sectors; files
+// are cut at CONFIG_MIC_STORE_FILE_KB on a frame boundary. When the
+// partition is full the oldest file is deleted, so the store always holds
+// the latest audio of the outage.
+//
+// Once Wi-Fi is back, the files go oldest first to
+// CONFIG_MIC_UPLOAD_HOST:CONFIG_MIC_UPLOAD_PORT over one TCP connection
+// (tools/receive_uploads.py), each deleted when the host acknowledges it:
+//
+//   device: "UPLOAD <name> <bytes>\n" and the file
+//   host:   "OK\n" once it is safely stored
+//
+// A failed upload is retried every 10 s while online.
+
+// Mounts the partition and starts the store task. Call after
+// start_stream_server(); with CONFIG_MIC_STORE_BENCH it first measures the
+// flash against the capture rate.
+void start_store_forward();
+
+// Wi-Fi event handler hook: true once the station has an IP, false when it
+// loses the AP.
+void store_forward_set_online(bool online);
+
+} // namespace mic
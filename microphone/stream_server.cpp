@@ -0,0 +1,678 @@
+#include "stream_server.h"
+#include "audio_format.h"
+#include "broadcast_ring.h"
+#include "ima_adpcm.h"
+#include "lossless.h"
+#include "net_util.h"
+#include "seqlock.h"
+#include "stream_frame.h"
+#include "vad.h"
+
+extern "C" {
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "sdkconfig.h"
+}
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+
+static const char *TAG = "MIC_SERVER";
+
+namespace mic {
+
+using audio::frame::kHeaderBytes;
+
+static constexpr int kMaxSubscribers = CONFIG_MIC_MAX_SUBSCRIBERS;
+static constexpr int kSendWaitMs = 20;
+
+// How long a new subscriber gets to send its hello line before we fall back
+// to v1 PCM16. Clients that never send one just see the header this much
+// later.
+static constexpr int kHelloWaitMs = 200;
+
+// Who reads an encoded stream. It is only encoded while somebody does: a
+// subscriber that asked for it (counted by the server task) or a task that
+// took its ring. The capture task checks before every chunk.
+struct Readers {
+  std::atomic<int> count{0};
+  bool active = false; // capture task only
+
+  // Whether to encode this chunk. restart is set on the first chunk after a
+  // time without readers, when the encoder has to start over.
+  bool begin(bool *restart) {
+    bool want = count.load(std::memory_order_relaxed) > 0;
+    *restart = want && !active;
+    active = want;
+    return want;
+  }
+};
+
+// One encoded form of the capture that subscribers can pick. Its ring holds
+// v2 frames of one fixed size (unit), so frame boundaries always sit a whole
+// number of units behind head(); a subscriber reads in place through its
+// own cursor and a skip moves it by whole frames. A stream of variable-size
+// frames (unit 0) only knows that head() is a boundary, and skips to it.
+struct Stream {
+  const char *codec; // name in the hello line and the v1 header
+  audio::BroadcastRing *ring;
+  uint32_t unit;
+  uint32_t send_block; // a multiple of unit, or any size with unit 0
+  bool framed_only;    // no v1 form: the gaps only make sense with headers
+  audio::frame::Info info;
+  Readers *readers; // null: always encoded
+};
+
+// Producer side of one stream: the frame being built and its sequence.
+struct Framer {
+  audio::BroadcastRing *ring;
+  uint8_t *slot; // kHeaderBytes + payload
+  uint32_t seq;
+};
+
+// Capture clock for frame timestamps: samples published so far and the
+// esp_timer time of the newest one.
+static uint32_t s_clock = 0;
+static int64_t s_clock_us = 0;
+// Capture gain and clock error of the newest chunk. Frames are stamped with
+// them as they are finished; a gated frame sent from the pre-roll gets
+// today's values. Atomic for log_report() on the server task.
+static std::atomic<int16_t> s_gain_db_q8{0};
+static std::atomic<int16_t> s_drift_ppm_q4{0};
+#if CONFIG_MIC_RESAMPLE
+static constexpr uint8_t kClockFlags = audio::frame::kFlagResampled;
+#else
+static constexpr uint8_t kClockFlags = 0;
+#endif
+
+static int64_t sample_time_us(uint32_t index) {
+  int32_t behind = (int32_t)(s_clock - 1 - index);
+  return s_clock_us - (int64_t)behind * 1000000 / audio::kSampleRate;
+}
+
+static void push_frame(Framer &fr, uint8_t codec, uint8_t flags,
+                       size_t payload_bytes, int samples,
+                       uint32_t sample_index) {
+  audio::frame::Header h = {};
+  h.codec = codec;
+  h.flags = flags | kClockFlags;
+  h.seq = fr.seq++;
+  h.payload_bytes = (uint16_t)payload_bytes;
+  h.samples = (uint16_t)samples;
+  h.timestamp_us = sample_time_us(sample_index);
+  h.sample_index = sample_index;
+  h.gain_db_q8 = s_gain_db_q8.load(std::memory_order_relaxed);
+  h.drift_ppm_q4 = s_drift_ppm_q4.load(std::memory_order_relaxed);
+  audio::frame::finish(h, fr.slot);
+  fr.ring->push(fr.slot, kHeaderBytes + payload_bytes);
+}
+
+static constexpr size_t kPcmPayloadBytes = kPcmFrameSamples * sizeof(int16_t);
+static constexpr uint32_t kPcmUnit = kHeaderBytes + kPcmPayloadBytes;
+
+// ~465 ms of PCM16 frames. Only has to cover the slowest subscriber we are
+// willing to keep.
+static uint8_t s_pcm_storage[16384];
+static audio::BroadcastRing s_pcm_ring(s_pcm_storage, sizeof(s_pcm_storage));
+static uint8_t s_pcm_slot[kPcmUnit];
+static Framer s_pcm_framer = {&s_pcm_ring, s_pcm_slot, 0};
+static int s_pcm_fill = 0; // samples staged in s_pcm_slot
+
+#if CONFIG_MIC_ADPCM
+static constexpr uint32_t kAdpcmUnit =
+    kHeaderBytes + audio::ima_adpcm::kBlockBytes;
+// 14 frames, ~440 ms of ADPCM.
+static uint8_t s_adpcm_storage[4096];
+static audio::BroadcastRing s_adpcm_ring(s_adpcm_storage,
+                                         sizeof(s_adpcm_storage));
+static audio::ImaAdpcmEncoder s_adpcm_encoder;
+static uint8_t s_adpcm_slot[kAdpcmUnit];
+static Framer s_adpcm_framer = {&s_adpcm_ring, s_adpcm_slot, 0};
+static uint32_t s_adpcm_index = 0; // sample clock of the block being built
+static Readers s_adpcm_readers;
+#endif
+
+#if CONFIG_MIC_LOSSLESS
+// Lossless stream: a block per frame, 1 .. kMaxBlockBytes of payload. ~16 KB
+// is half a second or more of typical audio, and 8 verbatim blocks.
+static uint8_t s_lossless_storage[16384];
+static audio::BroadcastRing s_lossless_ring(s_lossless_storage,
+                                            sizeof(s_lossless_storage));
+static audio::LosslessEncoder s_lossless_encoder;
+static uint8_t s_lossless_slot[kHeaderBytes +
+                               audio::lossless::kMaxBlockBytes];
+static Framer s_lossless_framer = {&s_lossless_ring, s_lossless_slot, 0};
+static uint32_t s_lossless_index = 0; // sample clock of the block being built
+static Readers s_lossless_readers;
+
+static_assert(audio::lossless::kMaxBlockBytes <=
+                  (int)audio::frame::kMaxPayloadBytes,
+              "a verbatim block fits one frame");
+#endif
+
+#if CONFIG_MIC_VAD
+// Speech-only stream: the same PCM16 frames, sent only while the gate is
+// open. Segment boundaries are frame flags; the silences show as jumps in
+// sample_index. ~465 ms of frames, a full pre-roll burst is 32 of the 46.
+static uint8_t s_vad_storage[16384];
+static audio::BroadcastRing s_vad_ring(s_vad_storage, sizeof(s_vad_storage));
+static audio::VoiceGate s_vad({CONFIG_MIC_VAD_THRESHOLD_DB,
+                               CONFIG_MIC_VAD_HANGOVER_MS,
+                               CONFIG_MIC_VAD_PREROLL_MS});
+static uint8_t s_vad_slot[kPcmUnit];
+static Framer s_vad_framer = {&s_vad_ring, s_vad_slot, 0};
+// s_vad.stats() as of the last chunk, for log_report() on the server task.
+static audio::SeqLock<audio::VadStats> s_vad_stats;
+
+static_assert(audio::VoiceGate::kFrameSamples == kPcmFrameSamples,
+              "gated frames go out as ordinary PCM16 frames");
+
+static void push_vad_frame(const audio::VadFrame &f) {
+  uint8_t flags = 0;
+  if (f.flags & audio::VadFrame::kStart)
+    flags |= audio::frame::kFlagSegmentStart;
+  if (f.flags & audio::VadFrame::kEnd)
+    flags |= audio::frame::kFlagSegmentEnd;
+  memcpy(&s_vad_slot[kHeaderBytes], f.samples, kPcmPayloadBytes);
+  push_frame(s_vad_framer, audio::frame::kCodecPcm16, flags,
+             kPcmPayloadBytes, kPcmFrameSamples, f.index);
+}
+#endif
+
+static const Stream s_streams[] = {
+    {"PCM16",
+     &s_pcm_ring,
+     kPcmUnit,
+     2 * kPcmUnit,
+     false,
+     {audio::kSampleRate, audio::kChannels, audio::frame::kCodecPcm16, 0,
+      kPcmFrameSamples},
+     nullptr},
+#if CONFIG_MIC_ADPCM
+    {"ADPCM",
+     &s_adpcm_ring,
+     kAdpcmUnit,
+     kAdpcmUnit,
+     false,
+     {audio::kSampleRate, audio::kChannels, audio::frame::kCodecImaAdpcm, 0,
+      audio::ima_adpcm::kBlockSamples},
+     &s_adpcm_readers},
+#endif
+#if CONFIG_MIC_LOSSLESS
+    {"LOSSLESS",
+     &s_lossless_ring,
+     0,
+     2048,
+     true,
+     {audio::kSampleRate, audio::kChannels, audio::frame::kCodecLossless, 0,
+      audio::lossless::kBlockSamples},
+     &s_lossless_readers},
+#endif
+#if CONFIG_MIC_VAD
+    {"VAD16",
+     &s_vad_ring,
+     kPcmUnit,
+     2 * kPcmUnit,
+     true,
+     {audio::kSampleRate, audio::kChannels, audio::frame::kCodecPcm16, 1,
+      kPcmFrameSamples},
+     nullptr},
+#endif
+};
+
+struct Subscriber {
+  int sock = -1;
+  const Stream *stream = nullptr; // null until the hello is settled
+  bool framed = false;            // v2: frames exactly as they are in the ring
+  uint32_t pos = 0;               // ring cursor, bytes
+  char hello[24];
+  int hello_len = 0;
+  int64_t attached_us = 0;
+  uint8_t header[kHeaderBytes + audio::frame::kInfoBytes];
+  int header_len = 0;
+  int header_sent = 0;
+  int64_t last_send_us = 0;
+  uint64_t sent_bytes = 0;
+  uint32_t skips = 0;
+  uint64_t skipped_bytes = 0;
+};
+
+static Subscriber s_subs[kMaxSubscribers];
+static TaskHandle_t s_server_task = nullptr;
+// Other tasks reading the rings directly: the RTP sender, store-and-forward,
+// the event clip task and the spectrum server, those that are built in.
+static constexpr int kMaxReaders = 4;
+static constexpr int kEnabledReaders = 0
+#if CONFIG_MIC_RTP
+                                       + 1
+#endif
+#if CONFIG_MIC_STORE_FORWARD
+                                       + 1
+#endif
+#if CONFIG_MIC_EVENT_CLIP
+                                       + 1
+#endif
+#if CONFIG_MIC_SPECTRUM
+                                       + 1
+#endif
+    ;
+static_assert(kEnabledReaders <= kMaxReaders, "a ring reader without a slot");
+static TaskHandle_t s_readers[kMaxReaders];
+static int s_reader_count = 0;
+static const audio::LevelMeter *s_levels = nullptr;
+static uint16_t s_port = 0;
+
+void publish_samples(const int16_t *samples, int n, int64_t captured_us,
+                     int16_t gain_db_q8, int16_t drift_ppm_q4) {
+  if (n <= 0)
+    return;
+  uint32_t first = s_clock;
+  s_clock += (uint32_t)n;
+  s_clock_us = captured_us;
+  s_gain_db_q8.store(gain_db_q8, std::memory_order_relaxed);
+  s_drift_ppm_q4.store(drift_ppm_q4, std::memory_order_relaxed);
+
+  for (int i = 0; i < n;) {
+    int take = kPcmFrameSamples - s_pcm_fill;
+    if (take > n - i)
+      take = n - i;
+    memcpy(&s_pcm_slot[kHeaderBytes + s_pcm_fill * sizeof(int16_t)],
+           &samples[i], (size_t)take * sizeof(int16_t));
+    s_pcm_fill += take;
+    i += take;
+    if (s_pcm_fill == kPcmFrameSamples) {
+      push_frame(s_pcm_framer, audio::frame::kCodecPcm16, 0, kPcmPayloadBytes,
+                 kPcmFrameSamples, first + (uint32_t)(i - kPcmFrameSamples));
+      s_pcm_fill = 0;
+    }
+  }
+
+#if CONFIG_MIC_ADPCM
+  bool adpcm_restart;
+  if (s_adpcm_readers.begin(&adpcm_restart)) {
+    if (adpcm_restart) {
+      s_adpcm_encoder.reset();
+      s_adpcm_index = first;
+    }
+    // Fed less than a block at a time so each call completes at most one
+    // block, which is encoded straight into the frame slot.
+    for (int i = 0; i < n;) {
+      int take = n - i;
+      if (take > audio::ima_adpcm::kBlockSamples - 1)
+        take = audio::ima_adpcm::kBlockSamples - 1;
+      if (s_adpcm_encoder.encode(&samples[i], take,
+                                 &s_adpcm_slot[kHeaderBytes]) > 0) {
+        push_frame(s_adpcm_framer, audio::frame::kCodecImaAdpcm, 0,
+                   audio::ima_adpcm::kBlockBytes,
+                   audio::ima_adpcm::kBlockSamples, s_adpcm_index);
+        s_adpcm_index += audio::ima_adpcm::kBlockSamples;
+      }
+      i += take;
+    }
+  }
+#endif
+#if CONFIG_MIC_LOSSLESS
+  bool lossless_restart;
+  if (s_lossless_readers.begin(&lossless_restart)) {
+    if (lossless_restart) {
+      s_lossless_encoder.reset();
+      s_lossless_index = first;
+    }
+    // Same as ADPCM: each call completes at most one block.
+    for (int i = 0; i < n;) {
+      int take = n - i;
+      if (take > audio::lossless::kBlockSamples - 1)
+        take = audio::lossless::kBlockSamples - 1;
+      int bytes = s_lossless_encoder.encode(&samples[i], take,
+                                            &s_lossless_slot[kHeaderBytes]);
+      if (bytes > 0) {
+        push_frame(s_lossless_framer, audio::frame::kCodecLossless, 0,
+                   (size_t)bytes, audio::lossless::kBlockSamples,
+                   s_lossless_index);
+        s_lossless_index += audio::lossless::kBlockSamples;
+      }
+      i += take;
+    }
+  }
+#endif
+#if CONFIG_MIC_VAD
+  // Unlike the encoders this runs without readers: a gate started when a
+  // subscriber arrives mid-speech takes the speech for its noise floor.
+  s_vad.process(samples, n, push_vad_frame);
+  s_vad_stats.publish(s_vad.stats());
+#endif
+  if (s_server_task)
+    xTaskNotifyGive(s_server_task);
+  for (int i = 0; i < s_reader_count; i++)
+    xTaskNotifyGive(s_readers[i]);
+}
+
+const audio::BroadcastRing &live_pcm_ring() { return s_pcm_ring; }
+
+const audio::BroadcastRing *live_adpcm_ring() {
+#if CONFIG_MIC_ADPCM
+  s_adpcm_readers.count.fetch_add(1, std::memory_order_relaxed);
+  return &s_adpcm_ring;
+#else
+  return nullptr;
+#endif
+}
+
+void add_stream_reader(TaskHandle_t task) {
+  if (s_reader_count == kMaxReaders) {
+    ESP_LOGE(TAG, "Too many stream readers");
+    return;
+  }
+  s_readers[s_reader_count++] = task;
+}
+
+static int active_subscribers() {
+  int count = 0;
+  for (const Subscriber &sub : s_subs) {
+    if (sub.sock >= 0)
+      count++;
+  }
+  return count;
+}
+
+static void drop_subscriber(Subscriber &sub, const char *why) {
+  if (sub.stream && sub.stream->readers)
+    sub.stream->readers->count.fetch_sub(1, std::memory_order_relaxed);
+  ESP_LOGI(TAG,
+           "Subscriber %d closed (%s): sent %llu bytes, %lu skips "
+           "(%llu bytes skipped)",
+           (int)(&sub - s_subs), why, (unsigned long long)sub.sent_bytes,
+           (unsigned long)sub.skips, (unsigned long long)sub.skipped_bytes);
+  close(sub.sock);
+  sub.sock = -1;
+}
+
+static void accept_pending(int listen_sock) {
+  while (true) {
+    int client = accept_client(listen_sock);
+    if (client < 0)
+      return;
+
+    Subscriber *slot = nullptr;
+    for (Subscriber &sub : s_subs) {
+      if (sub.sock < 0) {
+        slot = &sub;
+        break;
+      }
+    }
+    if (!slot) {
+      ESP_LOGW(TAG, "Rejecting subscriber, already serving %d",
+               kMaxSubscribers);
+      close(client);
+      continue;
+    }
+
+    int flags = fcntl(client, F_GETFL, 0);
+    fcntl(client, F_SETFL, flags | O_NONBLOCK);
+
+    *slot = Subscriber();
+    slot->sock = client;
+    slot->attached_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Subscriber %d attached (%d/%d)", (int)(slot - s_subs),
+             active_subscribers(), kMaxSubscribers);
+  }
+}
+
+static const Stream *find_stream(const char *codec) {
+  for (const Stream &st : s_streams) {
+    if (strcmp(st.codec, codec) == 0)
+      return &st;
+  }
+  return nullptr;
+}
+
+// Picks the subscriber's protocol and stream from its hello line (or the
+// timeout) and prepares the header. Returns 1 once it is streaming, 0 while
+// still waiting, or -1 if the subscriber has gone away (closed or failed
+// before a stream was picked).
+//
+//   (none)            v1 PCM16
+//   CODEC <name>      v1: text header, then the bare payload
+//   PROTO 2 [<name>]  v2: an info frame, then audio frames
+static int negotiate(Subscriber &sub, int64_t now) {
+  bool line_done = false;
+  while (sub.hello_len < (int)sizeof(sub.hello) - 1) {
+    int got = recv(sub.sock, &sub.hello[sub.hello_len], 1, 0);
+    if (got == 0)
+      return -1;
+    if (got < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      return -1;
+    }
+    if (sub.hello[sub.hello_len] == '\n') {
+      line_done = true;
+      break;
+    }
+    sub.hello_len++;
+  }
+  sub.hello[sub.hello_len] = '\0';
+  if (sub.hello_len == (int)sizeof(sub.hello) - 1)
+    line_done = true;
+  if (!line_done && now - sub.attached_us < kHelloWaitMs * 1000)
+    return 0;
+
+  const char *asked = nullptr;
+  if (strncmp(sub.hello, "PROTO 2", 7) == 0 &&
+      (sub.hello[7] == '\0' || sub.hello[7] == ' ')) {
+    sub.framed = true;
+    if (sub.hello[7] == ' ')
+      asked = sub.hello + 8;
+  } else if (strncmp(sub.hello, "CODEC ", 6) == 0) {
+    asked = sub.hello + 6;
+  } else if (sub.hello_len > 0) {
+    ESP_LOGW(TAG, "Subscriber %d sent '%s', ignoring", (int)(&sub - s_subs),
+             sub.hello);
+  }
+
+  const Stream *st = &s_streams[0];
+  if (asked) {
+    const Stream *found = find_stream(asked);
+    if (found && (sub.framed || !found->framed_only))
+      st = found;
+    else
+      ESP_LOGW(TAG, "Subscriber %d asked for %s%s, sending PCM16",
+               (int)(&sub - s_subs), asked, found ? " without PROTO 2" : "");
+  }
+
+  sub.stream = st;
+  if (st->readers)
+    st->readers->count.fetch_add(1, std::memory_order_relaxed);
+  // Start at the live edge: a new subscriber never gets stale audio. Ring
+  // heads only advance in whole frames, so this is a frame boundary.
+  sub.pos = st->ring->head();
+  sub.last_send_us = now;
+  if (sub.framed) {
+    sub.header_len = (int)audio::frame::write_info(st->info, now, sub.header);
+  } else if (st == &s_streams[0]) {
+    // A sample count of 0 means "unbounded, read until close".
+    sub.header_len = snprintf((char *)sub.header, sizeof(sub.header),
+                              "PCM16 %d %d 0\n", audio::kSampleRate,
+                              audio::kChannels);
+  } else {
+    sub.header_len = snprintf((char *)sub.header, sizeof(sub.header),
+                              "%s %d %d 0 %lu\n", st->codec,
+                              audio::kSampleRate, audio::kChannels,
+                              (unsigned long)(st->unit - kHeaderBytes));
+  }
+  ESP_LOGI(TAG, "Subscriber %d streaming %s (%s)", (int)(&sub - s_subs),
+           st->codec, sub.framed ? "v2" : "v1");
+  return 1;
+}
+
+// Non-blocking send. Returns bytes sent, 0 if the socket buffer is full, or
+// -1 if the subscriber has gone away.
+static int try_send(Subscriber &sub, const void *data, size_t len) {
+  int sent = send(sub.sock, data, len, 0);
+  if (sent < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return 0;
+    return -1;
+  }
+  return sent;
+}
+
+static void service_subscriber(Subscriber &sub, int64_t now) {
+  if (!sub.stream) {
+    int ready = negotiate(sub, now);
+    if (ready < 0)
+      drop_subscriber(sub, "closed before a hello");
+    if (ready <= 0)
+      return;
+  }
+
+  if (sub.header_sent < sub.header_len) {
+    int sent = try_send(sub, sub.header + sub.header_sent,
+                        (size_t)(sub.header_len - sub.header_sent));
+    if (sent < 0) {
+      drop_subscriber(sub, "send failed");
+      return;
+    }
+    sub.header_sent += sent;
+    if (sub.header_sent < sub.header_len)
+      return;
+  }
+
+  const Stream &st = *sub.stream;
+  uint32_t head = st.ring->head();
+  uint32_t lag = head - sub.pos;
+
+  // A subscriber lagging into the last quarter of the ring is about to have
+  // unread audio overwritten. That quarter is guard space so bytes are never
+  // overwritten while send() is still copying them out.
+  uint32_t capacity = (uint32_t)st.ring->capacity();
+  if (lag > capacity - capacity / 4) {
+#if CONFIG_MIC_SLOW_SUBSCRIBER_DROP
+    drop_subscriber(sub, "too slow");
+    return;
+#else
+    // Jump to one send block behind live, keeping the position within the
+    // current frame so a subscriber stopped mid-frame stays aligned after
+    // the skip. v2 readers see the skip as a sequence gap. Variable-size
+    // frames go straight to live; a frame cut short there fails its CRC,
+    // just as the spliced frame of a mid-frame skip does.
+    uint32_t target =
+        st.unit ? head - st.send_block - (lag % st.unit) : head;
+    sub.skips++;
+    sub.skipped_bytes += target - sub.pos;
+    sub.pos = target;
+    lag = head - sub.pos;
+#endif
+  }
+
+  // Batch into send blocks unless the oldest queued audio is getting stale.
+  if (lag < st.send_block && now - sub.last_send_us < kSendWaitMs * 1000)
+    return;
+
+  while (lag > 0) {
+    uint32_t avail = lag;
+    if (!sub.framed) {
+      // v1 gets the bare payload: step over frame headers and end each send
+      // at the end of the current frame.
+      uint32_t offset = (st.unit - lag % st.unit) % st.unit;
+      if (offset < kHeaderBytes) {
+        sub.pos += kHeaderBytes - offset;
+        lag -= kHeaderBytes - offset;
+        continue;
+      }
+      avail = st.unit - offset;
+    }
+    const uint8_t *data;
+    size_t len = st.ring->peek(sub.pos, &data, avail);
+    int sent = try_send(sub, data, len);
+    if (sent < 0) {
+      drop_subscriber(sub, "send failed");
+      return;
+    }
+    if (sent == 0)
+      break;
+    sub.pos += (uint32_t)sent;
+    sub.sent_bytes += (uint64_t)sent;
+    sub.last_send_us = now;
+    lag -= (uint32_t)sent;
+    if ((size_t)sent < len)
+      break;
+  }
+}
+
+static void log_report() {
+  for (const Subscriber &sub : s_subs) {
+    if (sub.sock < 0 || !sub.stream)
+      continue;
+    ESP_LOGI(TAG, "subscriber %d (%s): lag=%lu bytes, skips=%lu (%llu bytes)",
+             (int)(&sub - s_subs), sub.stream->codec,
+             (unsigned long)(sub.stream->ring->head() - sub.pos),
+             (unsigned long)sub.skips, (unsigned long long)sub.skipped_bytes);
+  }
+  if (s_levels) {
+    audio::LevelWindow w = s_levels->snapshot().second;
+    ESP_LOGI(TAG, "level: min=%d max=%d rms=%.1f dc=%.1f clips=%lu", w.min,
+             w.max, w.rms_q8 / 256.0, w.dc_offset_q8 / 256.0,
+             (unsigned long)w.clips);
+  }
+#if CONFIG_MIC_AGC
+  ESP_LOGI(TAG, "agc: gain=%.1f dB",
+           s_gain_db_q8.load(std::memory_order_relaxed) / 256.0);
+#endif
+  ESP_LOGI(TAG, "clock: %+.2f ppm%s",
+           s_drift_ppm_q4.load(std::memory_order_relaxed) / 16.0,
+           kClockFlags ? ", resampled" : "");
+#if CONFIG_MIC_VAD
+  audio::VadStats v = s_vad_stats.read();
+  ESP_LOGI(TAG, "vad: %s floor=%.1f dB energy=%.1f dB zcr=%.2f "
+           "active=%lu/%lu frames, %lu segments",
+           v.active ? "open" : "closed", v.noise_floor_db_q8 / 256.0,
+           v.energy_db_q8 / 256.0, v.zcr_q8 / 256.0,
+           (unsigned long)v.active_frames, (unsigned long)v.frames,
+           (unsigned long)v.segments);
+#endif
+}
+
+static void server_task(void *arg) {
+  (void)arg;
+  int listen_sock = open_listen_socket(s_port, kMaxSubscribers);
+  if (listen_sock < 0) {
+    vTaskDelete(nullptr);
+    return;
+  }
+  int flags = fcntl(listen_sock, F_GETFL, 0);
+  fcntl(listen_sock, F_SETFL, flags | O_NONBLOCK);
+
+  int64_t last_report_us = esp_timer_get_time();
+  while (true) {
+    // Woken by every captured chunk; the timeout keeps accept() and the
+    // latency flush going when nothing is being captured.
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(kSendWaitMs));
+
+    accept_pending(listen_sock);
+
+    int64_t now = esp_timer_get_time();
+    for (Subscriber &sub : s_subs) {
+      if (sub.sock >= 0)
+        service_subscriber(sub, now);
+    }
+
+    if (now - last_report_us >= 1000000) {
+      if (active_subscribers() > 0)
+        log_report();
+      last_report_us = now;
+    }
+  }
+}
+
+void start_stream_server(uint16_t port, const audio::LevelMeter *levels) {
+  s_port = port;
+  s_levels = levels;
+  // One below the capture task so a slow socket can never delay I2S reads.
+  xTaskCreate(server_task, "mic_server", 4096, nullptr, 4, &s_server_task);
+}
+
+} // namespace mic
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "audio_format.h"
+#include "audio_stats.h"
+#include "broadcast_ring.h"
+
+extern "C" {
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+}
+#include <stdint.h>
+
+namespace mic {
+
+// PCM16 frames (and VAD16 frames) carry 10 ms each.
+constexpr int kPcmFrameSamples = audio::kSampleRate / 100;
+
+// Fan-out audio server for continuous capture. Any number of subscribers up
+// to CONFIG_MIC_MAX_SUBSCRIBERS read the shared capture ring through their
+// own cursor; a slow subscriber is skipped ahead or dropped (Kconfig policy)
+// and never holds up capture or the other subscribers.
+//
+// Right after connecting a subscriber may send one hello line:
+//
+//   PROTO 2 [<name>]\n  v2 framing (audio/stream_frame.h): an info frame,
+//                       then CRC-checked frames with sequence numbers and
+//                       capture timestamps
+//   CODEC <name>\n      v1: a text header, then the bare payload
+//
+// name is PCM16 (the default), ADPCM (CONFIG_MIC_ADPCM), LOSSLESS
+// (CONFIG_MIC_LOSSLESS, v2 only) or VAD16 (CONFIG_MIC_VAD, v2 only).
+// Without a hello line the subscriber gets v1
+// PCM16. The v1 header is "PCM16 <rate> <channels> 0\n", or for ADPCM
+// "ADPCM <rate> <channels> 0 <block_bytes>\n".
+//
+// levels is optional and only used for the once-per-second log line.
+void start_stream_server(uint16_t port, const audio::LevelMeter *levels);
+
+// Called by the capture task for every decimated chunk, with the
+// esp_timer time the last sample was read, the capture gain it was scaled
+// with (AGC, dB Q8; 0 for the fixed shift) and the capture clock error
+// (ppm Q4, 0 while unknown), which v2 frames carry. With
+// CONFIG_MIC_RESAMPLE the frames are also flagged as resampled. Never
+// blocks.
+void publish_samples(const int16_t *samples, int n, int64_t captured_us,
+                     int16_t gain_db_q8, int16_t drift_ppm_q4);
+
+// The PCM16 ring publish_samples() fills, for in-process readers such as
+// the RTP sender. It holds v2 frames of kPcmFrameSamples, whole frames
+// only. Like a TCP subscriber, a reader keeps its own cursor and must check
+// its lag before reading.
+const audio::BroadcastRing &live_pcm_ring();
+
+// The IMA-ADPCM ring, same rules, frames of ima_adpcm::kBlockSamples. Null
+// without CONFIG_MIC_ADPCM. ADPCM is only encoded while it has readers;
+// taking the ring here keeps it encoded from then on.
+const audio::BroadcastRing *live_adpcm_ring();
+
+// Asks publish_samples() to notify task after every chunk, as it does for
+// the server task. Call before capture starts.
+void add_stream_reader(TaskHandle_t task);
+
+} // namespace mic
@@ -0,0 +1,449 @@
+// Host benchmark for the miniOS event bus. See CMakeLists.txt for the build;
+// run it as
+//
+//   ./event_bus_bench [events]
+//
+// Threads stand in for tasks and interrupts. The consumer polls drain()
+// instead of sleeping on a task notification, so the numbers are the bus
+// itself, not the scheduler. They are host numbers: good for comparing
+// designs, not an ESP32 budget.
+//
+// 1. Throughput with 1-8 producers into one lane, the consumer draining in
+//    batches, against a mutex-guarded queue of the same size (what a
+//    FreeRTOS queue amounts to). Producers retry when the lane is full.
+//    Every producer's events must arrive complete and in order.
+// 2. Latency from post to drain of critical events, alone and while three
+//    producers flood the bulk lane faster than a slow consumer keeps up,
+//    and the same flood through one shared ring like the old single queue.
+// 3. Fan-out of the system manager's notices to 1-32 subscribers: the
+//    shared NoticeLog that every subscriber reads with its own cursor,
+//    against a queue per subscriber that gets its own copy. An atomic
+//    counter stands in for the task notification. Reported: what a publish
+//    costs the manager, latency from publish to each subscriber's read,
+//    notices lost, and the memory either way.
+
+#include "event_bus.h"
+#include "notice_log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+using sys::Event;
+using sys::EventBus;
+using sys::EventType;
+using sys::Notice;
+using Clock = std::chrono::steady_clock;
+
+static const Clock::time_point kStart = Clock::now();
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() -
+                                                              kStart)
+      .count();
+}
+
+// Spin briefly, then give the core away: with fewer cores than threads a
+// pure spin would hold up the thread it is waiting for.
+static void cpu_relax(unsigned &spins) {
+  if (++spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+    return;
+  }
+  spins = 0;
+  std::this_thread::yield();
+}
+
+// The baseline: one lock around a bounded FIFO.
+class LockedQueue {
+public:
+  explicit LockedQueue(size_t capacity) : capacity_(capacity) {}
+
+  bool post(const Event &e) {
+    std::lock_guard<std::mutex> lock(m_);
+    if (q_.size() >= capacity_)
+      return false;
+    q_.push_back(e);
+    return true;
+  }
+
+  size_t drain(Event *out, size_t max) {
+    std::lock_guard<std::mutex> lock(m_);
+    size_t n = 0;
+    while (n < max && !q_.empty()) {
+      out[n++] = q_.front();
+      q_.pop_front();
+    }
+    return n;
+  }
+
+private:
+  std::mutex m_;
+  std::deque<Event> q_;
+  size_t capacity_;
+};
+
+// Old-style single FIFO on the lock-free ring, sized like all lanes
+// together, for the starvation comparison.
+class SingleRing {
+public:
+  bool post(const Event &e) { return ring_.push(e); }
+
+  size_t drain(Event *out, size_t max) {
+    size_t n = 0;
+    while (n < max && ring_.pop(&out[n]))
+      n++;
+    return n;
+  }
+
+private:
+  sys::MpscRing<Event, 128> ring_;
+};
+
+// Producers post arg0 = producer, arg1 = sequence; the consumer checks that
+// each producer's sequence arrives whole and in order.
+template <typename Bus>
+static void throughput(const char *name, Bus &bus, int producers,
+                       int per_producer) {
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      unsigned spins = 0;
+      while (!go.load())
+        cpu_relax(spins);
+      for (int i = 0; i < per_producer; i++) {
+        Event e{EventType::REQUEST_MODE_CHANGE, 0, p, i};
+        while (!bus.post(e))
+          cpu_relax(spins);
+      }
+    });
+  }
+
+  std::vector<int32_t> next((size_t)producers, 0);
+  uint64_t total = (uint64_t)producers * per_producer, got = 0;
+  bool in_order = true;
+  Event batch[16];
+  unsigned spins = 0;
+  int64_t t0 = now_ns();
+  go.store(true);
+  while (got < total) {
+    size_t n = bus.drain(batch, 16);
+    for (size_t i = 0; i < n; i++) {
+      int32_t &want = next[(size_t)batch[i].arg0];
+      in_order &= batch[i].arg1 == want;
+      want = batch[i].arg1 + 1;
+    }
+    got += n;
+    if (n == 0)
+      cpu_relax(spins);
+  }
+  int64_t dt = now_ns() - t0;
+  for (std::thread &t : threads)
+    t.join();
+
+  printf("%-6s %d producer(s): %5.1f M events/s  %6.1f ns/event  %s\n", name,
+         producers, total * 1e3 / dt, (double)dt / total,
+         in_order ? "in order" : "OUT OF ORDER");
+}
+
+struct LatencyResult {
+  uint64_t posted = 0;
+  uint64_t dropped = 0;
+  std::vector<int64_t> latency_ns;
+};
+
+static void print_latency(const char *what, LatencyResult &r) {
+  std::vector<int64_t> &l = r.latency_ns;
+  std::sort(l.begin(), l.end());
+  auto at = [&](double q) {
+    return l.empty() ? 0.0 : l[(size_t)(q * (l.size() - 1))] / 1000.0;
+  };
+  printf("  %-9s posted %7llu  dropped %7llu (%5.1f%%)", what,
+         (unsigned long long)r.posted, (unsigned long long)r.dropped,
+         100.0 * r.dropped / (r.posted ? r.posted : 1));
+  if (!l.empty())
+    printf("  latency p50 %6.1f us  p99 %7.1f us  max %7.1f us", at(0.5),
+           at(0.99), at(1.0));
+  printf("\n");
+}
+
+// One producer posts a critical event every 200 us; flooders (if any) post
+// telemetry as fast as they can. The consumer takes batches of 8 and spends
+// work_ns on each event, so a flood backs up. Latency is measured from just
+// before post to the drain that returned it.
+template <typename Bus>
+static void latency(const char *name, Bus &bus, int flooders, int64_t work_ns,
+                    int64_t run_ns) {
+  std::atomic<bool> stop{false};
+  LatencyResult critical, bulk;
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> flood_posted((size_t)flooders),
+      flood_dropped((size_t)flooders);
+  for (int f = 0; f < flooders; f++) {
+    threads.emplace_back([&, f] {
+      uint64_t posted = 0, dropped = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        int64_t t = now_ns();
+        Event e{EventType::TELEMETRY, 0, (int32_t)(t >> 32), (int32_t)t};
+        posted++;
+        if (!bus.post(e)) {
+          // Full: back off like a task would, rather than hold the core.
+          dropped++;
+          std::this_thread::yield();
+        }
+      }
+      flood_posted[(size_t)f] = posted;
+      flood_dropped[(size_t)f] = dropped;
+    });
+  }
+  threads.emplace_back([&] {
+    unsigned spins = 0;
+    int64_t next = now_ns();
+    while (!stop.load(std::memory_order_relaxed)) {
+      while (now_ns() < next)
+        cpu_relax(spins);
+      next += 200000;
+      int64_t t = now_ns();
+      Event e{EventType::INTERNAL_ERROR, 0, (int32_t)(t >> 32), (int32_t)t};
+      critical.posted++;
+      critical.dropped += !bus.post(e);
+    }
+  });
+
+  Event batch[8];
+  unsigned spins = 0;
+  int64_t end = now_ns() + run_ns;
+  while (now_ns() < end) {
+    size_t n = bus.drain(batch, 8);
+    int64_t t = now_ns();
+    for (size_t i = 0; i < n; i++) {
+      int64_t posted_at = ((int64_t)batch[i].arg0 << 32) |
+                          (uint32_t)batch[i].arg1;
+      if (batch[i].type == EventType::INTERNAL_ERROR)
+        critical.latency_ns.push_back(t - posted_at);
+      else
+        bulk.latency_ns.push_back(t - posted_at);
+      int64_t busy_until = now_ns() + work_ns;
+      while (now_ns() < busy_until) {
+      }
+    }
+    if (n == 0)
+      cpu_relax(spins);
+  }
+  stop.store(true);
+  for (std::thread &t : threads)
+    t.join();
+  for (int f = 0; f < flooders; f++) {
+    bulk.posted += flood_posted[(size_t)f];
+    bulk.dropped += flood_dropped[(size_t)f];
+  }
+
+  printf("%s\n", name);
+  print_latency("critical", critical);
+  if (flooders > 0)
+    print_latency("telemetry", bulk);
+}
+
+// Subscriber i of a fan-out is told about a notice by pending[i]; the
+// fan-outs differ in where the notice itself goes.
+struct Pending {
+  alignas(64) std::atomic<uint32_t> count{0};
+};
+
+// The firmware design: one copy into the log, cursors per subscriber.
+class SharedLog {
+public:
+  explicit SharedLog(int subscribers)
+      : n_(subscribers), cursors_(new sys::NoticeCursor[(size_t)n_]) {}
+
+  void publish(const Notice &notice, Pending *pending) {
+    log_.publish(notice);
+    for (int i = 0; i < n_; i++) {
+      if (notice.matches(sys::kAllEvents))
+        pending[i].count.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  bool read(int i, Notice *out) {
+    return log_.read_next(&cursors_[i], sys::kAllEvents, out);
+  }
+
+  uint32_t lost(int i) const { return cursors_[i].missed; }
+
+  // The log, plus a mask, a task handle and a cursor per subscriber, as
+  // in sys_manager.cpp.
+  size_t bytes() const {
+    return sizeof(log_) +
+           (size_t)n_ * (sizeof(sys::EventMask) + sizeof(void *) +
+                         sizeof(sys::NoticeCursor));
+  }
+
+private:
+  int n_;
+  sys::NoticeLog<sys::kNoticeSlots> log_;
+  std::unique_ptr<sys::NoticeCursor[]> cursors_;
+};
+
+// The alternative: each subscriber has a queue as deep as the log and gets
+// its own copy.
+class QueueEach {
+public:
+  using Queue = sys::MpscRing<Notice, sys::kNoticeSlots>;
+
+  explicit QueueEach(int subscribers)
+      : n_(subscribers), queues_(new Queue[(size_t)n_]),
+        lost_(new uint32_t[(size_t)n_]()) {}
+
+  void publish(const Notice &notice, Pending *pending) {
+    for (int i = 0; i < n_; i++) {
+      if (!notice.matches(sys::kAllEvents))
+        continue;
+      if (!queues_[i].push(notice)) {
+        lost_[i]++;
+        continue;
+      }
+      pending[i].count.fetch_add(1, std::memory_order_release);
+    }
+  }
+
+  bool read(int i, Notice *out) { return queues_[i].pop(out); }
+
+  uint32_t lost(int i) const { return lost_[i]; }
+
+  // Queue storage only; an RTOS queue adds its control block to each.
+  size_t bytes() const {
+    return (size_t)n_ * sys::kNoticeSlots * sizeof(Notice);
+  }
+
+private:
+  int n_;
+  std::unique_ptr<Queue[]> queues_;
+  std::unique_ptr<uint32_t[]> lost_;
+};
+
+// The publisher sends a mode-change notice every interval_ns, stamped in
+// the event's arguments, and times each publish. Each subscriber thread
+// waits for its counter and reads everything new.
+template <typename Fanout>
+static void fanout(const char *name, int subscribers, int notices,
+                   int64_t interval_ns) {
+  Fanout fan(subscribers);
+  std::unique_ptr<Pending[]> pending(new Pending[(size_t)subscribers]);
+  std::atomic<bool> stop{false};
+  std::vector<std::vector<int64_t>> latency((size_t)subscribers);
+  std::vector<uint64_t> received((size_t)subscribers, 0);
+  std::vector<std::thread> threads;
+  for (int s = 0; s < subscribers; s++) {
+    latency[(size_t)s].reserve((size_t)notices);
+    threads.emplace_back([&, s] {
+      unsigned spins = 0;
+      Notice notice;
+      while (true) {
+        if (pending[s].count.exchange(0, std::memory_order_acquire) == 0) {
+          if (stop.load())
+            break;
+          cpu_relax(spins);
+          continue;
+        }
+        while (fan.read(s, &notice)) {
+          int64_t posted_at = ((int64_t)notice.event.arg0 << 32) |
+                              (uint32_t)notice.event.arg1;
+          latency[(size_t)s].push_back(now_ns() - posted_at);
+          received[(size_t)s]++;
+        }
+      }
+    });
+  }
+
+  unsigned spins = 0;
+  int64_t publish_ns = 0;
+  int64_t next = now_ns();
+  for (int i = 0; i < notices; i++) {
+    while (now_ns() < next)
+      cpu_relax(spins);
+    next += interval_ns;
+    int64_t t = now_ns();
+    sys::Mode from = (i & 1) ? sys::Mode::ONLINE : sys::Mode::ERROR;
+    sys::Mode to = (i & 1) ? sys::Mode::ERROR : sys::Mode::ONLINE;
+    Notice notice{{EventType::WIFI_LOST, 0, (int32_t)(t >> 32), (int32_t)t},
+                  from,
+                  to};
+    fan.publish(notice, pending.get());
+    publish_ns += now_ns() - t;
+  }
+  // Let the subscribers catch up before they look at stop.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  stop.store(true);
+  for (std::thread &t : threads)
+    t.join();
+
+  std::vector<int64_t> all;
+  uint64_t got = 0, lost = 0;
+  for (int s = 0; s < subscribers; s++) {
+    all.insert(all.end(), latency[(size_t)s].begin(),
+               latency[(size_t)s].end());
+    got += received[(size_t)s];
+    lost += fan.lost(s);
+  }
+  std::sort(all.begin(), all.end());
+  auto at = [&](double q) {
+    return all.empty() ? 0.0 : all[(size_t)(q * (all.size() - 1))] / 1000.0;
+  };
+  printf("%-6s %2d subscriber(s): publish %6.1f ns  latency p50 %6.1f us  "
+         "p99 %7.1f us  lost %5.2f%%  %6zu bytes\n",
+         name, subscribers, (double)publish_ns / notices, at(0.5), at(0.99),
+         100.0 * lost / ((double)notices * subscribers), fan.bytes());
+  if (got + lost != (uint64_t)notices * subscribers)
+    printf("       MISSING %llu notices\n",
+           (unsigned long long)((uint64_t)notices * subscribers - got - lost));
+}
+
+int main(int argc, char **argv) {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  int events = argc > 1 ? atoi(argv[1]) : 1000000;
+  unsigned cores = std::thread::hardware_concurrency();
+  printf("host: %u hardware threads\n", cores);
+
+  printf("== throughput, one lane of %u slots ==\n",
+         (unsigned)EventBus::kNormalSlots);
+  for (int producers : {1, 2, 4, 8}) {
+    EventBus bus;
+    throughput("lanes", bus, producers, events / producers);
+    LockedQueue locked(EventBus::kNormalSlots);
+    throughput("mutex", locked, producers, events / producers);
+  }
+
+  printf("== latency, critical event every 200 us, consumer 1 us/event ==\n");
+  constexpr int64_t kRunNs = 2000000000;
+  {
+    EventBus bus;
+    latency("lanes, idle", bus, 0, 1000, kRunNs);
+  }
+  {
+    EventBus bus;
+    latency("lanes, 3 telemetry flooders", bus, 3, 1000, kRunNs);
+  }
+  {
+    SingleRing ring;
+    latency("one shared ring, 3 telemetry flooders", ring, 3, 1000, kRunNs);
+  }
+
+  printf("== fan-out, %u-notice log, a notice every 100 us ==\n",
+         (unsigned)sys::kNoticeSlots);
+  for (int subscribers : {1, 2, 4, 8, 16, 32}) {
+    fanout<SharedLog>("log", subscribers, 20000, 100000);
+    fanout<QueueEach>("queues", subscribers, 20000, 100000);
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+// Checks miniOS on the host (system/ against host/, see CMakeLists.txt):
+//
+//   ./minios_check
+//
+// 1. Every mode and event through compute_next_mode() against the mode
+//    machine written out independently below, and find_transition() in
+//    agreement with it.
+// 2. The real event bus and system manager: a run of posts walks the mode
+//    machine through every transition, and subscribers see each mode
+//    change, their own event types and nothing else, while current_mode()
+//    and the bus metrics follow, on the console as in the buffer.
+//
+// Prints each failure and exits non-zero if there was one.
+
+#include "sys_event.h"
+#include "sys_manager.h"
+#include "sys_mode.h"
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+#include <string.h>
+
+using sys::Event;
+using sys::EventType;
+using sys::Mode;
+using sys::Notice;
+
+static int s_checks = 0;
+static int s_failures = 0;
+
+#define CHECK(cond, ...)                                                       \
+  do {                                                                         \
+    s_checks++;                                                                \
+    if (!(cond)) {                                                             \
+      s_failures++;                                                            \
+      printf("FAIL %s:%d: ", __FILE__, __LINE__);                              \
+      printf(__VA_ARGS__);                                                     \
+      printf("\n");                                                            \
+    }                                                                          \
+  } while (0)
+
+// The mode machine as specified, one line per transition. Everything else
+// leaves the mode alone.
+static Mode expected_next(Mode m, EventType e) {
+  struct {
+    Mode from;
+    EventType on;
+    Mode to;
+  } const spec[] = {
+      {Mode::IDLE, EventType::WIFI_START, Mode::WIFI_CONNECTING},
+      {Mode::WIFI_CONNECTING, EventType::WIFI_GOT_IP, Mode::ONLINE},
+      {Mode::WIFI_CONNECTING, EventType::TIMEOUT, Mode::ERROR},
+      {Mode::ONLINE, EventType::WIFI_LOST, Mode::ERROR},
+      {Mode::ERROR, EventType::INTERNAL_RECOVERED, Mode::IDLE},
+  };
+  for (const auto &t : spec) {
+    if (t.from == m && t.on == e)
+      return t.to;
+  }
+  return m;
+}
+
+static void check_table() {
+  int transitions = 0;
+  for (int m = 0; m < sys::kModeCount; m++) {
+    for (int t = 0; t < sys::kEventTypeCount; t++) {
+      Mode mode = (Mode)m;
+      EventType type = (EventType)t;
+      Mode want = expected_next(mode, type);
+      Mode got = sys::compute_next_mode(mode, Event{type, 0, 0, 0});
+      CHECK(got == want, "%s + %s: got %s, want %s", sys::mode_name(mode),
+            sys::event_name(type), sys::mode_name(got), sys::mode_name(want));
+
+      const sys::Transition *tr = sys::find_transition(mode, type);
+      if (want == mode) {
+        CHECK(!tr, "%s + %s: a transition where there is none",
+              sys::mode_name(mode), sys::event_name(type));
+        continue;
+      }
+      transitions++;
+      CHECK(tr && tr->from == mode && tr->on == type && tr->to == want,
+            "%s + %s: find_transition() disagrees", sys::mode_name(mode),
+            sys::event_name(type));
+    }
+  }
+  printf("%d modes x %d events, %d transitions checked\n", sys::kModeCount,
+         sys::kEventTypeCount, transitions);
+}
+
+// Waits for the next notice on sub, up to a second.
+static bool next(sys::Subscription *sub, Notice *out) {
+  return sys::next_notice(sub, out, pdMS_TO_TICKS(1000));
+}
+
+static void check_manager() {
+  sys::init_event_bus();
+  sys::Subscription *modes = sys::subscribe(sys::kModeChanges);
+  // A subscription belongs to the task that made it, so the trigger
+  // subscriber is a task of its own, parked once it has subscribed.
+  struct Other {
+    sys::Subscription *sub;
+    TaskHandle_t done;
+  } other{nullptr, xTaskGetCurrentTaskHandle()};
+  xTaskCreate(
+      [](void *arg) {
+        Other *o = (Other *)arg;
+        o->sub = sys::subscribe(sys::event_bit(EventType::AUDIO_TRIGGER));
+        xTaskNotifyGive(o->done);
+        while (true)
+          vTaskDelay(portMAX_DELAY);
+      },
+      "triggers", 4096, &other, 5, nullptr);
+  ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  sys::Subscription *triggers = other.sub;
+  sys::start_system_manager();
+
+  // Every transition once, with events that change nothing in between.
+  struct Step {
+    EventType type;
+    Mode after;
+  } const steps[] = {
+      {EventType::BOOT, Mode::IDLE},
+      {EventType::WIFI_START, Mode::WIFI_CONNECTING},
+      {EventType::AUDIO_TRIGGER, Mode::WIFI_CONNECTING},
+      {EventType::TIMEOUT, Mode::ERROR},
+      {EventType::WIFI_START, Mode::ERROR},
+      {EventType::INTERNAL_RECOVERED, Mode::IDLE},
+      {EventType::WIFI_START, Mode::WIFI_CONNECTING},
+      {EventType::WIFI_GOT_IP, Mode::ONLINE},
+      {EventType::TELEMETRY, Mode::ONLINE},
+      {EventType::AUDIO_TRIGGER, Mode::ONLINE},
+      {EventType::WIFI_LOST, Mode::ERROR},
+      {EventType::INTERNAL_RECOVERED, Mode::IDLE},
+  };
+  Mode before = Mode::IDLE;
+  int changes = 0, audio = 0;
+  for (const Step &s : steps) {
+    CHECK(sys::post_event(s.type, (int32_t)s.type), "post %s",
+          sys::event_name(s.type));
+    if (s.after != before) {
+      Notice n;
+      bool got = next(modes, &n);
+      CHECK(got && n.previous == before && n.mode == s.after &&
+                n.event.type == s.type,
+            "%s: no notice of %s -> %s", sys::event_name(s.type),
+            sys::mode_name(before), sys::mode_name(s.after));
+      changes++;
+    } else {
+      // Give the manager time to handle it before looking at the mode.
+      vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    CHECK(sys::current_mode() == s.after, "after %s: mode %s, want %s",
+          sys::event_name(s.type), sys::mode_name(sys::current_mode()),
+          sys::mode_name(s.after));
+    audio += s.type == EventType::AUDIO_TRIGGER;
+    before = s.after;
+  }
+  Notice n;
+  CHECK(!sys::next_notice(modes, &n, 0), "mode subscriber: a stray notice");
+
+  // The trigger subscriber's task is parked, so read its cursor from here:
+  // nothing else touches it.
+  int seen = 0;
+  while (sys::next_notice(triggers, &n, 0)) {
+    CHECK(n.event.type == EventType::AUDIO_TRIGGER,
+          "trigger subscriber got %s", sys::event_name(n.event.type));
+    seen++;
+  }
+  CHECK(seen == audio, "trigger subscriber: %d notices, want %d", seen,
+        audio);
+  CHECK(sys::missed_notices(modes) == 0 && sys::missed_notices(triggers) == 0,
+        "notices missed");
+
+  // A late subscriber starts at the present.
+  sys::Subscription *everything =
+      sys::subscribe(sys::kAllEvents | sys::kModeChanges);
+  CHECK(everything && !sys::next_notice(everything, &n, 0),
+        "late subscriber sees the past");
+  sys::post_event(EventType::BOOT);
+  CHECK(next(everything, &n) && n.event.type == EventType::BOOT &&
+            !n.mode_changed(),
+        "late subscriber missed BOOT");
+  sys::unsubscribe(everything);
+
+  sys::BusMetrics m = sys::event_metrics();
+  uint32_t dispatched = 0, dropped = 0;
+  for (int t = 0; t < sys::kEventTypeCount; t++) {
+    dispatched += m.dispatched[t];
+    dropped += m.dropped[t];
+  }
+  CHECK(dispatched == sizeof(steps) / sizeof(steps[0]) + 1 && dropped == 0,
+        "metrics: %u dispatched, %u dropped", (unsigned)dispatched,
+        (unsigned)dropped);
+  CHECK(m.dispatched[(int)EventType::WIFI_START] == 3,
+        "metrics: %u WIFI_START",
+        (unsigned)m.dispatched[(int)EventType::WIFI_START]);
+
+  // The console dump is the same text as the buffer the HTTP server sends.
+  static char text[4096], dumped[4096];
+  size_t len = sys::format_event_metrics(text, sizeof(text));
+  FILE *out = fmemopen(dumped, sizeof(dumped), "w");
+  sys::print_event_metrics(out);
+  long dumped_len = ftell(out);
+  fclose(out);
+  CHECK(len < sizeof(text) && dumped_len == (long)len &&
+            memcmp(text, dumped, len) == 0,
+        "metrics: console dump differs from format_event_metrics()");
+  printf("manager: %d mode changes, %d trigger notices, %u events\n", changes,
+         seen, (unsigned)dispatched);
+}
+
+int main() {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  esp_log_level_set("*", ESP_LOG_WARN);
+  check_table();
+  check_manager();
+  printf("%d checks, %d failed\n", s_checks, s_failures);
+  return s_failures ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+// Stress benchmark for miniOS on the host (system/ against host/, see
+// CMakeLists.txt):
+//
+//   ./minios_stress [events] [producers]
+//
+// Producer threads push events through post_event() into the real bus and
+// system manager, retrying when a lane is full, until all of them are in.
+// In every 64 events one is critical (INTERNAL_ERROR) and one a request,
+// the rest alternate between telemetry and audio triggers, so all three
+// lanes fill. A subscriber task follows the critical events and mode
+// changes through the notice log, as a task on the device would.
+//
+// At the end the bus metrics must account for every event posted, type by
+// type. Reported: events per second through the manager, how often a post
+// found its lane full, lane high water, the post-to-dispatch wait and what
+// the subscriber saw. Exits non-zero if anything is missing.
+
+#include "sys_event.h"
+#include "sys_manager.h"
+#include "sys_mode.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+using sys::EventType;
+
+static EventType type_for(uint32_t i) {
+  switch (i % 64) {
+  case 0:
+    return EventType::INTERNAL_ERROR;
+  case 1:
+    return EventType::REQUEST_MODE_CHANGE;
+  default:
+    return i & 1 ? EventType::TELEMETRY : EventType::AUDIO_TRIGGER;
+  }
+}
+
+struct Follower {
+  std::atomic<bool> stop{false};
+  std::atomic<uint32_t> critical{0};
+  std::atomic<uint32_t> missed{0};
+  std::atomic<bool> done{false};
+};
+
+static void follower_task(void *arg) {
+  Follower *f = (Follower *)arg;
+  sys::Subscription *sub = sys::subscribe(
+      sys::event_bit(EventType::INTERNAL_ERROR) | sys::kModeChanges);
+  sys::Notice n;
+  while (!f->stop.load()) {
+    if (!sys::next_notice(sub, &n, pdMS_TO_TICKS(10)))
+      continue;
+    if (n.event.type == EventType::INTERNAL_ERROR)
+      f->critical.fetch_add(1, std::memory_order_relaxed);
+  }
+  while (sys::next_notice(sub, &n, 0)) {
+    if (n.event.type == EventType::INTERNAL_ERROR)
+      f->critical.fetch_add(1, std::memory_order_relaxed);
+  }
+  f->missed.store(sys::missed_notices(sub));
+  sys::unsubscribe(sub);
+  f->done.store(true);
+  while (true)
+    vTaskDelay(portMAX_DELAY);
+}
+
+int main(int argc, char **argv) {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  uint32_t events = argc > 1 ? (uint32_t)atol(argv[1]) : 4000000;
+  int producers = argc > 2 ? atoi(argv[2]) : 4;
+  // Full lanes are the point here; they are counted, not logged.
+  esp_log_level_set("SYS_EVENT", ESP_LOG_NONE);
+  printf("host: %u hardware threads; %lu events from %d producers\n",
+         std::thread::hardware_concurrency(), (unsigned long)events,
+         producers);
+
+  sys::init_event_bus();
+  sys::start_system_manager();
+  Follower follower;
+  xTaskCreate(follower_task, "follower", 4096, &follower, 5, nullptr);
+  vTaskDelay(pdMS_TO_TICKS(50));
+
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  std::vector<uint64_t> full((size_t)producers, 0);
+  std::vector<uint32_t> posted((size_t)producers * sys::kEventTypeCount, 0);
+  for (int p = 0; p < producers; p++) {
+    threads.emplace_back([&, p] {
+      while (!go.load())
+        std::this_thread::yield();
+      uint32_t *mine = &posted[(size_t)p * sys::kEventTypeCount];
+      for (uint32_t i = (uint32_t)p; i < events; i += (uint32_t)producers) {
+        EventType type = type_for(i);
+        while (!sys::post_event(type, (int32_t)i, p)) {
+          full[(size_t)p]++;
+          // Back off like a task would, rather than hold the core.
+          std::this_thread::yield();
+        }
+        mine[(int)type]++;
+      }
+    });
+  }
+
+  int64_t t0 = esp_timer_get_time();
+  go.store(true);
+  for (std::thread &t : threads)
+    t.join();
+  int64_t posted_us = esp_timer_get_time() - t0;
+
+  // Then wait for the manager to dispatch the last of them.
+  uint32_t want[sys::kEventTypeCount] = {};
+  uint32_t total = 0;
+  for (int p = 0; p < producers; p++) {
+    for (int t = 0; t < sys::kEventTypeCount; t++)
+      want[t] += posted[(size_t)p * sys::kEventTypeCount + t];
+  }
+  for (int t = 0; t < sys::kEventTypeCount; t++)
+    total += want[t];
+  sys::BusMetrics m;
+  uint32_t dispatched = 0;
+  for (int tries = 0; tries < 200; tries++) {
+    m = sys::event_metrics();
+    dispatched = 0;
+    for (int t = 0; t < sys::kEventTypeCount; t++)
+      dispatched += m.dispatched[t];
+    if (dispatched == total)
+      break;
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+  int64_t all_us = esp_timer_get_time() - t0;
+  follower.stop.store(true);
+  while (!follower.done.load())
+    vTaskDelay(pdMS_TO_TICKS(1));
+
+  bool ok = true;
+  for (int t = 0; t < sys::kEventTypeCount; t++) {
+    if (m.dispatched[t] == want[t])
+      continue;
+    printf("MISMATCH %s: posted %lu, dispatched %lu\n",
+           sys::event_name((EventType)t), (unsigned long)want[t],
+           (unsigned long)m.dispatched[t]);
+    ok = false;
+  }
+  uint64_t full_total = 0;
+  for (uint64_t f : full)
+    full_total += f;
+
+  printf("%lu events in %.2f s: %.2f M events/s posted, %.2f M/s "
+         "dispatched\n",
+         (unsigned long)total, all_us / 1e6, total / (double)posted_us,
+         total / (double)all_us);
+  printf("lane full on %.1f%% of posts (retried)\n",
+         100.0 * full_total / (double)(full_total + total));
+  printf("high water: critical %lu/%lu, normal %lu/%lu, bulk %lu/%lu\n",
+         (unsigned long)m.high_water[0],
+         (unsigned long)sys::EventBus::kCriticalSlots,
+         (unsigned long)m.high_water[1],
+         (unsigned long)sys::EventBus::kNormalSlots,
+         (unsigned long)m.high_water[2],
+         (unsigned long)sys::EventBus::kBulkSlots);
+  printf("wait post to dispatch: p50 <= %lu us, p99 <= %lu us, max %lu us\n",
+         (unsigned long)sys::latency_quantile_us(m, 0.5),
+         (unsigned long)sys::latency_quantile_us(m, 0.99),
+         (unsigned long)m.latency_max_us);
+  uint32_t critical = want[(int)EventType::INTERNAL_ERROR];
+  // missed counts notices of every type the log lapped it on.
+  printf("subscriber: %lu of %lu critical notices; fell a lap behind over "
+         "%lu notices\n",
+         (unsigned long)follower.critical.load(), (unsigned long)critical,
+         (unsigned long)follower.missed.load());
+  if (follower.critical.load() + follower.missed.load() < critical) {
+    printf("MISMATCH subscriber: notices unaccounted for\n");
+    ok = false;
+  }
+  printf("%s\n", ok ? "all events accounted for" : "FAILED");
+  return ok ? 0 : 1;
+}
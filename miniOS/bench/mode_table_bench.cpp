@@ -0,0 +1,134 @@
+// Host benchmark for the mode table (system/sys_mode.cpp) against the
+// nested switch it replaced. Run it as
+//
+//   ./mode_table_bench [events]
+//   ./mode_table_bench --dot | dot -Tsvg > modes.svg
+//
+// First every mode and event goes through both and must give the same
+// mode. Then a stream of events is run through each, every next mode
+// depending on the last, once with uniformly random events and once with
+// the mix a running device sees: mostly telemetry and audio triggers that
+// change nothing.
+
+#include "sys_mode.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using sys::Event;
+using sys::EventType;
+using sys::Mode;
+using Clock = std::chrono::steady_clock;
+
+// compute_next_mode() as it was before the table.
+__attribute__((noinline)) static Mode switch_next_mode(Mode current,
+                                                       const Event &e) {
+  switch (current) {
+
+  case Mode::IDLE:
+    if (e.type == EventType::WIFI_START)
+      return Mode::WIFI_CONNECTING;
+    break;
+
+  case Mode::WIFI_CONNECTING:
+    if (e.type == EventType::WIFI_GOT_IP)
+      return Mode::ONLINE;
+    if (e.type == EventType::TIMEOUT)
+      return Mode::ERROR;
+    break;
+
+  case Mode::ONLINE:
+    if (e.type == EventType::WIFI_LOST)
+      return Mode::ERROR;
+    break;
+
+  case Mode::ERROR:
+    if (e.type == EventType::INTERNAL_RECOVERED)
+      return Mode::IDLE;
+    break;
+
+  case Mode::OTA_UPDATE:
+    break;
+  }
+
+  return current;
+}
+
+static bool same_as_switch() {
+  bool same = true;
+  for (int m = 0; m < sys::kModeCount; m++) {
+    for (int t = 0; t < sys::kEventTypeCount; t++) {
+      Event e{(EventType)t, 0, 0, 0};
+      Mode a = switch_next_mode((Mode)m, e);
+      Mode b = sys::compute_next_mode((Mode)m, e);
+      if (a != b) {
+        printf("  %s + %s: switch %s, table %s\n", sys::mode_name((Mode)m),
+               sys::event_name((EventType)t), sys::mode_name(a),
+               sys::mode_name(b));
+        same = false;
+      }
+    }
+  }
+  return same;
+}
+
+template <typename Next>
+static void run(const char *name, const std::vector<Event> &events,
+                Next next) {
+  Mode mode = Mode::IDLE;
+  uint32_t changes = 0;
+  auto t0 = Clock::now();
+  for (const Event &e : events) {
+    Mode m = next(mode, e);
+    changes += m != mode;
+    mode = m;
+  }
+  double ns =
+      std::chrono::duration<double, std::nano>(Clock::now() - t0).count();
+  printf("  %-6s %5.2f ns/event  %u mode changes\n", name,
+         ns / events.size(), changes);
+}
+
+static void compare(const char *what, const std::vector<Event> &events) {
+  printf("%s\n", what);
+  run("switch", events, switch_next_mode);
+  run("table", events, sys::compute_next_mode);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--dot") == 0) {
+    sys::print_mode_graph(stdout);
+    return 0;
+  }
+  int count = argc > 1 ? atoi(argv[1]) : 10000000;
+
+  bool same = same_as_switch();
+  printf("%d modes x %d events: %s\n", sys::kModeCount, sys::kEventTypeCount,
+         same ? "table matches the switch" : "TABLE DIFFERS");
+
+  uint32_t rng = 1;
+  auto random = [&] {
+    rng = rng * 1664525u + 1013904223u;
+    return rng >> 8;
+  };
+  std::vector<Event> uniform((size_t)count), device((size_t)count);
+  for (Event &e : uniform)
+    e = Event{(EventType)(random() % sys::kEventTypeCount), 0, 0, 0};
+  // One in 64 is a lifecycle event, the rest telemetry and triggers.
+  for (Event &e : device) {
+    uint32_t r = random();
+    EventType t = r % 64 == 0
+                      ? (EventType)((r >> 6) % 7 + (int)EventType::WIFI_START)
+                      : (r & 64 ? EventType::TELEMETRY
+                                : EventType::AUDIO_TRIGGER);
+    e = Event{t, 0, 0, 0};
+  }
+
+  compare("uniform events", uniform);
+  compare("device mix", device);
+  return same ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE,
+} esp_log_level_t;
+
+// As on the device: "*" sets every tag, anything else one tag.
+void esp_log_level_set(const char *tag, esp_log_level_t level);
+int esp_log_enabled(const char *tag, esp_log_level_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+// One line to stdout each, "I TAG: message", without colours or times.
+#define ESP_LOG_LEVEL_HOST(level, letter, tag, format, ...)                    \
+  do {                                                                         \
+    if (esp_log_enabled(tag, level))                                           \
+      printf(letter " %s: " format "\n", tag, ##__VA_ARGS__);                  \
+  } while (0)
+
+#define ESP_LOGE(tag, format, ...)                                             \
+  ESP_LOG_LEVEL_HOST(ESP_LOG_ERROR, "E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)                                             \
+  ESP_LOG_LEVEL_HOST(ESP_LOG_WARN, "W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)                                             \
+  ESP_LOG_LEVEL_HOST(ESP_LOG_INFO, "I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)                                             \
+  ESP_LOG_LEVEL_HOST(ESP_LOG_DEBUG, "D", tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...)                                             \
+  ESP_LOG_LEVEL_HOST(ESP_LOG_VERBOSE, "V", tag, format, ##__VA_ARGS__)
@@ -0,0 +1,20 @@
+#pragma once
+
+// Just enough FreeRTOS for miniOS on a POSIX host (freertos_posix.cpp):
+// tasks are threads and a tick is a millisecond of the monotonic clock.
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms)                                                      \
+  ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+// There are no interrupts to return from.
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
@@ -0,0 +1,131 @@
+// The FreeRTOS and ESP-IDF calls miniOS makes, on POSIX threads. Only what
+// system/ uses; see freertos/FreeRTOS.h.
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string.h>
+#include <thread>
+
+struct HostTask {
+  std::mutex m;
+  std::condition_variable cv;
+  uint32_t notify = 0;
+};
+
+// Handles are never freed: like a task handle on the device, one may be
+// notified after its thread is gone.
+static thread_local HostTask *t_self = nullptr;
+
+static const std::chrono::steady_clock::time_point s_start =
+    std::chrono::steady_clock::now();
+
+extern "C" {
+
+int64_t esp_timer_get_time(void) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - s_start)
+      .count();
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name,
+                       uint32_t stack_depth, void *arg, UBaseType_t priority,
+                       TaskHandle_t *created) {
+  (void)name;
+  (void)stack_depth;
+  (void)priority;
+  HostTask *task = new HostTask;
+  std::thread([fn, arg, task] {
+    t_self = task;
+    fn(arg);
+  }).detach();
+  if (created)
+    *created = task;
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+  if (!t_self)
+    t_self = new HostTask;
+  return t_self;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> lock(task->m);
+    task->notify++;
+  }
+  task->cv.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken) {
+  xTaskNotifyGive(task);
+  if (woken)
+    *woken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+  HostTask *self = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> lock(self->m);
+  auto given = [self] { return self->notify > 0; };
+  if (timeout == portMAX_DELAY)
+    self->cv.wait(lock, given);
+  else
+    self->cv.wait_for(lock, std::chrono::milliseconds(timeout), given);
+  uint32_t value = self->notify;
+  if (clear_on_exit)
+    self->notify = 0;
+  else if (value > 0)
+    self->notify--;
+  return value;
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return (TickType_t)(esp_timer_get_time() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+// A handful of per-tag levels is plenty for a test or a benchmark.
+static std::mutex s_log_mutex;
+static esp_log_level_t s_log_default = ESP_LOG_INFO;
+static struct {
+  const char *tag;
+  esp_log_level_t level;
+} s_log_tags[16];
+
+void esp_log_level_set(const char *tag, esp_log_level_t level) {
+  std::lock_guard<std::mutex> lock(s_log_mutex);
+  if (strcmp(tag, "*") == 0) {
+    s_log_default = level;
+    for (auto &t : s_log_tags)
+      t.tag = nullptr;
+    return;
+  }
+  for (auto &t : s_log_tags) {
+    if (!t.tag || strcmp(t.tag, tag) == 0) {
+      t.tag = tag;
+      t.level = level;
+      return;
+    }
+  }
+}
+
+int esp_log_enabled(const char *tag, esp_log_level_t level) {
+  std::lock_guard<std::mutex> lock(s_log_mutex);
+  for (auto &t : s_log_tags) {
+    if (t.tag && strcmp(t.tag, tag) == 0)
+      return level <= t.level;
+  }
+  return level <= s_log_default;
+}
+
+} // extern "C"
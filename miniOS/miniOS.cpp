@@ -5,6 +5,14 @@ void app_main(void); // Forward declaration with C linkage
 #include "sys_event.h"
 #include "sys_manager.h"
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <stdio.h>
+
+// How often the bus metrics go to the console.
+static constexpr TickType_t kMetricsDumpTicks = pdMS_TO_TICKS(30000);
+
 extern "C" void app_main(void) {
   sys::init_event_bus();
   sys::start_system_manager();
@@ -14,4 +22,10 @@ extern "C" void app_main(void) {
 
   // Simulate Wi-Fi lifecycle (temporary)
   sys::post_event(sys::EventType::WIFI_START);
+
+  // The bus metrics on the serial console, in the Prometheus text format.
+  while (true) {
+    vTaskDelay(kMetricsDumpTicks);
+    sys::print_event_metrics(stdout);
+  }
 }
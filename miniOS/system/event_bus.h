@@ -0,0 +1,119 @@
+#pragma once
+
+#include "event_ring.h"
+#include "sys_types.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sys {
+
+struct Event {
+  EventType type;
+  uint32_t timestamp_us; // when posted, esp_timer_get_time() truncated
+
+  int32_t arg0; // generic payload
+  int32_t arg1;
+};
+
+// Lanes drain in this order, each to empty before the next.
+enum class Lane : uint8_t {
+  CRITICAL = 0, // faults and recovery: must never wait behind anything
+  NORMAL,       // lifecycle and requests
+  BULK,         // telemetry; first to be dropped when the consumer lags
+};
+
+constexpr int kLaneCount = 3;
+
+// Inlined everywhere, so post_event_from_isr() stays in IRAM.
+__attribute__((always_inline)) constexpr Lane lane_of(EventType type) {
+  switch (type) {
+  case EventType::INTERNAL_ERROR:
+  case EventType::INTERNAL_RECOVERED:
+    return Lane::CRITICAL;
+  case EventType::TELEMETRY:
+    return Lane::BULK;
+  default:
+    return Lane::NORMAL;
+  }
+}
+
+// The event bus proper, without the RTOS: one MpscRing per lane. Any number
+// of producers (tasks on either core, interrupts) post; one consumer
+// drains. A full lane drops the new event and counts it, and never touches
+// the other lanes, so a flood of telemetry cannot push out an error.
+class EventBus {
+public:
+  static constexpr uint32_t kCriticalSlots = 16;
+  static constexpr uint32_t kNormalSlots = 32;
+  static constexpr uint32_t kBulkSlots = 64;
+
+  // Any context. Returns false if the event's lane is full.
+  __attribute__((always_inline)) inline bool post(const Event &e) {
+    Lane lane = lane_of(e.type);
+    bool ok;
+    switch (lane) {
+    case Lane::CRITICAL:
+      ok = critical_.push(e);
+      break;
+    case Lane::NORMAL:
+      ok = normal_.push(e);
+      break;
+    default:
+      ok = bulk_.push(e);
+      break;
+    }
+    if (!ok && (int)e.type < kEventTypeCount)
+      dropped_[(int)e.type].fetch_add(1, std::memory_order_relaxed);
+    return ok;
+  }
+
+  // Consumer only. Moves up to max events into out, highest lane first,
+  // each lane in the order it was posted. Returns how many.
+  size_t drain(Event *out, size_t max) {
+    size_t n = 0;
+    while (n < max && critical_.pop(&out[n]))
+      n++;
+    while (n < max && normal_.pop(&out[n]))
+      n++;
+    while (n < max && bulk_.pop(&out[n]))
+      n++;
+    return n;
+  }
+
+  // Events lost to a full lane since start.
+  uint32_t dropped(EventType type) const {
+    return dropped_[(int)type].load(std::memory_order_relaxed);
+  }
+
+  uint32_t dropped(Lane lane) const {
+    uint32_t n = 0;
+    for (int t = 0; t < kEventTypeCount; t++) {
+      if (lane_of((EventType)t) == lane)
+        n += dropped((EventType)t);
+    }
+    return n;
+  }
+
+  // Consumer only: events waiting in a lane, counting any a producer is
+  // still writing.
+  uint32_t depth(Lane lane) const {
+    switch (lane) {
+    case Lane::CRITICAL:
+      return critical_.size();
+    case Lane::NORMAL:
+      return normal_.size();
+    default:
+      return bulk_.size();
+    }
+  }
+
+private:
+  MpscRing<Event, kCriticalSlots> critical_;
+  MpscRing<Event, kNormalSlots> normal_;
+  MpscRing<Event, kBulkSlots> bulk_;
+  std::atomic<uint32_t> dropped_[kEventTypeCount] = {};
+};
+
+} // namespace sys
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "event_bus.h"
+#include "sys_types.h"
+
+#include <atomic>
+#include <stdint.h>
+
+namespace sys {
+
+// Post-to-dispatch latency buckets: bucket b counts the events that waited
+// at most 2^b us and more than half that, the last one everything over
+// 2^(kLatencyBuckets - 2) us (about a second).
+constexpr int kLatencyBuckets = 22;
+
+constexpr int latency_bucket(uint32_t us) {
+  if (us <= 1)
+    return 0;
+  int b = 32 - __builtin_clz(us - 1);
+  return b < kLatencyBuckets - 1 ? b : kLatencyBuckets - 1;
+}
+
+// The bus counters at one moment, all since boot.
+struct BusMetrics {
+  uint32_t dispatched[kEventTypeCount]; // taken off the bus by the consumer
+  uint32_t dropped[kEventTypeCount];    // lost to a full lane
+  uint32_t high_water[kLaneCount];      // most events seen waiting in a lane
+  uint32_t latency_us[kLatencyBuckets]; // post to dispatch, by bucket
+  uint32_t latency_max_us;
+};
+
+// Upper bound of the bucket holding quantile q (0..1) of the dispatch
+// latency, or 0 with nothing dispatched; UINT32_MAX for the open bucket.
+inline uint32_t latency_quantile_us(const BusMetrics &m, double q) {
+  uint64_t total = 0;
+  for (int b = 0; b < kLatencyBuckets; b++)
+    total += m.latency_us[b];
+  if (total == 0)
+    return 0;
+  uint64_t want = (uint64_t)(q * (double)(total - 1)) + 1, seen = 0;
+  for (int b = 0; b < kLatencyBuckets - 1; b++) {
+    seen += m.latency_us[b];
+    if (seen >= want)
+      return 1u << b;
+  }
+  return UINT32_MAX;
+}
+
+// What the bus consumer records as it drains an EventBus. Only the
+// consumer writes, so each counter is a plain load and store and nothing
+// is added to the post path; any task can take a snapshot.
+class EventMetrics {
+public:
+  // Before a drain: how many events wait in the lane.
+  void record_depth(Lane lane, uint32_t depth) {
+    std::atomic<uint32_t> &hw = high_water_[(int)lane];
+    if (depth > hw.load(std::memory_order_relaxed))
+      hw.store(depth, std::memory_order_relaxed);
+  }
+
+  // After a drain, for each event, with the time (us, same clock as
+  // Event::timestamp_us) taken once the drain was done.
+  void record_dispatch(const Event &e, uint32_t now_us) {
+    uint32_t us = now_us - e.timestamp_us;
+    if ((int)e.type < kEventTypeCount)
+      bump(dispatched_[(int)e.type]);
+    bump(latency_[latency_bucket(us)]);
+    if (us > max_us_.load(std::memory_order_relaxed))
+      max_us_.store(us, std::memory_order_relaxed);
+  }
+
+  // Any task. Counters move on while it copies, so a snapshot may be a
+  // few events inconsistent, never torn.
+  void snapshot(const EventBus &bus, BusMetrics *out) const {
+    for (int t = 0; t < kEventTypeCount; t++) {
+      out->dispatched[t] = dispatched_[t].load(std::memory_order_relaxed);
+      out->dropped[t] = bus.dropped((EventType)t);
+    }
+    for (int l = 0; l < kLaneCount; l++)
+      out->high_water[l] = high_water_[l].load(std::memory_order_relaxed);
+    for (int b = 0; b < kLatencyBuckets; b++)
+      out->latency_us[b] = latency_[b].load(std::memory_order_relaxed);
+    out->latency_max_us = max_us_.load(std::memory_order_relaxed);
+  }
+
+private:
+  static void bump(std::atomic<uint32_t> &c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint32_t> dispatched_[kEventTypeCount] = {};
+  std::atomic<uint32_t> high_water_[kLaneCount] = {};
+  std::atomic<uint32_t> latency_[kLatencyBuckets] = {};
+  std::atomic<uint32_t> max_us_{0};
+};
+
+} // namespace sys
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+namespace sys {
+
+// Bounded lock-free ring for many producers and one consumer, after
+// Vyukov's bounded queue: every slot carries a sequence number that says
+// whether it is free for the producer of a given lap or holds a value for
+// the consumer.
+//
+// A producer claims a position with one compare-and-swap on head_, copies
+// its value in and then publishes the slot by bumping its sequence. Nothing
+// ever waits on a lock, so push() is safe from tasks on both cores and from
+// interrupts: an interrupt that lands between another producer's claim and
+// publish just claims the next slot. The consumer only stops early at a
+// claimed but not yet published slot and picks it up on its next pop().
+//
+// N must be a power of two. Only plain-copyable T.
+template <typename T, uint32_t N> class MpscRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  MpscRing() {
+    for (uint32_t i = 0; i < N; i++)
+      slots_[i].seq.store(i, std::memory_order_relaxed);
+  }
+
+  static constexpr uint32_t capacity() { return N; }
+
+  // Any context. Returns false, leaving the ring as it was, if it is full.
+  __attribute__((always_inline)) inline bool push(const T &value) {
+    uint32_t pos = head_.load(std::memory_order_relaxed);
+    while (true) {
+      Slot &slot = slots_[pos & (N - 1)];
+      uint32_t seq = slot.seq.load(std::memory_order_acquire);
+      int32_t diff = (int32_t)(seq - pos);
+      if (diff == 0) {
+        if (head_.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed))
+          break;
+        // pos now holds the head another producer moved to.
+      } else if (diff < 0) {
+        return false; // the consumer has not freed this slot yet: full
+      } else {
+        pos = head_.load(std::memory_order_relaxed);
+      }
+    }
+    Slot &slot = slots_[pos & (N - 1)];
+    slot.value = value;
+    slot.seq.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer only. Returns false if there is nothing published to take.
+  bool pop(T *out) {
+    Slot &slot = slots_[tail_ & (N - 1)];
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if ((int32_t)(seq - (tail_ + 1)) < 0)
+      return false;
+    *out = slot.value;
+    slot.seq.store(tail_ + N, std::memory_order_release);
+    tail_++;
+    return true;
+  }
+
+  // Claimed slots not yet popped. Exact only from the consumer when no
+  // producer is running.
+  uint32_t size() const {
+    return head_.load(std::memory_order_relaxed) - tail_;
+  }
+
+private:
+  struct Slot {
+    std::atomic<uint32_t> seq;
+    T value;
+  };
+
+  // Producers hammer head_; keep it off the consumer's line on chips that
+  // have caches.
+  alignas(64) std::atomic<uint32_t> head_{0};
+  alignas(64) uint32_t tail_ = 0;
+  Slot slots_[N];
+};
+
+} // namespace sys
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "event_bus.h"
+#include "sys_types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace sys {
+
+// Runs as the manager leaves or enters a mode through one transition.
+using TransitionHook = void (*)(const Event &e);
+
+// One line of a mode table: in mode `from`, event `on` moves to `to`.
+// on_exit runs before the mode changes, on_enter after.
+struct Transition {
+  Mode from;
+  EventType on;
+  Mode to;
+  TransitionHook on_exit = nullptr;
+  TransitionHook on_enter = nullptr;
+};
+
+// A transition list compiled into dense Mode x EventType arrays, so a
+// lookup is one load whatever the number of modes and events. Built at
+// compile time by build_mode_table().
+struct ModeTable {
+  Mode next[kModeCount][kEventTypeCount];
+  // 1 + index into the transition list, 0 where nothing happens.
+  uint8_t index[kModeCount][kEventTypeCount];
+};
+
+// The checks below are constexpr so a table can static_assert them.
+
+// Every mode and event is a real enumerator.
+template <size_t N>
+constexpr bool transitions_in_range(const Transition (&t)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    if ((int)t[i].from >= kModeCount || (int)t[i].to >= kModeCount ||
+        (int)t[i].on >= kEventTypeCount)
+      return false;
+  }
+  return true;
+}
+
+// At most one transition per mode and event.
+template <size_t N>
+constexpr bool transitions_deterministic(const Transition (&t)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = i + 1; j < N; j++) {
+      if (t[i].from == t[j].from && t[i].on == t[j].on)
+        return false;
+    }
+  }
+  return true;
+}
+
+// A transition changes the mode; staying put is the absence of one.
+template <size_t N>
+constexpr bool transitions_move(const Transition (&t)[N]) {
+  for (size_t i = 0; i < N; i++) {
+    if (t[i].from == t[i].to)
+      return false;
+  }
+  return true;
+}
+
+constexpr uint32_t mode_bit(Mode m) { return 1u << (uint32_t)m; }
+
+// Modes reachable from start, one bit each (mode_bit()).
+template <size_t N>
+constexpr uint32_t reachable_modes(const Transition (&t)[N], Mode start) {
+  uint32_t seen = mode_bit(start);
+  bool grew = true;
+  while (grew) {
+    grew = false;
+    for (size_t i = 0; i < N; i++) {
+      if ((seen & mode_bit(t[i].from)) && !(seen & mode_bit(t[i].to))) {
+        seen |= mode_bit(t[i].to);
+        grew = true;
+      }
+    }
+  }
+  return seen;
+}
+
+template <size_t N>
+constexpr ModeTable build_mode_table(const Transition (&t)[N]) {
+  static_assert(N < 255, "index is a uint8_t");
+  ModeTable table{};
+  for (int m = 0; m < kModeCount; m++) {
+    for (int e = 0; e < kEventTypeCount; e++)
+      table.next[m][e] = (Mode)m;
+  }
+  for (size_t i = 0; i < N; i++) {
+    table.next[(int)t[i].from][(int)t[i].on] = t[i].to;
+    table.index[(int)t[i].from][(int)t[i].on] = (uint8_t)(i + 1);
+  }
+  return table;
+}
+
+} // namespace sys
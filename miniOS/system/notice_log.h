@@ -0,0 +1,131 @@
+#pragma once
+
+#include "event_bus.h"
+#include "sys_types.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace sys {
+
+// What a subscriber asks for: one bit per EventType, plus one for mode
+// changes whatever the event behind them.
+using EventMask = uint32_t;
+
+constexpr EventMask event_bit(EventType type) {
+  return (EventMask)1 << (uint32_t)type;
+}
+constexpr EventMask kModeChanges = (EventMask)1 << 31;
+constexpr EventMask kAllEvents = kModeChanges - 1;
+
+// One event as the system manager handled it, with the mode before and
+// after.
+struct Notice {
+  Event event;
+  Mode previous;
+  Mode mode;
+
+  bool mode_changed() const { return mode != previous; }
+
+  bool matches(EventMask mask) const {
+    return (mask & event_bit(event.type)) ||
+           ((mask & kModeChanges) && mode_changed());
+  }
+};
+
+// The system manager's log.
+constexpr uint32_t kNoticeSlots = 64;
+
+// Where one reader is in a NoticeLog. Owned by that reader.
+struct NoticeCursor {
+  uint32_t next = 0;   // number of the next notice to look at
+  uint32_t missed = 0; // notices overwritten before they were read
+};
+
+// Single-writer broadcast log of Notices. The writer stores each notice
+// once and every reader follows the log with its own NoticeCursor, so
+// fanning out to any number of subscribers costs one copy in, not one per
+// subscriber, and nothing is kept per subscriber but the cursor.
+//
+// Every slot is a small sequence lock (see audio::SeqLock): the writer
+// marks it odd while it rewrites it and a reader checks the mark before
+// and after copying. The writer never waits: a reader that falls a whole
+// lap behind loses the oldest notices and counts them in its cursor.
+//
+// N must be a power of two. Only one task may call publish().
+template <uint32_t N> class NoticeLog {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of two");
+
+public:
+  static constexpr uint32_t capacity() { return N; }
+
+  // Writer only.
+  void publish(const Notice &notice) {
+    uint32_t n = head_.load(std::memory_order_relaxed);
+    Slot &slot = slots_[n & (N - 1)];
+    uint32_t words[kWords] = {};
+    memcpy(words, &notice, sizeof(Notice));
+
+    slot.seq.store(2 * n + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < kWords; i++)
+      slot.words[i].store(words[i], std::memory_order_relaxed);
+    slot.seq.store(2 * n + 2, std::memory_order_release);
+    head_.store(n + 1, std::memory_order_release);
+  }
+
+  // Number of the next notice to be published. A new reader starts here.
+  uint32_t head() const { return head_.load(std::memory_order_acquire); }
+
+  // Any reader. Copies the next notice matching mask into out and moves
+  // the cursor past it; returns false once the reader has caught up.
+  bool read_next(NoticeCursor *cursor, EventMask mask, Notice *out) const {
+    uint32_t head = head_.load(std::memory_order_acquire);
+    while (cursor->next != head) {
+      if (head - cursor->next > N) {
+        cursor->missed += head - cursor->next - N;
+        cursor->next = head - N;
+      }
+      uint32_t n = cursor->next++;
+      if (!read(n, out)) {
+        // Rewritten while we looked: it is gone, never wait for the writer.
+        cursor->missed++;
+        continue;
+      }
+      if (out->matches(mask))
+        return true;
+    }
+    return false;
+  }
+
+private:
+  static constexpr size_t kWords = (sizeof(Notice) + 3) / 4;
+
+  // Copies notice n if its slot still holds it, whole.
+  bool read(uint32_t n, Notice *out) const {
+    const Slot &slot = slots_[n & (N - 1)];
+    uint32_t before = slot.seq.load(std::memory_order_acquire);
+    if (before != 2 * n + 2)
+      return false;
+    uint32_t words[kWords];
+    for (size_t i = 0; i < kWords; i++)
+      words[i] = slot.words[i].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != before)
+      return false;
+    memcpy(out, words, sizeof(Notice));
+    return true;
+  }
+
+  struct Slot {
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> words[kWords] = {};
+  };
+
+  alignas(64) std::atomic<uint32_t> head_{0};
+  Slot slots_[N];
+};
+
+} // namespace sys
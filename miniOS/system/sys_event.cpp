@@ -1,35 +1,167 @@
 #include "sys_event.h"
+#include "sys_mode.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
+#include "freertos/task.h"
 
-static QueueHandle_t s_event_queue = nullptr;
+#include <atomic>
+#include <stdio.h>
+
+static sys::EventBus s_bus;
 // Static variable enforces single global event bus because no other file can
 // touch this (encapsulation)
+static std::atomic<TaskHandle_t> s_consumer{nullptr};
+// Written by the consumer only.
+static sys::EventMetrics s_metrics;
 static const char *TAG = "SYS_EVENT";
 
 namespace sys {
 
 void init_event_bus() {
-  s_event_queue = xQueueCreate(16, sizeof(Event));
-  configASSERT(s_event_queue);
+  ESP_LOGI(TAG, "Event bus: %lu critical, %lu normal, %lu bulk slots",
+           (unsigned long)EventBus::kCriticalSlots,
+           (unsigned long)EventBus::kNormalSlots,
+           (unsigned long)EventBus::kBulkSlots);
 }
 
-bool post_event(EventType type, int32_t arg0 = 0, int32_t arg1 = 0) {
+bool post_event(EventType type, int32_t arg0, int32_t arg1) {
   Event e{.type = type,
-          .timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000),
+          .timestamp_us = (uint32_t)esp_timer_get_time(),
           .arg0 = arg0,
           .arg1 = arg1};
 
-  BaseType_t ok = xQueueSend(s_event_queue, &e, 0);
-  if (ok != pdTRUE) {
-    ESP_LOGE(TAG, "Event queue full (lost event %d)", (int)type);
+  if (!s_bus.post(e)) {
+    // Bulk drops are expected under load and only counted.
+    if (lane_of(type) != Lane::BULK)
+      ESP_LOGE(TAG, "Lane %d full (lost event %d)", (int)lane_of(type),
+               (int)type);
     return false;
   }
+  TaskHandle_t consumer = s_consumer.load(std::memory_order_acquire);
+  if (consumer)
+    xTaskNotifyGive(consumer);
+  return true;
+}
+
+bool IRAM_ATTR post_event_from_isr(EventType type, int32_t arg0,
+                                   int32_t arg1, BaseType_t *woken) {
+  Event e{.type = type,
+          .timestamp_us = (uint32_t)esp_timer_get_time(),
+          .arg0 = arg0,
+          .arg1 = arg1};
+
+  if (!s_bus.post(e))
+    return false;
+  TaskHandle_t consumer = s_consumer.load(std::memory_order_acquire);
+  if (consumer)
+    vTaskNotifyGiveFromISR(consumer, woken);
   return true;
 }
 
-QueueHandle_t event_queue() { return s_event_queue; }
+// Every drain goes through here, so the metrics see all of them.
+static size_t drain_recorded(Event *out, size_t max) {
+  for (int l = 0; l < kLaneCount; l++)
+    s_metrics.record_depth((Lane)l, s_bus.depth((Lane)l));
+  size_t n = s_bus.drain(out, max);
+  if (n == 0)
+    return 0;
+  uint32_t now_us = (uint32_t)esp_timer_get_time();
+  for (size_t i = 0; i < n; i++)
+    s_metrics.record_dispatch(out[i], now_us);
+  return n;
+}
+
+size_t wait_events(Event *out, size_t max, TickType_t timeout) {
+  s_consumer.store(xTaskGetCurrentTaskHandle(), std::memory_order_release);
+  size_t n = drain_recorded(out, max);
+  if (n > 0)
+    return n;
+  // A post between the drain and here leaves a notification, so this
+  // returns straight away.
+  ulTaskNotifyTake(pdTRUE, timeout);
+  return drain_recorded(out, max);
+}
+
+size_t drain_events(Event *out, size_t max) {
+  return drain_recorded(out, max);
+}
+
+BusMetrics event_metrics() {
+  BusMetrics m;
+  s_metrics.snapshot(s_bus, &m);
+  return m;
+}
+
+static const char *const kLaneNames[kLaneCount] = {"critical", "normal",
+                                                   "bulk"};
+static const uint32_t kLaneSlots[kLaneCount] = {
+    EventBus::kCriticalSlots, EventBus::kNormalSlots, EventBus::kBulkSlots};
+
+void log_event_metrics() {
+  BusMetrics m = event_metrics();
+  uint32_t dispatched = 0, dropped = 0;
+  for (int t = 0; t < kEventTypeCount; t++) {
+    dispatched += m.dispatched[t];
+    dropped += m.dropped[t];
+  }
+  ESP_LOGI(TAG,
+           "%lu dispatched, %lu dropped; high water %lu/%lu %lu/%lu "
+           "%lu/%lu; wait p50 <= %lu us, p99 <= %lu us, max %lu us",
+           (unsigned long)dispatched, (unsigned long)dropped,
+           (unsigned long)m.high_water[0], (unsigned long)kLaneSlots[0],
+           (unsigned long)m.high_water[1], (unsigned long)kLaneSlots[1],
+           (unsigned long)m.high_water[2], (unsigned long)kLaneSlots[2],
+           (unsigned long)latency_quantile_us(m, 0.5),
+           (unsigned long)latency_quantile_us(m, 0.99),
+           (unsigned long)m.latency_max_us);
+}
+
+// The metrics text, a put(fmt, ...) per line.
+template <typename Put>
+static void write_metrics(const BusMetrics &m, Put &&put) {
+  for (int t = 0; t < kEventTypeCount; t++)
+    put("minios_events_dispatched_total{type=\"%s\"} %lu\n",
+        event_name((EventType)t), (unsigned long)m.dispatched[t]);
+  for (int t = 0; t < kEventTypeCount; t++)
+    put("minios_events_dropped_total{type=\"%s\"} %lu\n",
+        event_name((EventType)t), (unsigned long)m.dropped[t]);
+  for (int l = 0; l < kLaneCount; l++)
+    put("minios_lane_high_water{lane=\"%s\",slots=\"%lu\"} %lu\n",
+        kLaneNames[l], (unsigned long)kLaneSlots[l],
+        (unsigned long)m.high_water[l]);
+  // Cumulative, as the format wants.
+  uint32_t count = 0;
+  for (int b = 0; b < kLatencyBuckets - 1; b++) {
+    count += m.latency_us[b];
+    put("minios_dispatch_latency_us_bucket{le=\"%lu\"} %lu\n",
+        (unsigned long)(1u << b), (unsigned long)count);
+  }
+  count += m.latency_us[kLatencyBuckets - 1];
+  put("minios_dispatch_latency_us_bucket{le=\"+Inf\"} %lu\n",
+      (unsigned long)count);
+  put("minios_dispatch_latency_us_count %lu\n", (unsigned long)count);
+  put("minios_dispatch_latency_us_max %lu\n",
+      (unsigned long)m.latency_max_us);
+}
+
+size_t format_event_metrics(char *buf, size_t size) {
+  size_t len = 0;
+  // Keeps counting past the end of buf, like snprintf.
+  write_metrics(event_metrics(), [&](const char *fmt, auto... args) {
+    int n = snprintf(len < size ? buf + len : nullptr,
+                     len < size ? size - len : 0, fmt, args...);
+    if (n > 0)
+      len += (size_t)n;
+  });
+  return len;
+}
+
+void print_event_metrics(FILE *out) {
+  write_metrics(event_metrics(), [out](const char *fmt, auto... args) {
+    fprintf(out, fmt, args...);
+  });
+}
 
 } // namespace sys
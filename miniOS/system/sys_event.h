@@ -1,16 +1,59 @@
 #pragma once
 // Ensures file isn't duplicated (prevent duplicate definition errors)
 
+#include "event_bus.h"
+#include "event_metrics.h"
 #include "sys_types.h"
 
+#include "freertos/FreeRTOS.h"
+
+#include <stddef.h>
+#include <stdio.h>
+
 namespace sys {
 // Prevents name collision, everything within namespace sys becomes sys::...
-struct Event {
-  EventType type;
-  uint32_t timestamp_ms;
 
-  int32_t arg0; // generic payload
-  int32_t arg1;
-};
+// The system event bus: an EventBus (event_bus.h) with priority lanes, one
+// consumer task and any number of producers.
+
+// Logs the lane sizes. The bus itself is static storage, so nothing posted
+// earlier is lost.
+void init_event_bus();
+
+// Posts an event stamped with the current time to its lane (lane_of()).
+// Never blocks; returns false if the lane is full, which is counted and
+// logged.
+bool post_event(EventType type, int32_t arg0 = 0, int32_t arg1 = 0);
+
+// The same from an interrupt handler. Does not log. Sets *woken if the
+// consumer should run at the end of the interrupt (portYIELD_FROM_ISR).
+bool post_event_from_isr(EventType type, int32_t arg0, int32_t arg1,
+                         BaseType_t *woken);
+
+// Consumer side. Moves up to max pending events into out, critical ones
+// first, and returns how many; blocks up to timeout while there are none.
+// The calling task becomes the consumer the bus wakes up, so its
+// notification value belongs to the bus from then on.
+size_t wait_events(Event *out, size_t max, TickType_t timeout);
+
+// The same without blocking, for a consumer that wakes up on its own.
+size_t drain_events(Event *out, size_t max);
+
+// Bus metrics, recorded as the consumer drains: events dispatched and
+// dropped per type, the most events seen waiting in each lane, and how long
+// events waited between post and drain (us, from esp_timer_get_time()).
+// Any task.
+BusMetrics event_metrics();
+
+// Logs a one-line summary of event_metrics().
+void log_event_metrics();
+
+// Writes event_metrics() as text, one "name{labels} value" line per counter
+// in the Prometheus text format, for an HTTP or serial dump. Returns what
+// the full text needs, like snprintf; about 2 KB.
+size_t format_event_metrics(char *buf, size_t size);
+
+// The same text straight to out (the console: stdout), without a buffer.
+void print_event_metrics(FILE *out);
 
 } // namespace sys
@@ -6,47 +6,83 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
+#include <atomic>
+
 static const char *TAG = "SYS_MGR";
 
 namespace sys {
 
-static Mode s_current_mode = Mode::IDLE;
-
-static const char *mode_str(Mode m) {
-  switch (m) {
-  case Mode::IDLE:
-    return "IDLE";
-  case Mode::WIFI_CONNECTING:
-    return "WIFI_CONNECTING";
-  case Mode::ONLINE:
-    return "ONLINE";
-  case Mode::ERROR:
-    return "ERROR";
-  case Mode::OTA_UPDATE:
-    return "OTA_UPDATE";
-  default:
-    return "UNKNOWN";
+struct Subscription {
+  std::atomic<EventMask> mask{0}; // 0 while the slot is free
+  std::atomic<TaskHandle_t> task{nullptr};
+  NoticeCursor cursor; // the subscriber's own
+};
+
+// Only the manager task writes the mode and the log.
+static std::atomic<Mode> s_current_mode{Mode::IDLE};
+static NoticeLog<kNoticeSlots> s_log;
+static Subscription s_subs[kMaxSubscribers];
+static std::atomic<uint32_t> s_sub_used{0}; // bit i: s_subs[i] taken
+static constexpr size_t kBatch = 8;
+// Bus metrics go to the log this often, if anything was dispatched.
+static constexpr TickType_t kMetricsLogTicks = pdMS_TO_TICKS(60000);
+
+static_assert(kMaxSubscribers <= 32, "one bit per subscriber");
+static constexpr uint32_t kAllSubs =
+    kMaxSubscribers == 32 ? ~0u : (1u << kMaxSubscribers) - 1;
+
+// One copy into the log, then a notification to each subscriber that
+// wants it.
+static void broadcast(const Notice &notice) {
+  s_log.publish(notice);
+  uint32_t used = s_sub_used.load(std::memory_order_acquire);
+  while (used) {
+    int i = __builtin_ctz(used);
+    used &= used - 1;
+    if (!notice.matches(s_subs[i].mask.load(std::memory_order_acquire)))
+      continue;
+    TaskHandle_t task = s_subs[i].task.load(std::memory_order_relaxed);
+    if (task)
+      xTaskNotifyGive(task);
   }
 }
 
 static void system_manager_task(void *) {
-  QueueHandle_t q = event_queue();
-  Event e;
+  // Everything pending is taken in one go, critical events first.
+  Event batch[kBatch];
 
   ESP_LOGI(TAG, "System manager started, mode=IDLE");
 
+  TickType_t last_log = xTaskGetTickCount();
+  bool dispatched = false;
   while (true) {
-    if (xQueueReceive(q, &e, portMAX_DELAY) == pdTRUE) {
-
-      Mode next = compute_next_mode(s_current_mode, e);
+    TickType_t since = xTaskGetTickCount() - last_log;
+    if (since >= kMetricsLogTicks) {
+      if (dispatched)
+        log_event_metrics();
+      dispatched = false;
+      last_log += since;
+      since = 0;
+    }
+    size_t n = wait_events(batch, kBatch, kMetricsLogTicks - since);
+    dispatched |= n > 0;
+    for (size_t i = 0; i < n; i++) {
+      const Event &e = batch[i];
+      Mode current = s_current_mode.load(std::memory_order_relaxed);
+      const Transition *t = find_transition(current, e.type);
+      Mode next = t ? t->to : current;
 
-      if (next != s_current_mode) {
-        ESP_LOGI(TAG, "MODE CHANGE: %s -> %s (event=%d)",
-                 mode_str(s_current_mode), mode_str(next), (int)e.type);
+      if (t) {
+        ESP_LOGI(TAG, "MODE CHANGE: %s -> %s (event=%s)", mode_name(current),
+                 mode_name(next), event_name(e.type));
 
-        s_current_mode = next;
-        // broadcast will be added next
+        if (t->on_exit)
+          t->on_exit(e);
+        s_current_mode.store(next, std::memory_order_relaxed);
+        if (t->on_enter)
+          t->on_enter(e);
       }
+      broadcast(Notice{e, current, next});
     }
   }
 }
@@ -56,4 +92,55 @@ void start_system_manager() {
               nullptr);
 }
 
+Mode current_mode() { return s_current_mode.load(std::memory_order_relaxed); }
+
+Subscription *subscribe(EventMask mask) {
+  uint32_t used = s_sub_used.load(std::memory_order_relaxed);
+  int i;
+  do {
+    if (used == kAllSubs) {
+      ESP_LOGE(TAG, "No free subscription (%d taken)", kMaxSubscribers);
+      return nullptr;
+    }
+    i = __builtin_ctz(~used);
+  } while (!s_sub_used.compare_exchange_weak(used, used | (1u << i),
+                                             std::memory_order_acq_rel));
+
+  Subscription &sub = s_subs[i];
+  sub.cursor = NoticeCursor{s_log.head(), 0};
+  sub.task.store(xTaskGetCurrentTaskHandle(), std::memory_order_relaxed);
+  // The mask goes last: the manager skips the slot until it is set.
+  sub.mask.store(mask, std::memory_order_release);
+  return &sub;
+}
+
+void unsubscribe(Subscription *sub) {
+  if (!sub)
+    return;
+  sub->mask.store(0, std::memory_order_release);
+  sub->task.store(nullptr, std::memory_order_relaxed);
+  s_sub_used.fetch_and(~(1u << (uint32_t)(sub - s_subs)),
+                       std::memory_order_acq_rel);
+}
+
+bool next_notice(Subscription *sub, Notice *out, TickType_t timeout) {
+  EventMask mask = sub->mask.load(std::memory_order_relaxed);
+  TickType_t start = xTaskGetTickCount();
+  while (true) {
+    if (s_log.read_next(&sub->cursor, mask, out))
+      return true;
+    TickType_t waited = xTaskGetTickCount() - start;
+    if (waited >= timeout)
+      return false;
+    // The manager notifies after it publishes, so a notice that lands
+    // between the read above and here returns straight away. A
+    // notification left over from a notice already read just goes round
+    // again.
+    ulTaskNotifyTake(pdTRUE,
+                     timeout == portMAX_DELAY ? timeout : timeout - waited);
+  }
+}
+
+uint32_t missed_notices(const Subscription *sub) { return sub->cursor.missed; }
+
 } // namespace sys
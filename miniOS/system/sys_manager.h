@@ -1,5 +1,39 @@
 #pragma once
 
+#include "notice_log.h"
+#include "sys_types.h"
+
+#include "freertos/FreeRTOS.h"
+
 namespace sys {
+
 void start_system_manager();
-}
+
+// The mode the manager is in. Any task.
+Mode current_mode();
+
+// Subscriptions. The manager hands every event it takes off the bus, with
+// the mode before and after, to the tasks that asked for it: each notice
+// is written once into a shared NoticeLog and every subscriber reads it
+// from there with its own cursor, woken by a task notification.
+struct Subscription;
+
+constexpr int kMaxSubscribers = 32;
+
+// Subscribes the calling task to the notices whose event type is in mask
+// (event_bit()) and, with kModeChanges, to every mode change. Its
+// notification value belongs to the subscription from then on. Returns
+// nullptr if all kMaxSubscribers are taken.
+Subscription *subscribe(EventMask mask);
+
+void unsubscribe(Subscription *sub);
+
+// Subscriber only. Copies the next notice into out, blocking up to timeout
+// while there is none; returns false if nothing came. A task that wakes up
+// for other reasons polls with timeout 0.
+bool next_notice(Subscription *sub, Notice *out, TickType_t timeout);
+
+// Notices this subscriber lost by falling a whole log behind.
+uint32_t missed_notices(const Subscription *sub);
+
+} // namespace sys
@@ -2,40 +2,108 @@
 
 namespace sys {
 
+// Single writer principle prevents race conditions, inconsistent system
+// behavior and difficult debugging. In this setup, only the system manager
+// changes the mode, and only through this table. Anything not listed is
+// "no transition".
+static constexpr Transition kTransitions[] = {
+    {Mode::IDLE, EventType::WIFI_START, Mode::WIFI_CONNECTING},
+    {Mode::WIFI_CONNECTING, EventType::WIFI_GOT_IP, Mode::ONLINE},
+    {Mode::WIFI_CONNECTING, EventType::TIMEOUT, Mode::ERROR},
+    {Mode::ONLINE, EventType::WIFI_LOST, Mode::ERROR},
+    {Mode::ERROR, EventType::INTERNAL_RECOVERED, Mode::IDLE},
+    // OTA_UPDATE: transitions added later
+};
+
+// Modes with no way in yet. Listed so that losing the way into any other
+// mode fails the build.
+static constexpr uint32_t kNotYetReachable = mode_bit(Mode::OTA_UPDATE);
+
+static_assert(transitions_in_range(kTransitions), "unknown mode or event");
+static_assert(transitions_deterministic(kTransitions),
+              "two transitions for the same mode and event");
+static_assert(transitions_move(kTransitions),
+              "a transition back into the same mode");
+static_assert(reachable_modes(kTransitions, Mode::IDLE) ==
+                  (((1u << kModeCount) - 1) & ~kNotYetReachable),
+              "a mode cannot be reached from IDLE (or is marked "
+              "unreachable but can be)");
+
+static constexpr ModeTable kTable = build_mode_table(kTransitions);
+
 Mode compute_next_mode(Mode current, const Event &e) {
-  // Single writer principle prevents race conditions, inconsistent system
-  // behavior and difficult debugging. In this setup, only this functin can
-  // modify mode
-  switch (current) {
+  if ((int)e.type >= kEventTypeCount)
+    return current;
+  return kTable.next[(int)current][(int)e.type];
+}
 
-  case Mode::IDLE:
-    if (e.type == EventType::WIFI_START)
-      return Mode::WIFI_CONNECTING;
-    break;
+const Transition *find_transition(Mode current, EventType type) {
+  if ((int)type >= kEventTypeCount)
+    return nullptr;
+  uint8_t i = kTable.index[(int)current][(int)type];
+  return i ? &kTransitions[i - 1] : nullptr;
+}
 
+const char *mode_name(Mode m) {
+  switch (m) {
+  case Mode::IDLE:
+    return "IDLE";
   case Mode::WIFI_CONNECTING:
-    if (e.type == EventType::WIFI_GOT_IP)
-      return Mode::ONLINE;
-    if (e.type == EventType::TIMEOUT)
-      return Mode::ERROR;
-    break;
-
+    return "WIFI_CONNECTING";
   case Mode::ONLINE:
-    if (e.type == EventType::WIFI_LOST)
-      return Mode::ERROR;
-    break;
-
+    return "ONLINE";
   case Mode::ERROR:
-    if (e.type == EventType::INTERNAL_RECOVERED)
-      return Mode::IDLE;
-    break;
-
+    return "ERROR";
   case Mode::OTA_UPDATE:
-    // transitions added later
-    break;
+    return "OTA_UPDATE";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+const char *event_name(EventType type) {
+  switch (type) {
+  case EventType::BOOT:
+    return "BOOT";
+  case EventType::WIFI_START:
+    return "WIFI_START";
+  case EventType::WIFI_GOT_IP:
+    return "WIFI_GOT_IP";
+  case EventType::WIFI_LOST:
+    return "WIFI_LOST";
+  case EventType::TIMEOUT:
+    return "TIMEOUT";
+  case EventType::INTERNAL_ERROR:
+    return "INTERNAL_ERROR";
+  case EventType::INTERNAL_RECOVERED:
+    return "INTERNAL_RECOVERED";
+  case EventType::REQUEST_MODE_CHANGE:
+    return "REQUEST_MODE_CHANGE";
+  case EventType::AUDIO_TRIGGER:
+    return "AUDIO_TRIGGER";
+  case EventType::TELEMETRY:
+    return "TELEMETRY";
+  default:
+    return "UNKNOWN";
   }
+}
 
-  return current; // explicit "no transition"
+// From the compiled table rather than the list, so this is what runs.
+void print_mode_graph(FILE *out) {
+  fprintf(out, "digraph modes {\n  rankdir=LR;\n");
+  for (int m = 0; m < kModeCount; m++)
+    fprintf(out, "  %s;\n", mode_name((Mode)m));
+  for (int m = 0; m < kModeCount; m++) {
+    for (int e = 0; e < kEventTypeCount; e++) {
+      const Transition *t = find_transition((Mode)m, (EventType)e);
+      if (!t)
+        continue;
+      fprintf(out, "  %s -> %s [label=\"%s%s%s\"];\n", mode_name(t->from),
+              mode_name(t->to), event_name(t->on),
+              t->on_exit ? " /exit" : "", t->on_enter ? " /enter" : "");
+    }
+  }
+  fprintf(out, "}\n");
 }
 
 } // namespace sys
@@ -1,9 +1,22 @@
 #pragma once
-#include "sys_event.h"
+#include "event_bus.h"
+#include "mode_table.h"
 #include "sys_types.h"
 
+#include <stdio.h>
+
 namespace sys {
 
 Mode compute_next_mode(Mode current, const Event &e);
 
+// The transition event type takes from current, with its hooks, or nullptr
+// if it stays put.
+const Transition *find_transition(Mode current, EventType type);
+
+const char *mode_name(Mode m);
+const char *event_name(EventType type);
+
+// Writes the mode table as a Graphviz digraph, e.g. for `dot -Tsvg`.
+void print_mode_graph(FILE *out);
+
 } // namespace sys
@@ -11,6 +11,8 @@ enum class Mode : uint8_t {
   OTA_UPDATE,
 };
 
+constexpr int kModeCount = (int)Mode::OTA_UPDATE + 1; // last one above
+
 enum class EventType : uint8_t {
   BOOT,
   WIFI_START,
@@ -20,6 +22,10 @@ enum class EventType : uint8_t {
   INTERNAL_ERROR,
   INTERNAL_RECOVERED,
   REQUEST_MODE_CHANGE,
+  AUDIO_TRIGGER, // arg0 = sample index, arg1 = level in dBFS Q8
+  TELEMETRY,     // periodic readings, payload up to the source
 };
 
+constexpr int kEventTypeCount = (int)EventType::TELEMETRY + 1; // last above
+
 } // namespace sys
@@ -1,25 +1,54 @@
-"""Connect to the ESP32 mic over TCP, read one framed PCM blob, write WAV."""
+"""Connect to the ESP32 mic over TCP, read one framed PCM blob, write WAV.
 
+A sample count of 0 in the header means the device is streaming
+continuously; in that case we record until the socket closes or Ctrl-C.
+
+With --adpcm the stream is requested as 4:1 IMA-ADPCM blocks and decoded
+back to PCM16 here, so the output files look the same either way.
+
+With --v2 the stream uses the framed protocol (PROTO 2, see mic_frames.py):
+every frame is CRC-checked and carries its sample clock, so audio the device
+skipped or a damaged frame becomes silence of the right length instead of a
+splice, and the totals are reported at the end, with the capture gain range
+and the device's clock error.
+
+--lossless asks for the lossless stream (LPC + Rice, FLAC-style) and
+implies --v2; it decodes to exactly what PCM16 would have delivered.
+
+--vad asks for speech only and implies --v2. Gaps between segments are
+filled with silence so the output keeps real-time timing.
+
+A clip-mode device records after the client connects. --seconds=N,
+--rate=8000|16000 and --psram/--internal choose the clip; without any of
+them the device records its default, otherwise the rest default to 5 s,
+16 kHz and whichever RAM fits. It answers ERR <reason> if it cannot.
+"""
+
+import array
 import socket
 import sys
 import wave
 
+import mic_frames
+
 DEFAULT_PORT = 3333
 PCM_OUT = "recording.pcm"
 WAV_OUT = "recording.wav"
 
 
-def read_until_newline(sock):
+def read_header_line(sock):
+    """Read the text header line. Returns it and whatever arrived after it,
+    which is already stream data."""
     buf = bytearray()
-    while True:
-        chunk = sock.recv(1)
+    while b"\n" not in buf:
+        chunk = sock.recv(4096)
         if not chunk:
             raise RuntimeError("socket closed before header newline")
-        if chunk == b"\n":
-            return buf.decode("ascii")
         buf += chunk
-        if len(buf) > 128:
-            raise RuntimeError(f"header too long: {buf!r}")
+        if len(buf) > 128 and b"\n" not in buf[:128]:
+            raise RuntimeError(f"header too long: {bytes(buf[:128])!r}")
+    line, rest = buf.split(b"\n", 1)
+    return line.decode("ascii"), bytes(rest)
 
 
 def recv_exact(sock, n):
@@ -34,33 +63,320 @@ def recv_exact(sock, n):
     return bytes(buf)
 
 
+IMA_STEPS = [
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190,
+    209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499,
+    2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845,
+    8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350,
+    22385, 24623, 27086, 29794, 32767,
+]
+IMA_INDEX = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8]
+
+
+def decode_ima_block(block):
+    """Decode one mono IMA-ADPCM block (WAV layout) to a list of samples."""
+    predictor = int.from_bytes(block[0:2], "little", signed=True)
+    index = min(max(block[2], 0), 88)
+    out = [predictor]
+    for byte in block[4:]:
+        for nibble in (byte & 0x0F, byte >> 4):
+            step = IMA_STEPS[index]
+            diff = step >> 3
+            if nibble & 4:
+                diff += step
+            if nibble & 2:
+                diff += step >> 1
+            if nibble & 1:
+                diff += step >> 2
+            predictor += -diff if nibble & 8 else diff
+            predictor = min(max(predictor, -32768), 32767)
+            index = min(max(index + IMA_INDEX[nibble], 0), 88)
+            out.append(predictor)
+    return out
+
+
+LOSSLESS_PARTITIONS = 4
+LOSSLESS_VERBATIM = 0xFF
+LOSSLESS_ESCAPE = 31
+# Fixed predictors by order, from the samples decoded so far.
+LOSSLESS_PREDICTORS = (
+    lambda x: 0,
+    lambda x: x[-1],
+    lambda x: 2 * x[-1] - x[-2],
+    lambda x: 3 * x[-1] - 3 * x[-2] + x[-3],
+    lambda x: 4 * x[-1] - 6 * x[-2] + 4 * x[-3] - x[-4],
+)
+
+
+def decode_lossless_block(block, n):
+    """Decode one lossless block of n samples (microphone/audio/lossless.h)
+    to a list of samples."""
+    def sample(i):
+        return int.from_bytes(block[1 + 2 * i:3 + 2 * i], "little",
+                              signed=True)
+
+    order = block[0]
+    if order == LOSSLESS_VERBATIM:
+        return [sample(i) for i in range(n)]
+    out = [sample(i) for i in range(order)]
+    predict = LOSSLESS_PREDICTORS[order]
+    # The bit stream as a string of 0s and 1s, MSB first.
+    rest = block[1 + 2 * order:]
+    bits = bin(int.from_bytes(b"\1" + rest, "big"))[3:]
+    pos = 0
+
+    def take(width):
+        nonlocal pos
+        pos += width
+        return int(bits[pos - width:pos], 2) if width else 0
+
+    for p in range(LOSSLESS_PARTITIONS):
+        start = max(p * n // LOSSLESS_PARTITIONS, order)
+        end = (p + 1) * n // LOSSLESS_PARTITIONS
+        k = take(5)
+        if start >= end:
+            continue
+        width = take(5) if k == LOSSLESS_ESCAPE else 0
+        for _ in range(start, end):
+            if k == LOSSLESS_ESCAPE:
+                res = take(width)
+                if width and res >= 1 << (width - 1):
+                    res -= 1 << width
+            else:
+                one = bits.index("1", pos)
+                q = one - pos
+                pos = one + 1
+                u = (q << k) | take(k)
+                res = (u >> 1) ^ -(u & 1)
+            out.append(min(max(predict(out) + res, -32768), 32767))
+    return out
+
+
+class AdpcmWriter:
+    """File-like sink that decodes whole ADPCM blocks into a PCM16 file."""
+
+    def __init__(self, out, block_bytes):
+        self.out = out
+        self.block_bytes = block_bytes
+        self.pending = bytearray()
+
+    def write(self, data):
+        self.pending += data
+        whole = len(self.pending) - len(self.pending) % self.block_bytes
+        for off in range(0, whole, self.block_bytes):
+            block = self.pending[off:off + self.block_bytes]
+            pcm = array.array("h", decode_ima_block(block))
+            if sys.byteorder != "little":
+                pcm.byteswap()
+            self.out.write(pcm.tobytes())
+        del self.pending[:whole]
+
+
+class FrameWriter:
+    """File-like sink for the v2 framed stream. Decodes PCM16 and ADPCM
+    frames and writes each at its sample-clock position, relative to the
+    first audio frame, so anything not received is written as silence."""
+
+    def __init__(self, out):
+        self.out = out
+        self.parser = mic_frames.Parser()
+        self.info = None
+        self.origin = None
+        self.written = 0  # samples
+        self.segments = 0
+        self.gains = None  # (min, max) capture gain seen, dB
+        self.last = None  # newest audio frame, for its clock error
+
+    def write(self, data):
+        for frame in self.parser.feed(data):
+            if frame.codec == mic_frames.CODEC_INFO:
+                self.info = mic_frames.Info(frame.payload)
+                print(f"Stream: {self.info}")
+                continue
+            if frame.codec == mic_frames.CODEC_IMA_ADPCM:
+                pcm = array.array("h", decode_ima_block(frame.payload))
+                if sys.byteorder != "little":
+                    pcm.byteswap()
+                body = pcm.tobytes()
+            elif frame.codec == mic_frames.CODEC_LOSSLESS:
+                pcm = array.array("h", decode_lossless_block(frame.payload,
+                                                             frame.samples))
+                if sys.byteorder != "little":
+                    pcm.byteswap()
+                body = pcm.tobytes()
+            elif frame.codec == mic_frames.CODEC_PCM16:
+                body = frame.payload
+            else:
+                continue
+            self.place(frame, body)
+
+    def place(self, frame, body):
+        gain = frame.gain_db
+        if self.gains is None:
+            self.gains = (gain, gain)
+        else:
+            self.gains = (min(self.gains[0], gain), max(self.gains[1], gain))
+        self.last = frame
+        if self.origin is None:
+            self.origin = frame.sample_index
+        pos = (frame.sample_index - self.origin) & 0xFFFFFFFF
+        rate = self.info.sample_rate if self.info else 16000
+        if frame.flags & mic_frames.FLAG_SEGMENT_START:
+            self.segments += 1
+            print(f"speech from {pos / rate:.2f} s")
+        if pos > self.written:
+            self.out.write(b"\0\0" * (pos - self.written))
+            self.written = pos
+        # Never move backwards in the file; drop any overlap.
+        skip = min(self.written - pos, frame.samples)
+        self.out.write(body[2 * skip:])
+        self.written += frame.samples - skip
+        if frame.flags & mic_frames.FLAG_SEGMENT_END:
+            print(f"  ... to {(pos + frame.samples) / rate:.2f} s")
+
+
+def recv_stream(sock, out):
+    """Copy a continuous stream into out until close or Ctrl-C."""
+    total = 0
+    try:
+        while True:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            out.write(chunk)
+            total += len(chunk)
+    except KeyboardInterrupt:
+        print("Stopped by user")
+    return total
+
+
+CODEC_FLAGS = {"--adpcm": "ADPCM", "--lossless": "LOSSLESS", "--vad": "VAD16"}
+V2_ONLY = ("LOSSLESS", "VAD16")
+PLACEMENT_FLAGS = {"--psram": "psram", "--internal": "internal"}
+CLIP_OPTIONS = ("--seconds", "--rate")
+USAGE = ("[--v2] [--adpcm | --lossless | --vad] [--seconds=N] [--rate=R] "
+         "[--psram | --internal] <esp_ip> [port]")
+
+
+def clip_request(flags, options):
+    """RECORD line for a clip-mode device, or None to take its defaults."""
+    placements = [PLACEMENT_FLAGS[a] for a in flags if a in PLACEMENT_FLAGS]
+    if not options and not placements:
+        return None
+    seconds = options.get("--seconds", "5")
+    rate = options.get("--rate", "16000")
+    where = placements[-1] if placements else "auto"
+    return f"RECORD {seconds} {rate} {where}\n"
+
+
 def main():
-    if len(sys.argv) < 2:
-        print(f"usage: {sys.argv[0]} <esp_ip> [port]", file=sys.stderr)
+    flags = [a for a in sys.argv[1:] if a.startswith("--")]
+    args = [a for a in sys.argv[1:] if not a.startswith("--")]
+    options = dict(a.split("=", 1) for a in flags if "=" in a)
+    flags = [a for a in flags if "=" not in a]
+    codecs = [CODEC_FLAGS[a] for a in flags if a in CODEC_FLAGS]
+    want = codecs[-1] if codecs else None
+    framed = "--v2" in flags or want in V2_ONLY
+    unknown = [a for a in flags
+               if a not in CODEC_FLAGS and a not in PLACEMENT_FLAGS and
+               a != "--v2"]
+    unknown += [k for k, v in options.items()
+                if k not in CLIP_OPTIONS or not v.isdigit()]
+    if not args or unknown:
+        print(f"usage: {sys.argv[0]} {USAGE}", file=sys.stderr)
         sys.exit(1)
 
-    host = sys.argv[1]
-    port = int(sys.argv[2]) if len(sys.argv) > 2 else DEFAULT_PORT
+    host = args[0]
+    port = int(args[1]) if len(args) > 1 else DEFAULT_PORT
+    request = clip_request(flags, options)
+    # A clip is recorded before anything comes back.
+    timeout = 30 + int(options.get("--seconds", "0"))
 
     print(f"Connecting to {host}:{port} ...")
-    with socket.create_connection((host, port), timeout=30) as sock:
-        header = read_until_newline(sock)
+    with socket.create_connection((host, port), timeout=timeout) as sock:
+        if framed:
+            sock.sendall(f"PROTO 2 {want or 'PCM16'}\n".encode("ascii"))
+            print("Framed stream, press Ctrl-C to stop")
+            sock.settimeout(None)
+            with open(PCM_OUT, "wb") as f:
+                writer = FrameWriter(f)
+                recv_stream(sock, writer)
+            print(writer.parser.summary())
+            if writer.gains and writer.gains != (0, 0):
+                print(f"Capture gain (AGC) {writer.gains[0]:+.1f} .. "
+                      f"{writer.gains[1]:+.1f} dB")
+            if writer.last and writer.last.drift_ppm:
+                fixed = writer.last.flags & mic_frames.FLAG_RESAMPLED
+                print(f"Capture clock {writer.last.drift_ppm:+.2f} ppm"
+                      f"{', resampled on the device' if fixed else ''}")
+            info = writer.info
+            if info is None:
+                raise RuntimeError("device did not send a v2 stream")
+            got = "VAD16" if info.gated else mic_frames.CODEC_NAMES[info.codec]
+            if want and got != want:
+                print(f"Device does not offer {want}, got {got}")
+            sample_rate = info.sample_rate
+            channels = info.channels
+            with open(PCM_OUT, "rb") as f:
+                pcm = f.read()
+            samples = len(pcm) // (2 * channels)
+            print(f"Wrote {len(pcm)} bytes to {PCM_OUT}")
+            write_wav(pcm, sample_rate, channels, samples)
+            return
+
+        if request:
+            sock.sendall(request.encode("ascii"))
+        elif want:
+            sock.sendall(f"CODEC {want}\n".encode("ascii"))
+        header, rest = read_header_line(sock)
         print(f"Got header: {header}")
 
         parts = header.split()
-        if len(parts) != 4 or parts[0] != "PCM16":
+        if parts and parts[0] == "ERR":
+            raise RuntimeError(f"device refused: {header[4:]}")
+        if parts and parts[0] == "ADPCM" and len(parts) == 5:
+            unit_bytes = int(parts[4])
+        elif len(parts) == 4 and parts[0] == "PCM16":
+            if want:
+                print(f"Device does not offer {want}, using PCM16")
+        else:
             raise RuntimeError(f"unexpected header: {header!r}")
         sample_rate = int(parts[1])
         channels = int(parts[2])
         samples = int(parts[3])
-        byte_count = samples * 2 * channels
 
-        pcm = recv_exact(sock, byte_count)
+        if samples > 0:
+            pcm = rest[:samples * 2 * channels]
+            pcm += recv_exact(sock, samples * 2 * channels - len(pcm))
+            with open(PCM_OUT, "wb") as f:
+                f.write(pcm)
+        else:
+            print("Continuous stream, press Ctrl-C to stop")
+            sock.settimeout(None)
+            with open(PCM_OUT, "wb") as f:
+                if parts[0] == "ADPCM":
+                    writer = AdpcmWriter(f, unit_bytes)
+                    writer.write(rest)
+                    recv_stream(sock, writer)
+                    byte_count = f.tell()
+                else:
+                    # Keep whole samples only, a cut-off stream may end
+                    # mid-sample.
+                    f.write(rest)
+                    byte_count = len(rest) + recv_stream(sock, f)
+                    byte_count -= byte_count % 2
+                f.truncate(byte_count)
+            with open(PCM_OUT, "rb") as f:
+                pcm = f.read()
+            samples = len(pcm) // (2 * channels)
         print(f"Wrote {len(pcm)} bytes to {PCM_OUT}")
 
-    with open(PCM_OUT, "wb") as f:
-        f.write(pcm)
+    write_wav(pcm, sample_rate, channels, samples)
+
 
+def write_wav(pcm, sample_rate, channels, samples):
     with wave.open(WAV_OUT, "wb") as wf:
         wf.setnchannels(channels)
         wf.setsampwidth(2)
@@ -0,0 +1,439 @@
+// Stands in for a room full of microphones: N stream servers on
+// consecutive ports, each serving a recording the way the firmware's stream
+// server does (stream mode, TCP 3333), for testing the ingest daemon.
+//
+//   mic_fake_devices [--pcm FILE] [--count N] [--base-port P] [--speed X]
+//                    [--skip-every N] [--seconds N]
+//
+//   --pcm FILE      16 kHz mono int16 to serve, looped
+//                   (tools/recording.pcm)
+//   --count N       devices, ports P .. P + N - 1 (8)
+//   --base-port P   (43333)
+//   --speed X       send audio X times faster than real time (1)
+//   --skip-every N  drop every Nth audio frame, as a device does for a
+//                   subscriber that falls behind (0: never)
+//   --seconds N     exit after N seconds (0: at SIGINT/SIGTERM)
+//
+// Each connection gets 200 ms to send its hello, as on the device. "PROTO 2
+// ADPCM" gets IMA-ADPCM frames, "PROTO 2 LOSSLESS" lossless frames, any
+// other PROTO 2 request PCM16 frames, and no hello the v1 PCM16 header and
+// bare samples. Unlike a device, every connection starts at the beginning
+// of the recording with sequence 0 and sample clock 0, so what a client
+// wrote can be compared with the file. A client more than ~0.5 s of audio
+// behind has frames skipped, which it sees as sequence gaps.
+
+#include "ima_adpcm.h"
+#include "lossless.h"
+#include "stream_frame.h"
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fr = audio::frame;
+
+static constexpr int kSampleRate = 16000;
+static constexpr int kPcmFrameSamples = kSampleRate / 100;
+static constexpr int kHelloWaitMs = 200;
+static constexpr int kTickMs = 5;
+// What the device's per-stream ring holds before a slow subscriber skips.
+static constexpr int kBacklogSamples = kSampleRate / 2;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int) { g_stop = 1; }
+
+static int64_t now_us() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+struct Options {
+  std::string pcm = "tools/recording.pcm";
+  int count = 8;
+  int base_port = 43333;
+  double speed = 1;
+  int skip_every = 0;
+  int run_seconds = 0;
+};
+
+struct Listener {
+  int fd;
+  int port;
+};
+
+struct Client {
+  enum class Mode { Hello, V1, Pcm16, Adpcm, Lossless };
+
+  int fd = -1;
+  int port = 0;
+  Mode mode = Mode::Hello;
+  int64_t attached_us = 0;
+  int64_t start_us = 0; // when sample 0 was due
+  char hello[24] = {};
+  int hello_len = 0;
+
+  uint64_t next_sample = 0; // next to send, counts through the loops
+  uint32_t seq = 0;
+  audio::ImaAdpcmEncoder encoder;
+  std::vector<uint8_t> out; // built but not sent yet
+  size_t out_off = 0;
+  uint64_t queued_samples = 0;
+
+  uint64_t frames = 0;
+  uint64_t skipped = 0;
+  uint64_t bytes = 0;
+};
+
+// Tags for epoll_event.data.u64: listeners below, clients above.
+static constexpr uint64_t kClientTag = 1ull << 32;
+
+static Options g_opt;
+static std::vector<int16_t> g_pcm;
+static int g_epoll = -1;
+static std::vector<Listener> g_listeners;
+static std::vector<std::unique_ptr<Client>> g_clients;
+
+struct Totals {
+  uint64_t clients = 0;
+  uint64_t frames = 0;
+  uint64_t skipped = 0;
+  uint64_t bytes = 0;
+};
+static Totals g_totals;
+
+static bool load_pcm(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  int16_t buf[4096];
+  size_t got;
+  while ((got = fread(buf, sizeof(int16_t), 4096, f)) > 0)
+    g_pcm.insert(g_pcm.end(), buf, buf + got);
+  fclose(f);
+  if (g_pcm.empty()) {
+    fprintf(stderr, "%s: empty\n", path);
+    return false;
+  }
+  return true;
+}
+
+// n samples of the looped recording starting at pos.
+static void take_samples(uint64_t pos, int n, int16_t *out) {
+  size_t len = g_pcm.size();
+  for (int i = 0; i < n; i++)
+    out[i] = g_pcm[(size_t)((pos + (uint64_t)i) % len)];
+}
+
+static int listen_on(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons((uint16_t)port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+    fprintf(stderr, "port %d: %s\n", port, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void drop_client(size_t i, const char *why) {
+  Client &c = *g_clients[i];
+  printf("port %d: client gone (%s) after %llu frames, %llu skipped\n",
+         c.port, why, (unsigned long long)c.frames,
+         (unsigned long long)c.skipped);
+  g_totals.frames += c.frames;
+  g_totals.skipped += c.skipped;
+  g_totals.bytes += c.bytes;
+  epoll_ctl(g_epoll, EPOLL_CTL_DEL, c.fd, nullptr);
+  close(c.fd);
+  g_clients[i]->fd = -1;
+}
+
+static void accept_clients(const Listener &l, int64_t now) {
+  while (true) {
+    int fd = accept4(l.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0)
+      return;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    auto c = std::make_unique<Client>();
+    c->fd = fd;
+    c->port = l.port;
+    c->attached_us = now;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = kClientTag | g_clients.size();
+    epoll_ctl(g_epoll, EPOLL_CTL_ADD, fd, &ev);
+    g_clients.push_back(std::move(c));
+    g_totals.clients++;
+  }
+}
+
+static void start_stream(Client &c, int64_t now) {
+  const char *asked = nullptr;
+  bool framed = false;
+  if (strncmp(c.hello, "PROTO 2", 7) == 0 &&
+      (c.hello[7] == '\0' || c.hello[7] == ' ')) {
+    framed = true;
+    asked = c.hello[7] == ' ' ? c.hello + 8 : "PCM16";
+  }
+  if (!framed) {
+    c.mode = Client::Mode::V1;
+    char header[64];
+    int len = snprintf(header, sizeof(header), "PCM16 %d 1 0\n", kSampleRate);
+    c.out.insert(c.out.end(), header, header + len);
+  } else {
+    fr::Info info = {};
+    info.sample_rate = kSampleRate;
+    info.channels = 1;
+    if (strcmp(asked, "ADPCM") == 0) {
+      c.mode = Client::Mode::Adpcm;
+      info.codec = fr::kCodecImaAdpcm;
+      info.frame_samples = audio::ima_adpcm::kBlockSamples;
+    } else if (strcmp(asked, "LOSSLESS") == 0) {
+      c.mode = Client::Mode::Lossless;
+      info.codec = fr::kCodecLossless;
+      info.frame_samples = audio::lossless::kBlockSamples;
+    } else {
+      c.mode = Client::Mode::Pcm16;
+      info.codec = fr::kCodecPcm16;
+      info.frame_samples = kPcmFrameSamples;
+    }
+    uint8_t frame[fr::kHeaderBytes + fr::kInfoBytes];
+    size_t len = fr::write_info(info, now, frame);
+    c.out.insert(c.out.end(), frame, frame + len);
+  }
+  c.start_us = now;
+}
+
+static void read_hello(size_t i, int64_t now) {
+  Client &c = *g_clients[i];
+  char buf[256];
+  ssize_t got = recv(c.fd, buf, sizeof(buf), 0);
+  if (got == 0 || (got < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+    drop_client(i, got == 0 ? "closed" : strerror(errno));
+    return;
+  }
+  if (c.mode != Client::Mode::Hello || got < 0)
+    return; // anything after the hello is ignored, as on the device
+  for (ssize_t k = 0; k < got && c.mode == Client::Mode::Hello; k++) {
+    if (buf[k] == '\n' || c.hello_len == (int)sizeof(c.hello) - 1)
+      start_stream(c, now);
+    else
+      c.hello[c.hello_len++] = buf[k];
+  }
+}
+
+// Appends the frames that are due by now, then sends what the socket takes.
+static void service_client(size_t i, int64_t now) {
+  Client &c = *g_clients[i];
+  if (c.mode == Client::Mode::Hello) {
+    if (now - c.attached_us >= kHelloWaitMs * 1000)
+      start_stream(c, now);
+    else
+      return;
+  }
+
+  const bool adpcm = c.mode == Client::Mode::Adpcm;
+  const bool lossless = c.mode == Client::Mode::Lossless;
+  const int frame_samples = adpcm      ? audio::ima_adpcm::kBlockSamples
+                            : lossless ? audio::lossless::kBlockSamples
+                                       : kPcmFrameSamples;
+  const double rate = kSampleRate * g_opt.speed;
+  uint64_t due = (uint64_t)((now - c.start_us) * rate / 1e6);
+  int16_t pcm[audio::lossless::kBlockSamples];
+  uint8_t frame[fr::kHeaderBytes + audio::lossless::kMaxBlockBytes];
+  static_assert(audio::ima_adpcm::kBlockSamples <=
+                        audio::lossless::kBlockSamples &&
+                    audio::ima_adpcm::kBlockBytes <=
+                        audio::lossless::kMaxBlockBytes,
+                "buffers fit every codec");
+
+  while (c.next_sample + (uint64_t)frame_samples <= due) {
+    uint64_t index = c.next_sample;
+    c.next_sample += (uint64_t)frame_samples;
+    take_samples(index, frame_samples, pcm);
+    size_t payload;
+    if (adpcm) {
+      // Encode every block, skipped or not, so the step index carries on as
+      // it does on the device.
+      payload = (size_t)c.encoder.encode(pcm, frame_samples,
+                                         &frame[fr::kHeaderBytes]);
+    } else if (lossless) {
+      payload = (size_t)audio::lossless::encode_block(
+          pcm, frame_samples, &frame[fr::kHeaderBytes]);
+    } else {
+      payload = (size_t)frame_samples * sizeof(int16_t);
+      memcpy(&frame[fr::kHeaderBytes], pcm, payload);
+    }
+    uint32_t seq = c.seq++;
+    bool skip = c.queued_samples > (uint64_t)kBacklogSamples ||
+                (g_opt.skip_every > 0 &&
+                 seq % (uint32_t)g_opt.skip_every ==
+                     (uint32_t)g_opt.skip_every - 1);
+    if (skip) {
+      c.skipped++;
+      continue;
+    }
+    if (c.mode == Client::Mode::V1) {
+      c.out.insert(c.out.end(), &frame[fr::kHeaderBytes],
+                   &frame[fr::kHeaderBytes + payload]);
+    } else {
+      fr::Header h = {};
+      h.codec = adpcm      ? fr::kCodecImaAdpcm
+                : lossless ? fr::kCodecLossless
+                           : fr::kCodecPcm16;
+      h.seq = seq;
+      h.payload_bytes = (uint16_t)payload;
+      h.samples = (uint16_t)frame_samples;
+      h.timestamp_us = c.start_us + (int64_t)(index * 1e6 / rate);
+      h.sample_index = (uint32_t)index;
+      fr::finish(h, frame);
+      c.out.insert(c.out.end(), frame, frame + fr::kHeaderBytes + payload);
+    }
+    c.queued_samples += (uint64_t)frame_samples;
+    c.frames++;
+  }
+
+  while (c.out_off < c.out.size()) {
+    ssize_t sent = send(c.fd, &c.out[c.out_off], c.out.size() - c.out_off,
+                        MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+      drop_client(i, strerror(errno));
+      return;
+    }
+    c.out_off += (size_t)sent;
+    c.bytes += (uint64_t)sent;
+  }
+  if (c.out_off == c.out.size()) {
+    c.out.clear();
+    c.out_off = 0;
+    c.queued_samples = 0;
+  } else {
+    // Roughly what is still queued; only the skip decision uses it.
+    c.queued_samples = (c.out.size() - c.out_off) / 2;
+    if (c.out_off > 65536) {
+      c.out.erase(c.out.begin(), c.out.begin() + (long)c.out_off);
+      c.out_off = 0;
+    }
+  }
+}
+
+static void usage() {
+  fprintf(stderr, "usage: mic_fake_devices [--pcm FILE] [--count N] "
+                  "[--base-port P] [--speed X]\n"
+                  "                        [--skip-every N] [--seconds N]\n");
+}
+
+int main(int argc, char **argv) {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage();
+      return 2;
+    }
+    const char *value = argv[++i];
+    if (arg == "--pcm")
+      g_opt.pcm = value;
+    else if (arg == "--count")
+      g_opt.count = atoi(value);
+    else if (arg == "--base-port")
+      g_opt.base_port = atoi(value);
+    else if (arg == "--speed")
+      g_opt.speed = atof(value);
+    else if (arg == "--skip-every")
+      g_opt.skip_every = atoi(value);
+    else if (arg == "--seconds")
+      g_opt.run_seconds = atoi(value);
+    else {
+      usage();
+      return 2;
+    }
+  }
+  if (g_opt.count < 1 || g_opt.speed <= 0) {
+    usage();
+    return 2;
+  }
+  if (!load_pcm(g_opt.pcm.c_str()))
+    return 1;
+
+  struct sigaction sa = {};
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  g_epoll = epoll_create1(EPOLL_CLOEXEC);
+  for (int d = 0; d < g_opt.count; d++) {
+    int port = g_opt.base_port + d;
+    int fd = listen_on(port);
+    if (fd < 0)
+      return 1;
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)g_listeners.size();
+    epoll_ctl(g_epoll, EPOLL_CTL_ADD, fd, &ev);
+    g_listeners.push_back({fd, port});
+  }
+  printf("Serving %s (%.1f s) as %d devices on 127.0.0.1:%d-%d at %gx\n",
+         g_opt.pcm.c_str(), g_pcm.size() / (double)kSampleRate, g_opt.count,
+         g_opt.base_port, g_opt.base_port + g_opt.count - 1, g_opt.speed);
+
+  const int64_t start = now_us();
+  std::vector<epoll_event> events(64);
+  while (!g_stop) {
+    int64_t now = now_us();
+    if (g_opt.run_seconds > 0 && now - start >= g_opt.run_seconds * 1000000LL)
+      break;
+    int n = epoll_wait(g_epoll, events.data(), (int)events.size(), kTickMs);
+    now = now_us();
+    for (int k = 0; k < n; k++) {
+      uint64_t tag = events[(size_t)k].data.u64;
+      if (tag & kClientTag) {
+        size_t i = (size_t)(tag & ~kClientTag);
+        if (g_clients[i]->fd >= 0)
+          read_hello(i, now);
+      } else {
+        accept_clients(g_listeners[(size_t)tag], now);
+      }
+    }
+    for (size_t i = 0; i < g_clients.size(); i++)
+      if (g_clients[i]->fd >= 0)
+        service_client(i, now);
+  }
+
+  for (size_t i = 0; i < g_clients.size(); i++)
+    if (g_clients[i]->fd >= 0)
+      drop_client(i, "shutting down");
+  printf("fake: clients=%llu frames=%llu skipped=%llu bytes=%llu\n",
+         (unsigned long long)g_totals.clients,
+         (unsigned long long)g_totals.frames,
+         (unsigned long long)g_totals.skipped,
+         (unsigned long long)g_totals.bytes);
+  return 0;
+}
@@ -0,0 +1,177 @@
+"""Load test for mic_ingest against mic_fake_devices on this machine.
+
+    python3 tools/ingest/load_test.py build/ingest [--devices 32] [--speed 10]
+
+Three runs, each with a fresh output directory:
+
+1. PCM16 from every device at --speed times real time. Must end with no
+   CRC errors, no sequence gaps and no filled silence, the WAV data must add
+   up to the samples the daemon reported, and every device's audio must be
+   the recording, looped, byte for byte.
+2. LOSSLESS from every device, checked the same way: it must decode to
+   the recording byte for byte.
+3. ADPCM from a few devices with every 7th frame dropped and 10 s files.
+   The drops must come back as silence of the right length, so each
+   device's files add up to the time it streamed, and the files must
+   rotate.
+
+Prints the daemon's throughput and CPU time. Exits non-zero on a failure.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+import wave
+
+TOOLS = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+RECORDING = os.path.join(TOOLS, "recording.pcm")
+
+
+def parse_totals(output, prefix):
+    for line in output.splitlines():
+        if line.startswith(prefix):
+            return {k: float(v) for k, v in re.findall(r"(\w+)=([\d.]+)", line)}
+    raise RuntimeError(f"no '{prefix}' line in:\n{output}")
+
+
+def device_audio(out_dir, name):
+    """All of a device's WAV files, in order, as (rate, [data bytes])."""
+    files = sorted(os.listdir(os.path.join(out_dir, name)))
+    rate, chunks = 0, []
+    for f in files:
+        with wave.open(os.path.join(out_dir, name, f), "rb") as w:
+            rate = w.getframerate()
+            chunks.append(w.readframes(w.getnframes()))
+    return rate, chunks
+
+
+def run(build, args, codec, devices, speed, seconds, extra_fake, extra_ingest,
+        out_dir):
+    fake = subprocess.Popen(
+        [os.path.join(build, "mic_fake_devices"), "--pcm", RECORDING,
+         "--count", str(devices), "--base-port", str(args.base_port),
+         "--speed", str(speed), "--seconds", str(seconds + 5)] + extra_fake,
+        stdout=subprocess.PIPE, text=True)
+    time.sleep(0.3)
+    specs = [f"127.0.0.1:{args.base_port + d}=dev{d:03d}"
+             for d in range(devices)]
+    ingest = subprocess.Popen(
+        [os.path.join(build, "mic_ingest"), "--out", out_dir, "--codec",
+         codec, "--seconds", str(seconds), "--stats-seconds", "0"]
+        + extra_ingest + specs,
+        stdout=subprocess.PIPE, text=True)
+    output = ingest.stdout.read()
+    _, status, usage = os.wait4(ingest.pid, 0)
+    fake.terminate()
+    fake_output = fake.communicate()[0]
+    if status != 0:
+        raise RuntimeError(f"mic_ingest exited with {status}:\n{output}")
+    return (parse_totals(output, "total:"), parse_totals(fake_output, "fake:"),
+            usage, output)
+
+
+def check(failures, ok, what):
+    print(f"  {'ok  ' if ok else 'FAIL'} {what}")
+    if not ok:
+        failures.append(what)
+
+
+def exact_run(args, codec, out_dir, recording, failures):
+    """All devices at full speed; the files must be the recording."""
+    print(f"{codec}: {args.devices} devices at {args.speed:g}x for "
+          f"{args.seconds} s")
+    t, fake, usage, _ = run(args.build, args, codec, args.devices,
+                            args.speed, args.seconds, [], [], out_dir)
+    cpu = usage.ru_utime + usage.ru_stime
+    audio_s = t["samples"] / 16000
+    print(f"  {t['bytes_in'] / t['seconds'] / 1e6:.1f} MB/s in, "
+          f"{t['frames'] / t['seconds']:.0f} frames/s, "
+          f"{audio_s / t['seconds']:.0f} s of audio/s "
+          f"(~{audio_s / t['seconds']:.0f} real-time devices); "
+          f"CPU {cpu:.2f} s = {100 * cpu / t['seconds']:.1f}% of a core, "
+          f"{1e6 * cpu / max(t['frames'], 1):.1f} us/frame")
+    check(failures, t["connects"] == args.devices and t["failures"] == 0,
+          f"{args.devices} connections, none failed")
+    check(failures, t["crc_errors"] == 0 and t["resync_bytes"] == 0,
+          "no CRC errors or resyncs")
+    check(failures, t["seq_gaps"] == 0 and t["silence"] == 0
+          and fake["skipped"] == 0, "no gaps, nothing skipped or filled")
+    # The devices keep sending until they see the close, so they can count
+    # a socket buffer or two the daemon never read, or none at all.
+    check(failures, 0 <= fake["frames"] - t["frames"] < 100 * args.devices,
+          f"received {t['frames']:.0f} of the {fake['frames']:.0f} "
+          "frames sent")
+
+    data_bytes, mismatched = 0, []
+    for d in range(args.devices):
+        _, chunks = device_audio(out_dir, f"dev{d:03d}")
+        data = b"".join(chunks)
+        data_bytes += len(data)
+        loops = len(data) // len(recording) + 1
+        if data != (recording * loops)[:len(data)]:
+            mismatched.append(d)
+    check(failures, data_bytes == 2 * t["samples"],
+          f"WAV data {data_bytes} bytes = {t['samples']:.0f} samples")
+    check(failures, not mismatched,
+          "every device's audio is the recording byte for byte"
+          + (f" (not {mismatched})" if mismatched else ""))
+    if codec != "PCM16":
+        print(f"  {8 * t['bytes_in'] / audio_s / 1000:.1f} kbit/s per "
+              "device on the wire")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("build", help="build directory of tools/ingest")
+    ap.add_argument("--devices", type=int, default=32)
+    ap.add_argument("--speed", type=float, default=10)
+    ap.add_argument("--seconds", type=int, default=10)
+    ap.add_argument("--base-port", type=int, default=43333)
+    args = ap.parse_args()
+
+    with open(RECORDING, "rb") as f:
+        recording = f.read()
+    failures = []
+
+    with tempfile.TemporaryDirectory() as tmp:
+        for codec in ("PCM16", "LOSSLESS"):
+            exact_run(args, codec, os.path.join(tmp, codec.lower()),
+                      recording, failures)
+
+        out_dir = os.path.join(tmp, "adpcm")
+        devices, seconds = min(args.devices, 4), 5
+        print(f"ADPCM: {devices} devices at {args.speed:g}x for {seconds} s, "
+              "every 7th frame dropped, 10 s files")
+        t, fake, _, _ = run(args.build, args, "ADPCM", devices, args.speed,
+                            seconds, ["--skip-every", "7"],
+                            ["--segment-seconds", "10"], out_dir)
+        check(failures, t["crc_errors"] == 0, "no CRC errors")
+        check(failures, t["seq_gaps"] > 0 and t["seq_gaps"] <= fake["skipped"],
+              f"{t['seq_gaps']:.0f} sequence gaps seen "
+              f"({fake['skipped']:.0f} frames dropped)")
+        check(failures, t["silence"] == 505 * t["seq_gaps"],
+              f"{t['silence']:.0f} samples of silence = the dropped frames")
+        total, files, expected = 0, 0, 0
+        for d in range(devices):
+            _, chunks = device_audio(out_dir, f"dev{d:03d}")
+            samples = sum(len(c) for c in chunks) // 2
+            total += samples
+            files += len(chunks)
+            expected += -(-samples // 160000)
+        check(failures, total == t["samples"] + t["silence"],
+              f"files hold {total} samples = audio + silence")
+        check(failures, files == expected,
+              f"{files} files of 10 s (expected {expected})")
+
+    if failures:
+        print(f"{len(failures)} check(s) failed")
+        sys.exit(1)
+    print("all checks passed")
+
+
+if __name__ == "__main__":
+    main()
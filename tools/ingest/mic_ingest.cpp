@@ -0,0 +1,584 @@
+// Ingest daemon for many ESP32 microphones at once. Subscribes to each
+// device's stream server (stream mode, TCP 3333) with the v2 framed
+// protocol and writes its audio to rotating per-device WAV or PCM files:
+//
+//   mic_ingest [options] host[:port][=name] ...
+//
+//   --out DIR              output root, a directory per device (captures)
+//   --devices FILE         more devices, one per line, # comments
+//   --codec NAME           PCM16 (default), ADPCM, LOSSLESS or VAD16
+//   --format wav|pcm       file format (wav)
+//   --segment-seconds N    audio per file (300)
+//   --max-fill-seconds N   longest gap filled with silence; a longer one
+//                          starts a new file (10)
+//   --buffer-kb N          write buffer per device (256)
+//   --stats-seconds N      progress line interval, 0 for none (10)
+//   --seconds N            stop after N seconds (0: at SIGINT/SIGTERM)
+//
+// Everything runs on one thread around epoll. Sockets are non-blocking; a
+// device that refuses, drops or goes silent for kStallMs is retried with
+// backoff, and each connection starts a new file. Frames are checked with
+// the firmware's own audio::frame::Parser. Audio the device skipped shows
+// as a jump in the sample clock and is written as silence of the same
+// length, so files keep real time (with VAD16 the pauses between speech
+// segments too, up to --max-fill-seconds).
+//
+// At exit it prints one line per device and a totals line.
+
+#include "ima_adpcm.h"
+#include "lossless.h"
+#include "segment_writer.h"
+#include "stream_frame.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace fr = audio::frame;
+
+static constexpr uint16_t kDefaultPort = 3333;
+static constexpr int kMinBackoffMs = 1000;
+static constexpr int kMaxBackoffMs = 30000;
+// The device sends a frame every 10 ms; this much silence means it is gone
+// without having closed the connection (power cut, out of range).
+static constexpr int kStallMs = 5000;
+static constexpr int kFlushMs = 2000;
+static constexpr int kTickMs = 100;
+
+static volatile sig_atomic_t g_stop = 0;
+
+static void on_signal(int) { g_stop = 1; }
+
+static int64_t now_ms() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+struct Options {
+  std::string out = "captures";
+  std::string codec = "PCM16";
+  ingest::SegmentWriter::Format format = ingest::SegmentWriter::Format::Wav;
+  int segment_seconds = 300;
+  int max_fill_seconds = 10;
+  int buffer_kb = 256;
+  int stats_seconds = 10;
+  int run_seconds = 0;
+};
+
+struct Totals {
+  uint64_t bytes = 0;   // received
+  uint64_t frames = 0;  // audio frames that passed the CRC
+  uint64_t samples = 0; // decoded and written
+  uint64_t silence = 0; // samples written for gaps
+  uint64_t crc_errors = 0;
+  uint64_t seq_gaps = 0;
+  uint64_t resync_bytes = 0;
+};
+
+struct Device {
+  enum class State { Waiting, Connecting, Streaming };
+
+  std::string label; // host:port
+  std::string name;  // for files
+  sockaddr_storage addr = {};
+  socklen_t addr_len = 0;
+
+  int fd = -1;
+  State state = State::Waiting;
+  int64_t retry_at_ms = 0;
+  int backoff_ms = kMinBackoffMs;
+  int64_t last_rx_ms = 0;
+  std::unique_ptr<fr::Parser> parser;
+  fr::Parser::Stats parsed = {}; // of earlier connections
+  bool have_info = false;
+  fr::Info info = {};
+  bool have_next = false;
+  uint32_t next_index = 0;
+  std::unique_ptr<ingest::SegmentWriter> writer;
+
+  Totals totals;
+  uint32_t connects = 0;
+  uint32_t failures = 0;
+};
+
+static Options g_opt;
+static int g_epoll = -1;
+
+// host[:port][=name]. Names keep to [A-Za-z0-9._-] so they are safe in
+// paths.
+static bool parse_device(const std::string &spec, Device *dev) {
+  std::string addr = spec, name;
+  size_t eq = spec.find('=');
+  if (eq != std::string::npos) {
+    addr = spec.substr(0, eq);
+    name = spec.substr(eq + 1);
+  }
+  std::string host = addr, port = std::to_string(kDefaultPort);
+  size_t colon = addr.rfind(':');
+  if (colon != std::string::npos) {
+    host = addr.substr(0, colon);
+    port = addr.substr(colon + 1);
+  }
+  if (host.empty())
+    return false;
+
+  addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *res = nullptr;
+  int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
+  if (err != 0) {
+    fprintf(stderr, "%s: %s\n", spec.c_str(), gai_strerror(err));
+    return false;
+  }
+  memcpy(&dev->addr, res->ai_addr, res->ai_addrlen);
+  dev->addr_len = res->ai_addrlen;
+  freeaddrinfo(res);
+
+  dev->label = host + ":" + port;
+  if (name.empty())
+    name = host + "_" + port;
+  for (char &c : name)
+    if (!isalnum((unsigned char)c) && c != '.' && c != '_' && c != '-')
+      c = '_';
+  dev->name = name;
+  return true;
+}
+
+static void disconnect(Device &dev, const char *why, int64_t now) {
+  if (dev.fd >= 0) {
+    epoll_ctl(g_epoll, EPOLL_CTL_DEL, dev.fd, nullptr);
+    close(dev.fd);
+    dev.fd = -1;
+  }
+  if (dev.parser) {
+    fr::Parser::Stats st = dev.parser->stats();
+    dev.parsed.crc_errors += st.crc_errors;
+    dev.parsed.seq_gaps += st.seq_gaps;
+    dev.parsed.resync_bytes += st.resync_bytes;
+    dev.parser.reset();
+  }
+  dev.writer->close();
+  dev.failures++;
+  dev.state = Device::State::Waiting;
+  dev.retry_at_ms = now + dev.backoff_ms;
+  fprintf(stderr, "%s: %s, retrying in %d s\n", dev.label.c_str(), why,
+          dev.backoff_ms / 1000);
+  dev.backoff_ms = dev.backoff_ms * 2 > kMaxBackoffMs ? kMaxBackoffMs
+                                                      : dev.backoff_ms * 2;
+}
+
+static void start_connect(Device &dev, int64_t now) {
+  dev.fd = socket(dev.addr.ss_family,
+                  SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (dev.fd < 0) {
+    disconnect(dev, strerror(errno), now);
+    return;
+  }
+  int one = 1;
+  setsockopt(dev.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  if (connect(dev.fd, (const sockaddr *)&dev.addr, dev.addr_len) < 0 &&
+      errno != EINPROGRESS) {
+    disconnect(dev, strerror(errno), now);
+    return;
+  }
+  // Writable once connected (or failed); the hello goes out then.
+  epoll_event ev = {};
+  ev.events = EPOLLOUT;
+  ev.data.ptr = &dev;
+  epoll_ctl(g_epoll, EPOLL_CTL_ADD, dev.fd, &ev);
+  dev.state = Device::State::Connecting;
+  dev.last_rx_ms = now;
+}
+
+static void on_connected(Device &dev, int64_t now) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  getsockopt(dev.fd, SOL_SOCKET, SO_ERROR, &err, &len);
+  if (err != 0) {
+    disconnect(dev, strerror(err), now);
+    return;
+  }
+  std::string hello = "PROTO 2 " + g_opt.codec + "\n";
+  if (send(dev.fd, hello.data(), hello.size(), MSG_NOSIGNAL) !=
+      (ssize_t)hello.size()) {
+    disconnect(dev, "hello not sent", now);
+    return;
+  }
+  epoll_event ev = {};
+  ev.events = EPOLLIN;
+  ev.data.ptr = &dev;
+  epoll_ctl(g_epoll, EPOLL_CTL_MOD, dev.fd, &ev);
+  dev.state = Device::State::Streaming;
+  dev.parser = std::make_unique<fr::Parser>();
+  dev.have_info = false;
+  dev.have_next = false;
+  dev.last_rx_ms = now;
+  dev.connects++;
+}
+
+static void on_info(Device &dev, const uint8_t *payload, size_t len) {
+  fr::Info info;
+  if (!fr::parse_info(payload, len, &info) || info.channels == 0)
+    return;
+  if (info.codec != fr::kCodecPcm16 && info.codec != fr::kCodecImaAdpcm &&
+      info.codec != fr::kCodecLossless) {
+    fprintf(stderr, "%s: unknown codec %u\n", dev.label.c_str(),
+            (unsigned)info.codec);
+    return;
+  }
+  dev.info = info;
+  dev.have_info = true;
+  dev.have_next = false;
+  // A new connection is a new file, even at the same format.
+  dev.writer->close();
+  dev.writer->set_format((int)info.sample_rate, info.channels);
+}
+
+static void on_audio(Device &dev, const fr::Header &h, const uint8_t *payload) {
+  if (!dev.have_info || h.codec != dev.info.codec)
+    return;
+  constexpr int kBlock = audio::ima_adpcm::kBlockBytes;
+  int16_t pcm[fr::kMaxPayloadBytes / kBlock * audio::ima_adpcm::kBlockSamples];
+  int n = 0;
+  if (h.codec == fr::kCodecPcm16) {
+    n = h.payload_bytes / (int)sizeof(int16_t);
+    memcpy(pcm, payload, (size_t)n * sizeof(int16_t));
+  } else if (h.codec == fr::kCodecLossless) {
+    // A block that does not decode is left to the gap filling, like a
+    // frame that never arrived.
+    if (h.samples > audio::lossless::kBlockSamples ||
+        !audio::lossless::decode_block(payload, h.payload_bytes, h.samples,
+                                       pcm))
+      return;
+    n = h.samples;
+  } else {
+    for (int off = 0; off + kBlock <= h.payload_bytes; off += kBlock) {
+      audio::ima_adpcm::decode_block(&payload[off], &pcm[n]);
+      n += audio::ima_adpcm::kBlockSamples;
+    }
+  }
+  if (n > h.samples)
+    n = h.samples;
+
+  if (dev.have_next && h.sample_index != dev.next_index) {
+    uint32_t gap = h.sample_index - dev.next_index;
+    uint32_t max_fill = (uint32_t)g_opt.max_fill_seconds *
+                        dev.info.sample_rate * dev.info.channels;
+    if (gap <= max_fill) {
+      dev.writer->write_silence((int)gap);
+      dev.totals.silence += gap;
+    } else {
+      dev.writer->close(); // too long (or backwards): new file
+    }
+  }
+  dev.writer->write(pcm, n);
+  dev.next_index = h.sample_index + (uint32_t)n;
+  dev.have_next = true;
+  dev.totals.frames++;
+  dev.totals.samples += (uint64_t)n;
+}
+
+static void on_readable(Device &dev, int64_t now) {
+  static uint8_t buf[64 * 1024];
+  while (true) {
+    ssize_t got = recv(dev.fd, buf, sizeof(buf), 0);
+    if (got < 0) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return;
+      if (errno == EINTR)
+        continue;
+      disconnect(dev, strerror(errno), now);
+      return;
+    }
+    if (got == 0) {
+      disconnect(dev, "closed by device", now);
+      return;
+    }
+    dev.totals.bytes += (uint64_t)got;
+    dev.last_rx_ms = now;
+    dev.parser->feed(buf, (size_t)got,
+                     [&](const fr::Header &h, const uint8_t *payload) {
+                       if (h.codec == fr::kCodecInfo)
+                         on_info(dev, payload, h.payload_bytes);
+                       else
+                         on_audio(dev, h, payload);
+                     });
+    // Data is flowing: the next failure starts over at the short backoff.
+    dev.backoff_ms = kMinBackoffMs;
+  }
+}
+
+static Totals device_totals(const Device &dev) {
+  Totals t = dev.totals;
+  fr::Parser::Stats st = dev.parsed;
+  if (dev.parser) {
+    st.crc_errors += dev.parser->stats().crc_errors;
+    st.seq_gaps += dev.parser->stats().seq_gaps;
+    st.resync_bytes += dev.parser->stats().resync_bytes;
+  }
+  t.crc_errors = st.crc_errors;
+  t.seq_gaps = st.seq_gaps;
+  t.resync_bytes = st.resync_bytes;
+  return t;
+}
+
+static Totals sum_totals(const std::vector<std::unique_ptr<Device>> &devs) {
+  Totals sum;
+  for (const auto &dev : devs) {
+    Totals t = device_totals(*dev);
+    sum.bytes += t.bytes;
+    sum.frames += t.frames;
+    sum.samples += t.samples;
+    sum.silence += t.silence;
+    sum.crc_errors += t.crc_errors;
+    sum.seq_gaps += t.seq_gaps;
+    sum.resync_bytes += t.resync_bytes;
+  }
+  return sum;
+}
+
+static void print_stats(const std::vector<std::unique_ptr<Device>> &devs,
+                        const Totals &prev, const Totals &now_totals,
+                        double elapsed_s, double interval_s) {
+  int streaming = 0;
+  for (const auto &dev : devs)
+    streaming += dev->state == Device::State::Streaming;
+  printf("[%6.0fs] %d/%zu streaming | %.2f MB/s in, %.0f frames/s, "
+         "%.1f s of audio/s | crc=%llu gaps=%llu\n",
+         elapsed_s, streaming, devs.size(),
+         (now_totals.bytes - prev.bytes) / interval_s / 1e6,
+         (now_totals.frames - prev.frames) / interval_s,
+         (now_totals.samples - prev.samples) / interval_s / 16000.0,
+         (unsigned long long)now_totals.crc_errors,
+         (unsigned long long)now_totals.seq_gaps);
+  fflush(stdout);
+}
+
+static void print_summary(const std::vector<std::unique_ptr<Device>> &devs,
+                          double elapsed_s) {
+  uint32_t connects = 0, failures = 0, segments = 0;
+  uint64_t written = 0;
+  for (const auto &dev : devs) {
+    Totals t = device_totals(*dev);
+    printf("%s (%s): %u connects, %llu frames, %.1f s audio "
+           "(%.1f s filled), crc=%llu gaps=%llu, %u files, %.1f MB\n",
+           dev->name.c_str(), dev->label.c_str(), dev->connects,
+           (unsigned long long)t.frames,
+           t.samples / (double)(dev->info.sample_rate ? dev->info.sample_rate
+                                                      : 16000),
+           t.silence / (double)(dev->info.sample_rate ? dev->info.sample_rate
+                                                      : 16000),
+           (unsigned long long)t.crc_errors, (unsigned long long)t.seq_gaps,
+           dev->writer->segments(), dev->writer->bytes_written() / 1e6);
+    connects += dev->connects;
+    failures += dev->failures;
+    segments += dev->writer->segments();
+    written += dev->writer->bytes_written();
+  }
+  Totals sum = sum_totals(devs);
+  printf("total: devices=%zu connects=%u failures=%u frames=%llu "
+         "samples=%llu silence=%llu crc_errors=%llu seq_gaps=%llu "
+         "resync_bytes=%llu bytes_in=%llu bytes_out=%llu files=%u "
+         "seconds=%.2f\n",
+         devs.size(), connects, failures, (unsigned long long)sum.frames,
+         (unsigned long long)sum.samples, (unsigned long long)sum.silence,
+         (unsigned long long)sum.crc_errors,
+         (unsigned long long)sum.seq_gaps,
+         (unsigned long long)sum.resync_bytes, (unsigned long long)sum.bytes,
+         (unsigned long long)written, segments, elapsed_s);
+}
+
+static bool read_device_file(const char *path, std::vector<std::string> *out) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    char *hash = strchr(line, '#');
+    if (hash)
+      *hash = '\0';
+    char spec[256];
+    if (sscanf(line, "%255s", spec) == 1)
+      out->push_back(spec);
+  }
+  fclose(f);
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: mic_ingest [--out DIR] [--devices FILE] "
+          "[--codec PCM16|ADPCM|LOSSLESS|VAD16]\n"
+          "                  [--format wav|pcm] [--segment-seconds N] "
+          "[--max-fill-seconds N]\n"
+          "                  [--buffer-kb N] [--stats-seconds N] "
+          "[--seconds N] host[:port][=name] ...\n");
+}
+
+// Dozens of devices fit the default descriptor limit; hundreds may not.
+static void raise_fd_limit() {
+  rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+    rl.rlim_cur = rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl);
+  }
+}
+
+int main(int argc, char **argv) {
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  std::vector<std::string> specs;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    auto value = [&]() -> const char * {
+      if (i + 1 >= argc) {
+        usage();
+        exit(2);
+      }
+      return argv[++i];
+    };
+    if (arg == "--out")
+      g_opt.out = value();
+    else if (arg == "--devices") {
+      if (!read_device_file(value(), &specs))
+        return 1;
+    } else if (arg == "--codec")
+      g_opt.codec = value();
+    else if (arg == "--format") {
+      std::string f = value();
+      if (f != "wav" && f != "pcm") {
+        usage();
+        return 2;
+      }
+      g_opt.format = f == "wav" ? ingest::SegmentWriter::Format::Wav
+                                : ingest::SegmentWriter::Format::Pcm;
+    } else if (arg == "--segment-seconds")
+      g_opt.segment_seconds = atoi(value());
+    else if (arg == "--max-fill-seconds")
+      g_opt.max_fill_seconds = atoi(value());
+    else if (arg == "--buffer-kb")
+      g_opt.buffer_kb = atoi(value());
+    else if (arg == "--stats-seconds")
+      g_opt.stats_seconds = atoi(value());
+    else if (arg == "--seconds")
+      g_opt.run_seconds = atoi(value());
+    else if (arg.size() > 1 && arg[0] == '-') {
+      usage();
+      return 2;
+    } else
+      specs.push_back(arg);
+  }
+  if (specs.empty() || g_opt.segment_seconds < 1) {
+    usage();
+    return 2;
+  }
+
+  std::vector<std::unique_ptr<Device>> devices;
+  for (const std::string &spec : specs) {
+    auto dev = std::make_unique<Device>();
+    if (!parse_device(spec, dev.get()))
+      return 1;
+    ingest::SegmentWriter::Config wc;
+    wc.dir = g_opt.out + "/" + dev->name;
+    wc.name = dev->name;
+    wc.format = g_opt.format;
+    wc.segment_seconds = g_opt.segment_seconds;
+    wc.buffer_bytes = (size_t)g_opt.buffer_kb * 1024;
+    dev->writer = std::make_unique<ingest::SegmentWriter>(wc);
+    devices.push_back(std::move(dev));
+  }
+  mkdir(g_opt.out.c_str(), 0755);
+  raise_fd_limit();
+
+  struct sigaction sa = {};
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, nullptr);
+  sigaction(SIGTERM, &sa, nullptr);
+  signal(SIGPIPE, SIG_IGN);
+
+  g_epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (g_epoll < 0) {
+    perror("epoll_create1");
+    return 1;
+  }
+  printf("Ingesting %zu devices as %s into %s/, %d s files\n", devices.size(),
+         g_opt.codec.c_str(), g_opt.out.c_str(), g_opt.segment_seconds);
+
+  const int64_t start = now_ms();
+  int64_t next_flush = start + kFlushMs;
+  int64_t next_stats = start + (int64_t)g_opt.stats_seconds * 1000;
+  int64_t last_stats = start;
+  Totals last_totals;
+  std::vector<epoll_event> events(devices.size() + 1);
+
+  while (!g_stop) {
+    int64_t now = now_ms();
+    if (g_opt.run_seconds > 0 && now - start >= g_opt.run_seconds * 1000LL)
+      break;
+    for (auto &dev : devices) {
+      if (dev->state == Device::State::Waiting && now >= dev->retry_at_ms)
+        start_connect(*dev, now);
+      else if (dev->state != Device::State::Waiting &&
+               now - dev->last_rx_ms > kStallMs)
+        disconnect(*dev,
+                   dev->state == Device::State::Connecting
+                       ? "connect timed out"
+                       : "no data",
+                   now);
+    }
+
+    int n = epoll_wait(g_epoll, events.data(), (int)events.size(), kTickMs);
+    if (n < 0 && errno != EINTR) {
+      perror("epoll_wait");
+      break;
+    }
+    now = now_ms();
+    for (int i = 0; i < n; i++) {
+      Device &dev = *(Device *)events[(size_t)i].data.ptr;
+      if (dev.state == Device::State::Connecting)
+        on_connected(dev, now);
+      else if (dev.state == Device::State::Streaming)
+        on_readable(dev, now);
+    }
+
+    if (now >= next_flush) {
+      for (auto &dev : devices)
+        dev->writer->flush();
+      next_flush = now + kFlushMs;
+    }
+    if (g_opt.stats_seconds > 0 && now >= next_stats) {
+      Totals t = sum_totals(devices);
+      print_stats(devices, last_totals, t, (now - start) / 1000.0,
+                  (now - last_stats) / 1000.0);
+      last_totals = t;
+      last_stats = now;
+      next_stats += (int64_t)g_opt.stats_seconds * 1000;
+    }
+  }
+
+  for (auto &dev : devices) {
+    if (dev->fd >= 0)
+      close(dev->fd);
+    dev->writer->close();
+  }
+  print_summary(devices, (now_ms() - start) / 1000.0);
+  return 0;
+}
@@ -0,0 +1,170 @@
+#include "segment_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace ingest {
+
+static constexpr size_t kWavHeaderBytes = 44;
+
+static void put_u16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  put_u16(p, (uint16_t)v);
+  put_u16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void wav_header(uint8_t *h, int rate, int channels,
+                       uint32_t data_bytes) {
+  memcpy(&h[0], "RIFF", 4);
+  put_u32(&h[4], 36 + data_bytes);
+  memcpy(&h[8], "WAVEfmt ", 8);
+  put_u32(&h[16], 16);
+  put_u16(&h[20], 1); // PCM
+  put_u16(&h[22], (uint16_t)channels);
+  put_u32(&h[24], (uint32_t)rate);
+  put_u32(&h[28], (uint32_t)(rate * channels * 2));
+  put_u16(&h[32], (uint16_t)(channels * 2));
+  put_u16(&h[34], 16);
+  memcpy(&h[36], "data", 4);
+  put_u32(&h[40], data_bytes);
+}
+
+static bool write_all(int fd, const uint8_t *p, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    p += n;
+    len -= (size_t)n;
+  }
+  return true;
+}
+
+SegmentWriter::SegmentWriter(const Config &config) : config_(config) {
+  buf_.resize(config_.buffer_bytes < 4096 ? 4096 : config_.buffer_bytes);
+}
+
+void SegmentWriter::set_format(int sample_rate, int channels) {
+  if (sample_rate == sample_rate_ && channels == channels_)
+    return;
+  close();
+  sample_rate_ = sample_rate;
+  channels_ = channels;
+  segment_samples_ = (int64_t)config_.segment_seconds * sample_rate * channels;
+}
+
+bool SegmentWriter::write(const int16_t *pcm, int n) { return put(pcm, n); }
+
+bool SegmentWriter::write_silence(int n) { return put(nullptr, n); }
+
+bool SegmentWriter::put(const int16_t *pcm, int n) {
+  if (sample_rate_ == 0)
+    return false;
+  while (n > 0) {
+    if (fd_ < 0 && !open_segment())
+      return false;
+    int64_t room = segment_samples_ - written_samples_;
+    size_t space = (buf_.size() - fill_) / sizeof(int16_t);
+    int take = n;
+    if (take > room)
+      take = (int)room;
+    if ((size_t)take > space)
+      take = (int)space;
+    size_t bytes = (size_t)take * sizeof(int16_t);
+    if (pcm) {
+      // Little-endian on the wire and in the file.
+      memcpy(&buf_[fill_], pcm, bytes);
+      pcm += take;
+    } else {
+      memset(&buf_[fill_], 0, bytes);
+    }
+    fill_ += bytes;
+    written_samples_ += take;
+    n -= take;
+    if (fill_ == buf_.size() && !flush())
+      return false;
+    if (written_samples_ == segment_samples_)
+      close();
+  }
+  return true;
+}
+
+bool SegmentWriter::open_segment() {
+  mkdir(config_.dir.c_str(), 0755);
+  char stamp[32];
+  time_t now = time(nullptr);
+  struct tm utc;
+  gmtime_r(&now, &utc);
+  strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &utc);
+  char file[64];
+  snprintf(file, sizeof(file), "-%s-%04u.%s", stamp, (unsigned)segments_,
+           config_.format == Format::Wav ? "wav" : "pcm");
+  path_ = config_.dir + "/" + config_.name + file;
+
+  fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd_ < 0) {
+    fprintf(stderr, "%s: cannot create %s: %s\n", config_.name.c_str(),
+            path_.c_str(), strerror(errno));
+    return false;
+  }
+  segments_++;
+  written_samples_ = 0;
+  fill_ = 0;
+  if (config_.format == Format::Wav) {
+    // Sizes are filled in by flush().
+    wav_header(&buf_[0], sample_rate_, channels_, 0);
+    fill_ = kWavHeaderBytes;
+  }
+  return true;
+}
+
+bool SegmentWriter::flush() {
+  if (fd_ < 0 || fill_ == 0)
+    return true;
+  if (!write_all(fd_, buf_.data(), fill_)) {
+    fail("write");
+    return false;
+  }
+  bytes_written_ += fill_;
+  fill_ = 0;
+  if (config_.format == Format::Wav) {
+    // Everything written so far is in the file now.
+    uint8_t h[kWavHeaderBytes];
+    wav_header(h, sample_rate_, channels_,
+               (uint32_t)(written_samples_ * (int64_t)sizeof(int16_t)));
+    if (pwrite(fd_, h, sizeof(h), 0) != (ssize_t)sizeof(h)) {
+      fail("header update");
+      return false;
+    }
+  }
+  return true;
+}
+
+void SegmentWriter::close() {
+  if (fd_ < 0 || !flush())
+    return;
+  ::close(fd_);
+  fd_ = -1;
+}
+
+void SegmentWriter::fail(const char *what) {
+  fprintf(stderr, "%s: %s failed on %s: %s\n", config_.name.c_str(), what,
+          path_.c_str(), strerror(errno));
+  ::close(fd_);
+  fd_ = -1;
+  fill_ = 0;
+}
+
+} // namespace ingest
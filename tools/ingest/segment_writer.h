@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace ingest {
+
+// One device's audio as consecutive files of a fixed length,
+//
+//   <dir>/<name>-<UTC start>-<n>.wav   (or .pcm: the bare samples)
+//
+// a new one every segment_seconds of audio. Samples are staged in a large
+// buffer and reach the file in buffer-sized write()s, so dozens of devices
+// cost a few system calls a second each. The WAV header's sizes are brought
+// up to date on every flush, so a file cut short by a crash is valid up to
+// its last flush.
+class SegmentWriter {
+public:
+  enum class Format { Wav, Pcm };
+
+  struct Config {
+    std::string dir; // created if missing
+    std::string name;
+    Format format = Format::Wav;
+    int segment_seconds = 300;
+    size_t buffer_bytes = 256 * 1024;
+  };
+
+  explicit SegmentWriter(const Config &config);
+  ~SegmentWriter() { close(); }
+
+  SegmentWriter(const SegmentWriter &) = delete;
+  SegmentWriter &operator=(const SegmentWriter &) = delete;
+
+  // Sample format of what follows. A change closes the current segment.
+  void set_format(int sample_rate, int channels);
+
+  // Append n samples (or n of silence), opening and rotating segments as
+  // needed. Return false on an I/O error; the segment is then abandoned
+  // and the next call starts a new one.
+  bool write(const int16_t *pcm, int n);
+  bool write_silence(int n);
+
+  // Writes out what is staged; the segment stays open.
+  bool flush();
+
+  // Ends the current segment; the next write starts a new file.
+  void close();
+
+  uint32_t segments() const { return segments_; }
+  uint64_t bytes_written() const { return bytes_written_; }
+  const std::string &path() const { return path_; }
+
+private:
+  bool put(const int16_t *pcm, int n);
+  bool open_segment();
+  void fail(const char *what);
+
+  Config config_;
+  int sample_rate_ = 0;
+  int channels_ = 1;
+  int fd_ = -1;
+  std::string path_;
+  int64_t segment_samples_ = 0; // per file, all channels
+  int64_t written_samples_ = 0; // in the current file
+  std::vector<uint8_t> buf_;
+  size_t fill_ = 0;
+  uint32_t segments_ = 0;
+  uint64_t bytes_written_ = 0;
+};
+
+} // namespace ingest
@@ -0,0 +1,129 @@
+"""Reader for the ESP32 mic's v2 framed stream (PROTO 2).
+
+Mirrors microphone/audio/stream_frame.h: every frame has a 36-byte
+little-endian header
+
+    magic "MICF", version, codec, flags, header bytes,
+    sequence, payload bytes, samples,
+    capture time (us since device boot), sample clock,
+    CRC-32 of the rest of the header and the payload,
+    capture gain (dB, Q8), capture clock error (ppm, Q4)
+
+Frames from before those fields have a 32-byte header and read as 0 dB and
+0 ppm. FLAG_RESAMPLED means the clock error was resampled out on the device
+and the audio is at exactly the nominal rate.
+
+followed by the payload. The stream opens with one info frame (codec 0)
+describing the audio frames after it.
+"""
+
+import struct
+import zlib
+
+MAGIC = b"MICF"
+VERSION = 2
+HEADER_BYTES = 36
+MIN_HEADER_BYTES = 32
+MAX_HEADER_BYTES = 64
+MAX_PAYLOAD_BYTES = 4096
+
+CODEC_INFO = 0
+CODEC_PCM16 = 1
+CODEC_IMA_ADPCM = 2
+CODEC_LOSSLESS = 3
+CODEC_NAMES = {CODEC_PCM16: "PCM16", CODEC_IMA_ADPCM: "ADPCM",
+               CODEC_LOSSLESS: "LOSSLESS"}
+
+FLAG_SEGMENT_START = 1
+FLAG_SEGMENT_END = 2
+FLAG_RESAMPLED = 4
+
+_HEADER = struct.Struct("<4sBBBBIHHqII")
+_EXTRA = struct.Struct("<hh")
+_INFO = struct.Struct("<IBBBxH2x")
+
+
+class Frame:
+    __slots__ = ("codec", "flags", "seq", "samples", "timestamp_us",
+                 "sample_index", "gain_db", "drift_ppm", "payload")
+
+    def __init__(self, fields, extra, payload):
+        (_, _, self.codec, self.flags, _, self.seq, _, self.samples,
+         self.timestamp_us, self.sample_index, _) = fields
+        self.gain_db = extra[0] / 256
+        self.drift_ppm = extra[1] / 16
+        self.payload = payload
+
+
+class Info:
+    def __init__(self, payload):
+        (self.sample_rate, self.channels, self.codec, self.gated,
+         self.frame_samples) = _INFO.unpack_from(payload)
+
+    def __str__(self):
+        name = CODEC_NAMES.get(self.codec, f"codec {self.codec}")
+        gated = ", speech only" if self.gated else ""
+        return (f"{name} {self.sample_rate} Hz {self.channels} ch, "
+                f"{self.frame_samples} samples/frame{gated}")
+
+
+class Parser:
+    """Incremental parser. feed() whatever recv() returned and iterate the
+    good frames it yields. A bad header or CRC costs one byte of resync and
+    the frame it was in; missing sequence numbers are counted as gaps."""
+
+    def __init__(self):
+        self.buf = bytearray()
+        self.frames = 0
+        self.crc_errors = 0
+        self.resync_bytes = 0
+        self.seq_gaps = 0
+        self.last_seq = None
+
+    def feed(self, data):
+        self.buf += data
+        buf = self.buf
+        start = 0
+        while len(buf) - start >= MIN_HEADER_BYTES:
+            fields = _HEADER.unpack_from(buf, start)
+            magic, version, _, _, header_bytes, _, payload_bytes = fields[:7]
+            if (magic == MAGIC and version == VERSION and
+                    MIN_HEADER_BYTES <= header_bytes <= MAX_HEADER_BYTES and
+                    payload_bytes <= MAX_PAYLOAD_BYTES):
+                end = start + header_bytes + payload_bytes
+                if len(buf) < end:
+                    break
+                crc = zlib.crc32(buf[start:start + 28])
+                crc = zlib.crc32(buf[start + 32:end], crc)
+                if crc == fields[10]:
+                    extra = (0, 0)
+                    if header_bytes >= HEADER_BYTES:
+                        extra = _EXTRA.unpack_from(buf, start + 32)
+                    frame = Frame(fields, extra,
+                                  bytes(buf[start + header_bytes:end]))
+                    self._count(frame)
+                    start = end
+                    yield frame
+                    continue
+                self.crc_errors += 1
+            # Hunt for the next possible magic.
+            nxt = buf.find(MAGIC[:1], start + 1)
+            if nxt < 0:
+                nxt = len(buf)
+            self.resync_bytes += nxt - start
+            start = nxt
+        del buf[:start]
+
+    def _count(self, frame):
+        self.frames += 1
+        if frame.codec == CODEC_INFO:
+            return
+        if self.last_seq is not None:
+            gap = (frame.seq - self.last_seq - 1) & 0xFFFFFFFF
+            if gap < 0x80000000:
+                self.seq_gaps += gap
+        self.last_seq = frame.seq
+
+    def summary(self):
+        return (f"{self.frames} frames, {self.crc_errors} CRC errors, "
+                f"{self.seq_gaps} missing, {self.resync_bytes} bytes resynced")
@@ -0,0 +1,151 @@
+"""Receive the ESP32 mic's store-and-forward uploads and event clips.
+
+With CONFIG_MIC_STORE_FORWARD the device records to flash while Wi-Fi is
+down and, once it is back, connects here and sends each stored file;
+with CONFIG_MIC_EVENT_CLIP it sends a clip (evt<n>.mfr) around every loud
+event. Either way a file comes as
+
+    UPLOAD <name> <bytes>\\n<file bytes>
+
+answered with OK\\n once the file is on disk; only then does the device
+delete its copy. Files are v2 frame streams (see mic_frames.py). Each one
+is kept as received and also decoded to a WAV next to it, with silence
+wherever the device had to skip audio.
+
+    python receive_uploads.py [--port 5010] [--dir uploads]
+"""
+
+import argparse
+import io
+import os
+import re
+import socket
+import time
+import wave
+
+from capture_tcp import FrameWriter
+
+DEFAULT_PORT = 5010
+MAX_FILE_BYTES = 1 << 20
+NAME_RE = re.compile(r"^[A-Za-z0-9._-]{1,32}$")
+
+
+class Reader:
+    """Buffered line and exact-length reads from a socket."""
+
+    def __init__(self, sock):
+        self.sock = sock
+        self.buf = bytearray()
+
+    def _fill(self):
+        chunk = self.sock.recv(65536)
+        if not chunk:
+            raise EOFError
+        self.buf += chunk
+
+    def line(self):
+        while b"\n" not in self.buf:
+            if len(self.buf) > 128:
+                raise ValueError("header line too long")
+            self._fill()
+        line, _, rest = bytes(self.buf).partition(b"\n")
+        self.buf = bytearray(rest)
+        return line.decode("ascii")
+
+    def exact(self, n):
+        while len(self.buf) < n:
+            self._fill()
+        data = bytes(self.buf[:n])
+        del self.buf[:n]
+        return data
+
+
+def unique_path(directory, name):
+    """The device restarts its numbering once its store is empty, so
+    prefix the arrival time and never overwrite."""
+    stem = time.strftime("%Y%m%d-%H%M%S-") + name
+    path = os.path.join(directory, stem)
+    n = 1
+    while os.path.exists(path):
+        path = os.path.join(directory, f"{stem}.{n}")
+        n += 1
+    return path
+
+
+def save(directory, name, data):
+    path = unique_path(directory, name)
+    with open(path + ".part", "wb") as f:
+        f.write(data)
+        f.flush()
+        os.fsync(f.fileno())
+    os.replace(path + ".part", path)
+    return path
+
+
+def write_wav(path, data):
+    pcm = io.BytesIO()
+    writer = FrameWriter(pcm)
+    writer.write(data)
+    info = writer.info
+    if info is None:
+        print(f"  {path}: no info frame, WAV skipped")
+        return
+    with wave.open(path + ".wav", "wb") as wf:
+        wf.setnchannels(info.channels)
+        wf.setsampwidth(2)
+        wf.setframerate(info.sample_rate)
+        wf.writeframes(pcm.getvalue())
+    frames = writer.parser
+    print(f"  {frames.summary()}; "
+          f"{writer.written / info.sample_rate:.2f} s of audio")
+
+
+def serve(conn, peer, directory):
+    reader = Reader(conn)
+    count = 0
+    while True:
+        try:
+            line = reader.line()
+        except EOFError:
+            break
+        parts = line.split()
+        if (len(parts) != 3 or parts[0] != "UPLOAD" or
+                not NAME_RE.match(parts[1]) or not parts[2].isdigit() or
+                int(parts[2]) > MAX_FILE_BYTES):
+            print(f"{peer}: bad request {line!r}, closing")
+            break
+        name, size = parts[1], int(parts[2])
+        data = reader.exact(size)
+        path = save(directory, name, data)
+        conn.sendall(b"OK\n")
+        count += 1
+        print(f"{peer}: {name} ({size} bytes) -> {path}")
+        write_wav(path, data)
+    print(f"{peer}: {count} files")
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    ap.add_argument("--port", type=int, default=DEFAULT_PORT)
+    ap.add_argument("--dir", default="uploads")
+    args = ap.parse_args()
+    os.makedirs(args.dir, exist_ok=True)
+
+    with socket.create_server(("", args.port)) as srv:
+        print(f"Waiting for uploads on TCP port {args.port}, "
+              f"saving to {args.dir}/")
+        while True:
+            conn, addr = srv.accept()
+            with conn:
+                conn.settimeout(30)
+                try:
+                    serve(conn, addr[0], args.dir)
+                except (OSError, EOFError, ValueError) as e:
+                    print(f"{addr[0]}: {e}")
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass
@@ -0,0 +1,102 @@
+"""Stand-in for the ESP32's RTP sender, for testing rtp_receive.py on one
+machine.
+
+Sends a PCM16 file (looped) as L16 RTP in real time, packetised the way the
+firmware does it, and can impair the link on the way: random loss, random
+extra delay (which also reorders packets) and duplicates.
+
+    python rtp_fake_device.py --loss 5 --jitter-ms 30
+"""
+
+import argparse
+import heapq
+import random
+import socket
+import struct
+import sys
+import time
+
+RTP_HEADER = struct.Struct("!BBHII")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=5004)
+    parser.add_argument("--pcm", default="recording.pcm",
+                        help="16-bit little-endian mono input, looped")
+    parser.add_argument("--rate", type=int, default=16000)
+    parser.add_argument("--packet-ms", type=int, choices=(10, 20), default=20)
+    parser.add_argument("--payload-type", type=int, default=96)
+    parser.add_argument("--loss", type=float, default=0.0,
+                        help="percent of packets dropped")
+    parser.add_argument("--jitter-ms", type=float, default=0.0,
+                        help="max extra delay per packet, uniform")
+    parser.add_argument("--dup", type=float, default=0.0,
+                        help="percent of packets sent twice")
+    parser.add_argument("--seconds", type=float, default=0,
+                        help="stop after this long (0 = until Ctrl-C)")
+    parser.add_argument("--seed", type=int, default=None)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    with open(args.pcm, "rb") as f:
+        pcm = f.read()
+    samples = len(pcm) // 2
+    if samples == 0:
+        sys.exit(f"{args.pcm} is empty")
+    pcm = struct.unpack(f"<{samples}h", pcm[:samples * 2])
+
+    frame = args.rate * args.packet_ms // 1000
+    ssrc = rng.getrandbits(32)
+    seq = rng.getrandbits(16)
+    ts = rng.getrandbits(32)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    dest = (args.host, args.port)
+
+    in_flight = []  # (send time, order, packet), the impaired link
+    order = 0
+    sent = dropped = 0
+    pos = 0
+    start = time.monotonic()
+    next_packet = start
+    print(f"Sending {args.pcm} as RTP to {args.host}:{args.port}, "
+          f"{args.packet_ms} ms packets, loss {args.loss}%, "
+          f"jitter {args.jitter_ms} ms, dup {args.dup}%")
+    try:
+        while args.seconds <= 0 or next_packet - start < args.seconds:
+            now = time.monotonic()
+            if now >= next_packet:
+                chunk = [pcm[(pos + i) % samples] for i in range(frame)]
+                pos = (pos + frame) % samples
+                header = RTP_HEADER.pack(0x80, args.payload_type, seq, ts,
+                                         ssrc)
+                packet = header + struct.pack(f"!{frame}h", *chunk)
+                seq = (seq + 1) & 0xFFFF
+                ts = (ts + frame) & 0xFFFFFFFF
+                next_packet += args.packet_ms / 1000.0
+
+                copies = 2 if rng.random() * 100 < args.dup else 1
+                for _ in range(copies):
+                    if rng.random() * 100 < args.loss:
+                        dropped += 1
+                        continue
+                    delay = rng.uniform(0, args.jitter_ms) / 1000.0
+                    heapq.heappush(in_flight, (now + delay, order, packet))
+                    order += 1
+
+            while in_flight and in_flight[0][0] <= now:
+                sock.sendto(heapq.heappop(in_flight)[2], dest)
+                sent += 1
+
+            wake = next_packet
+            if in_flight:
+                wake = min(wake, in_flight[0][0])
+            time.sleep(max(0.0, wake - time.monotonic()))
+    except KeyboardInterrupt:
+        pass
+    print(f"sent={sent} dropped={dropped}")
+
+
+if __name__ == "__main__":
+    main()
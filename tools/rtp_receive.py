@@ -0,0 +1,305 @@
+"""Receive the ESP32 mic's RTP stream, play it out through a jitter buffer
+and report loss and latency once per second.
+
+Expects L16 mono (big-endian) RTP as sent with CONFIG_MIC_RTP. Audio is
+written to a WAV file in playout order, with silence wherever a packet was
+lost or arrived too late to be played.
+
+Packets are held until their playout time, which is their RTP timestamp
+mapped onto the local clock plus --jitter-ms. The mapping is anchored on
+the fastest packet seen in the last few seconds, so it follows slow clock
+drift between the device and this host.
+
+Latency is reported relative to that fastest packet: host and device
+clocks are not synchronised, so absolute one-way delay is unknown, but the
+spread above the best case is exactly what the jitter buffer has to absorb.
+
+Try it without hardware against the loopback stand-in:
+    python rtp_fake_device.py --loss 5 --jitter-ms 30 &
+    python rtp_receive.py --seconds 10
+"""
+
+import argparse
+import collections
+import socket
+import struct
+import time
+import wave
+
+DEFAULT_PORT = 5004
+WAV_OUT = "rtp_recording.wav"
+RTP_HEADER = struct.Struct("!BBHII")
+DRIFT_WINDOW_S = 5.0
+
+
+class Stats:
+    """Counters for one report interval plus running totals."""
+
+    def __init__(self):
+        self.received = 0
+        self.duplicates = 0
+        self.reordered = 0
+        self.late = 0
+        self.concealed = 0  # samples of silence inserted at playout
+        self.transit_ms = []
+        self.total_received = 0
+        self.total_late = 0
+        self.total_concealed = 0
+
+    def take_interval(self):
+        interval = (self.received, self.duplicates, self.reordered,
+                    self.late, self.concealed, self.transit_ms)
+        self.total_received += self.received
+        self.total_late += self.late
+        self.total_concealed += self.concealed
+        self.received = self.duplicates = self.reordered = 0
+        self.late = self.concealed = 0
+        self.transit_ms = []
+        return interval
+
+
+class Stream:
+    """State for one RTP source (SSRC)."""
+
+    def __init__(self, ssrc, seq, ts, rate):
+        self.ssrc = ssrc
+        self.rate = rate
+        self.base_seq = seq
+        self.max_seq = seq  # extended, see extend_seq
+        self.last_ts = ts
+        self.last_ext_ts = ts
+        self.seen = set()  # recent extended sequence numbers
+        self.last_arrival = None
+        self.jitter = 0.0  # RFC 3550 interarrival jitter, seconds
+        self.prev_transit = None
+        self.min_transit = collections.deque()  # (arrival, transit)
+        self.buffer = {}  # extended timestamp -> samples
+        self.next_play_ts = None
+        self.frame = None
+
+    def extend_seq(self, seq):
+        """Unwrap a 16-bit sequence number near the highest one seen."""
+        ext = (self.max_seq & ~0xFFFF) | seq
+        if ext < self.max_seq - 0x8000:
+            ext += 0x10000
+        elif ext > self.max_seq + 0x8000:
+            ext -= 0x10000
+        return ext
+
+    def extend_ts(self, ts):
+        """Unwrap a 32-bit timestamp near the newest one seen."""
+        delta = ((ts - self.last_ts + 0x80000000) & 0xFFFFFFFF) - 0x80000000
+        ext = self.last_ext_ts + delta
+        if delta > 0:
+            self.last_ts = ts
+            self.last_ext_ts = ext
+        return ext
+
+    def note_transit(self, arrival, transit):
+        """Keep the windowed minimum of transit (arrival minus media time)."""
+        q = self.min_transit
+        while q and q[-1][1] >= transit:
+            q.pop()
+        q.append((arrival, transit))
+        while q[0][0] < arrival - DRIFT_WINDOW_S:
+            q.popleft()
+
+    def best_transit(self):
+        return self.min_transit[0][1]
+
+    def play_time(self, ext_ts, delay_s):
+        return ext_ts / self.rate + self.best_transit() + delay_s
+
+    def expected(self):
+        return self.max_seq - self.base_seq + 1
+
+
+def parse_packet(data, payload_type):
+    if len(data) < RTP_HEADER.size:
+        return None
+    b0, b1, seq, ts, ssrc = RTP_HEADER.unpack_from(data)
+    if b0 >> 6 != 2 or (b1 & 0x7F) != payload_type:
+        return None
+    offset = RTP_HEADER.size + 4 * (b0 & 0x0F)
+    if b0 & 0x10:  # header extension
+        if len(data) < offset + 4:
+            return None
+        offset += 4 + 4 * struct.unpack_from("!H", data, offset + 2)[0]
+    end = len(data)
+    if b0 & 0x20:  # padding
+        end -= data[-1]
+    payload = data[offset:end]
+    if len(payload) % 2:
+        return None
+    return seq, ts, ssrc, payload
+
+
+def receive(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    sock.bind((args.bind, args.port))
+    sock.settimeout(0.002)
+    delay_s = args.jitter_ms / 1000.0
+
+    stream = None
+    stats = Stats()
+    out = wave.open(args.out, "wb")
+    out.setnchannels(1)
+    out.setsampwidth(2)
+    out.setframerate(args.rate)
+
+    start = time.monotonic()
+    next_report = start + 1.0
+    lost_at_report = 0
+    expected_at_report = 0
+    print(f"Listening for RTP on {args.bind}:{args.port}, "
+          f"jitter buffer {args.jitter_ms} ms")
+    try:
+        while args.seconds <= 0 or time.monotonic() - start < args.seconds:
+            try:
+                data = sock.recv(2048)
+            except socket.timeout:
+                data = None
+            now = time.monotonic()
+
+            if data:
+                packet = parse_packet(data, args.payload_type)
+                if packet:
+                    seq, ts, ssrc, payload = packet
+                    if stream is None or ssrc != stream.ssrc:
+                        if stream is not None:
+                            print(f"SSRC changed to {ssrc:08x}, resetting")
+                        stream = Stream(ssrc, seq, ts, args.rate)
+                        stats = Stats()
+                        expected_at_report = lost_at_report = 0
+                    handle_packet(stream, stats, seq, ts, payload, now)
+
+            if stream is not None and stream.min_transit:
+                play_out(stream, stats, out, now, delay_s)
+
+            if now >= next_report:
+                if stream is not None:
+                    expected = stream.expected()
+                    lost = expected - stats.total_received - stats.received
+                    report(stream, stats, expected - expected_at_report,
+                           lost - lost_at_report, delay_s)
+                    expected_at_report, lost_at_report = expected, lost
+                next_report += 1.0
+    except KeyboardInterrupt:
+        print("Stopped by user")
+    finally:
+        out.close()
+        sock.close()
+
+    if stream is not None:
+        expected = stream.expected()
+        received = stats.total_received + stats.received
+        late = stats.total_late + stats.late
+        lost = expected - received
+        print(f"total: expected={expected} received={received} "
+              f"lost={lost} ({100.0 * lost / max(expected, 1):.2f}%) "
+              f"late={late} "
+              f"concealed={stats.total_concealed + stats.concealed} samples")
+    print(f"Wrote {args.out}")
+
+
+def handle_packet(stream, stats, seq, ts, payload, now):
+    ext_seq = stream.extend_seq(seq)
+    if ext_seq < stream.base_seq:
+        return  # from before we joined
+    if ext_seq in stream.seen:
+        stats.duplicates += 1
+        return
+    stream.seen.add(ext_seq)
+    if len(stream.seen) > 4096:
+        stream.seen = {s for s in stream.seen if s > stream.max_seq - 2048}
+    if ext_seq > stream.max_seq:
+        stream.max_seq = ext_seq
+    elif ext_seq < stream.max_seq:
+        stats.reordered += 1
+    stats.received += 1
+    stream.last_arrival = now
+
+    ext_ts = stream.extend_ts(ts)
+    if stream.frame is None:
+        stream.frame = len(payload) // 2
+
+    transit = now - ext_ts / stream.rate
+    stream.note_transit(now, transit)
+    if stream.prev_transit is not None:
+        d = abs(transit - stream.prev_transit)
+        stream.jitter += (d - stream.jitter) / 16
+    stream.prev_transit = transit
+    stats.transit_ms.append((transit - stream.best_transit()) * 1000)
+
+    if stream.next_play_ts is None:
+        stream.next_play_ts = ext_ts
+    if ext_ts < stream.next_play_ts:
+        stats.late += 1
+        return
+    stream.buffer[ext_ts] = payload
+
+
+def play_out(stream, stats, out, now, delay_s):
+    """Write every frame whose playout time has come."""
+    # Once the device goes quiet, stop writing silence until it is back.
+    if not stream.buffer and now - stream.last_arrival > 0.25:
+        return
+    while stream.next_play_ts is not None and \
+            now >= stream.play_time(stream.next_play_ts, delay_s):
+        payload = stream.buffer.pop(stream.next_play_ts, None)
+        if payload is not None:
+            # L16 is big-endian, WAV wants little-endian.
+            n = len(payload) // 2
+            samples = struct.unpack(f"!{n}h", payload)
+            out.writeframes(struct.pack(f"<{n}h", *samples))
+        else:
+            # Lost, still in flight past its deadline, or a gap the device
+            # skipped. Fill up to the next buffered packet, at most a frame.
+            n = stream.frame
+            later = [t for t in stream.buffer if t > stream.next_play_ts]
+            if later:
+                n = min(n, min(later) - stream.next_play_ts)
+            out.writeframes(b"\0\0" * n)
+            stats.concealed += n
+        stream.next_play_ts += n
+
+
+def report(stream, stats, expected, lost, delay_s):
+    received, dups, reordered, late, concealed, transit = \
+        stats.take_interval()
+    # Packets reordered across a report boundary can make one interval's
+    # loss negative; report it as zero like an RTCP receiver report does.
+    lost = max(lost, 0)
+    loss_pct = 100.0 * lost / expected if expected > 0 else 0.0
+    if transit:
+        transit.sort()
+        p50 = transit[len(transit) // 2]
+        p99 = transit[min(len(transit) - 1, int(len(transit) * 0.99))]
+        latency = f"delay>best p50={p50:.1f} p99={p99:.1f} ms"
+    else:
+        latency = "no packets"
+    depth = len(stream.buffer) * stream.frame * 1000.0 / stream.rate \
+        if stream.frame else 0.0
+    print(f"rx={received} lost={lost} ({loss_pct:.1f}%) late={late} "
+          f"reordered={reordered} dup={dups} concealed={concealed} | "
+          f"jitter={stream.jitter * 1000:.1f} ms {latency} | "
+          f"buffer={depth:.0f} ms playout={delay_s * 1000:.0f} ms")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT)
+    parser.add_argument("--rate", type=int, default=16000)
+    parser.add_argument("--payload-type", type=int, default=96)
+    parser.add_argument("--jitter-ms", type=float, default=60.0,
+                        help="playout delay added to the fastest packet")
+    parser.add_argument("--seconds", type=float, default=0,
+                        help="stop after this long (0 = until Ctrl-C)")
+    parser.add_argument("--out", default=WAV_OUT)
+    receive(parser.parse_args())
+
+
+if __name__ == "__main__":
+    main()